@@ -28,6 +28,7 @@ Abstract:
 // Externals
 //-----------------------------------------------------------------------------
 NTSTATUS CreateMiniportWaveCyclicMSVAD(OUT PUNKNOWN *, IN  REFCLSID, IN  PUNKNOWN, IN  POOL_TYPE);
+NTSTATUS CreateMiniportWaveRTMSVAD(OUT PUNKNOWN *, IN  REFCLSID, IN  PUNKNOWN, IN  POOL_TYPE);
 NTSTATUS CreateMiniportTopologyMSVAD(OUT PUNKNOWN *, IN  REFCLSID, IN  PUNKNOWN, IN  POOL_TYPE);
 
 //-----------------------------------------------------------------------------
@@ -277,9 +278,14 @@ Return Value:
         ntStatus = InstallSubdevice(DeviceObject, Irp, L"Topology", CLSID_PortTopology, CLSID_PortTopology, CreateMiniportTopologyMSVAD, pAdapterCommon, NULL, IID_IPortTopology, NULL, &unknownTopology);
     }
 
-    // install MSVAD wavecyclic miniport.
+    // install MSVAD wave miniport. The wavert port exists from Windows Vista
+    // on; before that the wavecyclic miniport is used.
     if (NT_SUCCESS(ntStatus)) {
-        ntStatus = InstallSubdevice(DeviceObject, Irp, L"Wave", CLSID_PortWaveCyclic, CLSID_PortWaveCyclic, CreateMiniportWaveCyclicMSVAD, pAdapterCommon, NULL, IID_IPortWaveCyclic, pAdapterCommon->WavePortDriverDest(), &unknownWave);
+        ntStatus = InstallSubdevice(DeviceObject, Irp, L"Wave", CLSID_PortWaveRT, CLSID_PortWaveRT, CreateMiniportWaveRTMSVAD, pAdapterCommon, NULL, IID_IPortWaveRT, NULL, &unknownWave);
+        if (!NT_SUCCESS(ntStatus)) {
+            DPF(D_TERSE, ("[WaveRT port not available: %08X]", ntStatus));
+            ntStatus = InstallSubdevice(DeviceObject, Irp, L"Wave", CLSID_PortWaveCyclic, CLSID_PortWaveCyclic, CreateMiniportWaveCyclicMSVAD, pAdapterCommon, NULL, IID_IPortWaveCyclic, pAdapterCommon->WavePortDriverDest(), &unknownWave);
+        }
     }
 
     if (unknownTopology && unknownWave) {
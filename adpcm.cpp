@@ -0,0 +1,352 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    adpcm.cpp
+
+Abstract:
+    Implementation of the IMA ADPCM codec.
+
+    Each payload is one WAVE_FORMAT_IMA_ADPCM block, so a receiver can start
+    decoding at any datagram. Only the step index is carried from one block
+    to the next; the predictor restarts from the first sample of every block.
+
+    ADPCM is serial in time, so the x64 path vectorizes across channels
+    instead: up to four channels are quantized side by side in the 32 bit
+    lanes of an SSE2 register, and the nibbles of each channel are collected
+    into its output word in the register as well.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include "codec.h"
+
+#if defined(_M_AMD64)
+#include <emmintrin.h>
+#endif
+
+//=============================================================================
+// Defines
+//=============================================================================
+#define IMA_MAX_STEP_INDEX          88
+#define IMA_SAMPLES_PER_WORD        8
+
+//=============================================================================
+// Statics
+//=============================================================================
+static const LONG ImaStepTable[IMA_MAX_STEP_INDEX + 1] = {
+        7,     8,     9,    10,    11,    12,    13,    14,    16,    17,
+       19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+       50,    55,    60,    66,    73,    80,    88,    97,   107,   118,
+      130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+      337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+      876,   963,  1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+     2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+     5894,  6484,  7132,  7845,  8630,  9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const LONG ImaIndexTable[8] = {
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+//=============================================================================
+// Helper Functions
+//=============================================================================
+__forceinline ULONG ImaEncodeSample(IN LONG lSample, IN OUT PLONG plPredictor, IN OUT PLONG plStepIndex)
+{
+    LONG  lStep   = ImaStepTable[*plStepIndex];
+    LONG  lDiff   = lSample - *plPredictor;
+    LONG  lDelta  = lStep >> 3;
+    ULONG ulCode  = 0;
+
+    if (lDiff < 0) {
+        ulCode = 8;
+        lDiff = -lDiff;
+    }
+    if (lDiff >= lStep) {
+        ulCode |= 4;
+        lDiff  -= lStep;
+        lDelta += lStep;
+    }
+    lStep >>= 1;
+    if (lDiff >= lStep) {
+        ulCode |= 2;
+        lDiff  -= lStep;
+        lDelta += lStep;
+    }
+    lStep >>= 1;
+    if (lDiff >= lStep) {
+        ulCode |= 1;
+        lDelta += lStep;
+    }
+
+    LONG lPredictor = *plPredictor + ((ulCode & 8) ? -lDelta : lDelta);
+    if (lPredictor > 32767) {
+        lPredictor = 32767;
+    } else if (lPredictor < -32768) {
+        lPredictor = -32768;
+    }
+    *plPredictor = lPredictor;
+
+    LONG lStepIndex = *plStepIndex + ImaIndexTable[ulCode & 7];
+    if (lStepIndex < 0) {
+        lStepIndex = 0;
+    } else if (lStepIndex > IMA_MAX_STEP_INDEX) {
+        lStepIndex = IMA_MAX_STEP_INDEX;
+    }
+    *plStepIndex = lStepIndex;
+
+    return ulCode;
+}
+
+#pragma code_seg("PAGE")
+//=============================================================================
+// CImaAdpcmCodec
+//=============================================================================
+
+//=============================================================================
+NTSTATUS CImaAdpcmCodec::Init(
+    IN  PWAVEFORMATEX           pWfx,
+    IN  PCODEC_SETTINGS         pSettings
+)
+/*++
+Routine Description:
+  IMA ADPCM encodes 8 or 16 bit PCM with up to CODEC_MAX_CHANNELS channels.
+
+Arguments:
+  pWfx - stream format.
+  pSettings - codec settings.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    if ((pWfx->wBitsPerSample != 8) && (pWfx->wBitsPerSample != 16)) {
+        DPF(D_TERSE, ("IMA ADPCM needs 8 or 16 bit input"));
+        return STATUS_NOT_SUPPORTED;
+    }
+    if (pWfx->nChannels > CODEC_MAX_CHANNELS) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    RtlZeroMemory(m_lStepIndex, sizeof(m_lStepIndex));
+
+    return CAudioCodec::Init(pWfx, pSettings);
+} // Init
+
+//=============================================================================
+ULONG CImaAdpcmCodec::GetFramesPerPacket(
+    IN  ULONG                   ulMaxPayload
+)
+/*++
+Routine Description:
+  A block holds the header frame plus a whole number of 8 frame groups.
+
+Arguments:
+  ulMaxPayload - payload bytes available in one datagram.
+
+Return Value:
+  Frames per datagram.
+--*/
+{
+    PAGED_CODE();
+
+    ULONG ulWords = ulMaxPayload / (sizeof(ULONG) * m_nChannels);
+
+    if (ulWords < 2) {
+        return 0;
+    }
+
+    return 1 + (ulWords - 1) * IMA_SAMPLES_PER_WORD;
+} // GetFramesPerPacket
+#pragma code_seg()
+
+//=============================================================================
+ULONG CImaAdpcmCodec::GetMaxOutputSize(
+    IN  ULONG                   ulFrames
+)
+{
+    ULONG ulGroups = (ulFrames + IMA_SAMPLES_PER_WORD - 2) / IMA_SAMPLES_PER_WORD;
+
+    return (1 + ulGroups) * sizeof(ULONG) * m_nChannels;
+} // GetMaxOutputSize
+
+//=============================================================================
+ULONG CImaAdpcmCodec::Encode(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput
+)
+/*++
+Routine Description:
+  Encodes ulFrames frames as one block. The last group of 8 frames is
+  padded by repeating the last frame.
+
+Arguments:
+  pInput - interleaved 8 bit unsigned or 16 bit signed samples.
+  ulFrames - frames to encode, at least one.
+  pOutput - receives the block.
+
+Return Value:
+  Payload length.
+--*/
+{
+    ASSERT(ulFrames);
+
+    PAUDIONET_IMA_BLOCK_HEADER pHeader = (PAUDIONET_IMA_BLOCK_HEADER) pOutput;
+
+    for (ULONG c = 0; c < m_nChannels; c++) {
+        pHeader[c].Sample    = GetSample16(pInput, c);
+        pHeader[c].StepIndex = (UCHAR) m_lStepIndex[c];
+        pHeader[c].Reserved  = 0;
+    }
+
+#if defined(_M_AMD64)
+    EncodeSse2(pInput, ulFrames, pOutput);
+#else
+    EncodeScalar(pInput, ulFrames, pOutput);
+#endif
+
+    return GetMaxOutputSize(ulFrames);
+} // Encode
+
+//=============================================================================
+void CImaAdpcmCodec::EncodeScalar(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput
+)
+{
+    PULONG pulWords = (PULONG) (pOutput + sizeof(AUDIONET_IMA_BLOCK_HEADER) * m_nChannels);
+    ULONG  ulGroups = (ulFrames + IMA_SAMPLES_PER_WORD - 2) / IMA_SAMPLES_PER_WORD;
+
+    for (ULONG c = 0; c < m_nChannels; c++) {
+        LONG lPredictor = GetSample16(pInput, c);
+        LONG lStepIndex = m_lStepIndex[c];
+
+        for (ULONG g = 0; g < ulGroups; g++) {
+            ULONG ulWord = 0;
+
+            for (ULONG j = 0; j < IMA_SAMPLES_PER_WORD; j++) {
+                ULONG ulFrame = min(1 + g * IMA_SAMPLES_PER_WORD + j, ulFrames - 1);
+                LONG  lSample = GetSample16(pInput, ulFrame * m_nChannels + c);
+
+                ulWord |= ImaEncodeSample(lSample, &lPredictor, &lStepIndex) << (4 * j);
+            }
+
+            pulWords[g * m_nChannels + c] = ulWord;
+        }
+
+        m_lStepIndex[c] = lStepIndex;
+    }
+} // EncodeScalar
+
+#if defined(_M_AMD64)
+//=============================================================================
+void CImaAdpcmCodec::EncodeSse2(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput
+)
+/*++
+Routine Description:
+  Same bitstream as EncodeScalar, four channels per register. Only the step
+  table lookup and the sample gather are done per lane.
+--*/
+{
+    PULONG        pulWords = (PULONG) (pOutput + sizeof(AUDIONET_IMA_BLOCK_HEADER) * m_nChannels);
+    ULONG         ulGroups = (ulFrames + IMA_SAMPLES_PER_WORD - 2) / IMA_SAMPLES_PER_WORD;
+    const __m128i zero     = _mm_setzero_si128();
+    const __m128i four     = _mm_set1_epi32(4);
+    const __m128i three    = _mm_set1_epi32(3);
+    const __m128i two      = _mm_set1_epi32(2);
+    const __m128i one      = _mm_set1_epi32(1);
+    const __m128i eight    = _mm_set1_epi32(8);
+    const __m128i topIndex = _mm_set1_epi32(IMA_MAX_STEP_INDEX);
+
+    for (ULONG c0 = 0; c0 < m_nChannels; c0 += 4) {
+        ULONG  ulLanes = min(4, m_nChannels - c0);
+        LONG   lIndex[4] = { 0, 0, 0, 0 };
+        LONG   lSample[4] = { 0, 0, 0, 0 };
+        ULONG  ulWord[4];
+        ULONG  l;
+
+        for (l = 0; l < ulLanes; l++) {
+            lIndex[l]  = m_lStepIndex[c0 + l];
+            lSample[l] = GetSample16(pInput, c0 + l);
+        }
+
+        __m128i pred  = _mm_loadu_si128((const __m128i *) lSample);
+        __m128i index = _mm_loadu_si128((const __m128i *) lIndex);
+
+        for (ULONG g = 0; g < ulGroups; g++) {
+            __m128i word = zero;
+
+            for (ULONG j = 0; j < IMA_SAMPLES_PER_WORD; j++) {
+                ULONG ulFrame = min(1 + g * IMA_SAMPLES_PER_WORD + j, ulFrames - 1);
+
+                for (l = 0; l < ulLanes; l++) {
+                    lSample[l] = GetSample16(pInput, ulFrame * m_nChannels + c0 + l);
+                }
+                _mm_storeu_si128((__m128i *) lIndex, index);
+
+                __m128i step  = _mm_set_epi32(ImaStepTable[lIndex[3]], ImaStepTable[lIndex[2]], ImaStepTable[lIndex[1]], ImaStepTable[lIndex[0]]);
+                __m128i diff  = _mm_sub_epi32(_mm_loadu_si128((const __m128i *) lSample), pred);
+                __m128i sign  = _mm_srai_epi32(diff, 31);
+                __m128i mag   = _mm_sub_epi32(_mm_xor_si128(diff, sign), sign);
+                __m128i delta = _mm_srai_epi32(step, 3);
+                __m128i hit;
+                __m128i code;
+
+                hit   = _mm_cmpgt_epi32(step, mag);
+                hit   = _mm_andnot_si128(hit, _mm_set1_epi32(-1));
+                code  = _mm_and_si128(hit, four);
+                mag   = _mm_sub_epi32(mag, _mm_and_si128(hit, step));
+                delta = _mm_add_epi32(delta, _mm_and_si128(hit, step));
+
+                step  = _mm_srai_epi32(step, 1);
+                hit   = _mm_andnot_si128(_mm_cmpgt_epi32(step, mag), _mm_set1_epi32(-1));
+                code  = _mm_or_si128(code, _mm_and_si128(hit, two));
+                mag   = _mm_sub_epi32(mag, _mm_and_si128(hit, step));
+                delta = _mm_add_epi32(delta, _mm_and_si128(hit, step));
+
+                step  = _mm_srai_epi32(step, 1);
+                hit   = _mm_andnot_si128(_mm_cmpgt_epi32(step, mag), _mm_set1_epi32(-1));
+                code  = _mm_or_si128(code, _mm_and_si128(hit, one));
+                delta = _mm_add_epi32(delta, _mm_and_si128(hit, step));
+
+                // Predictor update; packs saturates to the 16 bit range.
+                pred = _mm_add_epi32(pred, _mm_sub_epi32(_mm_xor_si128(delta, sign), sign));
+                pred = _mm_packs_epi32(pred, pred);
+                pred = _mm_srai_epi32(_mm_unpacklo_epi16(pred, pred), 16);
+
+                // Index update: -1 for codes 0..3, 2 * (code & 3) + 2 otherwise.
+                __m128i big    = _mm_cmpgt_epi32(code, three);
+                __m128i adjust = _mm_add_epi32(_mm_slli_epi32(_mm_and_si128(code, three), 1), two);
+                adjust = _mm_or_si128(_mm_and_si128(big, adjust), _mm_andnot_si128(big, _mm_set1_epi32(-1)));
+                index  = _mm_add_epi32(index, adjust);
+                index  = _mm_andnot_si128(_mm_cmpgt_epi32(zero, index), index);
+                hit    = _mm_cmpgt_epi32(index, topIndex);
+                index  = _mm_or_si128(_mm_and_si128(hit, topIndex), _mm_andnot_si128(hit, index));
+
+                code = _mm_or_si128(code, _mm_and_si128(sign, eight));
+                word = _mm_or_si128(word, _mm_sll_epi32(code, _mm_cvtsi32_si128(4 * j)));
+            }
+
+            _mm_storeu_si128((__m128i *) ulWord, word);
+            for (l = 0; l < ulLanes; l++) {
+                pulWords[g * m_nChannels + c0 + l] = ulWord[l];
+            }
+        }
+
+        _mm_storeu_si128((__m128i *) lIndex, index);
+        for (l = 0; l < ulLanes; l++) {
+            m_lStepIndex[c0 + l] = lIndex[l];
+        }
+    }
+} // EncodeSse2
+#endif
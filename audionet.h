@@ -0,0 +1,305 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    audionet.h
+
+Abstract:
+    Private property set and wire format of the network audio sender.
+    This header is shared with the user-mode configuration and receiver
+    tools, so it only depends on basic Windows types.
+--*/
+
+#ifndef _MSVAD_AUDIONET_H_
+#define _MSVAD_AUDIONET_H_
+
+//=============================================================================
+// Property set
+//=============================================================================
+
+// {00A92BBE-FE72-4633-B1C2-EF855CE64B60}
+#define STATIC_KSPROPSETID_AudioNet 0x00a92bbe, 0xfe72, 0x4633, 0xb1, 0xc2, 0xef, 0x85, 0x5c, 0xe6, 0x4b, 0x60
+DEFINE_GUIDSTRUCT("00A92BBE-FE72-4633-B1C2-EF855CE64B60", KSPROPSETID_AudioNet);
+#define KSPROPSETID_AudioNet DEFINE_GUIDNAMED(KSPROPSETID_AudioNet)
+
+typedef enum {
+    KSPROPERTY_AUDIONET_CODEC = 0,          // ULONG, one of AUDIONET_CODEC_xxx
+    KSPROPERTY_AUDIONET_BITRATE,            // ULONG, bits per second of perceptual codecs
+    KSPROPERTY_AUDIONET_COMPLEXITY,         // ULONG, 0 (fastest) to 10
+    KSPROPERTY_AUDIONET_FRAME_DURATION,     // ULONG, microseconds per codec frame
+    KSPROPERTY_AUDIONET_BIT_DEPTH,          // ULONG, packed PCM bits, 0 for the stream depth
+    KSPROPERTY_AUDIONET_NOISE_SHAPING,      // ULONG, non-zero to shape the requantization noise
+    KSPROPERTY_AUDIONET_SAMPLE_RATE,        // ULONG, network sample rate, 0 for the stream rate
+    KSPROPERTY_AUDIONET_CHANNEL_MATRIX,     // AUDIONET_CHANNEL_MATRIX
+    KSPROPERTY_AUDIONET_DESTINATIONS,       // AUDIONET_DESTINATIONS
+    KSPROPERTY_AUDIONET_EQUALIZER,          // AUDIONET_EQUALIZER, per destination
+    KSPROPERTY_AUDIONET_LIMITER,            // AUDIONET_LIMITER
+    KSPROPERTY_AUDIONET_LIMITER_REDUCTION,  // LONG, get only
+    KSPROPERTY_AUDIONET_RMS_METER,          // LONG per channel, get only, on the peak meter node
+    KSPROPERTY_AUDIONET_NORMALIZATION,      // AUDIONET_NORMALIZATION
+    KSPROPERTY_AUDIONET_LOUDNESS,           // AUDIONET_LOUDNESS, get only
+    KSPROPERTY_AUDIONET_DELAY               // ULONG, microseconds, per destination
+} KSPROPERTY_AUDIONET;
+
+// Codec, frame duration, bit depth, noise shaping, sample rate, channel
+// matrix, destinations, limiter and normalization apply to streams opened
+// afterwards, bitrate and complexity also to running streams. Equalizers
+// and delays change in running streams without clicks.
+// Streams whose rate cannot be converted to the sample rate are sent at
+// their own rate.
+#define AUDIONET_MIN_BITRATE        6000
+#define AUDIONET_MAX_BITRATE        510000
+#define AUDIONET_MAX_COMPLEXITY     10
+#define AUDIONET_MIN_BIT_DEPTH      8
+#define AUDIONET_MAX_BIT_DEPTH      24
+
+// Value of KSPROPERTY_AUDIONET_CHANNEL_MATRIX. Output channel o is the sum
+// of Gain[o][i] times input channel i, with gains in 16.16 fixed point, so
+// 0x10000 passes a channel unchanged. Gains of input channels the stream
+// does not have are ignored. E.g. a stereo fold to mono is one output with
+// gains 0x8000, 0x8000.
+#define AUDIONET_MAX_CHANNELS       8
+#define AUDIONET_MAX_MATRIX_GAIN    0x40000     // +12 dB
+
+typedef struct _AUDIONET_CHANNEL_MATRIX {
+    ULONG           OutputChannels;         // 0 to send the stream channels unchanged
+    LONG            Gain[AUDIONET_MAX_CHANNELS][AUDIONET_MAX_CHANNELS];    // [output][input]
+} AUDIONET_CHANNEL_MATRIX;
+typedef AUDIONET_CHANNEL_MATRIX *PAUDIONET_CHANNEL_MATRIX;
+
+// Value of KSPROPERTY_AUDIONET_DESTINATIONS. Every destination is sent its
+// own datagrams with the channels its map selects, encoded separately and
+// numbered by their own Sequence; Timestamp is shared. Map entries are
+// channels of the stream after the channel matrix, so { 2, 3 } sends the
+// third and fourth channel as a stereo stream. Destinations whose map
+// selects channels the stream does not have are left out.
+#define AUDIONET_MAX_DESTINATIONS   4
+
+typedef struct _AUDIONET_DESTINATION {
+    ULONG           Address;                // IPv4 address, network byte order
+    USHORT          Port;                   // UDP port, network byte order
+    USHORT          Channels;               // Channels sent, 0 for all in order
+    UCHAR           ChannelMap[AUDIONET_MAX_CHANNELS];  // Stream channel of each channel sent
+} AUDIONET_DESTINATION;
+typedef AUDIONET_DESTINATION *PAUDIONET_DESTINATION;
+
+typedef struct _AUDIONET_DESTINATIONS {
+    ULONG           Count;                  // 0 for the default receiver
+    AUDIONET_DESTINATION Destination[AUDIONET_MAX_DESTINATIONS];
+} AUDIONET_DESTINATIONS;
+typedef AUDIONET_DESTINATIONS *PAUDIONET_DESTINATIONS;
+
+// Value of KSPROPERTY_AUDIONET_EQUALIZER, whose instance data is the ULONG
+// index of the destination (0 for the default receiver). The sections run
+// in order, each computing
+//   y[n] = B0 x[n] + B1 x[n-1] + B2 x[n-2] - A1 y[n-1] - A2 y[n-2]
+// with coefficients for the rate the destination is sent at. A set with an
+// unstable section is ignored by the streams.
+#define AUDIONET_MAX_BIQUADS        8
+
+typedef struct _AUDIONET_BIQUAD {
+    FLOAT           B0;
+    FLOAT           B1;
+    FLOAT           B2;
+    FLOAT           A1;
+    FLOAT           A2;
+} AUDIONET_BIQUAD;
+typedef AUDIONET_BIQUAD *PAUDIONET_BIQUAD;
+
+typedef struct _AUDIONET_EQUALIZER {
+    ULONG           Sections;               // 0 for none
+    AUDIONET_BIQUAD Section[AUDIONET_MAX_BIQUADS];
+} AUDIONET_EQUALIZER;
+typedef AUDIONET_EQUALIZER *PAUDIONET_EQUALIZER;
+
+// Value of KSPROPERTY_AUDIONET_DELAY, whose instance data is the ULONG
+// index of the destination like for KSPROPERTY_AUDIONET_EQUALIZER. The
+// frames sent there are delayed by the nearest whole number of frames at
+// the rate they are sent at, to line up speakers at different distances
+// or receivers with different latencies. A change fades over 10 ms.
+#define AUDIONET_MAX_DELAY          500000
+
+// Value of KSPROPERTY_AUDIONET_LIMITER. The limiter delays the stream by
+// the look-ahead so its gain is down before a peak arrives, keeping every
+// sample at or below the threshold. The gain recovers with the release
+// time constant. KSPROPERTY_AUDIONET_LIMITER_REDUCTION reads the deepest
+// gain reduction of the last block sent, in 1/65536 dB, 0 or negative.
+#define AUDIONET_MIN_LOOKAHEAD      1000
+#define AUDIONET_MAX_LOOKAHEAD      5000
+#define AUDIONET_MIN_RELEASE        1
+#define AUDIONET_MAX_RELEASE        1000
+
+typedef struct _AUDIONET_LIMITER {
+    ULONG           Lookahead;              // Microseconds, 0 for no limiter
+    LONG            Threshold;              // 1/65536 dB full scale, at most 0
+    ULONG           Release;                // Milliseconds
+} AUDIONET_LIMITER;
+typedef AUDIONET_LIMITER *PAUDIONET_LIMITER;
+
+// The wave out peak meter node of the topology filter answers
+// KSPROPERTY_AUDIO_PEAKMETER and KSPROPERTY_AUDIONET_RMS_METER, with the
+// channel as instance data. Both are linear levels of the render stream
+// before volume, MAXLONG for full scale, over the last 50 ms. They read 0
+// when no frames arrived for a quarter second.
+
+// Value of KSPROPERTY_AUDIONET_NORMALIZATION. The loudness of the stream is
+// measured as in EBU R128, K-weighted and gated, before volume. With a
+// target the stream gain follows it slowly, by at most 1 dB per second,
+// steered by the short-term loudness but held through passages quieter
+// than the integrated loudness by 10 LU, and limited to MaxGain either way.
+#define AUDIONET_MIN_LOUDNESS_TARGET (-50 * 0x10000)
+#define AUDIONET_MAX_LOUDNESS_TARGET (-5 * 0x10000)
+#define AUDIONET_MAX_NORMALIZATION_GAIN (24 * 0x10000)
+
+typedef struct _AUDIONET_NORMALIZATION {
+    LONG            Target;                 // 1/65536 LUFS, 0 for no normalization
+    ULONG           MaxGain;                // 1/65536 dB
+} AUDIONET_NORMALIZATION;
+typedef AUDIONET_NORMALIZATION *PAUDIONET_NORMALIZATION;
+
+// Value of KSPROPERTY_AUDIONET_LOUDNESS, of the last packet of the last
+// render stream, in 1/65536 LUFS. Momentary is over 400 ms, short-term
+// over 3 s and integrated since the stream started; each reads
+// AUDIONET_LOUDNESS_NONE until its window is filled and while it is below
+// the absolute gate of -70 LUFS.
+// Gain is the normalization gain in 1/65536 dB.
+#define AUDIONET_LOUDNESS_NONE      ((LONG) 0x80000000)
+
+typedef struct _AUDIONET_LOUDNESS {
+    LONG            Momentary;
+    LONG            ShortTerm;
+    LONG            Integrated;
+    LONG            Gain;
+} AUDIONET_LOUDNESS;
+typedef AUDIONET_LOUDNESS *PAUDIONET_LOUDNESS;
+
+//=============================================================================
+// Codecs
+//=============================================================================
+#define AUDIONET_CODEC_PCM          0       // Stream format, little-endian
+#define AUDIONET_CODEC_G711_ULAW    1       // G.711 mu-law, 8 bits per sample
+#define AUDIONET_CODEC_G711_ALAW    2       // G.711 A-law, 8 bits per sample
+#define AUDIONET_CODEC_IMA_ADPCM    3       // IMA ADPCM, 4 bits per sample
+#define AUDIONET_CODEC_LOSSLESS     4       // Linear prediction + Rice, bit-exact
+#define AUDIONET_CODEC_OPUS         5       // Opus, one packet per datagram
+#define AUDIONET_CODEC_LC3          6       // LC3, one frame per channel per datagram
+#define AUDIONET_CODEC_PACKED_PCM   7       // PCM packed to BitsPerSample, dithered if reduced
+#define AUDIONET_CODEC_PCM_NETWORK  8       // Stream format, big-endian and 8 bit signed (RTP L8/L16/L24)
+#define AUDIONET_CODEC_COUNT        9
+
+//=============================================================================
+// Wire format
+//=============================================================================
+
+// Every datagram starts with this header and carries a payload that decodes
+// on its own, so a lost datagram never affects its neighbours.
+#define AUDIONET_PACKET_VERSION     1
+#define AUDIONET_MAX_DATAGRAM       1472    // Ethernet MTU minus IPv4 and UDP headers
+
+// Receivers report back to the port the sender is bound to, each about the
+// datagrams sent to it, from the port it receives them on so that several
+// receivers on one host are told apart. A DTX capable receiver conceals
+// missing timestamps, so silent frames need not be sent.
+// Receivers that report their buffer depth set AUDIONET_FEEDBACK_BUFFER; the
+// sender then produces frames at the clock of the first destination, keeping
+// its buffer at the target. Reports from older receivers end before
+// BufferedFrames.
+#define AUDIONET_FEEDBACK_DTX       0x01
+#define AUDIONET_FEEDBACK_BUFFER    0x02
+
+//
+// AUDIONET_CODEC_IMA_ADPCM payloads are one WAVE_FORMAT_IMA_ADPCM block: an
+// AUDIONET_IMA_BLOCK_HEADER per channel (whose sample is the first frame),
+// then for every 8 further frames one ULONG of nibbles per channel, least
+// significant nibble first. The last group is padded; Frames in the packet
+// header gives the real count.
+//
+//
+// AUDIONET_CODEC_LC3 payloads are one LC3 frame per channel in channel
+// order. All frames have the same size, PayloadLength / Channels; the frame
+// duration follows from Frames and SampleRate.
+//
+//
+// AUDIONET_CODEC_PACKED_PCM payloads are interleaved two's complement
+// samples of BitsPerSample bits without padding, packed least significant
+// bit first into little-endian bytes. 24 bits is plain 3 byte PCM, 20 bits
+// puts two samples into five bytes. The last byte is zero padded.
+//
+//
+// AUDIONET_CODEC_LOSSLESS payloads are a bit stream, most significant bit
+// first and zero padded to a byte:
+//
+//   4 bits     channel assignment, AUDIONET_LOSSLESS_CHANNELS_xxx
+//   then one subframe per channel:
+//   2 bits     subframe type, AUDIONET_LOSSLESS_SUBFRAME_xxx
+//   CONSTANT:  one sample
+//   VERBATIM:  Frames samples
+//   FIXED:     3 bits order (0..4), order warm-up samples, residual
+//   LPC:       3 bits order - 1, 4 bits precision - 1, 4 bits shift,
+//              order coefficients of precision bits, warm-up samples,
+//              residual
+//
+// Samples and coefficients are two's complement. Samples are BitsPerSample
+// wide (8 bit input is made signed first), the side channel one bit wider.
+// Sample i is predicted as the sum of coefficient j times sample i - 1 - j,
+// arithmetically shifted right by shift; fixed order n uses the binomial
+// coefficients of the n-th difference and no shift. All arithmetic fits in
+// 32 bits.
+//
+// The residual starts with 2 bits partition order p. The Frames samples are
+// split into 2^p partitions of Frames >> p samples, the last one taking the
+// remainder, and the first one losing the warm-up samples. Every partition
+// has a 5 bit Rice parameter k followed by its residuals, each zigzag mapped
+// (0, -1, 1, -2, ...) to u and coded as u >> k zero bits, a one bit and the
+// low k bits of u.
+//
+// Stereo is restored as left = side + right, right = left - side or, for
+// mid/side, mid = (mid << 1) | (side & 1), left = (mid + side) >> 1 and
+// right = (mid - side) >> 1.
+//
+#define AUDIONET_LOSSLESS_CHANNELS_INDEPENDENT  0
+#define AUDIONET_LOSSLESS_CHANNELS_LEFT_SIDE    1
+#define AUDIONET_LOSSLESS_CHANNELS_SIDE_RIGHT   2
+#define AUDIONET_LOSSLESS_CHANNELS_MID_SIDE     3
+
+#define AUDIONET_LOSSLESS_SUBFRAME_CONSTANT     0
+#define AUDIONET_LOSSLESS_SUBFRAME_VERBATIM     1
+#define AUDIONET_LOSSLESS_SUBFRAME_FIXED        2
+#define AUDIONET_LOSSLESS_SUBFRAME_LPC          3
+
+#include <pshpack1.h>
+typedef struct _AUDIONET_IMA_BLOCK_HEADER {
+    SHORT           Sample;                 // First sample, decoder start value
+    UCHAR           StepIndex;              // Index into the IMA step table
+    UCHAR           Reserved;
+} AUDIONET_IMA_BLOCK_HEADER;
+typedef AUDIONET_IMA_BLOCK_HEADER *PAUDIONET_IMA_BLOCK_HEADER;
+
+typedef struct _AUDIONET_PACKET_HEADER {
+    UCHAR           Version;                // AUDIONET_PACKET_VERSION
+    UCHAR           Codec;                  // AUDIONET_CODEC_xxx
+    UCHAR           Channels;               // Channels in the payload
+    UCHAR           BitsPerSample;          // Bits per decoded sample
+    ULONG           SampleRate;             // Frames per second
+    ULONG           Sequence;               // Incremented for every datagram
+    ULONG           Timestamp;              // Stream frame of the first payload frame
+    USHORT          Frames;                 // Frames carried in the payload
+    USHORT          PayloadLength;          // Bytes following this header
+} AUDIONET_PACKET_HEADER;
+typedef AUDIONET_PACKET_HEADER *PAUDIONET_PACKET_HEADER;
+
+typedef struct _AUDIONET_FEEDBACK {
+    UCHAR           Version;                // AUDIONET_PACKET_VERSION
+    UCHAR           Flags;                  // AUDIONET_FEEDBACK_xxx
+    UCHAR           LossPercent;            // Recent datagram loss, 0 to 100
+    UCHAR           Reserved;
+    ULONG           Sequence;               // Highest sequence received
+    ULONG           BufferedFrames;         // Frames waiting to be played
+    ULONG           TargetFrames;           // Frames the receiver wants waiting
+} AUDIONET_FEEDBACK;
+typedef AUDIONET_FEEDBACK *PAUDIONET_FEEDBACK;
+
+#define AUDIONET_FEEDBACK_MIN_SIZE  FIELD_OFFSET(AUDIONET_FEEDBACK, BufferedFrames)
+#include <poppack.h>
+
+#endif
@@ -0,0 +1,501 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    codec.cpp
+
+Abstract:
+    Implementation of the codec base class, PCM passthrough and G.711.
+
+    The G.711 encoders use one 256-entry segment table generated by the
+    preprocessor, so there is nothing to build at runtime. On x64 the
+    16-bit input path is batched eight samples at a time with SSE2, which
+    is always present there and needs no floating point state save in
+    kernel mode.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include "codec.h"
+
+#if defined(_M_AMD64)
+#include <emmintrin.h>
+#endif
+
+//=============================================================================
+// Defines
+//=============================================================================
+#define ULAW_BIAS                   0x84
+#define ULAW_CLIP                   32635
+
+// Segment (exponent) of a biased mu-law magnitude indexed by bits 7..14, and
+// of a 13 bit A-law magnitude indexed by bits 4..11. Both are floor(log2(i))
+// for i > 0, so one table serves both laws.
+#define SEG_R2(x)                   x, x
+#define SEG_R4(x)                   SEG_R2(x), SEG_R2(x)
+#define SEG_R8(x)                   SEG_R4(x), SEG_R4(x)
+#define SEG_R16(x)                  SEG_R8(x), SEG_R8(x)
+#define SEG_R32(x)                  SEG_R16(x), SEG_R16(x)
+#define SEG_R64(x)                  SEG_R32(x), SEG_R32(x)
+#define SEG_R128(x)                 SEG_R64(x), SEG_R64(x)
+
+//=============================================================================
+// Statics
+//=============================================================================
+static const UCHAR SegmentTable[256] = {
+    SEG_R2(0), SEG_R2(1), SEG_R4(2), SEG_R8(3), SEG_R16(4), SEG_R32(5), SEG_R64(6), SEG_R128(7)
+};
+C_ASSERT(sizeof(SegmentTable) == 256);
+
+//=============================================================================
+// Helper Functions
+//=============================================================================
+__forceinline UCHAR LinearToULaw(IN LONG lSample)
+{
+    LONG lSign = (lSample >> 8) & 0x80;
+
+    if (lSign) {
+        lSample = ~lSample;
+    }
+    if (lSample > ULAW_CLIP) {
+        lSample = ULAW_CLIP;
+    }
+    lSample += ULAW_BIAS;
+
+    LONG lExponent = SegmentTable[(lSample >> 7) & 0xFF];
+    LONG lMantissa = (lSample >> (lExponent + 3)) & 0x0F;
+
+    return (UCHAR) ~(lSign | (lExponent << 4) | lMantissa);
+}
+
+__forceinline UCHAR LinearToALaw(IN LONG lSample)
+{
+    LONG lMask;
+
+    lSample >>= 3;
+    if (lSample >= 0) {
+        lMask = 0xD5;
+    } else {
+        lMask = 0x55;
+        lSample = -lSample - 1;
+    }
+    if (lSample > 0xFFF) {
+        lSample = 0xFFF;
+    }
+
+    LONG lSegment = SegmentTable[lSample >> 4];
+    LONG lMantissa = (lSample >> (lSegment ? lSegment : 1)) & 0x0F;
+
+    return (UCHAR) (((lSegment << 4) | lMantissa) ^ lMask);
+}
+
+#if defined(_M_AMD64)
+//-----------------------------------------------------------------------------
+// Eight samples per iteration. The segment is the number of thresholds the
+// magnitude reaches; the per-lane right shift by the segment is done as an
+// unsigned high multiply by a power of two that halves at every threshold.
+//
+static ULONG ULawEncodeSse2(IN const SHORT *pIn, IN ULONG ulCount, OUT PBYTE pOut)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i clip = _mm_set1_epi16(ULAW_CLIP);
+    const __m128i bias = _mm_set1_epi16(ULAW_BIAS);
+    const __m128i mant = _mm_set1_epi16(0x0F);
+    const __m128i sgn  = _mm_set1_epi16(0x80);
+    const __m128i one  = _mm_set1_epi16(0xFF);
+    ULONG         i;
+
+    for (i = 0; i + 8 <= ulCount; i += 8) {
+        __m128i s    = _mm_loadu_si128((const __m128i *)(pIn + i));
+        __m128i neg  = _mm_srai_epi16(s, 15);
+        __m128i mag  = _mm_xor_si128(s, neg);
+        __m128i exp  = zero;
+        __m128i mul  = _mm_set1_epi16(1 << 13);
+        LONG    t;
+
+        mag = _mm_add_epi16(_mm_min_epi16(mag, clip), bias);
+
+        for (t = 256; t <= 16384; t <<= 1) {
+            __m128i hit = _mm_cmpgt_epi16(mag, _mm_set1_epi16((SHORT) (t - 1)));
+            exp = _mm_sub_epi16(exp, hit);
+            mul = _mm_sub_epi16(mul, _mm_and_si128(hit, _mm_srli_epi16(mul, 1)));
+        }
+
+        __m128i code = _mm_and_si128(_mm_mulhi_epu16(mag, mul), mant);
+        code = _mm_or_si128(code, _mm_slli_epi16(exp, 4));
+        code = _mm_or_si128(code, _mm_and_si128(neg, sgn));
+        code = _mm_xor_si128(code, one);
+
+        _mm_storel_epi64((__m128i *)(pOut + i), _mm_packus_epi16(code, code));
+    }
+
+    return i;
+}
+
+//-----------------------------------------------------------------------------
+static ULONG ALawEncodeSse2(IN const SHORT *pIn, IN ULONG ulCount, OUT PBYTE pOut)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i top  = _mm_set1_epi16(0xFFF);
+    const __m128i mant = _mm_set1_epi16(0x0F);
+    const __m128i pos  = _mm_set1_epi16(0xD5);
+    const __m128i neg  = _mm_set1_epi16(0x55);
+    ULONG         i;
+
+    for (i = 0; i + 8 <= ulCount; i += 8) {
+        __m128i s    = _mm_srai_epi16(_mm_loadu_si128((const __m128i *)(pIn + i)), 3);
+        __m128i sign = _mm_srai_epi16(s, 15);
+        __m128i mag  = _mm_min_epi16(_mm_xor_si128(s, sign), top);
+        __m128i seg  = _mm_sub_epi16(zero, _mm_cmpgt_epi16(mag, _mm_set1_epi16(31)));
+        __m128i mul  = _mm_set1_epi16((SHORT) 0x8000);
+        LONG    t;
+
+        for (t = 64; t <= 2048; t <<= 1) {
+            __m128i hit = _mm_cmpgt_epi16(mag, _mm_set1_epi16((SHORT) (t - 1)));
+            seg = _mm_sub_epi16(seg, hit);
+            mul = _mm_sub_epi16(mul, _mm_and_si128(hit, _mm_srli_epi16(mul, 1)));
+        }
+
+        __m128i code = _mm_and_si128(_mm_mulhi_epu16(mag, mul), mant);
+        code = _mm_or_si128(code, _mm_slli_epi16(seg, 4));
+        code = _mm_xor_si128(code, _mm_or_si128(_mm_and_si128(sign, neg), _mm_andnot_si128(sign, pos)));
+
+        _mm_storel_epi64((__m128i *)(pOut + i), _mm_packus_epi16(code, code));
+    }
+
+    return i;
+}
+#endif
+
+//=============================================================================
+// CAudioCodec
+//=============================================================================
+
+#pragma code_seg("PAGE")
+//=============================================================================
+CAudioCodec::CAudioCodec(IN ULONG CodecId) : m_ulCodecId(CodecId), m_nChannels(0), m_nBlockAlign(0), m_wBitsPerSample(0), m_nSamplesPerSec(0)
+{
+    PAGED_CODE();
+} // CAudioCodec
+
+//=============================================================================
+CAudioCodec::~CAudioCodec()
+{
+    PAGED_CODE();
+} // ~CAudioCodec
+
+//=============================================================================
+NTSTATUS CAudioCodec::Init(
+    IN  PWAVEFORMATEX           pWfx,
+    IN  PCODEC_SETTINGS         pSettings
+)
+/*++
+Routine Description:
+  Latches the input format. Derived codecs check that they can encode it.
+
+Arguments:
+  pWfx - stream format.
+  pSettings - codec settings.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    UNREFERENCED_PARAMETER(pSettings);
+
+    ASSERT(pWfx);
+
+    if (!pWfx->nChannels || !pWfx->nBlockAlign) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    m_nChannels      = pWfx->nChannels;
+    m_nBlockAlign    = pWfx->nBlockAlign;
+    m_wBitsPerSample = pWfx->wBitsPerSample;
+    m_nSamplesPerSec = pWfx->nSamplesPerSec;
+
+    return STATUS_SUCCESS;
+} // Init
+
+//=============================================================================
+ULONG CAudioCodec::GetFramesPerPacket(
+    IN  ULONG                   ulMaxPayload
+)
+/*++
+Routine Description:
+  Default for codecs whose payload grows linearly with the frame count.
+
+Arguments:
+  ulMaxPayload - payload bytes available in one datagram.
+
+Return Value:
+  Frames per datagram.
+--*/
+{
+    PAGED_CODE();
+
+    return ulMaxPayload / GetMaxOutputSize(1);
+} // GetFramesPerPacket
+
+//=============================================================================
+ULONG CAudioCodec::GetFrameSize(void)
+{
+    PAGED_CODE();
+
+    return 0;
+} // GetFrameSize
+
+//=============================================================================
+ULONG CAudioCodec::GetAlgorithmicDelay(void)
+{
+    PAGED_CODE();
+
+    return 0;
+} // GetAlgorithmicDelay
+
+//=============================================================================
+void CAudioCodec::SetBitrate(
+    IN  ULONG                   ulBitrate
+)
+{
+    PAGED_CODE();
+
+    UNREFERENCED_PARAMETER(ulBitrate);
+} // SetBitrate
+
+//=============================================================================
+void CAudioCodec::SetComplexity(
+    IN  ULONG                   ulComplexity
+)
+{
+    PAGED_CODE();
+
+    UNREFERENCED_PARAMETER(ulComplexity);
+} // SetComplexity
+
+//=============================================================================
+void CAudioCodec::SetLossFeedback(
+    IN  ULONG                   ulLossPercent,
+    IN  BOOL                    fDtx
+)
+{
+    PAGED_CODE();
+
+    UNREFERENCED_PARAMETER(ulLossPercent);
+    UNREFERENCED_PARAMETER(fDtx);
+} // SetLossFeedback
+
+//=============================================================================
+// CG711Codec
+//=============================================================================
+
+//=============================================================================
+NTSTATUS CG711Codec::Init(
+    IN  PWAVEFORMATEX           pWfx,
+    IN  PCODEC_SETTINGS         pSettings
+)
+/*++
+Routine Description:
+  G.711 compands 8 or 16 bit PCM.
+
+Arguments:
+  pWfx - stream format.
+  pSettings - codec settings.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    if ((pWfx->wBitsPerSample != 8) && (pWfx->wBitsPerSample != 16)) {
+        DPF(D_TERSE, ("G.711 needs 8 or 16 bit input"));
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    return CAudioCodec::Init(pWfx, pSettings);
+} // Init
+
+//=============================================================================
+// Functions
+//=============================================================================
+
+//=============================================================================
+NTSTATUS NewAudioCodec(
+    OUT PCAudioCodec *          OutCodec,
+    IN  PCODEC_SETTINGS         pSettings,
+    IN  PWAVEFORMATEX           pWfx
+)
+/*++
+Routine Description:
+  Creates and initializes the codec selected by the settings for the given
+  stream format.
+
+Arguments:
+  OutCodec - receives the new codec.
+  pSettings - codec settings.
+  pWfx - stream format.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(OutCodec);
+    ASSERT(pSettings);
+    ASSERT(pWfx);
+
+    NTSTATUS     ntStatus = STATUS_SUCCESS;
+    PCAudioCodec pCodec = NULL;
+
+    switch (pSettings->CodecId) {
+        case AUDIONET_CODEC_PCM:
+            pCodec = new (NonPagedPool, MSVAD_POOLTAG) CPcmCodec();
+            break;
+
+        case AUDIONET_CODEC_G711_ULAW:
+        case AUDIONET_CODEC_G711_ALAW:
+            pCodec = new (NonPagedPool, MSVAD_POOLTAG) CG711Codec(pSettings->CodecId);
+            break;
+
+        case AUDIONET_CODEC_IMA_ADPCM:
+            pCodec = new (NonPagedPool, MSVAD_POOLTAG) CImaAdpcmCodec();
+            break;
+
+        case AUDIONET_CODEC_LOSSLESS:
+            pCodec = new (NonPagedPool, MSVAD_POOLTAG) CLosslessCodec();
+            break;
+
+        case AUDIONET_CODEC_PCM_NETWORK:
+            pCodec = new (NonPagedPool, MSVAD_POOLTAG) CNetworkPcmCodec();
+            break;
+
+        case AUDIONET_CODEC_PACKED_PCM:
+            pCodec = new (NonPagedPool, MSVAD_POOLTAG) CPackedPcmCodec();
+            break;
+
+#if defined(MSVAD_OPUS)
+        case AUDIONET_CODEC_OPUS:
+            pCodec = new (NonPagedPool, MSVAD_POOLTAG) COpusCodec();
+            break;
+#endif
+
+#if defined(MSVAD_LC3)
+        case AUDIONET_CODEC_LC3:
+            pCodec = new (NonPagedPool, MSVAD_POOLTAG) CLc3Codec();
+            break;
+#endif
+
+        default:
+            DPF(D_TERSE, ("Unsupported codec %d", pSettings->CodecId));
+            return STATUS_NOT_SUPPORTED;
+    }
+
+    if (!pCodec) {
+        ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+    } else {
+        ntStatus = pCodec->Init(pWfx, pSettings);
+        if (!NT_SUCCESS(ntStatus)) {
+            delete pCodec;
+            pCodec = NULL;
+        }
+    }
+
+    *OutCodec = pCodec;
+
+    return ntStatus;
+} // NewAudioCodec
+#pragma code_seg()
+
+//=============================================================================
+// CPcmCodec
+//=============================================================================
+
+//=============================================================================
+ULONG CPcmCodec::GetMaxOutputSize(
+    IN  ULONG                   ulFrames
+)
+{
+    return ulFrames * m_nBlockAlign;
+} // GetMaxOutputSize
+
+//=============================================================================
+ULONG CPcmCodec::Encode(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput
+)
+{
+    ULONG ulBytes = ulFrames * m_nBlockAlign;
+
+    RtlCopyMemory(pOutput, pInput, ulBytes);
+
+    return ulBytes;
+} // Encode
+
+//=============================================================================
+ULONG CG711Codec::GetMaxOutputSize(
+    IN  ULONG                   ulFrames
+)
+{
+    return ulFrames * m_nChannels;
+} // GetMaxOutputSize
+
+//=============================================================================
+ULONG CG711Codec::Encode(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput
+)
+/*++
+Routine Description:
+  Compands ulFrames frames, one output byte per input sample.
+
+Arguments:
+  pInput - interleaved 8 bit unsigned or 16 bit signed samples.
+  ulFrames - frames to encode.
+  pOutput - receives the companded samples.
+
+Return Value:
+  Payload length.
+--*/
+{
+    ULONG ulCount = ulFrames * m_nChannels;
+    ULONG i = 0;
+
+    if (m_wBitsPerSample == 16) {
+        const SHORT *pIn = (const SHORT *) pInput;
+
+        if (m_ulCodecId == AUDIONET_CODEC_G711_ULAW) {
+#if defined(_M_AMD64)
+            i = ULawEncodeSse2(pIn, ulCount, pOutput);
+#endif
+            for (; i < ulCount; i++) {
+                pOutput[i] = LinearToULaw(pIn[i]);
+            }
+        } else {
+#if defined(_M_AMD64)
+            i = ALawEncodeSse2(pIn, ulCount, pOutput);
+#endif
+            for (; i < ulCount; i++) {
+                pOutput[i] = LinearToALaw(pIn[i]);
+            }
+        }
+    } else {
+        if (m_ulCodecId == AUDIONET_CODEC_G711_ULAW) {
+            for (; i < ulCount; i++) {
+                pOutput[i] = LinearToULaw(((LONG) pInput[i] - 0x80) << 8);
+            }
+        } else {
+            for (; i < ulCount; i++) {
+                pOutput[i] = LinearToALaw(((LONG) pInput[i] - 0x80) << 8);
+            }
+        }
+    }
+
+    return ulCount;
+} // Encode
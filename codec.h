@@ -0,0 +1,377 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    codec.h
+
+Abstract:
+    Declaration of the payload codecs used by the network sender. A codec
+    turns a block of frames in the stream format into the payload of one
+    datagram.
+--*/
+
+#ifndef _MSVAD_CODEC_H_
+#define _MSVAD_CODEC_H_
+
+#include "audionet.h"
+
+//=============================================================================
+// Defines
+//=============================================================================
+#define CODEC_MAX_CHANNELS          8
+
+#define CODEC_DEFAULT_BITRATE       96000
+#define CODEC_DEFAULT_COMPLEXITY    5
+#define CODEC_DEFAULT_FRAME_DURATION 10000  // Microseconds
+#define CODEC_DEFAULT_BIT_DEPTH     0       // Stream depth
+#define CODEC_DEFAULT_NOISE_SHAPING TRUE
+#define CODEC_DEFAULT_SAMPLE_RATE   0       // Stream rate
+#define CODEC_DEFAULT_LIMITER_THRESHOLD (-19661) // -0.3 dBFS
+#define CODEC_DEFAULT_LIMITER_RELEASE 50     // Milliseconds
+#define CODEC_DEFAULT_NORMALIZATION_GAIN (12 * 0x10000) // 1/65536 dB
+
+//=============================================================================
+// Structs
+//=============================================================================
+
+// Codec settings of the wave miniport, see KSPROPERTY_AUDIONET.
+typedef struct _CODEC_SETTINGS {
+    ULONG       CodecId;                    // AUDIONET_CODEC_xxx
+    ULONG       Bitrate;                    // Bits per second
+    ULONG       Complexity;                 // 0 to AUDIONET_MAX_COMPLEXITY
+    ULONG       FrameDuration;              // Microseconds
+    ULONG       BitDepth;                   // 0 or AUDIONET_MIN_BIT_DEPTH to AUDIONET_MAX_BIT_DEPTH
+    ULONG       NoiseShaping;               // Non-zero to shape requantization noise
+    ULONG       SampleRate;                 // Network rate, 0 for the stream rate
+    AUDIONET_CHANNEL_MATRIX ChannelMatrix;  // OutputChannels 0 for the stream channels
+    AUDIONET_DESTINATIONS Destinations;     // Count 0 for the default receiver
+    AUDIONET_EQUALIZER Equalizer[AUDIONET_MAX_DESTINATIONS];
+    volatile LONG EqualizerGeneration;      // Odd while Equalizer is written
+    ULONG       Delay[AUDIONET_MAX_DESTINATIONS];   // Microseconds
+    AUDIONET_LIMITER Limiter;               // Lookahead 0 for no limiter
+    AUDIONET_NORMALIZATION Normalization;   // Target 0 for none
+} CODEC_SETTINGS;
+typedef CODEC_SETTINGS *PCODEC_SETTINGS;
+
+// State of the running render stream, written by the sender thread and read
+// by the miniport without a lock.
+typedef struct _CODEC_STATUS {
+    volatile LONG LimiterReduction;         // 1/65536 dB, see KSPROPERTY_AUDIONET_LIMITER_REDUCTION
+    AUDIONET_LOUDNESS Loudness;             // Each member written on its own
+} CODEC_STATUS;
+typedef CODEC_STATUS *PCODEC_STATUS;
+
+//=============================================================================
+// Helper Functions
+//=============================================================================
+
+// Whether the stream carries IEEE float rather than integer samples.
+__forceinline BOOL IsFloatFormat(IN PWAVEFORMATEX pWfx)
+{
+    if (pWfx->wFormatTag == WAVE_FORMAT_EXTENSIBLE) {
+        return IsEqualGUIDAligned(((PWAVEFORMATEXTENSIBLE) pWfx)->SubFormat, KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
+    }
+    return (pWfx->wFormatTag == WAVE_FORMAT_IEEE_FLOAT);
+}
+
+//=============================================================================
+// Classes
+//=============================================================================
+
+///////////////////////////////////////////////////////////////////////////////
+// CAudioCodec
+//   Base class of all payload codecs. Everything but Init is called on the
+//   sender thread at PASSIVE_LEVEL; Encode should still not allocate, it is
+//   on the audio path.
+//
+class CAudioCodec {
+protected:
+    ULONG                       m_ulCodecId;        // AUDIONET_CODEC_xxx
+    USHORT                      m_nChannels;        // Input format
+    USHORT                      m_nBlockAlign;
+    USHORT                      m_wBitsPerSample;
+    ULONG                       m_nSamplesPerSec;
+
+    // Sample ulIndex of the interleaved input as 16 bit signed.
+    SHORT                       GetSample16(IN PBYTE pInput, IN ULONG ulIndex)
+    {
+        if (m_wBitsPerSample == 8) {
+            return (SHORT) (((LONG) pInput[ulIndex] - 0x80) << 8);
+        }
+        return ((SHORT *) pInput)[ulIndex];
+    }
+
+    // Sample ulIndex of the interleaved input as 32 bit signed, left aligned.
+    LONG                        GetSample32(IN PBYTE pInput, IN ULONG ulIndex)
+    {
+        switch (m_wBitsPerSample) {
+            case 8:
+                return ((LONG) pInput[ulIndex] - 0x80) << 24;
+            case 16:
+                return (LONG) ((SHORT *) pInput)[ulIndex] << 16;
+            case 24:
+                pInput += ulIndex * 3;
+                return (LONG) (((ULONG) pInput[0] << 8) | ((ULONG) pInput[1] << 16) | ((ULONG) pInput[2] << 24));
+            default:
+                return ((LONG *) pInput)[ulIndex];
+        }
+    }
+
+public:
+    CAudioCodec(IN ULONG CodecId);
+    virtual ~CAudioCodec();
+
+    // Validates and latches the input format.
+    virtual NTSTATUS            Init(IN PWAVEFORMATEX pWfx, IN PCODEC_SETTINGS pSettings);
+
+    // Upper bound of the payload produced by encoding ulFrames frames.
+    virtual ULONG               GetMaxOutputSize(IN ULONG ulFrames) = 0;
+
+    // Number of frames that fit in a payload of ulMaxPayload bytes.
+    virtual ULONG               GetFramesPerPacket(IN ULONG ulMaxPayload);
+
+    // Frames every Encode call must get, or 0 for any count up to
+    // GetFramesPerPacket.
+    virtual ULONG               GetFrameSize(void);
+
+    // Delay added by the codec, in frames.
+    virtual ULONG               GetAlgorithmicDelay(void);
+
+    // Runtime controls of perceptual codecs, ignored by the others.
+    virtual void                SetBitrate(IN ULONG ulBitrate);
+    virtual void                SetComplexity(IN ULONG ulComplexity);
+    virtual void                SetLossFeedback(IN ULONG ulLossPercent, IN BOOL fDtx);
+
+    // Encodes ulFrames frames into pOutput, which holds at least
+    // GetMaxOutputSize(ulFrames) bytes. Returns the payload length.
+    virtual ULONG               Encode(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput) = 0;
+
+    ULONG                       GetCodecId(void)        { return m_ulCodecId; }
+    USHORT                      GetChannels(void)       { return m_nChannels; }
+    virtual USHORT              GetBitsPerSample(void)  { return m_wBitsPerSample; }
+    ULONG                       GetSampleRate(void)     { return m_nSamplesPerSec; }
+};
+typedef CAudioCodec *PCAudioCodec;
+
+///////////////////////////////////////////////////////////////////////////////
+// CPcmCodec
+//   Sends the stream format unchanged.
+//
+class CPcmCodec : public CAudioCodec {
+public:
+    CPcmCodec() : CAudioCodec(AUDIONET_CODEC_PCM) {}
+
+    ULONG                       GetMaxOutputSize(IN ULONG ulFrames);
+    ULONG                       Encode(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// CNetworkPcmCodec
+//   Sends the stream format in network byte order, with 8 bit samples made
+//   signed, as RTP L8, L16 and L24 receivers expect it.
+//
+typedef void (*PFNCONVERTSAMPLES)(IN PBYTE pInput, IN ULONG ulSamples, OUT PBYTE pOutput);
+
+class CNetworkPcmCodec : public CAudioCodec {
+protected:
+    PFNCONVERTSAMPLES           m_pfnConvert;       // Best kernel for the sample size
+    BOOL                        m_fExtendedState;   // m_pfnConvert uses AVX registers
+
+public:
+    CNetworkPcmCodec() : CAudioCodec(AUDIONET_CODEC_PCM_NETWORK), m_pfnConvert(NULL), m_fExtendedState(FALSE) {}
+
+    NTSTATUS                    Init(IN PWAVEFORMATEX pWfx, IN PCODEC_SETTINGS pSettings);
+    ULONG                       GetMaxOutputSize(IN ULONG ulFrames);
+    ULONG                       Encode(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// CG711Codec
+//   G.711 mu-law and A-law companding, one byte per sample.
+//
+class CG711Codec : public CAudioCodec {
+public:
+    CG711Codec(IN ULONG CodecId) : CAudioCodec(CodecId) {}
+
+    NTSTATUS                    Init(IN PWAVEFORMATEX pWfx, IN PCODEC_SETTINGS pSettings);
+    ULONG                       GetMaxOutputSize(IN ULONG ulFrames);
+    ULONG                       Encode(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// CImaAdpcmCodec
+//   IMA ADPCM, 4:1 on 16 bit input. Every payload is a self-contained block.
+//
+class CImaAdpcmCodec : public CAudioCodec {
+protected:
+    LONG                        m_lStepIndex[CODEC_MAX_CHANNELS];   // Carried from block to block
+
+    void                        EncodeScalar(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput);
+#if defined(_M_AMD64)
+    void                        EncodeSse2(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput);
+#endif
+
+public:
+    CImaAdpcmCodec() : CAudioCodec(AUDIONET_CODEC_IMA_ADPCM) {}
+
+    NTSTATUS                    Init(IN PWAVEFORMATEX pWfx, IN PCODEC_SETTINGS pSettings);
+    ULONG                       GetMaxOutputSize(IN ULONG ulFrames);
+    ULONG                       GetFramesPerPacket(IN ULONG ulMaxPayload);
+    ULONG                       Encode(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// CLosslessCodec
+//   Fixed or LPC prediction with stereo decorrelation and Rice coded
+//   residuals. Every payload is a self-contained frame.
+//
+#define LOSSLESS_MAX_LPC_ORDER      8
+#define LOSSLESS_MAX_PARTITION_ORDER 3
+
+typedef struct _LOSSLESS_SUBFRAME {
+    ULONG       Type;                       // AUDIONET_LOSSLESS_SUBFRAME_xxx
+    ULONG       Order;
+    ULONG       Shift;
+    LONG        Coefs[LOSSLESS_MAX_LPC_ORDER];
+    ULONG       PartitionOrder;
+    ULONG       Parameters[1 << LOSSLESS_MAX_PARTITION_ORDER];
+    ULONG       Bits;                       // Upper bound of the coded size
+} LOSSLESS_SUBFRAME;
+typedef LOSSLESS_SUBFRAME *PLOSSLESS_SUBFRAME;
+
+typedef struct _LOSSLESS_BIT_WRITER {
+    PBYTE       pOutput;
+    ULONG       ulBytes;                    // Complete bytes written
+    ULONGLONG   ullPending;                 // Bits not yet written, in the low ulBits
+    ULONG       ulBits;
+} LOSSLESS_BIT_WRITER;
+typedef LOSSLESS_BIT_WRITER *PLOSSLESS_BIT_WRITER;
+
+class CLosslessCodec : public CAudioCodec {
+protected:
+    ULONG                       m_ulMaxFrames;
+    PLONG                       m_plBuffer;         // One allocation for all scratch buffers
+    PLONG                       m_plSignal[CODEC_MAX_CHANNELS];     // Left, right, mid, side for stereo
+    PLONG                       m_plResidual;
+    FLOAT *                     m_pfWindowed;
+
+    void                        PlanSubframe(IN PLONG plSignal, IN ULONG ulFrames, IN ULONG ulBits, IN BOOL fLpc, OUT PLOSSLESS_SUBFRAME pPlan);
+    BOOL                        PlanLpc(IN PLONG plSignal, IN ULONG ulFrames, IN ULONG ulBits, OUT PLOSSLESS_SUBFRAME pPlan);
+    void                        WriteSubframe(IN OUT PLOSSLESS_BIT_WRITER pWriter, IN PLONG plSignal, IN ULONG ulFrames, IN ULONG ulBits, IN PLOSSLESS_SUBFRAME pPlan);
+
+public:
+    CLosslessCodec() : CAudioCodec(AUDIONET_CODEC_LOSSLESS), m_ulMaxFrames(0), m_plBuffer(NULL) {}
+    ~CLosslessCodec();
+
+    NTSTATUS                    Init(IN PWAVEFORMATEX pWfx, IN PCODEC_SETTINGS pSettings);
+    ULONG                       GetMaxOutputSize(IN ULONG ulFrames);
+    ULONG                       GetFramesPerPacket(IN ULONG ulMaxPayload);
+    ULONG                       Encode(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// CPackedPcmCodec
+//   PCM without container padding at 8 to 24 bits. Below the stream depth
+//   samples are requantized with TPDF dither and optional noise shaping.
+//
+class CPackedPcmCodec : public CAudioCodec {
+protected:
+    USHORT                      m_wPackedBits;
+    BOOL                        m_fRequantize;
+    BOOL                        m_fNoiseShaping;
+    ULONG                       m_ulMaxFrames;
+    PLONG                       m_plBuffer;         // Packed depth samples, right aligned
+    ULONG                       m_ulSeed;           // Dither generator
+    LONG                        m_lError[CODEC_MAX_CHANNELS][2];    // Last two requantization errors
+
+    void                        Requantize(IN PBYTE pInput, IN ULONG ulFrames);
+    void                        Convert(IN PBYTE pInput, IN ULONG ulSamples);
+    ULONG                       Pack(IN ULONG ulSamples, OUT PBYTE pOutput);
+
+public:
+    CPackedPcmCodec() : CAudioCodec(AUDIONET_CODEC_PACKED_PCM), m_ulMaxFrames(0), m_plBuffer(NULL) {}
+    ~CPackedPcmCodec();
+
+    NTSTATUS                    Init(IN PWAVEFORMATEX pWfx, IN PCODEC_SETTINGS pSettings);
+    ULONG                       GetMaxOutputSize(IN ULONG ulFrames);
+    ULONG                       GetFramesPerPacket(IN ULONG ulMaxPayload);
+    ULONG                       Encode(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput);
+    USHORT                      GetBitsPerSample(void)  { return m_wPackedBits; }
+};
+
+#if defined(MSVAD_OPUS)
+///////////////////////////////////////////////////////////////////////////////
+// COpusCodec
+//   Opus in the low delay CELT mode, one Opus packet per datagram. Needs a
+//   kernel build of libopus, see the sources file.
+//
+struct OpusEncoder;
+
+class COpusCodec : public CAudioCodec {
+protected:
+    struct OpusEncoder *        m_pEncoder;
+    ULONG                       m_ulFrameSize;
+    ULONG                       m_ulBitrate;
+    ULONG                       m_ulComplexity;
+    ULONG                       m_ulLossPercent;
+    BOOL                        m_fDtx;
+    BOOL                        m_fFec;             // Encoder runs in the FEC capable mode
+
+    NTSTATUS                    Reset(IN BOOL fFec);
+
+public:
+    COpusCodec() : CAudioCodec(AUDIONET_CODEC_OPUS), m_pEncoder(NULL) {}
+    ~COpusCodec();
+
+    NTSTATUS                    Init(IN PWAVEFORMATEX pWfx, IN PCODEC_SETTINGS pSettings);
+    ULONG                       GetMaxOutputSize(IN ULONG ulFrames);
+    ULONG                       GetFramesPerPacket(IN ULONG ulMaxPayload);
+    ULONG                       GetFrameSize(void);
+    ULONG                       GetAlgorithmicDelay(void);
+    void                        SetBitrate(IN ULONG ulBitrate);
+    void                        SetComplexity(IN ULONG ulComplexity);
+    void                        SetLossFeedback(IN ULONG ulLossPercent, IN BOOL fDtx);
+    ULONG                       Encode(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput);
+};
+#endif
+
+#if defined(MSVAD_LC3)
+///////////////////////////////////////////////////////////////////////////////
+// CLc3Codec
+//   LC3 in 7.5 or 10 ms frames, one encoder per channel. Needs a kernel
+//   build of liblc3, see the sources file.
+//
+class CLc3Codec : public CAudioCodec {
+protected:
+    PVOID                       m_pMemory;          // One allocation for all encoders
+    PVOID                       m_pEncoder[CODEC_MAX_CHANNELS];
+    ULONG                       m_ulFrameDuration;  // Microseconds
+    ULONG                       m_ulFrameSize;
+    ULONG                       m_ulFrameBytes;     // Per channel
+
+    ULONG                       GetFrameBytes(IN ULONG ulBitrate);
+
+public:
+    CLc3Codec() : CAudioCodec(AUDIONET_CODEC_LC3), m_pMemory(NULL) {}
+    ~CLc3Codec();
+
+    NTSTATUS                    Init(IN PWAVEFORMATEX pWfx, IN PCODEC_SETTINGS pSettings);
+    ULONG                       GetMaxOutputSize(IN ULONG ulFrames);
+    ULONG                       GetFramesPerPacket(IN ULONG ulMaxPayload);
+    ULONG                       GetFrameSize(void);
+    ULONG                       GetAlgorithmicDelay(void);
+    void                        SetBitrate(IN ULONG ulBitrate);
+    ULONG                       Encode(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput);
+};
+#endif
+
+//=============================================================================
+// Function Prototypes
+//=============================================================================
+NTSTATUS NewAudioCodec(
+    OUT PCAudioCodec *          OutCodec,
+    IN  PCODEC_SETTINGS         pSettings,
+    IN  PWAVEFORMATEX           pWfx
+);
+
+#endif
@@ -15,12 +15,25 @@ Abstract:
 #include "hw.h"
 #include "savedata.h"
 
+// Resolution the system timer is raised to while the adapter timer runs
+// without high resolution at a tick shorter than the system clock tick,
+// 100 ns units.
+#define TIMER_WHEEL_RESOLUTION      10000
+
 //-----------------------------------------------------------------------------
 // Externals
 //-----------------------------------------------------------------------------
 //PSAVEWORKER_PARAM CSaveData::m_pWorkItems = NULL;
 PDEVICE_OBJECT    CSaveData::m_pDeviceObject = NULL;
 
+//-----------------------------------------------------------------------------
+// High resolution timer routines, NULL where the system has none.
+//
+static PFN_EX_ALLOCATE_TIMER    g_pfnExAllocateTimer = NULL;
+static PFN_EX_SET_TIMER         g_pfnExSetTimer = NULL;
+static PFN_EX_CANCEL_TIMER      g_pfnExCancelTimer = NULL;
+static PFN_EX_DELETE_TIMER      g_pfnExDeleteTimer = NULL;
+
 //=============================================================================
 // Classes
 //=============================================================================
@@ -36,6 +49,30 @@ private:
     DEVICE_POWER_STATE      m_PowerState;        
     PCMSVADHW               m_pHW;          // Virtual MSVAD HW object
 
+    KMUTEX                  m_TimerSync;    // Serializes registrations
+    KSPIN_LOCK              m_TimerLock;    // Guards the wheel
+    LIST_ENTRY              m_TimerWheel[TIMER_WHEEL_SLOTS];
+    LIST_ENTRY              m_TimerDue;     // Due and not notified yet
+    PFNTIMERNOTIFY          m_pfnTimerCurrent; // Being called, or NULL
+    PVOID                   m_TimerCurrentContext;
+    BOOLEAN                 m_fTimerNotifying; // A tick is notifying m_TimerDue
+    KEVENT                  m_TimerIdle;    // Set while no callback runs
+    ULONG                   m_ulTimerSlot;  // Slot of the last tick
+    ULONG                   m_ulTimerTick;  // Milliseconds, 0 with no entries
+    ULONGLONG               m_ullTimerFrequency; // Performance counter ticks per second
+    ULONGLONG               m_ullTimerStart; // Performance counter when the tick was set
+    ULONGLONG               m_ullTimerTicks; // Ticks advanced since then
+    PEX_TIMER               m_pExTimer;     // High resolution timer, where the system has them
+    KTIMER                  m_Timer;        // Timer and DPC, otherwise
+    KDPC                    m_TimerDpc;
+    BOOLEAN                 m_fTimerResolution; // System timer resolution raised
+
+    void                    TimerPlace(IN PTIMER_WHEEL_ENTRY Entry, IN ULONG Ticks);
+    void                    TimerAdvance(void);
+    void                    TimerRetick(IN ULONG Tick);
+    ULONG                   TimerGcd(void);
+    void                    TimerSet(void);
+
 public:
     //=====================================================================
     // Default CUnknown
@@ -70,6 +107,14 @@ public:
     STDMETHODIMP_(void)     MixerReset(void);
     STDMETHODIMP_(LONG)     MixerVolumeRead(IN ULONG Index, IN LONG Channel);
     STDMETHODIMP_(void)     MixerVolumeWrite(IN ULONG Index, IN LONG Channel, IN LONG Value);
+    STDMETHODIMP_(ULONG)    MixerGenerationRead(void);
+    STDMETHODIMP_(LONG)     MeterPeakRead(IN LONG Channel);
+    STDMETHODIMP_(LONG)     MeterRmsRead(IN LONG Channel);
+    STDMETHODIMP_(void)     MeterWrite(IN LONG Channel, IN LONG Peak, IN LONG Rms);
+    STDMETHODIMP_(NTSTATUS) TimerRegister(IN PTIMER_WHEEL_ENTRY Entry);
+    STDMETHODIMP_(void)     TimerUnregister(IN PTIMER_WHEEL_ENTRY Entry);
+
+    void                    TimerTick(void);
 
     //=====================================================================
     // friends
@@ -80,8 +125,74 @@ public:
 // Functions
 //-----------------------------------------------------------------------------
 
-//=============================================================================
+//-----------------------------------------------------------------------------
+// Greatest common divisor, the longest tick that suits periods a and b.
+//
+static ULONG Gcd(IN ULONG a, IN ULONG b)
+{
+    while (b) {
+        ULONG t = a % b;
+
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+//-----------------------------------------------------------------------------
+// Callbacks of the adapter timer, at DISPATCH_LEVEL.
+//
+static VOID AdapterTimerNotify(IN PEX_TIMER Timer, IN PVOID Context)
+{
+    UNREFERENCED_PARAMETER(Timer);
+
+    ((CAdapterCommon *) Context)->TimerTick();
+}
+
+static VOID AdapterTimerDpc(IN PKDPC Dpc, IN PVOID DeferredContext, IN PVOID SA1, IN PVOID SA2)
+{
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SA1);
+    UNREFERENCED_PARAMETER(SA2);
+
+    ((CAdapterCommon *) DeferredContext)->TimerTick();
+}
+
 #pragma code_seg("PAGE")
+//-----------------------------------------------------------------------------
+// Looks up the high resolution timer routines once. All four are needed,
+// and g_pfnExDeleteTimer is set last so it tells whether they are there.
+//
+static void LookupHighResolutionTimers(void)
+{
+    PAGED_CODE();
+
+    UNICODE_STRING  name;
+    PVOID           pfnAllocate, pfnSet, pfnCancel, pfnDelete;
+
+    if (g_pfnExDeleteTimer) {
+        return;
+    }
+
+    RtlInitUnicodeString(&name, L"ExAllocateTimer");
+    pfnAllocate = MmGetSystemRoutineAddress(&name);
+    RtlInitUnicodeString(&name, L"ExSetTimer");
+    pfnSet = MmGetSystemRoutineAddress(&name);
+    RtlInitUnicodeString(&name, L"ExCancelTimer");
+    pfnCancel = MmGetSystemRoutineAddress(&name);
+    RtlInitUnicodeString(&name, L"ExDeleteTimer");
+    pfnDelete = MmGetSystemRoutineAddress(&name);
+
+    if (pfnAllocate && pfnSet && pfnCancel && pfnDelete) {
+        g_pfnExAllocateTimer = (PFN_EX_ALLOCATE_TIMER) pfnAllocate;
+        g_pfnExSetTimer      = (PFN_EX_SET_TIMER) pfnSet;
+        g_pfnExCancelTimer   = (PFN_EX_CANCEL_TIMER) pfnCancel;
+        g_pfnExDeleteTimer   = (PFN_EX_DELETE_TIMER) pfnDelete;
+    }
+}
+
+//=============================================================================
 NTSTATUS NewAdapterCommon( 
     OUT PUNKNOWN *              Unknown,
     IN  REFCLSID,
@@ -128,6 +239,14 @@ Return Value:
         delete m_pHW;
     }
 
+    // The streams unregistered, so the timer is cancelled; wait for a last
+    // callback still running.
+    if (m_pExTimer) {
+        g_pfnExDeleteTimer(m_pExTimer, TRUE, TRUE, NULL);
+    } else {
+        KeFlushQueuedDpcs();
+    }
+
     //CSaveData::DestroyWorkItems();
 
     if (m_pPortWave) {
@@ -173,13 +292,43 @@ Return Value:
 
     ASSERT(DeviceObject);
 
-    NTSTATUS ntStatus = STATUS_SUCCESS;
+    NTSTATUS      ntStatus = STATUS_SUCCESS;
+    LARGE_INTEGER frequency;
 
     DPF_ENTER(("[CAdapterCommon::Init]"));
 
     m_pDeviceObject = DeviceObject;
     m_PowerState    = PowerDeviceD0;
 
+    // One timer services every registered stream, a high resolution one
+    // where the system has them.
+    KeInitializeMutex(&m_TimerSync, 1);
+    KeInitializeSpinLock(&m_TimerLock);
+    for (ULONG i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+        InitializeListHead(&m_TimerWheel[i]);
+    }
+    InitializeListHead(&m_TimerDue);
+    m_pfnTimerCurrent     = NULL;
+    m_TimerCurrentContext = NULL;
+    m_fTimerNotifying = FALSE;
+    KeInitializeEvent(&m_TimerIdle, NotificationEvent, TRUE);
+    m_ulTimerSlot = 0;
+    m_ulTimerTick = 0;
+    m_ullTimerStart = 0;
+    m_ullTimerTicks = 0;
+
+    KeQueryPerformanceCounter(&frequency);
+    m_ullTimerFrequency = (ULONGLONG) frequency.QuadPart;
+
+    LookupHighResolutionTimers();
+    if (g_pfnExDeleteTimer) {
+        m_pExTimer = g_pfnExAllocateTimer(AdapterTimerNotify, this, EX_TIMER_HIGH_RESOLUTION);
+    }
+    if (!m_pExTimer) {
+        KeInitializeTimerEx(&m_Timer, NotificationTimer);
+        KeInitializeDpc(&m_TimerDpc, AdapterTimerDpc, this);
+    }
+
     // Initialize HW.
     m_pHW = new (NonPagedPool, MSVAD_POOLTAG)  CMSVADHW;
     if (!m_pHW) {
@@ -552,6 +701,466 @@ Return Value:
     }
 } // MixerVolumeWrite
 
+//=============================================================================
+STDMETHODIMP_(ULONG) CAdapterCommon::MixerGenerationRead(void)
+/*++
+Routine Description:
+  Return the mixer generation, which changes with every mute or volume
+  write.
+
+Arguments:
+
+Return Value:
+  ULONG - generation
+--*/
+{
+    if (m_pHW) {
+        return m_pHW->GetMixerGeneration();
+    }
+
+    return 0;
+} // MixerGenerationRead
+
+//=============================================================================
+STDMETHODIMP_(LONG) CAdapterCommon::MeterPeakRead(
+    IN  LONG                    Channel
+)
+/*++
+Routine Description:
+  Return the peak level of the render stream.
+
+Arguments:
+  Channel - which channel
+
+Return Value:
+  LONG - linear peak of the last meter period
+--*/
+{
+    if (m_pHW) {
+        return m_pHW->GetMeterPeak(Channel);
+    }
+
+    return 0;
+} // MeterPeakRead
+
+//=============================================================================
+STDMETHODIMP_(LONG) CAdapterCommon::MeterRmsRead(
+    IN  LONG                    Channel
+)
+/*++
+Routine Description:
+  Return the RMS level of the render stream.
+
+Arguments:
+  Channel - which channel
+
+Return Value:
+  LONG - linear RMS of the last meter period
+--*/
+{
+    if (m_pHW) {
+        return m_pHW->GetMeterRms(Channel);
+    }
+
+    return 0;
+} // MeterRmsRead
+
+//=============================================================================
+STDMETHODIMP_(void) CAdapterCommon::MeterWrite(
+    IN  LONG                    Channel,
+    IN  LONG                    Peak,
+    IN  LONG                    Rms
+)
+/*++
+Routine Description:
+  Store the levels of the render stream.
+
+Arguments:
+  Channel - which channel
+  Peak - linear peak
+  Rms - linear RMS
+
+Return Value:
+  void
+--*/
+{
+    if (m_pHW) {
+        m_pHW->SetMeter(Channel, Peak, Rms);
+    }
+} // MeterWrite
+
+//=============================================================================
+void CAdapterCommon::TimerPlace(
+    IN  PTIMER_WHEEL_ENTRY      Entry,
+    IN  ULONG                   Ticks
+)
+/*++
+Routine Description:
+  Puts an entry in the slot it is due in, Ticks ticks from the last one.
+  Called with m_TimerLock held.
+
+Arguments:
+  Entry - timer wheel entry.
+  Ticks - ticks until it is due, at least 1.
+
+Return Value:
+  void
+--*/
+{
+    Ticks = max(Ticks, 1);
+
+    Entry->Rounds = (Ticks - 1) / TIMER_WHEEL_SLOTS;
+    InsertTailList(&m_TimerWheel[(m_ulTimerSlot + Ticks) % TIMER_WHEEL_SLOTS], &Entry->ListEntry);
+} // TimerPlace
+
+//=============================================================================
+void CAdapterCommon::TimerRetick(
+    IN  ULONG                   Tick
+)
+/*++
+Routine Description:
+  Changes the tick of the wheel, placing every entry again so that it
+  keeps the time it has left, to the nearest new tick. Ticks count from
+  now, as the timer is set again. Called with m_TimerLock held.
+
+Arguments:
+  Tick - new tick in milliseconds, non-zero.
+
+Return Value:
+  void
+--*/
+{
+    LIST_ENTRY          entries;
+    PTIMER_WHEEL_ENTRY  pEntry;
+
+    InitializeListHead(&entries);
+
+    for (ULONG i = 1; i <= TIMER_WHEEL_SLOTS; i++) {
+        PLIST_ENTRY pHead = &m_TimerWheel[(m_ulTimerSlot + i) % TIMER_WHEEL_SLOTS];
+
+        while (!IsListEmpty(pHead)) {
+            pEntry = CONTAINING_RECORD(RemoveHeadList(pHead), TIMER_WHEEL_ENTRY, ListEntry);
+
+            // Milliseconds left, kept in Rounds until it is placed again.
+            pEntry->Rounds = (i + pEntry->Rounds * TIMER_WHEEL_SLOTS) * m_ulTimerTick;
+            InsertTailList(&entries, &pEntry->ListEntry);
+        }
+    }
+
+    m_ulTimerTick   = Tick;
+    m_ullTimerStart = (ULONGLONG) KeQueryPerformanceCounter(NULL).QuadPart;
+    m_ullTimerTicks = 0;
+
+    while (!IsListEmpty(&entries)) {
+        pEntry = CONTAINING_RECORD(RemoveHeadList(&entries), TIMER_WHEEL_ENTRY, ListEntry);
+        TimerPlace(pEntry, (pEntry->Rounds + Tick / 2) / Tick);
+    }
+} // TimerRetick
+
+//=============================================================================
+ULONG CAdapterCommon::TimerGcd(void)
+/*++
+Routine Description:
+  Returns the greatest common divisor of the periods of all entries, in
+  the wheel or due, or 0 without entries. Called with m_TimerLock held.
+
+Arguments:
+
+Return Value:
+  Tick in milliseconds.
+--*/
+{
+    ULONG ulTick = 0;
+
+    for (ULONG i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+        for (PLIST_ENTRY pLink = m_TimerWheel[i].Flink; pLink != &m_TimerWheel[i]; pLink = pLink->Flink) {
+            ulTick = Gcd(ulTick, CONTAINING_RECORD(pLink, TIMER_WHEEL_ENTRY, ListEntry)->Period);
+        }
+    }
+    for (PLIST_ENTRY pLink = m_TimerDue.Flink; pLink != &m_TimerDue; pLink = pLink->Flink) {
+        ulTick = Gcd(ulTick, CONTAINING_RECORD(pLink, TIMER_WHEEL_ENTRY, ListEntry)->Period);
+    }
+
+    return ulTick;
+} // TimerGcd
+
+//=============================================================================
+void CAdapterCommon::TimerAdvance(void)
+/*++
+Routine Description:
+  Advances the wheel by the ticks that passed since it was last advanced,
+  to the nearest tick of the performance counter, and moves the entries
+  due in every slot passed to m_TimerDue. A late or coalesced timer
+  callback so catches up rather than slipping the wheel. After a stall of
+  a whole turn every entry is due. Called with m_TimerLock held.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    ULONGLONG           ullNow   = (ULONGLONG) KeQueryPerformanceCounter(NULL).QuadPart;
+    ULONGLONG           ullTick  = (ULONGLONG) m_ulTimerTick * 1000;
+    ULONGLONG           ullTicks = (ScaleRatio(ullNow - m_ullTimerStart, 1000000, m_ullTimerFrequency) + ullTick / 2) / ullTick;
+    PLIST_ENTRY         pHead;
+    PLIST_ENTRY         pLink;
+    PTIMER_WHEEL_ENTRY  pEntry;
+
+    if (ullTicks - m_ullTimerTicks > TIMER_WHEEL_SLOTS) {
+        DPF(D_VERBOSE, ("Timer wheel %d ticks late", (ULONG) (ullTicks - m_ullTimerTicks)));
+
+        for (ULONG i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+            pHead = &m_TimerWheel[i];
+            while (!IsListEmpty(pHead)) {
+                InsertTailList(&m_TimerDue, RemoveHeadList(pHead));
+            }
+        }
+        m_ullTimerTicks = ullTicks;
+    }
+
+    for (; m_ullTimerTicks < ullTicks; m_ullTimerTicks++) {
+        m_ulTimerSlot = (m_ulTimerSlot + 1) % TIMER_WHEEL_SLOTS;
+        pHead         = &m_TimerWheel[m_ulTimerSlot];
+
+        for (pLink = pHead->Flink; pLink != pHead; ) {
+            pEntry = CONTAINING_RECORD(pLink, TIMER_WHEEL_ENTRY, ListEntry);
+            pLink  = pLink->Flink;
+
+            if (pEntry->Rounds) {
+                pEntry->Rounds--;
+            } else {
+                RemoveEntryList(&pEntry->ListEntry);
+                InsertTailList(&m_TimerDue, &pEntry->ListEntry);
+            }
+        }
+    }
+} // TimerAdvance
+
+//=============================================================================
+void CAdapterCommon::TimerTick(void)
+/*++
+Routine Description:
+  Advances the wheel to now, moving the entries due to m_TimerDue. Due
+  entries are then placed one period ahead and notified one at a time, at
+  DISPATCH_LEVEL but without m_TimerLock, so long callbacks do not hold up
+  the wheel. Entries due together with the same callback and context, such
+  as the streams of one service group, are notified once. A tick that
+  comes while another one is still notifying leaves its due entries to
+  that one.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    PLIST_ENTRY         pLink;
+    PTIMER_WHEEL_ENTRY  pEntry;
+    PTIMER_WHEEL_ENTRY  pOther;
+    PFNTIMERNOTIFY      pfnNotify;
+    PVOID               Context;
+
+    KeAcquireSpinLockAtDpcLevel(&m_TimerLock);
+
+    if (m_ulTimerTick) {
+        TimerAdvance();
+    }
+
+    if (!m_fTimerNotifying) {
+        m_fTimerNotifying = TRUE;
+
+        while (!IsListEmpty(&m_TimerDue)) {
+            pEntry    = CONTAINING_RECORD(RemoveHeadList(&m_TimerDue), TIMER_WHEEL_ENTRY, ListEntry);
+            pfnNotify = pEntry->pfnNotify;
+            Context   = pEntry->Context;
+            TimerPlace(pEntry, pEntry->Period / m_ulTimerTick);
+
+            for (pLink = m_TimerDue.Flink; pLink != &m_TimerDue; ) {
+                pOther = CONTAINING_RECORD(pLink, TIMER_WHEEL_ENTRY, ListEntry);
+                pLink  = pLink->Flink;
+
+                if ((pOther->pfnNotify == pfnNotify) && (pOther->Context == Context)) {
+                    RemoveEntryList(&pOther->ListEntry);
+                    TimerPlace(pOther, pOther->Period / m_ulTimerTick);
+                }
+            }
+
+            // TimerUnregister waits for m_TimerIdle while the callback and
+            // context of its entry are the current ones.
+            m_pfnTimerCurrent     = pfnNotify;
+            m_TimerCurrentContext = Context;
+            KeClearEvent(&m_TimerIdle);
+            KeReleaseSpinLockFromDpcLevel(&m_TimerLock);
+
+            pfnNotify(Context);
+
+            KeAcquireSpinLockAtDpcLevel(&m_TimerLock);
+            m_pfnTimerCurrent     = NULL;
+            m_TimerCurrentContext = NULL;
+            KeSetEvent(&m_TimerIdle, IO_NO_INCREMENT, FALSE);
+        }
+
+        m_fTimerNotifying = FALSE;
+    }
+
+    KeReleaseSpinLockFromDpcLevel(&m_TimerLock);
+} // TimerTick
+
+#pragma code_seg("PAGE")
+//=============================================================================
+void CAdapterCommon::TimerSet(void)
+/*++
+Routine Description:
+  Sets the timer to the tick of the wheel, or cancels it when the wheel is
+  empty. Without high resolution timers the system clock is raised to
+  1 ms while the tick is shorter than its default tick. Called with
+  m_TimerSync held.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    LONGLONG    llPeriod = (LONGLONG) m_ulTimerTick * 10000;
+    BOOLEAN     fResolution = FALSE;
+
+    if (m_pExTimer) {
+        if (m_ulTimerTick) {
+            g_pfnExSetTimer(m_pExTimer, -llPeriod, llPeriod, NULL);
+        } else {
+            g_pfnExCancelTimer(m_pExTimer, NULL);
+        }
+    } else if (m_ulTimerTick) {
+        LARGE_INTEGER dueTime;
+
+        fResolution = (llPeriod < (LONGLONG) KeQueryTimeIncrement());
+
+        // A negative due time is relative to now.
+        dueTime.QuadPart = -llPeriod;
+        KeSetTimerEx(&m_Timer, dueTime, m_ulTimerTick, &m_TimerDpc);
+    } else {
+        KeCancelTimer(&m_Timer);
+    }
+
+    if (fResolution != m_fTimerResolution) {
+        ExSetTimerResolution(TIMER_WHEEL_RESOLUTION, fResolution);
+        m_fTimerResolution = fResolution;
+    }
+} // TimerSet
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CAdapterCommon::TimerRegister(
+    IN  PTIMER_WHEEL_ENTRY      Entry
+)
+/*++
+Routine Description:
+  Adds an entry to the timer wheel. It is notified every Period
+  milliseconds, the first time one period from now, until it is
+  unregistered. The tick of the wheel is the greatest common divisor of
+  the periods, so entries due together are notified in the same tick.
+
+Arguments:
+  Entry - timer wheel entry with pfnNotify, Context and Period set.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(Entry);
+
+    KIRQL   oldIrql;
+    ULONG   ulTick;
+    BOOLEAN fRetick;
+
+    if (!Entry->pfnNotify || !Entry->Period) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    KeWaitForSingleObject(&m_TimerSync, Executive, KernelMode, FALSE, NULL);
+
+    ulTick  = Gcd(m_ulTimerTick, Entry->Period);
+    fRetick = (ulTick != m_ulTimerTick);
+
+    KeAcquireSpinLock(&m_TimerLock, &oldIrql);
+    if (fRetick) {
+        TimerRetick(ulTick);
+    }
+    TimerPlace(Entry, Entry->Period / ulTick);
+    KeReleaseSpinLock(&m_TimerLock, oldIrql);
+
+    if (fRetick) {
+        TimerSet();
+    }
+
+    KeReleaseMutex(&m_TimerSync, FALSE);
+
+    return STATUS_SUCCESS;
+} // TimerRegister
+
+//=============================================================================
+STDMETHODIMP_(void) CAdapterCommon::TimerUnregister(
+    IN  PTIMER_WHEEL_ENTRY      Entry
+)
+/*++
+Routine Description:
+  Removes an entry from the timer wheel. Its callback is not running and
+  will not run once this returns: a call in flight is waited for. The tick
+  follows the periods left, and the timer stops with the last entry.
+
+Arguments:
+  Entry - registered timer wheel entry.
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(Entry);
+
+    KIRQL   oldIrql;
+    ULONG   ulTick;
+    BOOLEAN fRetick;
+    BOOLEAN fWait;
+
+    KeWaitForSingleObject(&m_TimerSync, Executive, KernelMode, FALSE, NULL);
+
+    KeAcquireSpinLock(&m_TimerLock, &oldIrql);
+
+    RemoveEntryList(&Entry->ListEntry);
+
+    ulTick  = TimerGcd();
+    fRetick = (ulTick != m_ulTimerTick);
+    if (fRetick && ulTick) {
+        TimerRetick(ulTick);
+    } else if (fRetick) {
+        m_ulTimerTick = 0;
+    }
+
+    fWait = (m_pfnTimerCurrent == Entry->pfnNotify) && (m_TimerCurrentContext == Entry->Context);
+
+    KeReleaseSpinLock(&m_TimerLock, oldIrql);
+
+    if (fRetick) {
+        TimerSet();
+    }
+
+    KeReleaseMutex(&m_TimerSync, FALSE);
+
+    // m_TimerIdle was cleared when the callback started and is set once it
+    // returns.
+    if (fWait) {
+        KeWaitForSingleObject(&m_TimerIdle, Executive, KernelMode, FALSE, NULL);
+    }
+} // TimerUnregister
+#pragma code_seg()
+
 //=============================================================================
 STDMETHODIMP_(void) CAdapterCommon::PowerChangeState( 
     IN  POWER_STATE             NewState 
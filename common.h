@@ -16,6 +16,29 @@ Abstract:
 //=============================================================================
 DEFINE_GUID(IID_IAdapterCommon, 0x7eda2950, 0xbf9f, 0x11d0, 0x87, 0x1f, 0x0, 0xa0, 0xc9, 0x11, 0xb5, 0x44);
 
+// Slots of the adapter timer wheel. Entries due further ahead wait for
+// whole turns of the wheel.
+#define TIMER_WHEEL_SLOTS           32
+
+//=============================================================================
+// Typedefs
+//=============================================================================
+
+// Called at DISPATCH_LEVEL whenever a timer wheel entry is due. Entries
+// due in the same tick with the same callback and context share one call.
+typedef VOID (*PFNTIMERNOTIFY)(IN PVOID Context);
+
+// Entry of the adapter timer wheel, owned by the object it notifies and
+// left alone by it while registered.
+typedef struct _TIMER_WHEEL_ENTRY {
+    LIST_ENTRY      ListEntry;              // Slot the entry is due in
+    PFNTIMERNOTIFY  pfnNotify;
+    PVOID           Context;
+    ULONG           Period;                 // Milliseconds
+    ULONG           Rounds;                 // Turns of the wheel before it is due
+} TIMER_WHEEL_ENTRY;
+typedef TIMER_WHEEL_ENTRY *PTIMER_WHEEL_ENTRY;
+
 //=============================================================================
 // Interfaces
 //=============================================================================
@@ -45,6 +68,13 @@ DECLARE_INTERFACE_(IAdapterCommon, IUnknown) {
     STDMETHOD_(LONG,            MixerVolumeRead)     (THIS_ IN ULONG Index, IN LONG Channel) PURE;
     STDMETHOD_(VOID,            MixerVolumeWrite)    (THIS_ IN ULONG Index, IN LONG Channel, IN LONG Value) PURE;
     STDMETHOD_(VOID,            MixerReset)          (THIS) PURE;
+    STDMETHOD_(ULONG,           MixerGenerationRead) (THIS) PURE;
+    STDMETHOD_(LONG,            MeterPeakRead)       (THIS_ IN LONG Channel) PURE;
+    STDMETHOD_(LONG,            MeterRmsRead)        (THIS_ IN LONG Channel) PURE;
+    STDMETHOD_(VOID,            MeterWrite)          (THIS_ IN LONG Channel, IN LONG Peak, IN LONG Rms) PURE;
+
+    STDMETHOD_(NTSTATUS,        TimerRegister)       (THIS_ IN PTIMER_WHEEL_ENTRY Entry) PURE;
+    STDMETHOD_(VOID,            TimerUnregister)     (THIS_ IN PTIMER_WHEEL_ENTRY Entry) PURE;
 };
 typedef IAdapterCommon *PADAPTERCOMMON;
 
@@ -0,0 +1,346 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    delay.cpp
+
+Abstract:
+    Implementation of the per destination delay line.
+
+    The ring holds the longest delay set so far plus one block, so the
+    frames of a block can be written before the delayed ones are read, and
+    a delay of 0 reads back the block just written. It is only allocated
+    once a delay is set, and grows when a longer one is. Moving the read
+    position would cut the signal, so a new delay is cross-faded from the
+    old one.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include "dsp.h"
+
+//=============================================================================
+// CDelay
+//=============================================================================
+
+#pragma code_seg("PAGE")
+//=============================================================================
+CDelay::CDelay() : m_pKernels(NULL), m_nChannels(0), m_nBlockAlign(0), m_ulRate(0), m_ulMaxFrames(0), m_pRing(NULL), m_ulRingFrames(0), m_ulWrite(0),
+    m_pfOld(NULL), m_pfNew(NULL), m_ulDelayTime(0), m_ulDelay(0), m_ulOldDelay(0), m_ulFade(0), m_ulFadeFrames(0), m_ulFadeLength(1)
+{
+    PAGED_CODE();
+} // CDelay
+
+//=============================================================================
+CDelay::~CDelay()
+{
+    PAGED_CODE();
+
+    Free();
+} // ~CDelay
+
+//=============================================================================
+void CDelay::Free(void)
+{
+    PAGED_CODE();
+
+    if (m_pRing) {
+        ExFreePoolWithTag(m_pRing, MSVAD_POOLTAG);
+        m_pRing = NULL;
+    }
+    if (m_pfOld) {
+        ExFreePoolWithTag(m_pfOld, MSVAD_POOLTAG);
+        m_pfOld = NULL;
+    }
+    if (m_pfNew) {
+        ExFreePoolWithTag(m_pfNew, MSVAD_POOLTAG);
+        m_pfNew = NULL;
+    }
+    m_ulRingFrames = 0;
+} // Free
+
+//=============================================================================
+NTSTATUS CDelay::GrowRing(
+    IN  ULONG                   ulDelay
+)
+/*++
+Routine Description:
+  Makes the ring hold ulDelay frames plus one block. The frames of the old
+  ring keep their distance from the write position, so a fade from the old
+  delay goes on; the frames before them are silence.
+
+Arguments:
+  ulDelay - delay in frames.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ULONG ulRingFrames = ulDelay + m_ulMaxFrames;
+    PBYTE pRing;
+
+    if (ulRingFrames <= m_ulRingFrames) {
+        return STATUS_SUCCESS;
+    }
+
+    pRing = (PBYTE) ExAllocatePoolWithTag(NonPagedPool, ulRingFrames * m_nBlockAlign, MSVAD_POOLTAG);
+    if (!pRing) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(pRing, ulRingFrames * m_nBlockAlign);
+
+    if (m_pRing) {
+        if (IsActive()) {
+            ULONG ulFirst = m_ulRingFrames - m_ulWrite;
+
+            RtlCopyMemory(pRing, m_pRing + m_ulWrite * m_nBlockAlign, ulFirst * m_nBlockAlign);
+            RtlCopyMemory(pRing + ulFirst * m_nBlockAlign, m_pRing, m_ulWrite * m_nBlockAlign);
+            m_ulWrite = m_ulRingFrames;
+        }
+        ExFreePoolWithTag(m_pRing, MSVAD_POOLTAG);
+    }
+
+    DPF(D_TERSE, ("Delay ring of %d frames", ulRingFrames));
+
+    m_pRing        = pRing;
+    m_ulRingFrames = ulRingFrames;
+
+    return STATUS_SUCCESS;
+} // GrowRing
+
+//=============================================================================
+NTSTATUS CDelay::Init(
+    IN  PWAVEFORMATEX           pWfx,
+    IN  USHORT                  nChannels,
+    IN  ULONG                   ulMaxFrames
+)
+/*++
+Routine Description:
+  Selects the kernels and allocates the fade buffers. The delay starts at
+  0, without a ring.
+
+Arguments:
+  pWfx - format of the frames, for the sample type and rate.
+  nChannels - channels of the frames.
+  ulMaxFrames - most frames of one Process call.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    Free();
+    m_ulDelayTime  = 0;
+    m_ulDelay      = 0;
+    m_ulOldDelay   = 0;
+    m_ulFadeFrames = 0;
+    m_ulWrite      = 0;
+
+    m_pKernels = DspGetKernels(pWfx, nChannels);
+    if (!m_pKernels || !ulMaxFrames) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    m_nChannels    = nChannels;
+    m_nBlockAlign  = (USHORT) (pWfx->nBlockAlign / pWfx->nChannels * nChannels);
+    m_ulRate       = pWfx->nSamplesPerSec;
+    m_ulMaxFrames  = ulMaxFrames;
+    m_ulFadeLength = max(m_ulRate * DSP_DELAY_FADE_MS / 1000, 1);
+
+    m_pfOld = (FLOAT *) ExAllocatePoolWithTag(NonPagedPool, ulMaxFrames * nChannels * sizeof(FLOAT), MSVAD_POOLTAG);
+    m_pfNew = (FLOAT *) ExAllocatePoolWithTag(NonPagedPool, ulMaxFrames * nChannels * sizeof(FLOAT), MSVAD_POOLTAG);
+    if (!m_pfOld || !m_pfNew) {
+        Free();
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    return STATUS_SUCCESS;
+} // Init
+
+//=============================================================================
+void CDelay::SetDelay(
+    IN  ULONG                   ulDelayTime
+)
+/*++
+Routine Description:
+  Starts a fade to a new delay, growing the ring first if the delay is
+  longer than it holds. While the line is idle at delay 0 the ring is not
+  written, so it is cleared before it is used again: a longer delay then
+  fades in from silence rather than from old frames. If the ring cannot
+  grow the old delay stays.
+
+Arguments:
+  ulDelayTime - delay in microseconds.
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    ULONG ulDelay;
+
+    if (!m_pfOld) {
+        return;
+    }
+
+    ulDelayTime = min(ulDelayTime, AUDIONET_MAX_DELAY);
+    ulDelay     = (ULONG) (((ULONGLONG) ulDelayTime * m_ulRate + 500000) / 1000000);
+
+    m_ulDelayTime = ulDelayTime;
+    if (ulDelay == m_ulDelay) {
+        return;
+    }
+
+    if (!NT_SUCCESS(GrowRing(ulDelay))) {
+        DPF(D_TERSE, ("No ring for a delay of %d frames", ulDelay));
+        return;
+    }
+
+    if (!IsActive()) {
+        RtlZeroMemory(m_pRing, m_ulRingFrames * m_nBlockAlign);
+        m_ulWrite = 0;
+    }
+
+    DPF(D_TERSE, ("Delay %d to %d frames", m_ulDelay, ulDelay));
+
+    m_ulOldDelay   = m_ulDelay;
+    m_ulDelay      = ulDelay;
+    m_ulFade       = 0;
+    m_ulFadeFrames = m_ulFadeLength;
+} // SetDelay
+#pragma code_seg()
+
+//=============================================================================
+void CDelay::Read(
+    IN  ULONG                   ulDelay,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput
+)
+/*++
+Routine Description:
+  Copies the frames that were written ulDelay frames before the block just
+  written, in up to two parts.
+
+Arguments:
+  ulDelay - delay in frames.
+  ulFrames - frames of the block.
+  pOutput - receives the frames.
+
+Return Value:
+  void
+--*/
+{
+    ULONG ulRead  = (m_ulWrite + m_ulRingFrames - ulFrames - ulDelay) % m_ulRingFrames;
+    ULONG ulFirst = min(ulFrames, m_ulRingFrames - ulRead);
+
+    RtlCopyMemory(pOutput, m_pRing + ulRead * m_nBlockAlign, ulFirst * m_nBlockAlign);
+    if (ulFirst < ulFrames) {
+        RtlCopyMemory(pOutput + ulFirst * m_nBlockAlign, m_pRing, (ulFrames - ulFirst) * m_nBlockAlign);
+    }
+} // Read
+
+//=============================================================================
+void CDelay::Crossfade(
+    IN  ULONG                   ulFrames,
+    IN OUT PBYTE                pOutput
+)
+/*++
+Routine Description:
+  Reads the block at the old and the new delay and moves linearly from the
+  one to the other, ending the fade once it is complete. If the floating
+  point state cannot be saved the fade is skipped.
+
+Arguments:
+  ulFrames - frames of the block.
+  pOutput - receives the frames.
+
+Return Value:
+  void
+--*/
+{
+    FLOAT fStep;
+    FLOAT fMix;
+
+#if !defined(_M_AMD64)
+    KFLOATING_SAVE floatSave;
+
+    if (!NT_SUCCESS(KeSaveFloatingPointState(&floatSave))) {
+        m_ulFadeFrames = 0;
+        Read(m_ulDelay, ulFrames, pOutput);
+        return;
+    }
+#endif
+
+    Read(m_ulOldDelay, ulFrames, pOutput);
+    m_pKernels->ToFloat(pOutput, ulFrames, m_pfOld);
+    Read(m_ulDelay, ulFrames, pOutput);
+    m_pKernels->ToFloat(pOutput, ulFrames, m_pfNew);
+
+    fStep = 1.0f / m_ulFadeFrames;
+    fMix  = m_ulFade * fStep;
+
+    for (ULONG i = 0; i < ulFrames; i++) {
+        FLOAT * pfOld = m_pfOld + i * m_nChannels;
+        FLOAT * pfNew = m_pfNew + i * m_nChannels;
+
+        fMix = (m_ulFade + i < m_ulFadeFrames) ? fMix + fStep : 1.0f;
+
+        for (ULONG c = 0; c < m_nChannels; c++) {
+            pfOld[c] += (pfNew[c] - pfOld[c]) * fMix;
+        }
+    }
+
+    m_pKernels->FromFloat(m_pfOld, ulFrames, pOutput);
+
+#if !defined(_M_AMD64)
+    KeRestoreFloatingPointState(&floatSave);
+#endif
+
+    m_ulFade += ulFrames;
+    if (m_ulFade >= m_ulFadeFrames) {
+        m_ulFadeFrames = 0;
+    }
+} // Crossfade
+
+//=============================================================================
+void CDelay::Process(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput
+)
+/*++
+Routine Description:
+  Writes the frames to the ring and reads the delayed ones back.
+
+Arguments:
+  pInput - interleaved frames.
+  ulFrames - number of frames, at most the maximum given to Init.
+  pOutput - receives the delayed frames.
+
+Return Value:
+  void
+--*/
+{
+    ASSERT(m_pRing);
+    ASSERT(ulFrames <= m_ulMaxFrames);
+
+    ULONG ulFirst = min(ulFrames, m_ulRingFrames - m_ulWrite);
+
+    RtlCopyMemory(m_pRing + m_ulWrite * m_nBlockAlign, pInput, ulFirst * m_nBlockAlign);
+    if (ulFirst < ulFrames) {
+        RtlCopyMemory(m_pRing, pInput + ulFirst * m_nBlockAlign, (ulFrames - ulFirst) * m_nBlockAlign);
+    }
+    m_ulWrite = (m_ulWrite + ulFrames) % m_ulRingFrames;
+
+    if (m_ulFadeFrames) {
+        Crossfade(ulFrames, pOutput);
+    } else {
+        Read(m_ulDelay, ulFrames, pOutput);
+    }
+} // Process
@@ -0,0 +1,1072 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    dsp.cpp
+
+Abstract:
+    Implementation of the render stream processing.
+
+    The conversions to and from float are templates on the sample type and
+    the channel count. With both known at compile time the inner loops are
+    straight line code the compiler can unroll and vectorize, and SetFormat
+    only has to pick one entry of DspKernels.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include "dsp.h"
+
+#if defined(_M_AMD64)
+#include <emmintrin.h>
+#endif
+
+//=============================================================================
+// Sample types
+//=============================================================================
+
+#include <pshpack1.h>
+typedef struct _DSP_SAMPLE24 {
+    UCHAR           b[3];
+} DSP_SAMPLE24;
+#include <poppack.h>
+C_ASSERT(sizeof(DSP_SAMPLE24) == 3);
+
+//-----------------------------------------------------------------------------
+// Rounds fSample * fScale to the nearest integer in [-fScale, fMax].
+//
+static __forceinline LONG DspQuantize(IN FLOAT fSample, IN FLOAT fScale, IN FLOAT fMax)
+{
+    FLOAT f = fSample * fScale;
+
+    f = (f < -fScale) ? -fScale : f;
+    f = (f > fMax) ? fMax : f;
+
+    return (LONG) (f + ((f >= 0) ? 0.5f : -0.5f));
+}
+
+// Get and Put of one sample, specialized per sample type.
+template <class T> struct DspSample;
+
+template <> struct DspSample<UCHAR> {
+    static __forceinline FLOAT Get(IN const UCHAR *p)
+    {
+        return ((LONG) *p - 0x80) * (1.0f / 128);
+    }
+    static __forceinline void Put(IN FLOAT f, OUT UCHAR *p)
+    {
+        *p = (UCHAR) (DspQuantize(f, 128.0f, 127.0f) + 0x80);
+    }
+};
+
+template <> struct DspSample<SHORT> {
+    static __forceinline FLOAT Get(IN const SHORT *p)
+    {
+        return *p * (1.0f / 32768);
+    }
+    static __forceinline void Put(IN FLOAT f, OUT SHORT *p)
+    {
+        *p = (SHORT) DspQuantize(f, 32768.0f, 32767.0f);
+    }
+};
+
+template <> struct DspSample<DSP_SAMPLE24> {
+    static __forceinline FLOAT Get(IN const DSP_SAMPLE24 *p)
+    {
+        LONG l = (LONG) (((ULONG) p->b[2] << 24) | ((ULONG) p->b[1] << 16) | ((ULONG) p->b[0] << 8));
+
+        return (l >> 8) * (1.0f / 8388608);
+    }
+    static __forceinline void Put(IN FLOAT f, OUT DSP_SAMPLE24 *p)
+    {
+        LONG l = DspQuantize(f, 8388608.0f, 8388607.0f);
+
+        p->b[0] = (UCHAR) l;
+        p->b[1] = (UCHAR) (l >> 8);
+        p->b[2] = (UCHAR) (l >> 16);
+    }
+};
+
+// 2^31 - 1 is not a float; the largest one below 2^31 is 2^31 - 128.
+template <> struct DspSample<LONG> {
+    static __forceinline FLOAT Get(IN const LONG *p)
+    {
+        return (FLOAT) *p * (1.0f / 2147483648.0f);
+    }
+    static __forceinline void Put(IN FLOAT f, OUT LONG *p)
+    {
+        *p = DspQuantize(f, 2147483648.0f, 2147483520.0f);
+    }
+};
+
+template <> struct DspSample<FLOAT> {
+    static __forceinline FLOAT Get(IN const FLOAT *p)
+    {
+        return *p;
+    }
+    static __forceinline void Put(IN FLOAT f, OUT FLOAT *p)
+    {
+        *p = f;
+    }
+};
+
+//=============================================================================
+// Kernels
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+template <class T, ULONG C>
+static void DspToFloat(IN PBYTE pInput, IN ULONG ulFrames, OUT FLOAT *pfOutput)
+{
+    const T *pIn = (const T *) pInput;
+
+    for (ULONG i = 0; i < ulFrames; i++) {
+        for (ULONG c = 0; c < C; c++) {
+            pfOutput[c] = DspSample<T>::Get(pIn + c);
+        }
+        pIn      += C;
+        pfOutput += C;
+    }
+}
+
+//-----------------------------------------------------------------------------
+template <class T, ULONG C>
+static void DspFromFloat(IN FLOAT *pfInput, IN ULONG ulFrames, OUT PBYTE pOutput)
+{
+    T *pOut = (T *) pOutput;
+
+    for (ULONG i = 0; i < ulFrames; i++) {
+        for (ULONG c = 0; c < C; c++) {
+            DspSample<T>::Put(pfInput[c], pOut + c);
+        }
+        pfInput += C;
+        pOut    += C;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Copies the frames unchanged and adds their per channel peak and sum of
+// squares to pfPeak and pfSquares.
+//
+template <class T, ULONG C>
+static void DspMeterCopy(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput, IN OUT FLOAT *pfPeak, IN OUT FLOAT *pfSquares)
+{
+    const T *pIn  = (const T *) pInput;
+    T *      pOut = (T *) pOutput;
+    FLOAT    afMax[C];
+    FLOAT    afMin[C];
+    FLOAT    afSquares[C];
+    ULONG    c;
+
+    // Locals, as pOut might alias the accumulators as far as the compiler
+    // knows. Maximum and minimum instead of the absolute value keep the
+    // loop free of branches on the sign.
+    for (c = 0; c < C; c++) {
+        afMax[c]     = pfPeak[c];
+        afMin[c]     = -pfPeak[c];
+        afSquares[c] = pfSquares[c];
+    }
+
+    for (ULONG i = 0; i < ulFrames; i++) {
+        for (c = 0; c < C; c++) {
+            FLOAT f = DspSample<T>::Get(pIn + c);
+
+            pOut[c] = pIn[c];
+            afMax[c]      = (f > afMax[c]) ? f : afMax[c];
+            afMin[c]      = (f < afMin[c]) ? f : afMin[c];
+            afSquares[c] += f * f;
+        }
+        pIn  += C;
+        pOut += C;
+    }
+
+    for (c = 0; c < C; c++) {
+        pfPeak[c]    = (-afMin[c] > afMax[c]) ? -afMin[c] : afMax[c];
+        pfSquares[c] = afSquares[c];
+    }
+}
+
+#if defined(_M_AMD64)
+//-----------------------------------------------------------------------------
+// Copies four samples and returns them as floats.
+//
+static __forceinline __m128 DspCopy4(IN const SHORT *pIn, OUT SHORT *pOut)
+{
+    __m128i v = _mm_loadl_epi64((const __m128i *) pIn);
+
+    _mm_storel_epi64((__m128i *) pOut, v);
+
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), _mm_set1_ps(1.0f / 32768));
+}
+
+static __forceinline __m128 DspCopy4(IN const FLOAT *pIn, OUT FLOAT *pOut)
+{
+    __m128 v = _mm_loadu_ps(pIn);
+
+    _mm_storeu_ps(pOut, v);
+
+    return v;
+}
+
+//-----------------------------------------------------------------------------
+// DspMeterCopy for 16 bit and float samples. Four frames are C vectors;
+// lane j of vector k is always channel (4k + j) % C, so every vector keeps
+// its own peak and sum and they are folded into the channels at the end.
+//
+template <class T, ULONG C>
+static void DspMeterCopySse(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput, IN OUT FLOAT *pfPeak, IN OUT FLOAT *pfSquares)
+{
+    const T *pIn  = (const T *) pInput;
+    T *      pOut = (T *) pOutput;
+    __m128   sign = _mm_set1_ps(-0.0f);
+    __m128   peak[C];
+    __m128   squares[C];
+    FLOAT    afPeak[4 * C];
+    FLOAT    afSquares[4 * C];
+    ULONG    i;
+    ULONG    k;
+
+    for (k = 0; k < C; k++) {
+        peak[k]    = _mm_setzero_ps();
+        squares[k] = _mm_setzero_ps();
+    }
+
+    for (i = 0; i + 4 <= ulFrames; i += 4) {
+        for (k = 0; k < C; k++) {
+            __m128 v = DspCopy4(pIn + 4 * k, pOut + 4 * k);
+
+            peak[k]    = _mm_max_ps(peak[k], _mm_andnot_ps(sign, v));
+            squares[k] = _mm_add_ps(squares[k], _mm_mul_ps(v, v));
+        }
+        pIn  += 4 * C;
+        pOut += 4 * C;
+    }
+
+    for (k = 0; k < C; k++) {
+        _mm_storeu_ps(afPeak + 4 * k, peak[k]);
+        _mm_storeu_ps(afSquares + 4 * k, squares[k]);
+    }
+    for (k = 0; k < 4 * C; k++) {
+        pfPeak[k % C]     = (afPeak[k] > pfPeak[k % C]) ? afPeak[k] : pfPeak[k % C];
+        pfSquares[k % C] += afSquares[k];
+    }
+
+    DspMeterCopy<T, C>((PBYTE) pIn, ulFrames - i, (PBYTE) pOut, pfPeak, pfSquares);
+}
+
+#define DSP_METER_SSE           DspMeterCopySse
+#else
+#define DSP_METER_SSE           DspMeterCopy
+#endif
+
+#define DSP_KERNEL(T, C, M)     { DspToFloat<T, C>, DspFromFloat<T, C>, M<T, C> }
+#define DSP_KERNEL_ROW(T, M)    { DSP_KERNEL(T, 1, M), DSP_KERNEL(T, 2, M), DSP_KERNEL(T, 3, M), DSP_KERNEL(T, 4, M), \
+                                  DSP_KERNEL(T, 5, M), DSP_KERNEL(T, 6, M), DSP_KERNEL(T, 7, M), DSP_KERNEL(T, 8, M) }
+
+C_ASSERT(CODEC_MAX_CHANNELS == 8);
+C_ASSERT(AUDIONET_MAX_CHANNELS == CODEC_MAX_CHANNELS);
+
+// Indexed by DSP_SAMPLE_TYPE and channels - 1.
+static const DSP_KERNELS DspKernels[DSP_SAMPLE_COUNT][CODEC_MAX_CHANNELS] =
+{
+    DSP_KERNEL_ROW(UCHAR, DspMeterCopy),
+    DSP_KERNEL_ROW(SHORT, DSP_METER_SSE),
+    DSP_KERNEL_ROW(DSP_SAMPLE24, DspMeterCopy),
+    DSP_KERNEL_ROW(LONG, DspMeterCopy),
+    DSP_KERNEL_ROW(FLOAT, DSP_METER_SSE)
+};
+
+//=============================================================================
+// Math, without the C runtime
+//=============================================================================
+
+//=============================================================================
+double DspSin(
+    IN  double                  x
+)
+/*++
+Routine Description:
+  sin(x) by its Taylor series after reduction to [-pi / 2, pi / 2].
+
+Arguments:
+  x - angle in radians.
+
+Return Value:
+  The sine.
+--*/
+{
+    double dSign = 1;
+    double x2;
+
+    if (x < 0) {
+        x     = -x;
+        dSign = -1;
+    }
+
+    x -= 2 * DSP_PI * (double) (LONGLONG) (x / (2 * DSP_PI));
+    if (x > DSP_PI) {
+        x    -= DSP_PI;
+        dSign = -dSign;
+    }
+    if (x > DSP_PI / 2) {
+        x = DSP_PI - x;
+    }
+
+    x2 = x * x;
+
+    return dSign * x * (1 - x2 / 6 * (1 - x2 / 20 * (1 - x2 / 42 * (1 - x2 / 72 * (1 - x2 / 110 * (1 - x2 / 156 * (1 - x2 / 210)))))));
+} // DspSin
+
+//=============================================================================
+FLOAT DspDecibelsToGain(
+    IN  FLOAT                   fDb
+)
+/*++
+Routine Description:
+  10^(dB / 20) = 2^(dB * log2(10) / 20), split into a power of two and 2^x
+  for x in [-1, 0]. The latter is e^(x ln 2) by its Taylor series to the
+  7th power, good to about 1e-6.
+
+Arguments:
+  fDb - decibels.
+
+Return Value:
+  Linear gain.
+--*/
+{
+    FLOAT fExponent = fDb * 0.16609640474f;
+    FLOAT fGain     = 1.0f;
+
+    while (fExponent > 0.0f) {
+        fGain     *= 2.0f;
+        fExponent -= 1.0f;
+    }
+    while (fExponent < -1.0f) {
+        fGain     *= 0.5f;
+        fExponent += 1.0f;
+    }
+    fExponent *= 0.69314718f;
+
+    return fGain * (1 + fExponent * (1 + fExponent * (1.0f / 2 + fExponent * (1.0f / 6 + fExponent * (1.0f / 24 +
+                    fExponent * (1.0f / 120 + fExponent * (1.0f / 720 + fExponent * (1.0f / 5040))))))));
+} // DspDecibelsToGain
+
+//=============================================================================
+FLOAT DspDecibels(
+    IN  FLOAT                   fGain
+)
+/*++
+Routine Description:
+  20 log10(gain). The gain is split into a power of two and a mantissa m
+  in [1, 2), whose natural log is 2 atanh((m - 1) / (m + 1)) by its series
+  to the 7th power, good to about 1e-5.
+
+Arguments:
+  fGain - linear gain.
+
+Return Value:
+  Decibels, DSP_MIN_DECIBELS for gains of 0 or less.
+--*/
+{
+    union {
+        FLOAT   f;
+        ULONG   ul;
+    } bits;
+    FLOAT fRatio;
+    FLOAT fSquare;
+    LONG  lExponent;
+
+    if (fGain <= 0.0f) {
+        return DSP_MIN_DECIBELS;
+    }
+
+    bits.f    = fGain;
+    lExponent = (LONG) ((bits.ul >> 23) & 0xff) - 127;
+    bits.ul   = (bits.ul & 0x007fffff) | 0x3f800000;
+
+    fRatio  = (bits.f - 1.0f) / (bits.f + 1.0f);
+    fSquare = fRatio * fRatio;
+
+    // 20 / ln(10) and 20 log10(2).
+    return 8.6858896f * 2 * fRatio * (1 + fSquare * (1.0f / 3 + fSquare * (1.0f / 5 + fSquare * (1.0f / 7)))) + 6.0205999f * lExponent;
+} // DspDecibels
+
+//=============================================================================
+FLOAT DspVolumeToGain(
+    IN  LONG                    lVolume
+)
+/*++
+Routine Description:
+  10^(dB / 20) for a volume in 1/65536 dB.
+
+Arguments:
+  lVolume - volume, clamped to DSP_MAX_VOLUME.
+
+Return Value:
+  Linear gain, 0 at or below DSP_MIN_VOLUME.
+--*/
+{
+    if (lVolume <= DSP_MIN_VOLUME) {
+        return 0.0f;
+    }
+    if (lVolume > DSP_MAX_VOLUME) {
+        lVolume = DSP_MAX_VOLUME;
+    }
+
+    return DspDecibelsToGain(lVolume * (1.0f / 65536));
+} // DspVolumeToGain
+
+//=============================================================================
+LONG DspGainToVolume(
+    IN  FLOAT                   fGain
+)
+/*++
+Routine Description:
+  20 log10(gain) in 1/65536 dB.
+
+Arguments:
+  fGain - linear gain.
+
+Return Value:
+  Volume, DSP_MIN_VOLUME for gains too small to express.
+--*/
+{
+    FLOAT fDb = DspDecibels(fGain);
+
+    if (fDb <= DSP_MIN_VOLUME / 65536.0f) {
+        return DSP_MIN_VOLUME;
+    }
+    return (LONG) (fDb * 65536);
+} // DspGainToVolume
+
+//-----------------------------------------------------------------------------
+// Multiplies every channel by its gain, which grows by pfStep per frame
+// when that is given. On x64 four frames are done per iteration, which is
+// a whole number of vectors for any channel count.
+//
+static void DspScale(IN OUT FLOAT *pfSamples, IN ULONG ulFrames, IN ULONG nChannels, IN const FLOAT *pfGain, IN const FLOAT *pfStep OPTIONAL)
+{
+    ULONG i = 0;
+    ULONG c;
+
+#if defined(_M_AMD64)
+    FLOAT afGain[4 * CODEC_MAX_CHANNELS];
+    FLOAT afStep[4 * CODEC_MAX_CHANNELS];
+
+    for (i = 0; i < 4; i++) {
+        for (c = 0; c < nChannels; c++) {
+            afGain[i * nChannels + c] = pfStep ? pfGain[c] + pfStep[c] * i : pfGain[c];
+            afStep[i * nChannels + c] = pfStep ? pfStep[c] * 4 : 0;
+        }
+    }
+
+    for (i = 0; i + 4 <= ulFrames; i += 4) {
+        for (c = 0; c < nChannels; c++) {
+            __m128 gain = _mm_loadu_ps(afGain + 4 * c);
+
+            _mm_storeu_ps(pfSamples + 4 * c, _mm_mul_ps(_mm_loadu_ps(pfSamples + 4 * c), gain));
+            if (pfStep) {
+                _mm_storeu_ps(afGain + 4 * c, _mm_add_ps(gain, _mm_loadu_ps(afStep + 4 * c)));
+            }
+        }
+        pfSamples += 4 * nChannels;
+    }
+#endif
+
+    for (; i < ulFrames; i++) {
+        for (c = 0; c < nChannels; c++) {
+            pfSamples[c] *= pfStep ? pfGain[c] + pfStep[c] * i : pfGain[c];
+        }
+        pfSamples += nChannels;
+    }
+}
+
+//=============================================================================
+// Channel matrix
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+// Output frame = sum over the used inputs k of input sample times column k.
+// On x64 the outputs of a frame are one or two vectors, so the work is one
+// multiply-add per used input and vector whatever the matrix holds.
+//
+static void DspMix(IN const FLOAT *pfInput, IN ULONG ulFrames, IN ULONG nInput, IN ULONG nOutput, IN ULONG ulInputs, IN const ULONG *pulInput, IN const FLOAT pfColumn[][CODEC_MAX_CHANNELS], OUT FLOAT *pfOutput)
+{
+    ULONG i;
+    ULONG k;
+
+#if defined(_M_AMD64)
+    if (nOutput <= 4) {
+        for (i = 0; i < ulFrames; i++) {
+            __m128 lo = _mm_setzero_ps();
+
+            for (k = 0; k < ulInputs; k++) {
+                lo = _mm_add_ps(lo, _mm_mul_ps(_mm_set1_ps(pfInput[pulInput[k]]), _mm_loadu_ps(pfColumn[k])));
+            }
+            _mm_storeu_ps(pfOutput, lo);
+
+            pfInput  += nInput;
+            pfOutput += nOutput;
+        }
+    } else {
+        for (i = 0; i < ulFrames; i++) {
+            __m128 lo = _mm_setzero_ps();
+            __m128 hi = _mm_setzero_ps();
+
+            for (k = 0; k < ulInputs; k++) {
+                __m128 sample = _mm_set1_ps(pfInput[pulInput[k]]);
+
+                lo = _mm_add_ps(lo, _mm_mul_ps(sample, _mm_loadu_ps(pfColumn[k])));
+                hi = _mm_add_ps(hi, _mm_mul_ps(sample, _mm_loadu_ps(pfColumn[k] + 4)));
+            }
+            _mm_storeu_ps(pfOutput, lo);
+            _mm_storeu_ps(pfOutput + 4, hi);
+
+            pfInput  += nInput;
+            pfOutput += nOutput;
+        }
+    }
+#else
+    for (i = 0; i < ulFrames; i++) {
+        for (ULONG o = 0; o < nOutput; o++) {
+            FLOAT fSum = 0;
+
+            for (k = 0; k < ulInputs; k++) {
+                fSum += pfInput[pulInput[k]] * pfColumn[k][o];
+            }
+            pfOutput[o] = fSum;
+        }
+
+        pfInput  += nInput;
+        pfOutput += nOutput;
+    }
+#endif
+}
+
+//=============================================================================
+// Kernel selection
+//=============================================================================
+
+#pragma code_seg("PAGE")
+//=============================================================================
+PCDSP_KERNELS DspGetKernels(
+    IN  PWAVEFORMATEX           pWfx,
+    IN  USHORT                  nChannels
+)
+/*++
+Routine Description:
+  Selects the conversion kernels for the sample type of a format.
+
+Arguments:
+  pWfx - format whose sample type is used.
+  nChannels - channels of the frames, which may differ from the format.
+
+Return Value:
+  The kernels, or NULL if the sample type or channel count is not supported.
+--*/
+{
+    PAGED_CODE();
+
+    DSP_SAMPLE_TYPE sampleType;
+
+    if (!nChannels || (nChannels > CODEC_MAX_CHANNELS)) {
+        return NULL;
+    }
+
+    if (IsFloatFormat(pWfx)) {
+        sampleType = DSP_SAMPLE_F32;
+    } else {
+        switch (pWfx->wBitsPerSample) {
+            case 8:  sampleType = DSP_SAMPLE_U8;  break;
+            case 16: sampleType = DSP_SAMPLE_S16; break;
+            case 24: sampleType = DSP_SAMPLE_S24; break;
+            case 32: sampleType = DSP_SAMPLE_S32; break;
+
+            default:
+                return NULL;
+        }
+    }
+
+    return &DspKernels[sampleType][nChannels - 1];
+} // DspGetKernels
+
+//=============================================================================
+// CAudioProcessor
+//=============================================================================
+
+//=============================================================================
+CAudioProcessor::CAudioProcessor() : m_pKernels(NULL), m_pOutputKernels(NULL), m_nChannels(0), m_nBlockAlign(0), m_nOutputChannels(0), m_nOutputBlockAlign(0),
+    m_ulMaxFrames(0), m_pfWork(NULL), m_pfMixed(NULL), m_pfResampled(NULL), m_fNormalizeGain(1.0f), m_ulStages(0),
+    m_fMute(FALSE), m_fGainPending(FALSE), m_fGainValid(FALSE), m_ulGainRamp(0), m_ulGainRampFrames(1), m_ulMixInputs(0)
+{
+    PAGED_CODE();
+
+    RtlZeroMemory(m_lVolume, sizeof(m_lVolume));
+} // CAudioProcessor
+
+//=============================================================================
+CAudioProcessor::~CAudioProcessor()
+{
+    PAGED_CODE();
+
+    Free();
+} // ~CAudioProcessor
+
+//=============================================================================
+void CAudioProcessor::Free(void)
+{
+    PAGED_CODE();
+
+    if (m_pfWork) {
+        ExFreePoolWithTag(m_pfWork, MSVAD_POOLTAG);
+        m_pfWork = NULL;
+    }
+    if (m_pfMixed) {
+        ExFreePoolWithTag(m_pfMixed, MSVAD_POOLTAG);
+        m_pfMixed = NULL;
+    }
+    if (m_pfResampled) {
+        ExFreePoolWithTag(m_pfResampled, MSVAD_POOLTAG);
+        m_pfResampled = NULL;
+    }
+} // Free
+
+//=============================================================================
+NTSTATUS CAudioProcessor::SetFormat(
+    IN  PWAVEFORMATEX           pWfx,
+    IN  ULONG                   ulMaxFrames,
+    IN  ULONG                   ulOutputRate,
+    IN  PAUDIONET_CHANNEL_MATRIX pMatrix OPTIONAL,
+    IN  PAUDIONET_LIMITER       pLimiter OPTIONAL,
+    IN  PAUDIONET_NORMALIZATION pNormalization OPTIONAL
+)
+/*++
+Routine Description:
+  Selects the kernels for the stream format and allocates the work buffer.
+  Called whenever the format or the packet size changes. Mixing is turned
+  on by a channel matrix, resampling when the output rate differs from the
+  stream rate, limiting by limiter settings and normalization by its
+  settings. Loudness is always measured.
+
+Arguments:
+  pWfx - stream format, already validated by the miniport.
+  ulMaxFrames - most frames of one Process call.
+  ulOutputRate - sample rate of the output.
+  pMatrix - channel matrix, NULL to keep the stream channels.
+  pLimiter - limiter settings, NULL for no limiter.
+  pNormalization - normalization settings, NULL for no normalization.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    NTSTATUS        ntStatus;
+    USHORT          nOutputChannels;
+
+    Free();
+    m_pKernels       = NULL;
+    m_pOutputKernels = NULL;
+    m_ulMaxFrames    = 0;
+    m_ulStages       = 0;
+    m_fGainPending   = FALSE;
+    m_fGainValid     = FALSE;
+    m_ulGainRamp     = 0;
+    m_fNormalizeGain = 1.0f;
+
+    nOutputChannels = pMatrix ? (USHORT) pMatrix->OutputChannels : pWfx->nChannels;
+
+    m_pKernels       = DspGetKernels(pWfx, pWfx->nChannels);
+    m_pOutputKernels = DspGetKernels(pWfx, nOutputChannels);
+    if (!m_pKernels || !m_pOutputKernels || !ulMaxFrames) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    m_pfWork = (FLOAT *) ExAllocatePoolWithTag(NonPagedPool, ulMaxFrames * pWfx->nChannels * sizeof(FLOAT), MSVAD_POOLTAG);
+    if (!m_pfWork) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    m_nChannels         = pWfx->nChannels;
+    m_nBlockAlign       = pWfx->nBlockAlign;
+    m_nOutputChannels   = nOutputChannels;
+    m_nOutputBlockAlign = (USHORT) (m_nBlockAlign / m_nChannels * m_nOutputChannels);
+    m_ulMaxFrames       = ulMaxFrames;
+
+    m_ulGainRampFrames = max(pWfx->nSamplesPerSec * DSP_GAIN_RAMP_MS / 1000, 1);
+
+    ntStatus = m_Loudness.Init(pWfx, pNormalization);
+    if (!NT_SUCCESS(ntStatus)) {
+        return ntStatus;
+    }
+    m_ulStages |= pNormalization ? DSP_STAGE_LOUDNESS | DSP_STAGE_NORMALIZE : DSP_STAGE_LOUDNESS;
+
+    // Mix stores whole vectors, up to eight floats past the last frame.
+    if (pMatrix) {
+        m_pfMixed = (FLOAT *) ExAllocatePoolWithTag(NonPagedPool, (ulMaxFrames * m_nOutputChannels + CODEC_MAX_CHANNELS) * sizeof(FLOAT), MSVAD_POOLTAG);
+        if (!m_pfMixed) {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        SetMatrix(pMatrix);
+        m_ulStages |= DSP_STAGE_MIX;
+    }
+
+    if (ulOutputRate != pWfx->nSamplesPerSec) {
+        ntStatus = m_Resampler.Init(pWfx->nSamplesPerSec, ulOutputRate, m_nOutputChannels, ulMaxFrames);
+        if (!NT_SUCCESS(ntStatus)) {
+            return ntStatus;
+        }
+
+        m_pfResampled = (FLOAT *) ExAllocatePoolWithTag(NonPagedPool, m_Resampler.GetMaxOutputFrames(ulMaxFrames) * m_nOutputChannels * sizeof(FLOAT), MSVAD_POOLTAG);
+        if (!m_pfResampled) {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        m_ulStages |= DSP_STAGE_RESAMPLE;
+    }
+
+    if (pLimiter) {
+        ntStatus = m_Limiter.Init(pLimiter, ulOutputRate, m_nOutputChannels);
+        if (!NT_SUCCESS(ntStatus)) {
+            return ntStatus;
+        }
+
+        m_ulStages |= DSP_STAGE_LIMIT;
+    }
+
+    return STATUS_SUCCESS;
+} // SetFormat
+
+//=============================================================================
+void CAudioProcessor::SetMatrix(
+    IN  PAUDIONET_CHANNEL_MATRIX pMatrix
+)
+/*++
+Routine Description:
+  Keeps the input channels that reach any output, with their gains as
+  float columns padded with zeros to CODEC_MAX_CHANNELS outputs.
+
+Arguments:
+  pMatrix - channel matrix, validated by the miniport.
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    m_ulMixInputs = 0;
+    RtlZeroMemory(m_afMixColumn, sizeof(m_afMixColumn));
+
+#if !defined(_M_AMD64)
+    KFLOATING_SAVE floatSave;
+
+    if (!NT_SUCCESS(KeSaveFloatingPointState(&floatSave))) {
+        return;
+    }
+#endif
+
+    for (ULONG i = 0; i < m_nChannels; i++) {
+        BOOL fUsed = FALSE;
+
+        for (ULONG o = 0; o < m_nOutputChannels; o++) {
+            m_afMixColumn[m_ulMixInputs][o] = pMatrix->Gain[o][i] * (1.0f / 65536);
+            if (pMatrix->Gain[o][i]) {
+                fUsed = TRUE;
+            }
+        }
+
+        if (fUsed) {
+            m_aulMixInput[m_ulMixInputs++] = i;
+        } else {
+            RtlZeroMemory(m_afMixColumn[m_ulMixInputs], sizeof(m_afMixColumn[0]));
+        }
+    }
+
+#if !defined(_M_AMD64)
+    KeRestoreFloatingPointState(&floatSave);
+#endif
+
+    DPF(D_TERSE, ("Mixing %d to %d channels from %d inputs", m_nChannels, m_nOutputChannels, m_ulMixInputs));
+} // SetMatrix
+
+//=============================================================================
+ULONG CAudioProcessor::GetMaxOutputFrames(
+    IN  ULONG                   ulFrames
+)
+/*++
+Routine Description:
+  Most frames one Process call of ulFrames can return.
+
+Arguments:
+  ulFrames - input frames.
+
+Return Value:
+  Output frames.
+--*/
+{
+    PAGED_CODE();
+
+    return (m_ulStages & DSP_STAGE_RESAMPLE) ? m_Resampler.GetMaxOutputFrames(ulFrames) : ulFrames;
+} // GetMaxOutputFrames
+
+//=============================================================================
+void CAudioProcessor::SetGain(
+    IN  const LONG *            plVolume,
+    IN  BOOL                    fMute
+)
+/*++
+Routine Description:
+  Requests a new gain. The conversion to linear gain needs the floating
+  point state, so it is left to the next Process call.
+
+Arguments:
+  plVolume - volume of each channel in 1/65536 dB.
+  fMute - whether the stream is muted.
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    if (m_fGainValid && (fMute == m_fMute) && RtlEqualMemory(plVolume, m_lVolume, m_nChannels * sizeof(LONG))) {
+        return;
+    }
+
+    RtlCopyMemory(m_lVolume, plVolume, m_nChannels * sizeof(LONG));
+    m_fMute        = fMute;
+    m_fGainPending = TRUE;
+    m_ulStages    |= DSP_STAGE_GAIN;
+} // SetGain
+#pragma code_seg()
+
+//=============================================================================
+void CAudioProcessor::UpdateGain(void)
+/*++
+Routine Description:
+  Converts the requested volume to linear gain and starts a ramp to it.
+  The first gain after SetFormat is applied at once.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    for (ULONG c = 0; c < m_nChannels; c++) {
+        m_afGainTarget[c] = m_fMute ? 0.0f : DspVolumeToGain(m_lVolume[c]);
+        if (m_fGainValid) {
+            m_afGainStep[c] = (m_afGainTarget[c] - m_afGain[c]) / m_ulGainRampFrames;
+        } else {
+            m_afGain[c] = m_afGainTarget[c];
+        }
+    }
+
+    m_ulGainRamp   = m_fGainValid ? m_ulGainRampFrames : 0;
+    m_fGainValid   = TRUE;
+    m_fGainPending = FALSE;
+} // UpdateGain
+
+//=============================================================================
+void CAudioProcessor::ApplyGain(
+    IN OUT FLOAT *              pfSamples,
+    IN  ULONG                   ulFrames
+)
+/*++
+Routine Description:
+  Applies the gain, first the rest of a running ramp and then the constant
+  target. Once the ramp is done at unity gain the stage turns itself off.
+
+Arguments:
+  pfSamples - interleaved samples.
+  ulFrames - number of frames.
+
+Return Value:
+  void
+--*/
+{
+    BOOL  fUnity = TRUE;
+    ULONG c;
+
+    if (m_ulGainRamp) {
+        ULONG ulRamp = min(ulFrames, m_ulGainRamp);
+
+        DspScale(pfSamples, ulRamp, m_nChannels, m_afGain, m_afGainStep);
+
+        m_ulGainRamp -= ulRamp;
+        for (c = 0; c < m_nChannels; c++) {
+            m_afGain[c] = m_ulGainRamp ? m_afGain[c] + m_afGainStep[c] * ulRamp : m_afGainTarget[c];
+        }
+
+        pfSamples += ulRamp * m_nChannels;
+        ulFrames  -= ulRamp;
+    }
+
+    for (c = 0; c < m_nChannels; c++) {
+        if (m_afGain[c] != 1.0f) {
+            fUnity = FALSE;
+        }
+    }
+
+    if (!m_ulGainRamp && fUnity) {
+        m_ulStages &= ~DSP_STAGE_GAIN;
+    } else if (ulFrames) {
+        DspScale(pfSamples, ulFrames, m_nChannels, m_afGain, NULL);
+    }
+} // ApplyGain
+
+//=============================================================================
+void CAudioProcessor::Normalize(
+    IN OUT FLOAT *              pfSamples,
+    IN  ULONG                   ulFrames
+)
+/*++
+Routine Description:
+  Ramps the normalization gain over the frames to what the loudness
+  measured up to their end asks for. The steps between sub-blocks are
+  small, so a ramp per call is smooth enough.
+
+Arguments:
+  pfSamples - interleaved samples.
+  ulFrames - number of frames.
+
+Return Value:
+  void
+--*/
+{
+    FLOAT fTarget = m_Loudness.GetGain();
+    FLOAT afGain[CODEC_MAX_CHANNELS];
+    FLOAT afStep[CODEC_MAX_CHANNELS];
+
+    if (!ulFrames || ((fTarget == 1.0f) && (m_fNormalizeGain == 1.0f))) {
+        return;
+    }
+
+    for (ULONG c = 0; c < m_nChannels; c++) {
+        afGain[c] = m_fNormalizeGain;
+        afStep[c] = (fTarget - m_fNormalizeGain) / ulFrames;
+    }
+
+    DspScale(pfSamples, ulFrames, m_nChannels, afGain, (fTarget != m_fNormalizeGain) ? afStep : NULL);
+
+    m_fNormalizeGain = fTarget;
+} // Normalize
+
+//=============================================================================
+ULONG CAudioProcessor::Process(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput
+)
+/*++
+Routine Description:
+  Converts the frames to float, runs the active stages on them and
+  converts them back. If the floating point state cannot be saved the
+  frames are passed through unchanged, or dropped when converting.
+
+Arguments:
+  pInput - interleaved frames in the stream format.
+  ulFrames - number of frames, at most the maximum given to SetFormat.
+  pOutput - receives the processed frames.
+
+Return Value:
+  Frames written.
+--*/
+{
+    ASSERT(m_pKernels && m_pfWork);
+    ASSERT(ulFrames <= m_ulMaxFrames);
+
+    FLOAT * pfOutput = m_pfWork;
+
+#if !defined(_M_AMD64)
+    KFLOATING_SAVE      floatSave;
+
+    if (!NT_SUCCESS(KeSaveFloatingPointState(&floatSave))) {
+        if (IsConverting()) {
+            return 0;
+        }
+        if (pOutput != pInput) {
+            RtlCopyMemory(pOutput, pInput, ulFrames * m_nBlockAlign);
+        }
+        return ulFrames;
+    }
+#endif
+
+    m_pKernels->ToFloat(pInput, ulFrames, m_pfWork);
+
+    if (m_fGainPending) {
+        UpdateGain();
+    }
+    if (m_ulStages & DSP_STAGE_LOUDNESS) {
+        m_Loudness.Process(m_pfWork, ulFrames);
+    }
+    if (m_ulStages & DSP_STAGE_GAIN) {
+        ApplyGain(m_pfWork, ulFrames);
+    }
+    if (m_ulStages & DSP_STAGE_NORMALIZE) {
+        Normalize(m_pfWork, ulFrames);
+    }
+    if (m_ulStages & DSP_STAGE_MIX) {
+        DspMix(m_pfWork, ulFrames, m_nChannels, m_nOutputChannels, m_ulMixInputs, m_aulMixInput, m_afMixColumn, m_pfMixed);
+        pfOutput = m_pfMixed;
+    }
+    if (m_ulStages & DSP_STAGE_RESAMPLE) {
+        ulFrames = m_Resampler.Process(pfOutput, ulFrames, m_pfResampled);
+        pfOutput = m_pfResampled;
+    }
+    if (m_ulStages & DSP_STAGE_LIMIT) {
+        m_Limiter.Process(pfOutput, ulFrames);
+    }
+
+    m_pOutputKernels->FromFloat(pfOutput, ulFrames, pOutput);
+
+#if !defined(_M_AMD64)
+    KeRestoreFloatingPointState(&floatSave);
+#endif
+
+    return ulFrames;
+} // Process
+
+//=============================================================================
+void CAudioProcessor::Measure(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames
+)
+/*++
+Routine Description:
+  Measures the loudness of frames that do not go through Process. Nothing
+  is measured if the floating point state cannot be saved.
+
+Arguments:
+  pInput - interleaved frames in the stream format.
+  ulFrames - number of frames, at most the maximum given to SetFormat.
+
+Return Value:
+  void
+--*/
+{
+    ASSERT(ulFrames <= m_ulMaxFrames);
+
+    if (!m_pfWork || !(m_ulStages & DSP_STAGE_LOUDNESS)) {
+        return;
+    }
+
+#if !defined(_M_AMD64)
+    KFLOATING_SAVE      floatSave;
+
+    if (!NT_SUCCESS(KeSaveFloatingPointState(&floatSave))) {
+        return;
+    }
+#endif
+
+    m_pKernels->ToFloat(pInput, ulFrames, m_pfWork);
+    m_Loudness.Process(m_pfWork, ulFrames);
+
+#if !defined(_M_AMD64)
+    KeRestoreFloatingPointState(&floatSave);
+#endif
+} // Measure
@@ -0,0 +1,494 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    dsp.h
+
+Abstract:
+    Declaration of the render stream processing. Frames are converted from
+    the stream format to interleaved float, processed and converted back
+    on the sender thread, before they reach the codec.
+--*/
+
+#ifndef _MSVAD_DSP_H_
+#define _MSVAD_DSP_H_
+
+#include "codec.h"
+
+//=============================================================================
+// Defines
+//=============================================================================
+
+// Sample types of the stream formats.
+typedef enum {
+    DSP_SAMPLE_U8 = 0,                      // 8 bit unsigned
+    DSP_SAMPLE_S16,
+    DSP_SAMPLE_S24,                         // Packed in 3 bytes
+    DSP_SAMPLE_S32,                         // Also 20 or 24 valid bits in 32
+    DSP_SAMPLE_F32,                         // IEEE float
+    DSP_SAMPLE_COUNT
+} DSP_SAMPLE_TYPE;
+
+// Processing stages, bits of CAudioProcessor::m_ulStages.
+#define DSP_STAGE_GAIN              0x00000001
+#define DSP_STAGE_RESAMPLE          0x00000002
+#define DSP_STAGE_MIX               0x00000004
+#define DSP_STAGE_LIMIT             0x00000008
+#define DSP_STAGE_LOUDNESS          0x00000010      // Measures only
+#define DSP_STAGE_NORMALIZE         0x00000020
+
+// Gain changes are ramped linearly over this time to avoid clicks.
+#define DSP_GAIN_RAMP_MS            5
+
+// Resampler. Rates are converted by their exact ratio, up / down in lowest
+// terms, so the number of filter phases is the reduced output rate. 64 taps
+// per phase at the lower of the two rates give a passband to about 0.85 of
+// its Nyquist frequency and 80 dB stop band attenuation.
+#define DSP_RESAMPLER_MAX_PHASES    1024
+#define DSP_RESAMPLER_TAPS          64
+#define DSP_RESAMPLER_MAX_TAPS      256
+#define DSP_RESAMPLER_CUTOFF        0.92    // Of the lower Nyquist frequency
+#define DSP_RESAMPLER_KAISER_BETA   7.857   // 80 dB
+
+// Equalizer. A new set of sections runs next to the old one while the
+// output fades over to it. Every section adds a tiny offset to its input
+// so states decaying in silence never become denormal.
+#define DSP_EQ_FADE_MS              10
+#define DSP_DENORMAL_OFFSET         1e-20f
+
+// Delay line. A new delay is cross-faded from the old one.
+#define DSP_DELAY_FADE_MS           10
+
+// Meter. Peak and RMS are measured over periods of this length and
+// published at the end of each one.
+#define DSP_METER_PERIOD_MS         50
+
+// Loudness as in EBU R128. Power is summed over 100 ms sub-blocks; the
+// gating blocks of 400 ms overlap by 75%, so each is the mean of the last
+// four sub-blocks. The integrated loudness keeps a histogram of the block
+// loudness in 0.1 LU bins, with the count and total power of each, rather
+// than the blocks. That is constant memory, and only blocks within 0.05 LU
+// of the relative gate can be gated wrongly. The normalization gain slews
+// by at most 0.1 dB per sub-block. Filtered samples are squared with an
+// offset so silence gives no denormal squares.
+#define DSP_LOUDNESS_SUBBLOCK_MS    100
+#define DSP_LOUDNESS_MOMENTARY      4       // Sub-blocks
+#define DSP_LOUDNESS_SHORT_TERM     30
+#define DSP_LOUDNESS_MIN            -70     // LUFS, the absolute gate
+#define DSP_LOUDNESS_MAX            10
+#define DSP_LOUDNESS_BINS           ((DSP_LOUDNESS_MAX - DSP_LOUDNESS_MIN) * 10)
+#define DSP_LOUDNESS_RELATIVE_GATE  10      // LU
+#define DSP_LOUDNESS_SLEW           0.1f    // dB per sub-block
+#define DSP_LOUDNESS_OFFSET         1e-15f
+
+// Volumes are in 1/65536 dB like KSPROPERTY_AUDIO_VOLUMELEVEL. Anything
+// below the minimum is silence.
+#define DSP_MIN_VOLUME              (-96 * 0x10000)
+#define DSP_MAX_VOLUME              0
+#define DSP_MIN_DECIBELS            -1000.0f
+
+#define DSP_PI                      3.14159265358979323846
+
+//=============================================================================
+// Structs
+//=============================================================================
+
+// Conversion kernels of one sample type and channel count. Float samples
+// are interleaved and nominally in [-1, 1); integer FromFloat clips.
+// MeterCopy copies frames in the stream format and accumulates their per
+// channel peak and sum of squares, as floats of the same scale.
+typedef void (*PFNDSPTOFLOAT)(IN PBYTE pInput, IN ULONG ulFrames, OUT FLOAT *pfOutput);
+typedef void (*PFNDSPFROMFLOAT)(IN FLOAT *pfInput, IN ULONG ulFrames, OUT PBYTE pOutput);
+typedef void (*PFNDSPMETERCOPY)(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput, IN OUT FLOAT *pfPeak, IN OUT FLOAT *pfSquares);
+
+typedef struct _DSP_KERNELS {
+    PFNDSPTOFLOAT       ToFloat;
+    PFNDSPFROMFLOAT     FromFloat;
+    PFNDSPMETERCOPY     MeterCopy;
+} DSP_KERNELS;
+typedef const DSP_KERNELS *PCDSP_KERNELS;
+
+// Biquad section for transposed direct form II, with the feedback
+// coefficients negated.
+typedef struct _DSP_BIQUAD {
+    FLOAT               b0;
+    FLOAT               b1;
+    FLOAT               b2;
+    FLOAT               na1;
+    FLOAT               na2;
+} DSP_BIQUAD;
+typedef DSP_BIQUAD *PDSP_BIQUAD;
+
+//=============================================================================
+// Functions
+//=============================================================================
+
+// Kernels for the sample type of pWfx and nChannels channels, or NULL.
+PCDSP_KERNELS DspGetKernels(IN PWAVEFORMATEX pWfx, IN USHORT nChannels);
+
+// Math without the C runtime. Volumes are in 1/65536 dB and clamped to
+// the volume range; decibels are plain floats.
+double DspSin(IN double x);
+FLOAT DspDecibelsToGain(IN FLOAT fDb);
+FLOAT DspDecibels(IN FLOAT fGain);
+FLOAT DspVolumeToGain(IN LONG lVolume);
+LONG DspGainToVolume(IN FLOAT fGain);
+
+//=============================================================================
+// Classes
+//=============================================================================
+
+///////////////////////////////////////////////////////////////////////////////
+// CResampler
+//   Polyphase sample rate converter on float samples. The input is kept per
+//   channel so every output sample is one dot product of a coefficient
+//   phase with consecutive input samples.
+//
+class CResampler {
+protected:
+    ULONG                       m_ulUp;             // Output rate in lowest terms
+    ULONG                       m_ulDown;           // Input rate in lowest terms
+    ULONG                       m_ulTaps;           // Per phase, a multiple of 4
+    USHORT                      m_nChannels;
+    FLOAT *                     m_pfCoefficients;   // m_ulUp phases of m_ulTaps, time reversed
+    FLOAT *                     m_pfHistory;        // m_ulHistorySize samples per channel
+    ULONG                       m_ulHistorySize;
+    ULONG                       m_ulFill;           // Samples per channel in m_pfHistory
+    ULONG                       m_ulIndex;          // Newest input sample of the next output
+    ULONG                       m_ulPhase;          // Of the next output, 0 to m_ulUp - 1
+
+    void                        Free(void);
+    void                        Design(void);
+
+public:
+    CResampler();
+    ~CResampler();
+
+    static BOOL                 IsSupported(IN ULONG ulInputRate, IN ULONG ulOutputRate);
+
+    NTSTATUS                    Init(IN ULONG ulInputRate, IN ULONG ulOutputRate, IN USHORT nChannels, IN ULONG ulMaxFrames);
+    ULONG                       GetMaxOutputFrames(IN ULONG ulFrames);
+    ULONG                       Process(IN const FLOAT *pfInput, IN ULONG ulFrames, OUT FLOAT *pfOutput);
+};
+typedef CResampler *PCResampler;
+
+///////////////////////////////////////////////////////////////////////////////
+// CLimiter
+//   Look-ahead peak limiter on float frames. The gain a frame needs is
+//   the lowest over the look-ahead window, found with a monotonic queue in
+//   constant amortized time, and is then smoothed by a moving average as
+//   long as the window so it ramps down before the peak leaves the delay
+//   line.
+//
+class CLimiter {
+protected:
+    USHORT                      m_nChannels;
+    ULONG                       m_ulLookahead;      // Frames of delay
+    FLOAT                       m_fThreshold;
+    FLOAT                       m_fRelease;         // Share of the gap recovered per frame
+    PVOID                       m_pBuffers;         // Allocation behind the pointers below
+    FLOAT *                     m_pfDelay;          // m_ulLookahead frames
+    FLOAT *                     m_pfEnvelope;       // Last m_ulLookahead envelope values
+    FLOAT *                     m_pfQueueGain;      // Queue of m_ulLookahead + 1 entries,
+    ULONG *                     m_pulQueueFrame;    // gains rising from the head
+    ULONG                       m_ulQueueHead;
+    ULONG                       m_ulQueueCount;
+    ULONG                       m_ulFrame;          // Frames processed, wraps
+    ULONG                       m_ulPosition;       // In m_pfDelay and m_pfEnvelope
+    FLOAT                       m_fEnvelope;
+    FLOAT                       m_fSum;             // Of m_pfEnvelope
+    LONG                        m_lReduction;       // Deepest since the last ReadReduction
+
+    void                        Free(void);
+
+public:
+    CLimiter();
+    ~CLimiter();
+
+    NTSTATUS                    Init(IN PAUDIONET_LIMITER pSettings, IN ULONG ulRate, IN USHORT nChannels);
+
+    // Limits and delays ulFrames interleaved frames in place.
+    void                        Process(IN OUT FLOAT *pfSamples, IN ULONG ulFrames);
+
+    // Deepest gain reduction since the last call in 1/65536 dB.
+    LONG                        ReadReduction(void) { LONG lReduction = m_lReduction; m_lReduction = 0; return lReduction; }
+};
+typedef CLimiter *PCLimiter;
+
+///////////////////////////////////////////////////////////////////////////////
+// CMeter
+//   Per channel peak and RMS of the stream, measured while the frames are
+//   copied so the samples are only read once. Levels are linear, with
+//   MAXLONG for full scale like KSPROPERTY_AUDIO_PEAKMETER.
+//
+class CMeter {
+protected:
+    PCDSP_KERNELS               m_pKernels;
+    USHORT                      m_nChannels;
+    USHORT                      m_nBlockAlign;
+    ULONG                       m_ulPeriod;         // Frames per period
+    ULONG                       m_ulFrames;         // Frames of the period so far
+    FLOAT                       m_afPeak[CODEC_MAX_CHANNELS];
+    FLOAT                       m_afSquares[CODEC_MAX_CHANNELS];
+    LONG                        m_alPeak[CODEC_MAX_CHANNELS];   // Of the last whole period
+    LONG                        m_alRms[CODEC_MAX_CHANNELS];
+
+    void                        EndPeriod(void);
+
+public:
+    CMeter();
+
+    NTSTATUS                    Init(IN PWAVEFORMATEX pWfx);
+
+    // Copies ulFrames frames from pInput to pOutput and measures them. Returns
+    // TRUE when a period ended, whose levels GetPeak and GetRms then return.
+    // Callable at DISPATCH_LEVEL.
+    BOOL                        CopyFrames(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput);
+
+    USHORT                      GetChannels(void)            { return m_nChannels; }
+    LONG                        GetPeak(IN ULONG ulChannel)  { return m_alPeak[ulChannel]; }
+    LONG                        GetRms(IN ULONG ulChannel)   { return m_alRms[ulChannel]; }
+};
+typedef CMeter *PCMeter;
+
+///////////////////////////////////////////////////////////////////////////////
+// CLoudness
+//   K-weighted loudness of float frames with the gating of EBU R128, in
+//   constant memory, and the normalization gain that steers it towards a
+//   target. The channels of a frame are filtered together, one SSE vector
+//   for up to four of them.
+//
+class CLoudness {
+protected:
+    USHORT                      m_nChannels;
+    ULONG                       m_ulSubBlock;       // Frames per sub-block
+    ULONG                       m_ulFrames;         // Frames of the sub-block so far
+    DSP_BIQUAD                  m_aFilter[2];       // Shelf, then high-pass
+    FLOAT                       m_afState[2][2][CODEC_MAX_CHANNELS];
+    FLOAT                       m_afWeight[CODEC_MAX_CHANNELS];
+    FLOAT                       m_afSum[CODEC_MAX_CHANNELS];        // Of the filtered squares
+    FLOAT                       m_afPower[DSP_LOUDNESS_SHORT_TERM]; // Of the last sub-blocks
+    ULONG                       m_ulPower;          // Next entry of m_afPower
+    ULONG                       m_ulPowers;         // Valid entries of m_afPower
+    ULONG                       m_aulHistogram[DSP_LOUDNESS_BINS];  // Blocks above the absolute gate
+    double                      m_adHistogram[DSP_LOUDNESS_BINS];   // Their total power
+    ULONG                       m_ulBlocks;         // In m_aulHistogram
+    FLOAT                       m_fIntegrated;      // LUFS, DSP_MIN_DECIBELS for none
+    AUDIONET_LOUDNESS           m_Loudness;         // Of the last sub-block
+
+    // Normalization
+    BOOL                        m_fNormalize;
+    FLOAT                       m_fTarget;          // LUFS
+    FLOAT                       m_fMaxGain;         // dB
+    FLOAT                       m_fGainDb;
+    FLOAT                       m_fGain;            // Linear of m_fGainDb
+
+    void                        Filter(IN const FLOAT *pfSamples, IN ULONG ulFrames);
+    void                        EndSubBlock(void);
+    void                        UpdateIntegrated(void);
+
+public:
+    CLoudness();
+
+    NTSTATUS                    Init(IN PWAVEFORMATEX pWfx, IN PAUDIONET_NORMALIZATION pNormalization OPTIONAL);
+
+    // Measures ulFrames interleaved frames. Called with the floating point
+    // state saved.
+    void                        Process(IN const FLOAT *pfSamples, IN ULONG ulFrames);
+
+    // Linear normalization gain for the frames after the last Process call.
+    FLOAT                       GetGain(void)       { return m_fGain; }
+
+    void                        GetLoudness(OUT PAUDIONET_LOUDNESS pLoudness) { *pLoudness = m_Loudness; }
+};
+typedef CLoudness *PCLoudness;
+
+///////////////////////////////////////////////////////////////////////////////
+// CAudioProcessor
+//   Processing of one render stream. SetFormat picks the kernels for the
+//   format once, so the per-sample loops have no format branches. Only
+//   called on the sender thread.
+//
+class CAudioProcessor {
+protected:
+    PCDSP_KERNELS               m_pKernels;         // Selected by SetFormat
+    PCDSP_KERNELS               m_pOutputKernels;   // Same sample type, output channels
+    USHORT                      m_nChannels;
+    USHORT                      m_nBlockAlign;
+    USHORT                      m_nOutputChannels;
+    USHORT                      m_nOutputBlockAlign;
+    ULONG                       m_ulMaxFrames;
+    FLOAT *                     m_pfWork;           // m_ulMaxFrames interleaved frames
+    FLOAT *                     m_pfMixed;          // Output of Mix
+    FLOAT *                     m_pfResampled;      // Output of m_Resampler
+    CResampler                  m_Resampler;
+    CLimiter                    m_Limiter;
+    CLoudness                   m_Loudness;         // Of the stream channels before gain
+    FLOAT                       m_fNormalizeGain;   // Applied to the last frame
+    ULONG                       m_ulStages;         // DSP_STAGE_xxx
+
+    // Gain, see SetGain
+    LONG                        m_lVolume[CODEC_MAX_CHANNELS];      // Requested, 1/65536 dB
+    BOOL                        m_fMute;
+    BOOL                        m_fGainPending;     // Requested gain not applied yet
+    BOOL                        m_fGainValid;       // m_afGain is not just the default
+    FLOAT                       m_afGain[CODEC_MAX_CHANNELS];        // Of the next frame
+    FLOAT                       m_afGainStep[CODEC_MAX_CHANNELS];    // Per frame while ramping
+    FLOAT                       m_afGainTarget[CODEC_MAX_CHANNELS];
+    ULONG                       m_ulGainRamp;       // Frames left in the ramp
+    ULONG                       m_ulGainRampFrames;
+
+    // Channel matrix, only the input channels with a non-zero gain. Column
+    // k holds the gains of input m_aulMixInput[k] to every output.
+    ULONG                       m_ulMixInputs;
+    ULONG                       m_aulMixInput[CODEC_MAX_CHANNELS];
+    FLOAT                       m_afMixColumn[CODEC_MAX_CHANNELS][CODEC_MAX_CHANNELS];
+
+    void                        Free(void);
+    void                        UpdateGain(void);
+    void                        ApplyGain(IN OUT FLOAT *pfSamples, IN ULONG ulFrames);
+    void                        SetMatrix(IN PAUDIONET_CHANNEL_MATRIX pMatrix);
+    void                        Normalize(IN OUT FLOAT *pfSamples, IN ULONG ulFrames);
+
+public:
+    CAudioProcessor();
+    ~CAudioProcessor();
+
+    NTSTATUS                    SetFormat(IN PWAVEFORMATEX pWfx, IN ULONG ulMaxFrames, IN ULONG ulOutputRate, IN PAUDIONET_CHANNEL_MATRIX pMatrix OPTIONAL,
+                                          IN PAUDIONET_LIMITER pLimiter OPTIONAL, IN PAUDIONET_NORMALIZATION pNormalization OPTIONAL);
+
+    // Whether Process would change anything. If not, the sender skips it
+    // and calls Measure instead.
+    BOOL                        IsActive(void)      { return m_pfWork && (m_ulStages & ~DSP_STAGE_LOUDNESS); }
+
+    // Requests a new per channel volume, applied with a ramp from the next
+    // Process call on.
+    void                        SetGain(IN const LONG *plVolume, IN BOOL fMute);
+
+    // Whether the output differs from the stream in rate or channels. When
+    // resampling, Process returns a different number of frames than it is
+    // given.
+    BOOL                        IsConverting(void)  { return (m_ulStages & (DSP_STAGE_RESAMPLE | DSP_STAGE_MIX)) != 0; }
+    USHORT                      GetOutputBlockAlign(void) { return m_nOutputBlockAlign; }
+    ULONG                       GetMaxOutputFrames(IN ULONG ulFrames);
+
+    // Deepest gain reduction of the limiter since the last call, 0 without
+    // it.
+    LONG                        ReadLimiterReduction(void) { return (m_ulStages & DSP_STAGE_LIMIT) ? m_Limiter.ReadReduction() : 0; }
+
+    // Loudness of the stream and the normalization gain.
+    void                        GetLoudness(OUT PAUDIONET_LOUDNESS pLoudness) { m_Loudness.GetLoudness(pLoudness); }
+
+    // Measures the loudness of frames that are passed through unprocessed.
+    void                        Measure(IN PBYTE pInput, IN ULONG ulFrames);
+
+    // Processes up to the maximum frames from pInput into pOutput, both in
+    // the stream sample type, but pOutput with the output channels and at
+    // the output rate. Unless converting they may be the same buffer.
+    // Returns the frames written.
+    ULONG                       Process(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput);
+};
+typedef CAudioProcessor *PCAudioProcessor;
+
+///////////////////////////////////////////////////////////////////////////////
+// CEqualizer
+//   Cascade of biquad sections on the frames sent to one destination. The
+//   channels of a frame are padded to whole vectors and filtered together,
+//   one section at a time over the whole block. Two banks of sections let
+//   a new set take over with a cross-fade. Only called on the sender
+//   thread.
+//
+class CEqualizer {
+protected:
+    PCDSP_KERNELS               m_pKernels;
+    USHORT                      m_nChannels;
+    USHORT                      m_nBlockAlign;
+    ULONG                       m_ulStride;         // Floats per frame, a multiple of 4
+    ULONG                       m_ulMaxFrames;
+    FLOAT *                     m_pfWork;           // m_ulMaxFrames frames of m_ulStride
+    FLOAT *                     m_pfFade;           // Input of the new bank while fading
+    AUDIONET_EQUALIZER          m_Settings;         // Last set given to SetSections
+
+    ULONG                       m_ulBank;           // Bank in use
+    ULONG                       m_aulSections[2];
+    DSP_BIQUAD                  m_aSection[2][AUDIONET_MAX_BIQUADS];
+    FLOAT                       m_afState[2][AUDIONET_MAX_BIQUADS][2][CODEC_MAX_CHANNELS];
+    ULONG                       m_ulFade;           // Frames faded to the other bank
+    ULONG                       m_ulFadeFrames;     // 0 unless fading
+    ULONG                       m_ulFadeLength;     // DSP_EQ_FADE_MS in frames
+
+    void                        Free(void);
+    void                        Filter(IN ULONG ulBank, IN OUT FLOAT *pfSamples, IN ULONG ulFrames);
+    void                        Crossfade(IN OUT FLOAT *pfSamples, IN const FLOAT *pfTarget, IN ULONG ulFrames);
+
+public:
+    CEqualizer();
+    ~CEqualizer();
+
+    NTSTATUS                    Init(IN PWAVEFORMATEX pWfx, IN USHORT nChannels, IN ULONG ulMaxFrames);
+
+    // Takes a new set of sections, faded in over DSP_EQ_FADE_MS when
+    // fFade is set. Returns FALSE if a section is unstable.
+    BOOL                        SetSections(IN PAUDIONET_EQUALIZER pEqualizer, IN BOOL fFade);
+
+    BOOL                        IsActive(void)      { return m_pfWork && (m_aulSections[m_ulBank] || m_ulFadeFrames); }
+
+    // Filters up to the maximum frames from pInput into pOutput, which may
+    // be the same buffer.
+    void                        Process(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput);
+};
+typedef CEqualizer *PCEqualizer;
+
+///////////////////////////////////////////////////////////////////////////////
+// CDelay
+//   Delay line of the frames sent to one destination, in their sample
+//   format. Frames are written to a ring sized for the longest delay set
+//   and read back from behind the write position, so a block costs two
+//   copies whatever the delay. A destination that is never delayed has no
+//   ring; while a new delay fades in, both read positions are converted to
+//   float and mixed. Only called on the sender thread.
+//
+class CDelay {
+protected:
+    PCDSP_KERNELS               m_pKernels;
+    USHORT                      m_nChannels;
+    USHORT                      m_nBlockAlign;
+    ULONG                       m_ulRate;
+    ULONG                       m_ulMaxFrames;
+    PBYTE                       m_pRing;
+    ULONG                       m_ulRingFrames;     // Longest delay set plus m_ulMaxFrames
+    ULONG                       m_ulWrite;          // Frame of the ring written next
+    FLOAT *                     m_pfOld;            // m_ulMaxFrames frames read at the old delay
+    FLOAT *                     m_pfNew;            // And at the new one
+    ULONG                       m_ulDelayTime;      // Microseconds, as last set
+    ULONG                       m_ulDelay;          // Frames
+    ULONG                       m_ulOldDelay;       // Frames, faded out
+    ULONG                       m_ulFade;           // Frames faded to the new delay
+    ULONG                       m_ulFadeFrames;     // 0 unless fading
+    ULONG                       m_ulFadeLength;     // DSP_DELAY_FADE_MS in frames
+
+    void                        Free(void);
+    NTSTATUS                    GrowRing(IN ULONG ulDelay);
+    void                        Read(IN ULONG ulDelay, IN ULONG ulFrames, OUT PBYTE pOutput);
+    void                        Crossfade(IN ULONG ulFrames, IN OUT PBYTE pOutput);
+
+public:
+    CDelay();
+    ~CDelay();
+
+    NTSTATUS                    Init(IN PWAVEFORMATEX pWfx, IN USHORT nChannels, IN ULONG ulMaxFrames);
+
+    // Sets the delay in microseconds, up to AUDIONET_MAX_DELAY, faded in
+    // over DSP_DELAY_FADE_MS. A fade still in progress is cut short.
+    void                        SetDelay(IN ULONG ulDelayTime);
+    ULONG                       GetDelay(void)      { return m_ulDelayTime; }
+
+    BOOL                        IsActive(void)      { return m_pRing && (m_ulDelay || m_ulFadeFrames); }
+
+    // Delays up to the maximum frames from pInput into pOutput, which may
+    // be the same buffer.
+    void                        Process(IN PBYTE pInput, IN ULONG ulFrames, OUT PBYTE pOutput);
+};
+typedef CDelay *PCDelay;
+
+#endif
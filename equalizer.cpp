@@ -0,0 +1,383 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    equalizer.cpp
+
+Abstract:
+    Implementation of the per destination equalizer.
+
+    Each section is a biquad in transposed direct form II, which needs two
+    states per channel and has good numerical behaviour in float. The
+    frames are padded to whole SSE vectors so one instruction filters four
+    channels; a section runs over the whole block before the next so its
+    coefficients and states stay in registers.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include "dsp.h"
+
+#if defined(_M_AMD64)
+#include <xmmintrin.h>
+#endif
+
+//=============================================================================
+// CEqualizer
+//=============================================================================
+
+#pragma code_seg("PAGE")
+//=============================================================================
+CEqualizer::CEqualizer() : m_pKernels(NULL), m_nChannels(0), m_nBlockAlign(0), m_ulStride(0), m_ulMaxFrames(0), m_pfWork(NULL), m_pfFade(NULL),
+    m_ulBank(0), m_ulFade(0), m_ulFadeFrames(0), m_ulFadeLength(1)
+{
+    PAGED_CODE();
+
+    RtlZeroMemory(&m_Settings, sizeof(m_Settings));
+    RtlZeroMemory(m_aulSections, sizeof(m_aulSections));
+    RtlZeroMemory(m_afState, sizeof(m_afState));
+} // CEqualizer
+
+//=============================================================================
+CEqualizer::~CEqualizer()
+{
+    PAGED_CODE();
+
+    Free();
+} // ~CEqualizer
+
+//=============================================================================
+void CEqualizer::Free(void)
+{
+    PAGED_CODE();
+
+    if (m_pfWork) {
+        ExFreePoolWithTag(m_pfWork, MSVAD_POOLTAG);
+        m_pfWork = NULL;
+    }
+    if (m_pfFade) {
+        ExFreePoolWithTag(m_pfFade, MSVAD_POOLTAG);
+        m_pfFade = NULL;
+    }
+} // Free
+
+//=============================================================================
+NTSTATUS CEqualizer::Init(
+    IN  PWAVEFORMATEX           pWfx,
+    IN  USHORT                  nChannels,
+    IN  ULONG                   ulMaxFrames
+)
+/*++
+Routine Description:
+  Selects the kernels and allocates the buffers. The equalizer starts
+  without sections.
+
+Arguments:
+  pWfx - format of the frames, for the sample type and rate.
+  nChannels - channels of the frames.
+  ulMaxFrames - most frames of one Process call.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    Free();
+
+    m_pKernels = DspGetKernels(pWfx, nChannels);
+    if (!m_pKernels || !ulMaxFrames) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    m_nChannels    = nChannels;
+    m_nBlockAlign  = (USHORT) (pWfx->nBlockAlign / pWfx->nChannels * nChannels);
+    m_ulStride     = (nChannels + 3) & ~3;
+    m_ulMaxFrames  = ulMaxFrames;
+    m_ulFadeLength = max(pWfx->nSamplesPerSec * DSP_EQ_FADE_MS / 1000, 1);
+
+    m_pfWork = (FLOAT *) ExAllocatePoolWithTag(NonPagedPool, ulMaxFrames * m_ulStride * sizeof(FLOAT), MSVAD_POOLTAG);
+    m_pfFade = (FLOAT *) ExAllocatePoolWithTag(NonPagedPool, ulMaxFrames * m_ulStride * sizeof(FLOAT), MSVAD_POOLTAG);
+    if (!m_pfWork || !m_pfFade) {
+        Free();
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    return STATUS_SUCCESS;
+} // Init
+
+//=============================================================================
+BOOL CEqualizer::SetSections(
+    IN  PAUDIONET_EQUALIZER     pEqualizer,
+    IN  BOOL                    fFade
+)
+/*++
+Routine Description:
+  Loads a set of sections into the idle bank and fades over to it, or
+  replaces the bank in use. The new sections start from the states of the
+  old ones, which keeps the fade short for small changes. A fade still in
+  progress is cut short.
+
+Arguments:
+  pEqualizer - sections from the settings.
+  fFade - whether to cross-fade rather than switch.
+
+Return Value:
+  FALSE if a section is unstable, in which case nothing changes.
+--*/
+{
+    PAGED_CODE();
+
+    ULONG ulSections = min(pEqualizer->Sections, AUDIONET_MAX_BIQUADS);
+    ULONG ulBank;
+    BOOL  fStable = TRUE;
+
+    if (RtlEqualMemory(pEqualizer, &m_Settings, sizeof(m_Settings))) {
+        return TRUE;
+    }
+
+#if !defined(_M_AMD64)
+    KFLOATING_SAVE floatSave;
+
+    if (!NT_SUCCESS(KeSaveFloatingPointState(&floatSave))) {
+        return FALSE;
+    }
+#endif
+
+    // Both poles are inside the unit circle when (A1, A2) is inside the
+    // stability triangle.
+    for (ULONG s = 0; s < ulSections; s++) {
+        PAUDIONET_BIQUAD pSection = &pEqualizer->Section[s];
+
+        if (!((pSection->A2 < 1.0f) && (pSection->A2 > -1.0f) && (pSection->A1 < 1.0f + pSection->A2) && (-pSection->A1 < 1.0f + pSection->A2))) {
+            fStable = FALSE;
+        }
+    }
+
+    if (fStable) {
+        if (m_ulFadeFrames) {
+            m_ulBank      ^= 1;
+            m_ulFadeFrames = 0;
+        }
+
+        ulBank = fFade ? m_ulBank ^ 1 : m_ulBank;
+
+        for (ULONG s = 0; s < ulSections; s++) {
+            m_aSection[ulBank][s].b0  = pEqualizer->Section[s].B0;
+            m_aSection[ulBank][s].b1  = pEqualizer->Section[s].B1;
+            m_aSection[ulBank][s].b2  = pEqualizer->Section[s].B2;
+            m_aSection[ulBank][s].na1 = -pEqualizer->Section[s].A1;
+            m_aSection[ulBank][s].na2 = -pEqualizer->Section[s].A2;
+
+            if (fFade && (s < m_aulSections[m_ulBank])) {
+                RtlCopyMemory(m_afState[ulBank][s], m_afState[m_ulBank][s], sizeof(m_afState[0][0]));
+            } else {
+                RtlZeroMemory(m_afState[ulBank][s], sizeof(m_afState[0][0]));
+            }
+        }
+        m_aulSections[ulBank] = ulSections;
+
+        if (fFade) {
+            m_ulFade       = 0;
+            m_ulFadeFrames = m_ulFadeLength;
+        }
+
+        m_Settings = *pEqualizer;
+    } else {
+        DPF(D_TERSE, ("Unstable equalizer section ignored"));
+    }
+
+#if !defined(_M_AMD64)
+    KeRestoreFloatingPointState(&floatSave);
+#endif
+
+    return fStable;
+} // SetSections
+#pragma code_seg()
+
+//=============================================================================
+void CEqualizer::Filter(
+    IN  ULONG                   ulBank,
+    IN OUT FLOAT *              pfSamples,
+    IN  ULONG                   ulFrames
+)
+/*++
+Routine Description:
+  Runs the sections of a bank over padded frames, in place.
+
+Arguments:
+  ulBank - bank to run.
+  pfSamples - ulFrames frames of m_ulStride floats.
+  ulFrames - number of frames.
+
+Return Value:
+  void
+--*/
+{
+    ULONG i;
+
+    for (ULONG s = 0; s < m_aulSections[ulBank]; s++) {
+        PDSP_BIQUAD pSection = &m_aSection[ulBank][s];
+        FLOAT *     pfState0 = m_afState[ulBank][s][0];
+        FLOAT *     pfState1 = m_afState[ulBank][s][1];
+
+#if defined(_M_AMD64)
+        __m128 b0     = _mm_set1_ps(pSection->b0);
+        __m128 b1     = _mm_set1_ps(pSection->b1);
+        __m128 b2     = _mm_set1_ps(pSection->b2);
+        __m128 na1    = _mm_set1_ps(pSection->na1);
+        __m128 na2    = _mm_set1_ps(pSection->na2);
+        __m128 offset = _mm_set1_ps(DSP_DENORMAL_OFFSET);
+
+        for (ULONG v = 0; v < m_ulStride; v += 4) {
+            FLOAT * pf = pfSamples + v;
+            __m128  s1 = _mm_loadu_ps(pfState0 + v);
+            __m128  s2 = _mm_loadu_ps(pfState1 + v);
+
+            for (i = 0; i < ulFrames; i++) {
+                __m128 x = _mm_add_ps(_mm_loadu_ps(pf), offset);
+                __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), s1);
+
+                s1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b1, x), _mm_mul_ps(na1, y)), s2);
+                s2 = _mm_add_ps(_mm_mul_ps(b2, x), _mm_mul_ps(na2, y));
+                _mm_storeu_ps(pf, y);
+
+                pf += m_ulStride;
+            }
+
+            _mm_storeu_ps(pfState0 + v, s1);
+            _mm_storeu_ps(pfState1 + v, s2);
+        }
+#else
+        for (ULONG c = 0; c < m_nChannels; c++) {
+            FLOAT * pf = pfSamples + c;
+            FLOAT   s1 = pfState0[c];
+            FLOAT   s2 = pfState1[c];
+
+            for (i = 0; i < ulFrames; i++) {
+                FLOAT x = *pf + DSP_DENORMAL_OFFSET;
+                FLOAT y = pSection->b0 * x + s1;
+
+                s1  = pSection->b1 * x + pSection->na1 * y + s2;
+                s2  = pSection->b2 * x + pSection->na2 * y;
+                *pf = y;
+
+                pf += m_ulStride;
+            }
+
+            pfState0[c] = s1;
+            pfState1[c] = s2;
+        }
+#endif
+    }
+} // Filter
+
+//=============================================================================
+void CEqualizer::Crossfade(
+    IN OUT FLOAT *              pfSamples,
+    IN  const FLOAT *           pfTarget,
+    IN  ULONG                   ulFrames
+)
+/*++
+Routine Description:
+  Moves the output of the bank in use linearly towards the output of the
+  other bank, and makes that the bank in use once the fade is complete.
+
+Arguments:
+  pfSamples - output of the bank in use, replaced by the faded output.
+  pfTarget - output of the other bank.
+  ulFrames - number of frames.
+
+Return Value:
+  void
+--*/
+{
+    FLOAT fStep = 1.0f / m_ulFadeFrames;
+    FLOAT fMix  = m_ulFade * fStep;
+
+    for (ULONG i = 0; i < ulFrames; i++) {
+        fMix = (m_ulFade + i < m_ulFadeFrames) ? fMix + fStep : 1.0f;
+
+        for (ULONG c = 0; c < m_ulStride; c++) {
+            pfSamples[c] += (pfTarget[c] - pfSamples[c]) * fMix;
+        }
+        pfSamples += m_ulStride;
+        pfTarget  += m_ulStride;
+    }
+
+    m_ulFade += ulFrames;
+    if (m_ulFade >= m_ulFadeFrames) {
+        m_ulBank      ^= 1;
+        m_ulFadeFrames = 0;
+    }
+} // Crossfade
+
+//=============================================================================
+void CEqualizer::Process(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput
+)
+/*++
+Routine Description:
+  Converts the frames to padded float, filters them and converts them
+  back. If the floating point state cannot be saved they pass unfiltered.
+
+Arguments:
+  pInput - interleaved frames.
+  ulFrames - number of frames, at most the maximum given to Init.
+  pOutput - receives the filtered frames.
+
+Return Value:
+  void
+--*/
+{
+    ASSERT(m_pKernels && m_pfWork);
+    ASSERT(ulFrames <= m_ulMaxFrames);
+
+    ULONG i;
+
+#if !defined(_M_AMD64)
+    KFLOATING_SAVE      floatSave;
+
+    if (!NT_SUCCESS(KeSaveFloatingPointState(&floatSave))) {
+        if (pOutput != pInput) {
+            RtlCopyMemory(pOutput, pInput, ulFrames * m_nBlockAlign);
+        }
+        return;
+    }
+#endif
+
+    m_pKernels->ToFloat(pInput, ulFrames, m_pfWork);
+
+    // Spread the frames to the padded stride, last frame first so nothing
+    // is overwritten before it moved.
+    if (m_ulStride != m_nChannels) {
+        for (i = ulFrames; i-- > 0; ) {
+            RtlMoveMemory(m_pfWork + i * m_ulStride, m_pfWork + i * m_nChannels, m_nChannels * sizeof(FLOAT));
+            RtlZeroMemory(m_pfWork + i * m_ulStride + m_nChannels, (m_ulStride - m_nChannels) * sizeof(FLOAT));
+        }
+    }
+
+    if (m_ulFadeFrames) {
+        RtlCopyMemory(m_pfFade, m_pfWork, ulFrames * m_ulStride * sizeof(FLOAT));
+        Filter(m_ulBank, m_pfWork, ulFrames);
+        Filter(m_ulBank ^ 1, m_pfFade, ulFrames);
+        Crossfade(m_pfWork, m_pfFade, ulFrames);
+    } else {
+        Filter(m_ulBank, m_pfWork, ulFrames);
+    }
+
+    if (m_ulStride != m_nChannels) {
+        for (i = 0; i < ulFrames; i++) {
+            RtlMoveMemory(m_pfWork + i * m_nChannels, m_pfWork + i * m_ulStride, m_nChannels * sizeof(FLOAT));
+        }
+    }
+
+    m_pKernels->FromFloat(m_pfWork, ulFrames, pOutput);
+
+#if !defined(_M_AMD64)
+    KeRestoreFloatingPointState(&floatSave);
+#endif
+} // Process
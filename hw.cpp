@@ -18,7 +18,7 @@ Abstract:
 
 //=============================================================================
 #pragma code_seg("PAGE")
-CMSVADHW::CMSVADHW() : m_ulMux(0), m_bDevSpecific(FALSE), m_iDevSpecific(0), m_uiDevSpecific(0)
+CMSVADHW::CMSVADHW() : m_lMixerGeneration(0), m_ulMeterTime(0), m_ulMux(0), m_bDevSpecific(FALSE), m_iDevSpecific(0), m_uiDevSpecific(0)
 /*++
 Routine Description:
   Constructor for MSVADHW. 
@@ -31,6 +31,8 @@ Return Value:
 {
     PAGED_CODE();
     
+    RtlZeroMemory((PVOID) m_MeterPeak, sizeof(m_MeterPeak));
+    RtlZeroMemory((PVOID) m_MeterRms, sizeof(m_MeterRms));
     MixerReset();
 } // CMSVADHW
 #pragma code_seg()
@@ -184,15 +186,80 @@ Return Value:
   LONG - volume level
 --*/
 {
-    UNREFERENCED_PARAMETER(lChannel);
-
     if (ulNode < MAX_TOPOLOGY_NODES) {
-        return m_VolumeControls[ulNode];
+        if ((lChannel < 0) || (lChannel >= MAX_TOPOLOGY_CHANNELS)) {
+            lChannel = 0;
+        }
+        return m_VolumeControls[ulNode][lChannel];
     }
 
     return 0;
 } // GetMixerVolume
 
+//=============================================================================
+ULONG CMSVADHW::GetMixerGeneration()
+/*++
+Routine Description:
+  Returns the mixer generation, which changes after every mute or volume
+  change. Readers take it before and after reading the controls and retry
+  if it moved, which gives them a consistent snapshot without a lock.
+
+Arguments:
+
+Return Value:
+  ULONG - generation
+--*/
+{
+    return (ULONG) m_lMixerGeneration;
+} // GetMixerGeneration
+
+//=============================================================================
+LONG CMSVADHW::GetMeterPeak(
+    IN  LONG                    lChannel
+)
+/*++
+Routine Description:
+  Gets the peak level of a channel in the last meter period. Each level is
+  a single aligned LONG, so it is read without a lock.
+
+Arguments:
+  lChannel - which channel
+
+Return Value:
+  LONG - linear peak, MAXLONG for full scale, 0 if the meter is stale
+--*/
+{
+    if ((lChannel < 0) || (lChannel >= MAX_TOPOLOGY_CHANNELS) ||
+        ((ULONG) (KeQueryInterruptTime() / 10000) - m_ulMeterTime > METER_TIMEOUT_MS)) {
+        return 0;
+    }
+
+    return m_MeterPeak[lChannel];
+} // GetMeterPeak
+
+//=============================================================================
+LONG CMSVADHW::GetMeterRms(
+    IN  LONG                    lChannel
+)
+/*++
+Routine Description:
+  Gets the RMS level of a channel in the last meter period.
+
+Arguments:
+  lChannel - which channel
+
+Return Value:
+  LONG - linear RMS, MAXLONG for full scale, 0 if the meter is stale
+--*/
+{
+    if ((lChannel < 0) || (lChannel >= MAX_TOPOLOGY_CHANNELS) ||
+        ((ULONG) (KeQueryInterruptTime() / 10000) - m_ulMeterTime > METER_TIMEOUT_MS)) {
+        return 0;
+    }
+
+    return m_MeterRms[lChannel];
+} // GetMeterRms
+
 //=============================================================================
 #pragma code_seg("PAGE")
 void CMSVADHW::MixerReset()
@@ -208,8 +275,11 @@ Return Value:
 {
     PAGED_CODE();
     
-    RtlFillMemory(m_VolumeControls, sizeof(LONG) * MAX_TOPOLOGY_NODES, 0xFF);
-    RtlFillMemory(m_MuteControls, sizeof(BOOL) * MAX_TOPOLOGY_NODES, TRUE);
+    // 0 dB and not muted, so the render stream is sent unchanged until the
+    // audio service restores the user's settings.
+    RtlZeroMemory(m_VolumeControls, sizeof(m_VolumeControls));
+    RtlZeroMemory(m_MuteControls, sizeof(m_MuteControls));
+    InterlockedIncrement(&m_lMixerGeneration);
     
     // BUGBUG change this depending on the topology
     m_ulMux = 2;
@@ -235,6 +305,7 @@ Return Value:
 {
     if (ulNode < MAX_TOPOLOGY_NODES) {
         m_MuteControls[ulNode] = fMute;
+        InterlockedIncrement(&m_lMixerGeneration);
     }
 } // SetMixerMute
 
@@ -268,16 +339,50 @@ Routine Description:
 
 Arguments:
   ulNode - topology node id
-  lChannel - which channel are we setting?
+  lChannel - which channel are we setting? -1 sets all of them.
   lVolume - volume level
 
 Return Value:
   void
 --*/
 {
-    UNREFERENCED_PARAMETER(lChannel);
-
     if (ulNode < MAX_TOPOLOGY_NODES) {
-        m_VolumeControls[ulNode] = lVolume;
+        if ((lChannel >= 0) && (lChannel < MAX_TOPOLOGY_CHANNELS)) {
+            m_VolumeControls[ulNode][lChannel] = lVolume;
+        } else if (lChannel == -1) {
+            for (ULONG ch = 0; ch < MAX_TOPOLOGY_CHANNELS; ch++) {
+                m_VolumeControls[ulNode][ch] = lVolume;
+            }
+        } else {
+            return;
+        }
+        InterlockedIncrement(&m_lMixerGeneration);
     }
 } // SetMixerVolume
+
+//=============================================================================
+void CMSVADHW::SetMeter(
+    IN  LONG                    lChannel,
+    IN  LONG                    lPeak,
+    IN  LONG                    lRms
+)
+/*++
+Routine Description:
+  Sets the levels of a channel for the last meter period. Called by the
+  render stream at DISPATCH_LEVEL.
+
+Arguments:
+  lChannel - which channel
+  lPeak - linear peak
+  lRms - linear RMS
+
+Return Value:
+  void
+--*/
+{
+    if ((lChannel >= 0) && (lChannel < MAX_TOPOLOGY_CHANNELS)) {
+        m_MeterPeak[lChannel] = lPeak;
+        m_MeterRms[lChannel]  = lRms;
+        m_ulMeterTime         = (ULONG) (KeQueryInterruptTime() / 10000);
+    }
+} // SetMeter
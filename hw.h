@@ -19,6 +19,11 @@ Abstract:
 //=============================================================================
 // BUGBUG we should dynamically allocate this...
 #define MAX_TOPOLOGY_NODES      20
+#define MAX_TOPOLOGY_CHANNELS   8
+
+// Meter levels not written for this long read as silence, so a stopped or
+// paused stream does not look like it is still playing.
+#define METER_TIMEOUT_MS        250
 
 //=============================================================================
 // Classes
@@ -31,7 +36,11 @@ Abstract:
 class CMSVADHW {
 protected:
     BOOL  m_MuteControls[MAX_TOPOLOGY_NODES];
-    LONG  m_VolumeControls[MAX_TOPOLOGY_NODES];
+    LONG  m_VolumeControls[MAX_TOPOLOGY_NODES][MAX_TOPOLOGY_CHANNELS];
+    volatile LONG m_lMixerGeneration;   // Bumped after every mute or volume change
+    volatile LONG m_MeterPeak[MAX_TOPOLOGY_CHANNELS];
+    volatile LONG m_MeterRms[MAX_TOPOLOGY_CHANNELS];
+    volatile ULONG m_ulMeterTime;       // Interrupt time in ms of the last meter write
     ULONG m_ulMux;            // Mux selection
     BOOL  m_bDevSpecific;
     INT   m_iDevSpecific;
@@ -56,6 +65,10 @@ public:
     void  SetMixerMux(IN ULONG ulNode);
     LONG  GetMixerVolume(IN ULONG ulNode, IN LONG lChannel);
     void  SetMixerVolume(IN ULONG ulNode, IN LONG lChannel, IN LONG lVolume);
+    ULONG GetMixerGeneration();
+    LONG  GetMeterPeak(IN LONG lChannel);
+    LONG  GetMeterRms(IN LONG lChannel);
+    void  SetMeter(IN LONG lChannel, IN LONG lPeak, IN LONG lRms);
 };
 typedef CMSVADHW* PCMSVADHW;
 
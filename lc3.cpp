@@ -0,0 +1,250 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    lc3.cpp
+
+Abstract:
+    Implementation of the LC3 codec wrapper.
+
+    LC3 is mono, so every channel gets its own encoder and frame. With 10 ms
+    frames the encoder adds 2.5 ms of look-ahead, with 7.5 ms frames 4 ms.
+    Calls into liblc3 are bracketed by an extended processor state save
+    because the library computes in floating point.
+
+    Only built when the sources file finds a liblc3, see LC3_ROOT there.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include "codec.h"
+
+#if defined(MSVAD_LC3)
+
+#include <lc3.h>
+
+//=============================================================================
+// Defines
+//=============================================================================
+#define LC3_XSTATE_MASK             (XSTATE_MASK_LEGACY | XSTATE_MASK_AVX)
+#define LC3_ENCODER_ALIGN           16
+
+#pragma code_seg("PAGE")
+//=============================================================================
+// CLc3Codec
+//=============================================================================
+
+//=============================================================================
+CLc3Codec::~CLc3Codec()
+{
+    PAGED_CODE();
+
+    if (m_pMemory) {
+        ExFreePoolWithTag(m_pMemory, MSVAD_POOLTAG);
+        m_pMemory = NULL;
+    }
+} // ~CLc3Codec
+
+//=============================================================================
+NTSTATUS CLc3Codec::Init(
+    IN  PWAVEFORMATEX           pWfx,
+    IN  PCODEC_SETTINGS         pSettings
+)
+/*++
+Routine Description:
+  LC3 takes 16 bit input at 8, 16, 24, 32 or 48 kHz in frames of 7.5 or
+  10 ms.
+
+Arguments:
+  pWfx - stream format.
+  pSettings - codec settings.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    NTSTATUS    ntStatus;
+    ULONG       ulEncoderSize;
+    PBYTE       pMemory;
+
+    if (pWfx->wBitsPerSample != 16) {
+        DPF(D_TERSE, ("LC3 needs 16 bit input"));
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    switch (pWfx->nSamplesPerSec) {
+        case 8000:
+        case 16000:
+        case 24000:
+        case 32000:
+        case 48000:
+            break;
+
+        default:
+            DPF(D_TERSE, ("LC3 does not support %d Hz", pWfx->nSamplesPerSec));
+            return STATUS_NOT_SUPPORTED;
+    }
+
+    if ((pSettings->FrameDuration != 7500) && (pSettings->FrameDuration != 10000)) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    ntStatus = CAudioCodec::Init(pWfx, pSettings);
+    if (!NT_SUCCESS(ntStatus)) {
+        return ntStatus;
+    }
+
+    m_ulFrameDuration = pSettings->FrameDuration;
+    m_ulFrameSize     = (ULONG) lc3_frame_samples(m_ulFrameDuration, m_nSamplesPerSec);
+    m_ulFrameBytes    = GetFrameBytes(pSettings->Bitrate);
+
+    ulEncoderSize = lc3_encoder_size(m_ulFrameDuration, m_nSamplesPerSec);
+    ulEncoderSize = (ulEncoderSize + LC3_ENCODER_ALIGN - 1) & ~(LC3_ENCODER_ALIGN - 1);
+
+    m_pMemory = ExAllocatePoolWithTag(NonPagedPool, ulEncoderSize * m_nChannels, MSVAD_POOLTAG);
+    if (!m_pMemory) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    pMemory = (PBYTE) m_pMemory;
+    for (ULONG ch = 0; ch < m_nChannels; ch++) {
+        m_pEncoder[ch] = lc3_setup_encoder(m_ulFrameDuration, m_nSamplesPerSec, 0, pMemory);
+        if (!m_pEncoder[ch]) {
+            DPF(D_TERSE, ("lc3_setup_encoder failed"));
+            return STATUS_UNSUCCESSFUL;
+        }
+        pMemory += ulEncoderSize;
+    }
+
+    return STATUS_SUCCESS;
+} // Init
+
+//=============================================================================
+ULONG CLc3Codec::GetFrameBytes(
+    IN  ULONG                   ulBitrate
+)
+/*++
+Routine Description:
+  Size of the frame of one channel for the given total bitrate.
+
+Arguments:
+  ulBitrate - bits per second of all channels.
+
+Return Value:
+  Bytes per channel and frame.
+--*/
+{
+    PAGED_CODE();
+
+    ULONG ulBytes = (ULONG) ((ULONGLONG) (ulBitrate / m_nChannels) * m_ulFrameDuration / 8000000);
+
+    return min(max(ulBytes, LC3_MIN_FRAME_BYTES), LC3_MAX_FRAME_BYTES);
+} // GetFrameBytes
+
+//=============================================================================
+ULONG CLc3Codec::GetFramesPerPacket(
+    IN  ULONG                   ulMaxPayload
+)
+{
+    PAGED_CODE();
+
+    return (ulMaxPayload >= m_nChannels * LC3_MAX_FRAME_BYTES) ? m_ulFrameSize : 0;
+} // GetFramesPerPacket
+
+//=============================================================================
+ULONG CLc3Codec::GetFrameSize(void)
+{
+    PAGED_CODE();
+
+    return m_ulFrameSize;
+} // GetFrameSize
+
+//=============================================================================
+ULONG CLc3Codec::GetAlgorithmicDelay(void)
+/*++
+Routine Description:
+  The encoder look-ahead plus the frame being collected.
+
+Arguments:
+
+Return Value:
+  Delay in frames.
+--*/
+{
+    PAGED_CODE();
+
+    return m_ulFrameSize + (ULONG) lc3_delay_samples(m_ulFrameDuration, m_nSamplesPerSec);
+} // GetAlgorithmicDelay
+
+//=============================================================================
+void CLc3Codec::SetBitrate(
+    IN  ULONG                   ulBitrate
+)
+{
+    PAGED_CODE();
+
+    m_ulFrameBytes = GetFrameBytes(ulBitrate);
+} // SetBitrate
+#pragma code_seg()
+
+//=============================================================================
+ULONG CLc3Codec::GetMaxOutputSize(
+    IN  ULONG                   ulFrames
+)
+{
+    UNREFERENCED_PARAMETER(ulFrames);
+
+    return m_nChannels * LC3_MAX_FRAME_BYTES;
+} // GetMaxOutputSize
+
+//=============================================================================
+ULONG CLc3Codec::Encode(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput
+)
+/*++
+Routine Description:
+  Encodes one LC3 frame per channel straight from the interleaved input.
+
+Arguments:
+  pInput - interleaved 16 bit samples.
+  ulFrames - frames to encode, always GetFrameSize().
+  pOutput - receives the frames.
+
+Return Value:
+  Payload length, 0 on failure.
+--*/
+{
+    ASSERT(ulFrames == m_ulFrameSize);
+    UNREFERENCED_PARAMETER(ulFrames);
+
+    XSTATE_SAVE xstateSave;
+    ULONG       ulFrameBytes = m_ulFrameBytes;
+    ULONG       ulPayload = 0;
+
+    if (!NT_SUCCESS(KeSaveExtendedProcessorState(LC3_XSTATE_MASK, &xstateSave))) {
+        return 0;
+    }
+
+    for (ULONG ch = 0; ch < m_nChannels; ch++) {
+        if (lc3_encode((lc3_encoder_t) m_pEncoder[ch], LC3_PCM_FORMAT_S16, (SHORT *) pInput + ch, m_nChannels, ulFrameBytes, pOutput + ulPayload)) {
+            ulPayload = 0;
+            break;
+        }
+        ulPayload += ulFrameBytes;
+    }
+
+    KeRestoreExtendedProcessorState(&xstateSave);
+
+    if (!ulPayload) {
+        DPF(D_TERSE, ("lc3_encode failed"));
+    }
+
+    return ulPayload;
+} // Encode
+
+#endif
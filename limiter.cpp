@@ -0,0 +1,217 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    limiter.cpp
+
+Abstract:
+    Implementation of the look-ahead limiter.
+
+    Every frame needs the gain threshold / peak, or 1. A frame leaves the
+    delay line m_ulLookahead frames after it entered; the gain applied to
+    it is the average of the envelope over those frames, and the envelope
+    in each of them is at most the lowest needed gain of the window that
+    still holds the frame. So the average never exceeds the gain the frame
+    needs, while the gain moves down in a straight line rather than a step.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include "dsp.h"
+
+//=============================================================================
+// CLimiter
+//=============================================================================
+
+#pragma code_seg("PAGE")
+//=============================================================================
+CLimiter::CLimiter() : m_nChannels(0), m_ulLookahead(0), m_fThreshold(1.0f), m_fRelease(1.0f), m_pBuffers(NULL), m_pfDelay(NULL), m_pfEnvelope(NULL),
+    m_pfQueueGain(NULL), m_pulQueueFrame(NULL), m_ulQueueHead(0), m_ulQueueCount(0), m_ulFrame(0), m_ulPosition(0), m_fEnvelope(1.0f), m_fSum(0), m_lReduction(0)
+{
+    PAGED_CODE();
+} // CLimiter
+
+//=============================================================================
+CLimiter::~CLimiter()
+{
+    PAGED_CODE();
+
+    Free();
+} // ~CLimiter
+
+//=============================================================================
+void CLimiter::Free(void)
+{
+    PAGED_CODE();
+
+    if (m_pBuffers) {
+        ExFreePoolWithTag(m_pBuffers, MSVAD_POOLTAG);
+        m_pBuffers = NULL;
+    }
+} // Free
+
+//=============================================================================
+NTSTATUS CLimiter::Init(
+    IN  PAUDIONET_LIMITER       pSettings,
+    IN  ULONG                   ulRate,
+    IN  USHORT                  nChannels
+)
+/*++
+Routine Description:
+  Sizes the delay line for the look-ahead and starts at unity gain with
+  silence in the delay line.
+
+Arguments:
+  pSettings - limiter settings, validated by the miniport.
+  ulRate - sample rate of the frames.
+  nChannels - channels of the frames.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ULONG ulLookahead;
+
+    Free();
+
+    ulLookahead = max((ULONG) ((ULONGLONG) ulRate * pSettings->Lookahead / 1000000), 1);
+
+    m_pBuffers = ExAllocatePoolWithTag(NonPagedPool, ulLookahead * (nChannels + 1) * sizeof(FLOAT) + (ulLookahead + 1) * (sizeof(FLOAT) + sizeof(ULONG)), MSVAD_POOLTAG);
+    if (!m_pBuffers) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    m_nChannels     = nChannels;
+    m_ulLookahead   = ulLookahead;
+    m_pfDelay       = (FLOAT *) m_pBuffers;
+    m_pfEnvelope    = m_pfDelay + ulLookahead * nChannels;
+    m_pfQueueGain   = m_pfEnvelope + ulLookahead;
+    m_pulQueueFrame = (ULONG *) (m_pfQueueGain + ulLookahead + 1);
+    m_ulQueueHead   = 0;
+    m_ulQueueCount  = 0;
+    m_ulFrame       = 0;
+    m_ulPosition    = 0;
+    m_lReduction    = 0;
+
+    RtlZeroMemory(m_pfDelay, ulLookahead * nChannels * sizeof(FLOAT));
+
+#if !defined(_M_AMD64)
+    KFLOATING_SAVE floatSave;
+
+    if (!NT_SUCCESS(KeSaveFloatingPointState(&floatSave))) {
+        Free();
+        return STATUS_UNSUCCESSFUL;
+    }
+#endif
+
+    m_fThreshold = DspVolumeToGain(min(pSettings->Threshold, DSP_MAX_VOLUME));
+    m_fRelease   = 1.0f / max((ULONGLONG) ulRate * pSettings->Release / 1000, 1);
+    m_fEnvelope  = 1.0f;
+    m_fSum       = (FLOAT) ulLookahead;
+    for (ULONG i = 0; i < ulLookahead; i++) {
+        m_pfEnvelope[i] = 1.0f;
+    }
+
+#if !defined(_M_AMD64)
+    KeRestoreFloatingPointState(&floatSave);
+#endif
+
+    return STATUS_SUCCESS;
+} // Init
+#pragma code_seg()
+
+//=============================================================================
+void CLimiter::Process(
+    IN OUT FLOAT *              pfSamples,
+    IN  ULONG                   ulFrames
+)
+/*++
+Routine Description:
+  Runs the frames through the delay line with the limiter gain. Called
+  with the floating point state saved.
+
+Arguments:
+  pfSamples - interleaved frames, replaced by the delayed limited frames.
+  ulFrames - number of frames.
+
+Return Value:
+  void
+--*/
+{
+    ULONG ulQueueSize = m_ulLookahead + 1;
+    FLOAT fScale      = 1.0f / m_ulLookahead;
+    FLOAT fLowest     = 1.0f;
+
+    for (ULONG i = 0; i < ulFrames; i++) {
+        FLOAT * pfDelay = m_pfDelay + m_ulPosition * m_nChannels;
+        FLOAT   fPeak   = 0;
+        FLOAT   fNeeded = 1.0f;
+        FLOAT   fGain;
+        ULONG   c;
+
+        for (c = 0; c < m_nChannels; c++) {
+            FLOAT fAbs = (pfSamples[c] < 0) ? -pfSamples[c] : pfSamples[c];
+
+            if (fAbs > fPeak) {
+                fPeak = fAbs;
+            }
+        }
+        if (fPeak > m_fThreshold) {
+            fNeeded = m_fThreshold / fPeak;
+        }
+
+        // Window minimum: the head leaves once it is more than the
+        // look-ahead old, before the push, so the queue never holds more
+        // than the m_ulLookahead + 1 frames of the window. Entries behind the
+        // new one that need no less gain can never be the minimum again.
+        if (m_ulQueueCount && (m_ulFrame - m_pulQueueFrame[m_ulQueueHead] > m_ulLookahead)) {
+            m_ulQueueHead = (m_ulQueueHead + 1) % ulQueueSize;
+            m_ulQueueCount--;
+        }
+        while (m_ulQueueCount && (m_pfQueueGain[(m_ulQueueHead + m_ulQueueCount - 1) % ulQueueSize] >= fNeeded)) {
+            m_ulQueueCount--;
+        }
+        m_pfQueueGain[(m_ulQueueHead + m_ulQueueCount) % ulQueueSize]   = fNeeded;
+        m_pulQueueFrame[(m_ulQueueHead + m_ulQueueCount) % ulQueueSize] = m_ulFrame;
+        m_ulQueueCount++;
+
+        // Down at once, up with the release time constant.
+        if (m_pfQueueGain[m_ulQueueHead] < m_fEnvelope) {
+            m_fEnvelope = m_pfQueueGain[m_ulQueueHead];
+        } else {
+            m_fEnvelope += (m_pfQueueGain[m_ulQueueHead] - m_fEnvelope) * m_fRelease;
+        }
+
+        m_fSum += m_fEnvelope - m_pfEnvelope[m_ulPosition];
+        m_pfEnvelope[m_ulPosition] = m_fEnvelope;
+        fGain = m_fSum * fScale;
+        if (fGain < fLowest) {
+            fLowest = fGain;
+        }
+
+        for (c = 0; c < m_nChannels; c++) {
+            FLOAT fDelayed = pfDelay[c];
+
+            pfDelay[c]    = pfSamples[c];
+            pfSamples[c]  = fDelayed * fGain;
+        }
+        pfSamples += m_nChannels;
+
+        // Resum once per pass over the ring so rounding cannot build up.
+        m_ulFrame++;
+        if (++m_ulPosition == m_ulLookahead) {
+            m_ulPosition = 0;
+            m_fSum       = 0;
+            for (c = 0; c < m_ulLookahead; c++) {
+                m_fSum += m_pfEnvelope[c];
+            }
+        }
+    }
+
+    if (fLowest < 1.0f) {
+        m_lReduction = min(m_lReduction, DspGainToVolume(fLowest));
+    }
+} // Process
@@ -0,0 +1,776 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    lossless.cpp
+
+Abstract:
+    Implementation of the lossless codec.
+
+    Every channel of a payload is coded as a constant, verbatim, fixed
+    polynomial or LPC subframe, whichever is smallest, and stereo picks the
+    cheapest of left/right, left/side, side/right and mid/side. The size of
+    each candidate is bounded from the Rice partition sums before anything is
+    written, and a subframe never exceeds its verbatim size, so the payload
+    never exceeds the PCM payload of the same frames.
+
+    LPC analysis uses floating point. On x64 it is done with SSE2, which the
+    kernel preserves for us; on x86 the floating point state is saved around
+    the analysis and only the fixed predictors are used if that fails. The
+    decoder only needs integer arithmetic.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include "codec.h"
+
+#if defined(_M_AMD64)
+#include <emmintrin.h>
+#endif
+
+//=============================================================================
+// Defines
+//=============================================================================
+#define LOSSLESS_LPC_PRECISION      12      // Bits per quantized coefficient
+#define LOSSLESS_MAX_SHIFT          15
+#define LOSSLESS_MAX_FIXED_ORDER    4
+#define LOSSLESS_MAX_RICE_PARAMETER 31
+
+// Residuals and predictions stay in 32 bits: 17 bit samples times 12 bit
+// coefficients summed over 8 taps.
+C_ASSERT(LOSSLESS_MAX_LPC_ORDER <= 8);
+C_ASSERT(LOSSLESS_LPC_PRECISION <= 12);
+
+//=============================================================================
+// Statics
+//=============================================================================
+
+// Coefficients of the fixed predictors, order n in row n.
+static const LONG FixedCoefs[LOSSLESS_MAX_FIXED_ORDER + 1][LOSSLESS_MAX_FIXED_ORDER] = {
+    { 0,  0, 0,  0 },
+    { 1,  0, 0,  0 },
+    { 2, -1, 0,  0 },
+    { 3, -3, 1,  0 },
+    { 4, -6, 4, -1 }
+};
+
+//=============================================================================
+// Helper Functions
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+// Appends the low ulCount (at most 32) bits of ulValue.
+//
+__forceinline void PutBits(IN OUT PLOSSLESS_BIT_WRITER pWriter, IN ULONG ulValue, IN ULONG ulCount)
+{
+    pWriter->ullPending = (pWriter->ullPending << ulCount) | (ulValue & (ULONG) (((ULONGLONG) 1 << ulCount) - 1));
+    pWriter->ulBits    += ulCount;
+
+    while (pWriter->ulBits >= 8) {
+        pWriter->ulBits -= 8;
+        pWriter->pOutput[pWriter->ulBytes++] = (BYTE) (pWriter->ullPending >> pWriter->ulBits);
+    }
+}
+
+//-----------------------------------------------------------------------------
+__forceinline void PutRice(IN OUT PLOSSLESS_BIT_WRITER pWriter, IN ULONG ulValue, IN ULONG ulParameter)
+{
+    ULONG ulZeros = ulValue >> ulParameter;
+
+    while (ulZeros > 32) {
+        PutBits(pWriter, 0, 32);
+        ulZeros -= 32;
+    }
+    PutBits(pWriter, 0, ulZeros);
+    PutBits(pWriter, ((ULONG) 1 << ulParameter) | ulValue, ulParameter + 1);
+}
+
+//-----------------------------------------------------------------------------
+// Exponent e of x = m * 2^e with 0.5 <= m < 1, for positive normal x.
+//
+__forceinline LONG FloatExponent(IN FLOAT fValue)
+{
+    return (LONG) ((*(PULONG) &fValue >> 23) & 0xFF) - 126;
+}
+
+//-----------------------------------------------------------------------------
+// Piecewise linear log2, good to 0.09 and enough to pick an order.
+//
+__forceinline FLOAT Log2Approx(IN FLOAT fValue)
+{
+    ULONG ulBits = *(PULONG) &fValue;
+
+    return (FLOAT) ((LONG) ((ulBits >> 23) & 0xFF) - 127) + (FLOAT) (ulBits & 0x7FFFFF) / 8388608.0f;
+}
+
+#if defined(_M_AMD64)
+//-----------------------------------------------------------------------------
+// Low 32 bits of the lane products; SSE2 has no pmulld.
+//
+__forceinline __m128i MulLo32(IN __m128i a, IN __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd  = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Zigzag mapped residual of frames ulOrder..ulFrames-1 into pulResidual.
+//
+static void ComputeResidual
+(
+    IN  const LONG *            plSignal,
+    IN  ULONG                   ulFrames,
+    IN  const LONG *            plCoefs,
+    IN  ULONG                   ulOrder,
+    IN  ULONG                   ulShift,
+    OUT PULONG                  pulResidual
+)
+{
+    ULONG i = ulOrder;
+    ULONG j;
+
+#if defined(_M_AMD64)
+    __m128i coef[LOSSLESS_MAX_LPC_ORDER];
+    __m128i shift = _mm_cvtsi32_si128(ulShift);
+
+    for (j = 0; j < ulOrder; j++) {
+        coef[j] = _mm_set1_epi32(plCoefs[j]);
+    }
+
+    for (; i + 4 <= ulFrames; i += 4) {
+        __m128i sum = _mm_setzero_si128();
+
+        for (j = 0; j < ulOrder; j++) {
+            sum = _mm_add_epi32(sum, MulLo32(_mm_loadu_si128((const __m128i *) (plSignal + i - 1 - j)), coef[j]));
+        }
+
+        __m128i res = _mm_sub_epi32(_mm_loadu_si128((const __m128i *) (plSignal + i)), _mm_sra_epi32(sum, shift));
+        res = _mm_xor_si128(_mm_slli_epi32(res, 1), _mm_srai_epi32(res, 31));
+
+        _mm_storeu_si128((__m128i *) (pulResidual + i - ulOrder), res);
+    }
+#endif
+
+    for (; i < ulFrames; i++) {
+        LONG lSum = 0;
+
+        for (j = 0; j < ulOrder; j++) {
+            lSum += plCoefs[j] * plSignal[i - 1 - j];
+        }
+
+        LONG lResidual = plSignal[i] - (lSum >> ulShift);
+        pulResidual[i - ulOrder] = ((ULONG) lResidual << 1) ^ (ULONG) (lResidual >> 31);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Chooses the partition order and Rice parameters for a residual and returns
+// an upper bound of its coded size in bits. sum(u >> k) never exceeds
+// sum(u) >> k, so the bound only needs the partition sums.
+//
+static ULONG PlanResidual
+(
+    IN  const ULONG *           pulResidual,
+    IN  ULONG                   ulFrames,
+    IN  ULONG                   ulOrder,
+    OUT PLOSSLESS_SUBFRAME      pPlan
+)
+{
+    ULONG ulBest = MAXULONG;
+
+    for (ULONG p = 0; p <= LOSSLESS_MAX_PARTITION_ORDER; p++) {
+        ULONG ulSize  = ulFrames >> p;
+        ULONG ulParts = 1 << p;
+        ULONG ulBits  = 2;
+        ULONG ulParameters[1 << LOSSLESS_MAX_PARTITION_ORDER];
+        ULONG ulStart = 0;
+
+        if (ulSize <= ulOrder) {
+            break;
+        }
+
+        for (ULONG n = 0; n < ulParts; n++) {
+            ULONG     ulEnd   = (n == ulParts - 1) ? ulFrames - ulOrder : (n + 1) * ulSize - ulOrder;
+            ULONG     ulCount = ulEnd - ulStart;
+            ULONGLONG ullSum  = 0;
+            ULONGLONG ullMin  = ~(ULONGLONG) 0;
+
+            for (ULONG i = ulStart; i < ulEnd; i++) {
+                ullSum += pulResidual[i];
+            }
+
+            for (ULONG k = 0; k <= LOSSLESS_MAX_RICE_PARAMETER; k++) {
+                ULONGLONG ullCost = (ULONGLONG) ulCount * (k + 1) + (ullSum >> k);
+
+                if (ullCost < ullMin) {
+                    ullMin = ullCost;
+                    ulParameters[n] = k;
+                }
+            }
+
+            ulBits += 5 + (ULONG) ullMin;
+            ulStart = ulEnd;
+        }
+
+        if (ulBits < ulBest) {
+            ulBest = ulBits;
+            pPlan->PartitionOrder = p;
+            RtlCopyMemory(pPlan->Parameters, ulParameters, ulParts * sizeof(ULONG));
+        }
+    }
+
+    return ulBest;
+}
+
+//-----------------------------------------------------------------------------
+// Autocorrelation of lags 0..ulLags-1.
+//
+static void Autocorrelation(IN const FLOAT *pfData, IN ULONG ulCount, IN ULONG ulLags, OUT double *pdAutoc)
+{
+    for (ULONG l = 0; l < ulLags; l++) {
+        double dSum = 0;
+        ULONG  i = l;
+
+#if defined(_M_AMD64)
+        __m128d sum0 = _mm_setzero_pd();
+        __m128d sum1 = _mm_setzero_pd();
+
+        for (; i + 4 <= ulCount; i += 4) {
+            __m128 a = _mm_loadu_ps(pfData + i);
+            __m128 b = _mm_loadu_ps(pfData + i - l);
+
+            sum0 = _mm_add_pd(sum0, _mm_mul_pd(_mm_cvtps_pd(a), _mm_cvtps_pd(b)));
+            sum1 = _mm_add_pd(sum1, _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(a, a)), _mm_cvtps_pd(_mm_movehl_ps(b, b))));
+        }
+
+        sum0 = _mm_add_pd(sum0, sum1);
+        sum0 = _mm_add_sd(sum0, _mm_unpackhi_pd(sum0, sum0));
+        dSum = _mm_cvtsd_f64(sum0);
+#endif
+
+        for (; i < ulCount; i++) {
+            dSum += (double) pfData[i] * pfData[i - l];
+        }
+
+        pdAutoc[l] = dSum;
+    }
+}
+
+#pragma code_seg("PAGE")
+//=============================================================================
+// CLosslessCodec
+//=============================================================================
+
+//=============================================================================
+CLosslessCodec::~CLosslessCodec()
+{
+    PAGED_CODE();
+
+    if (m_plBuffer) {
+        ExFreePoolWithTag(m_plBuffer, MSVAD_POOLTAG);
+        m_plBuffer = NULL;
+    }
+} // ~CLosslessCodec
+
+//=============================================================================
+NTSTATUS CLosslessCodec::Init(
+    IN  PWAVEFORMATEX           pWfx,
+    IN  PCODEC_SETTINGS         pSettings
+)
+/*++
+Routine Description:
+  The lossless codec takes 8 or 16 bit PCM with up to CODEC_MAX_CHANNELS
+  channels. Allocates the scratch buffers for the largest datagram, so
+  Encode never allocates.
+
+Arguments:
+  pWfx - stream format.
+  pSettings - codec settings.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    NTSTATUS ntStatus;
+    ULONG    ulSignals;
+
+    if ((pWfx->wBitsPerSample != 8) && (pWfx->wBitsPerSample != 16)) {
+        DPF(D_TERSE, ("Lossless codec needs 8 or 16 bit input"));
+        return STATUS_NOT_SUPPORTED;
+    }
+    if (pWfx->nChannels > CODEC_MAX_CHANNELS) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    ntStatus = CAudioCodec::Init(pWfx, pSettings);
+    if (!NT_SUCCESS(ntStatus)) {
+        return ntStatus;
+    }
+
+    // Stereo also needs the mid and side signals.
+    ulSignals     = (m_nChannels == 2) ? 4 : m_nChannels;
+    m_ulMaxFrames = GetFramesPerPacket(AUDIONET_MAX_DATAGRAM - sizeof(AUDIONET_PACKET_HEADER));
+
+    // Signals, residual and windowed data, each m_ulMaxFrames long.
+    m_plBuffer = (PLONG) ExAllocatePoolWithTag(NonPagedPool, (ulSignals + 2) * m_ulMaxFrames * sizeof(LONG), MSVAD_POOLTAG);
+    if (!m_plBuffer) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    for (ULONG c = 0; c < ulSignals; c++) {
+        m_plSignal[c] = m_plBuffer + c * m_ulMaxFrames;
+    }
+    m_plResidual = m_plBuffer + ulSignals * m_ulMaxFrames;
+    m_pfWindowed = (FLOAT *) (m_plResidual + m_ulMaxFrames);
+
+    return STATUS_SUCCESS;
+} // Init
+
+//=============================================================================
+ULONG CLosslessCodec::GetFramesPerPacket(
+    IN  ULONG                   ulMaxPayload
+)
+/*++
+Routine Description:
+  Frames are sized for the verbatim worst case, so compression shrinks the
+  datagrams rather than reducing their number.
+
+Arguments:
+  ulMaxPayload - payload bytes available in one datagram.
+
+Return Value:
+  Frames per datagram.
+--*/
+{
+    PAGED_CODE();
+
+    ULONG ulHeaderBits = 4 + 2 * m_nChannels;
+
+    if (ulMaxPayload * 8 <= ulHeaderBits) {
+        return 0;
+    }
+
+    return (ulMaxPayload * 8 - ulHeaderBits) / (m_nChannels * m_wBitsPerSample);
+} // GetFramesPerPacket
+#pragma code_seg()
+
+//=============================================================================
+ULONG CLosslessCodec::GetMaxOutputSize(
+    IN  ULONG                   ulFrames
+)
+{
+    return (4 + m_nChannels * (2 + ulFrames * m_wBitsPerSample) + 7) / 8;
+} // GetMaxOutputSize
+
+//=============================================================================
+ULONG CLosslessCodec::Encode(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput
+)
+/*++
+Routine Description:
+  Encodes ulFrames frames as one frame of the lossless format.
+
+Arguments:
+  pInput - interleaved 8 bit unsigned or 16 bit signed samples.
+  ulFrames - frames to encode, at most the frames per packet.
+  pOutput - receives the frame.
+
+Return Value:
+  Payload length.
+--*/
+{
+    ASSERT(ulFrames && ulFrames <= m_ulMaxFrames);
+
+    LOSSLESS_BIT_WRITER writer = { pOutput, 0, 0, 0 };
+    ULONG               ulBits = m_wBitsPerSample;
+    BOOL                fLpc   = TRUE;
+    ULONG               c;
+    ULONG               i;
+
+#if !defined(_M_AMD64)
+    KFLOATING_SAVE      floatSave;
+
+    fLpc = NT_SUCCESS(KeSaveFloatingPointState(&floatSave));
+#endif
+
+    for (c = 0; c < m_nChannels; c++) {
+        PLONG plSignal = m_plSignal[c];
+
+        if (ulBits == 8) {
+            for (i = 0; i < ulFrames; i++) {
+                plSignal[i] = (LONG) pInput[i * m_nChannels + c] - 0x80;
+            }
+        } else {
+            for (i = 0; i < ulFrames; i++) {
+                plSignal[i] = ((SHORT *) pInput)[i * m_nChannels + c];
+            }
+        }
+    }
+
+    if (m_nChannels == 2) {
+        LOSSLESS_SUBFRAME plan[4];
+        ULONG             ulMode;
+        ULONG             ulCost;
+        PLONG             plLeft  = m_plSignal[0];
+        PLONG             plRight = m_plSignal[1];
+
+        for (i = 0; i < ulFrames; i++) {
+            m_plSignal[2][i] = (plLeft[i] + plRight[i]) >> 1;
+            m_plSignal[3][i] = plLeft[i] - plRight[i];
+        }
+
+        for (c = 0; c < 4; c++) {
+            PlanSubframe(m_plSignal[c], ulFrames, (c == 3) ? ulBits + 1 : ulBits, fLpc, &plan[c]);
+        }
+
+        // Subframes of the two channels in each channel assignment.
+        static const ULONG Modes[4][2] = { { 0, 1 }, { 0, 3 }, { 3, 1 }, { 2, 3 } };
+
+        ulMode = AUDIONET_LOSSLESS_CHANNELS_INDEPENDENT;
+        ulCost = plan[0].Bits + plan[1].Bits;
+        for (c = 1; c < 4; c++) {
+            if (plan[Modes[c][0]].Bits + plan[Modes[c][1]].Bits < ulCost) {
+                ulCost = plan[Modes[c][0]].Bits + plan[Modes[c][1]].Bits;
+                ulMode = c;
+            }
+        }
+
+        PutBits(&writer, ulMode, 4);
+        for (c = 0; c < 2; c++) {
+            ULONG s = Modes[ulMode][c];
+
+            WriteSubframe(&writer, m_plSignal[s], ulFrames, (s == 3) ? ulBits + 1 : ulBits, &plan[s]);
+        }
+    } else {
+        LOSSLESS_SUBFRAME plan;
+
+        PutBits(&writer, AUDIONET_LOSSLESS_CHANNELS_INDEPENDENT, 4);
+        for (c = 0; c < m_nChannels; c++) {
+            PlanSubframe(m_plSignal[c], ulFrames, ulBits, fLpc, &plan);
+            WriteSubframe(&writer, m_plSignal[c], ulFrames, ulBits, &plan);
+        }
+    }
+
+#if !defined(_M_AMD64)
+    if (fLpc) {
+        KeRestoreFloatingPointState(&floatSave);
+    }
+#endif
+
+    if (writer.ulBits) {
+        PutBits(&writer, 0, 8 - writer.ulBits);
+    }
+
+    ASSERT(writer.ulBytes <= GetMaxOutputSize(ulFrames));
+
+    return writer.ulBytes;
+} // Encode
+
+//=============================================================================
+void CLosslessCodec::PlanSubframe(
+    IN  PLONG                   plSignal,
+    IN  ULONG                   ulFrames,
+    IN  ULONG                   ulBits,
+    IN  BOOL                    fLpc,
+    OUT PLOSSLESS_SUBFRAME      pPlan
+)
+/*++
+Routine Description:
+  Picks the smallest subframe type for one signal. The fixed order is
+  chosen from the sums of the absolute differences of orders 0 to 4.
+
+Arguments:
+  plSignal - samples of the signal.
+  ulFrames - number of samples.
+  ulBits - bits per sample of the signal.
+  fLpc - whether floating point may be used.
+  pPlan - receives the subframe plan.
+
+Return Value:
+  void
+--*/
+{
+    ULONG i;
+
+    pPlan->Type = AUDIONET_LOSSLESS_SUBFRAME_CONSTANT;
+    pPlan->Bits = 2 + ulBits;
+    for (i = 1; i < ulFrames; i++) {
+        if (plSignal[i] != plSignal[0]) {
+            break;
+        }
+    }
+    if (i == ulFrames) {
+        return;
+    }
+
+    pPlan->Type = AUDIONET_LOSSLESS_SUBFRAME_VERBATIM;
+    pPlan->Bits = 2 + ulFrames * ulBits;
+
+    if (ulFrames > 2 * LOSSLESS_MAX_FIXED_ORDER) {
+        ULONGLONG ullError[LOSSLESS_MAX_FIXED_ORDER + 1] = { 0, 0, 0, 0, 0 };
+        ULONG     ulOrder = 0;
+
+        for (i = LOSSLESS_MAX_FIXED_ORDER; i < ulFrames; i++) {
+            LONG e0 = plSignal[i];
+            LONG e1 = e0 - plSignal[i - 1];
+            LONG e2 = e1 - (plSignal[i - 1] - plSignal[i - 2]);
+            LONG e3 = e2 - (plSignal[i - 1] - 2 * plSignal[i - 2] + plSignal[i - 3]);
+            LONG e4 = e3 - (plSignal[i - 1] - 3 * plSignal[i - 2] + 3 * plSignal[i - 3] - plSignal[i - 4]);
+
+            ullError[0] += (e0 < 0) ? -e0 : e0;
+            ullError[1] += (e1 < 0) ? -e1 : e1;
+            ullError[2] += (e2 < 0) ? -e2 : e2;
+            ullError[3] += (e3 < 0) ? -e3 : e3;
+            ullError[4] += (e4 < 0) ? -e4 : e4;
+        }
+        for (i = 1; i <= LOSSLESS_MAX_FIXED_ORDER; i++) {
+            if (ullError[i] < ullError[ulOrder]) {
+                ulOrder = i;
+            }
+        }
+
+        LOSSLESS_SUBFRAME fixed;
+
+        ComputeResidual(plSignal, ulFrames, FixedCoefs[ulOrder], ulOrder, 0, (PULONG) m_plResidual);
+        fixed.Type  = AUDIONET_LOSSLESS_SUBFRAME_FIXED;
+        fixed.Order = ulOrder;
+        fixed.Shift = 0;
+        fixed.Bits  = 2 + 3 + ulOrder * ulBits + PlanResidual((PULONG) m_plResidual, ulFrames, ulOrder, &fixed);
+        RtlCopyMemory(fixed.Coefs, FixedCoefs[ulOrder], sizeof(FixedCoefs[ulOrder]));
+
+        if (fixed.Bits < pPlan->Bits) {
+            *pPlan = fixed;
+        }
+    }
+
+    if (fLpc && (ulFrames > 4 * LOSSLESS_MAX_LPC_ORDER)) {
+        LOSSLESS_SUBFRAME lpc;
+
+        if (PlanLpc(plSignal, ulFrames, ulBits, &lpc) && (lpc.Bits < pPlan->Bits)) {
+            *pPlan = lpc;
+        }
+    }
+} // PlanSubframe
+
+//=============================================================================
+BOOL CLosslessCodec::PlanLpc(
+    IN  PLONG                   plSignal,
+    IN  ULONG                   ulFrames,
+    IN  ULONG                   ulBits,
+    OUT PLOSSLESS_SUBFRAME      pPlan
+)
+/*++
+Routine Description:
+  Levinson-Durbin on the autocorrelation of the Welch windowed signal. The
+  order is estimated from the prediction error of every order, then the
+  coefficients are quantized with error feedback.
+
+Arguments:
+  plSignal - samples of the signal.
+  ulFrames - number of samples, more than 4 * LOSSLESS_MAX_LPC_ORDER.
+  ulBits - bits per sample of the signal.
+  pPlan - receives the subframe plan.
+
+Return Value:
+  FALSE if the signal has no usable predictor.
+--*/
+{
+    double dAutoc[LOSSLESS_MAX_LPC_ORDER + 1];
+    double dLpc[LOSSLESS_MAX_LPC_ORDER];
+    double dCoefs[LOSSLESS_MAX_LPC_ORDER][LOSSLESS_MAX_LPC_ORDER];
+    double dError[LOSSLESS_MAX_LPC_ORDER];
+    double dErr;
+    ULONG  ulMaxOrder = LOSSLESS_MAX_LPC_ORDER;
+    ULONG  ulOrder;
+    FLOAT  fBest;
+    FLOAT  fHalf = (FLOAT) (ulFrames + 1) / 2;
+    ULONG  i;
+    ULONG  j;
+
+    for (i = 0; i < ulFrames; i++) {
+        FLOAT fPos = ((FLOAT) i + 0.5f - fHalf) / fHalf;
+
+        m_pfWindowed[i] = (FLOAT) plSignal[i] * (1.0f - fPos * fPos);
+    }
+
+    Autocorrelation(m_pfWindowed, ulFrames, LOSSLESS_MAX_LPC_ORDER + 1, dAutoc);
+    if (dAutoc[0] <= 0) {
+        return FALSE;
+    }
+
+    dErr = dAutoc[0];
+    for (i = 0; i < ulMaxOrder; i++) {
+        double r = -dAutoc[i + 1];
+
+        for (j = 0; j < i; j++) {
+            r -= dLpc[j] * dAutoc[i - j];
+        }
+        r /= dErr;
+
+        dLpc[i] = r;
+        for (j = 0; j < (i >> 1); j++) {
+            double dTmp = dLpc[j];
+
+            dLpc[j]         += r * dLpc[i - 1 - j];
+            dLpc[i - 1 - j] += r * dTmp;
+        }
+        if (i & 1) {
+            dLpc[j] += dLpc[j] * r;
+        }
+
+        dErr *= 1.0 - r * r;
+        for (j = 0; j <= i; j++) {
+            dCoefs[i][j] = -dLpc[j];
+        }
+        dError[i] = dErr;
+
+        if (dErr <= 0) {
+            ulMaxOrder = i + 1;
+            break;
+        }
+    }
+
+    // Bits per residual are about half the log2 of the mean squared error.
+    ulOrder = 0;
+    fBest   = 0;
+    for (i = 0; i < ulMaxOrder; i++) {
+        FLOAT fMse  = (FLOAT) (dError[i] / ulFrames);
+        FLOAT fCost = (FLOAT) ((i + 1) * (LOSSLESS_LPC_PRECISION + ulBits));
+
+        if (fMse > 1.0f) {
+            fCost += (FLOAT) (ulFrames - i - 1) * 0.5f * Log2Approx(fMse);
+        }
+        if (!i || (fCost < fBest)) {
+            fBest   = fCost;
+            ulOrder = i + 1;
+        }
+    }
+
+    // Quantize to LOSSLESS_LPC_PRECISION bits with the largest fitting shift.
+    FLOAT fMax = 0;
+    LONG  lShift;
+    LONG  lMax = (1 << (LOSSLESS_LPC_PRECISION - 1)) - 1;
+
+    for (j = 0; j < ulOrder; j++) {
+        FLOAT fAbs = (FLOAT) ((dCoefs[ulOrder - 1][j] < 0) ? -dCoefs[ulOrder - 1][j] : dCoefs[ulOrder - 1][j]);
+
+        fMax = max(fMax, fAbs);
+    }
+    if (fMax <= 0) {
+        return FALSE;
+    }
+
+    lShift = (LOSSLESS_LPC_PRECISION - 1) - FloatExponent(fMax);
+    if (lShift < 0) {
+        return FALSE;
+    }
+    if (lShift > LOSSLESS_MAX_SHIFT) {
+        lShift = LOSSLESS_MAX_SHIFT;
+    }
+
+    dErr = 0;
+    for (j = 0; j < ulOrder; j++) {
+        LONG lCoef;
+
+        dErr += dCoefs[ulOrder - 1][j] * (1 << lShift);
+        lCoef = (LONG) ((dErr < 0) ? dErr - 0.5 : dErr + 0.5);
+        lCoef = max(-lMax - 1, min(lMax, lCoef));
+        dErr -= lCoef;
+
+        pPlan->Coefs[j] = lCoef;
+    }
+
+    pPlan->Type  = AUDIONET_LOSSLESS_SUBFRAME_LPC;
+    pPlan->Order = ulOrder;
+    pPlan->Shift = lShift;
+
+    ComputeResidual(plSignal, ulFrames, pPlan->Coefs, ulOrder, lShift, (PULONG) m_plResidual);
+    pPlan->Bits = 2 + 3 + 4 + 4 + ulOrder * (LOSSLESS_LPC_PRECISION + ulBits) + PlanResidual((PULONG) m_plResidual, ulFrames, ulOrder, pPlan);
+
+    return TRUE;
+} // PlanLpc
+
+//=============================================================================
+void CLosslessCodec::WriteSubframe(
+    IN OUT PLOSSLESS_BIT_WRITER pWriter,
+    IN  PLONG                   plSignal,
+    IN  ULONG                   ulFrames,
+    IN  ULONG                   ulBits,
+    IN  PLOSSLESS_SUBFRAME      pPlan
+)
+/*++
+Routine Description:
+  Writes one subframe as planned. The residual is recomputed because the
+  scratch buffer holds the last candidate evaluated.
+
+Arguments:
+  pWriter - bit stream.
+  plSignal - samples of the signal.
+  ulFrames - number of samples.
+  ulBits - bits per sample of the signal.
+  pPlan - subframe plan.
+
+Return Value:
+  void
+--*/
+{
+    ULONG i;
+
+    PutBits(pWriter, pPlan->Type, 2);
+
+    switch (pPlan->Type) {
+        case AUDIONET_LOSSLESS_SUBFRAME_CONSTANT:
+            PutBits(pWriter, plSignal[0], ulBits);
+            return;
+
+        case AUDIONET_LOSSLESS_SUBFRAME_VERBATIM:
+            for (i = 0; i < ulFrames; i++) {
+                PutBits(pWriter, plSignal[i], ulBits);
+            }
+            return;
+
+        case AUDIONET_LOSSLESS_SUBFRAME_FIXED:
+            PutBits(pWriter, pPlan->Order, 3);
+            break;
+
+        case AUDIONET_LOSSLESS_SUBFRAME_LPC:
+            PutBits(pWriter, pPlan->Order - 1, 3);
+            PutBits(pWriter, LOSSLESS_LPC_PRECISION - 1, 4);
+            PutBits(pWriter, pPlan->Shift, 4);
+            for (i = 0; i < pPlan->Order; i++) {
+                PutBits(pWriter, pPlan->Coefs[i], LOSSLESS_LPC_PRECISION);
+            }
+            break;
+    }
+
+    for (i = 0; i < pPlan->Order; i++) {
+        PutBits(pWriter, plSignal[i], ulBits);
+    }
+
+    PULONG pulResidual = (PULONG) m_plResidual;
+    ULONG  ulParts     = 1 << pPlan->PartitionOrder;
+    ULONG  ulSize      = ulFrames >> pPlan->PartitionOrder;
+    ULONG  ulStart     = 0;
+
+    ComputeResidual(plSignal, ulFrames, pPlan->Coefs, pPlan->Order, pPlan->Shift, pulResidual);
+
+    PutBits(pWriter, pPlan->PartitionOrder, 2);
+    for (ULONG n = 0; n < ulParts; n++) {
+        ULONG ulEnd = (n == ulParts - 1) ? ulFrames - pPlan->Order : (n + 1) * ulSize - pPlan->Order;
+        ULONG k     = pPlan->Parameters[n];
+
+        PutBits(pWriter, k, 5);
+        for (i = ulStart; i < ulEnd; i++) {
+            PutRice(pWriter, pulResidual[i], k);
+        }
+        ulStart = ulEnd;
+    }
+} // WriteSubframe
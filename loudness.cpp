@@ -0,0 +1,464 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    loudness.cpp
+
+Abstract:
+    Implementation of the loudness meter and normalization.
+
+    The K-weighting of ITU-R BS.1770 is a high shelf followed by a high-pass,
+    designed here for the stream rate from their analog prototypes so any
+    rate gives the filters of the standard at 48 kHz. The filtered squares
+    are summed per channel over 100 ms sub-blocks; the gated blocks and the
+    windows of the momentary and short-term loudness are all made of whole
+    sub-blocks, so after filtering the per frame work is one multiply-add.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include "dsp.h"
+
+#if defined(_M_AMD64)
+#include <emmintrin.h>
+#endif
+
+//-----------------------------------------------------------------------------
+// Loudness in LUFS of a mean weighted power, DSP_MIN_DECIBELS for none.
+//
+static __forceinline FLOAT DspLufs(IN FLOAT fPower)
+{
+    return (fPower > 0) ? -0.691f + DspDecibels(fPower) / 2 : DSP_MIN_DECIBELS;
+}
+
+//-----------------------------------------------------------------------------
+// Loudness as reported, AUDIONET_LOUDNESS_NONE below the absolute gate.
+//
+static __forceinline LONG DspLufsToFixed(IN FLOAT fLufs)
+{
+    return (fLufs > DSP_LOUDNESS_MIN) ? (LONG) (fLufs * 65536) : AUDIONET_LOUDNESS_NONE;
+}
+
+//-----------------------------------------------------------------------------
+// tan(pi f / rate), the prewarped frequency of the bilinear transform.
+//
+static double DspPrewarp(IN double dFrequency, IN ULONG ulRate)
+{
+    double dOmega = DSP_PI * dFrequency / ulRate;
+
+    return DspSin(dOmega) / DspSin(dOmega + DSP_PI / 2);
+}
+
+#if defined(_M_AMD64)
+//-----------------------------------------------------------------------------
+// The first nLanes floats at pf, the other lanes zero, without reading
+// past them.
+//
+static __forceinline __m128 DspLoadLanes(IN const FLOAT *pf, IN ULONG nLanes)
+{
+    switch (nLanes) {
+        case 1:  return _mm_load_ss(pf);
+        case 2:  return _mm_castpd_ps(_mm_load_sd((const double *) pf));
+        case 3:  return _mm_movelh_ps(_mm_castpd_ps(_mm_load_sd((const double *) pf)), _mm_load_ss(pf + 2));
+        default: return _mm_loadu_ps(pf);
+    }
+}
+#endif
+
+//=============================================================================
+// CLoudness
+//=============================================================================
+
+#pragma code_seg("PAGE")
+//=============================================================================
+CLoudness::CLoudness() : m_nChannels(0), m_ulSubBlock(1), m_ulFrames(0), m_ulPower(0), m_ulPowers(0), m_ulBlocks(0), m_fIntegrated(DSP_MIN_DECIBELS),
+    m_fNormalize(FALSE), m_fTarget(0), m_fMaxGain(0), m_fGainDb(0), m_fGain(1.0f)
+{
+    PAGED_CODE();
+
+    RtlZeroMemory(m_aFilter, sizeof(m_aFilter));
+    RtlZeroMemory(m_afState, sizeof(m_afState));
+    RtlZeroMemory(m_afWeight, sizeof(m_afWeight));
+    RtlZeroMemory(m_afSum, sizeof(m_afSum));
+    RtlZeroMemory(m_afPower, sizeof(m_afPower));
+    RtlZeroMemory(m_aulHistogram, sizeof(m_aulHistogram));
+    RtlZeroMemory(m_adHistogram, sizeof(m_adHistogram));
+
+    m_Loudness.Momentary  = AUDIONET_LOUDNESS_NONE;
+    m_Loudness.ShortTerm  = AUDIONET_LOUDNESS_NONE;
+    m_Loudness.Integrated = AUDIONET_LOUDNESS_NONE;
+    m_Loudness.Gain       = 0;
+} // CLoudness
+
+//=============================================================================
+NTSTATUS CLoudness::Init(
+    IN  PWAVEFORMATEX           pWfx,
+    IN  PAUDIONET_NORMALIZATION pNormalization OPTIONAL
+)
+/*++
+Routine Description:
+  Designs the K-weighting filters for the stream rate, weights the channels
+  by their speaker positions and starts a new measurement. LFE channels are
+  left out and surround channels count 1.41 times; without a channel mask
+  the fourth of six or more channels is taken for LFE and those after it
+  for surrounds.
+
+Arguments:
+  pWfx - stream format.
+  pNormalization - normalization settings, NULL for none.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ULONG  ulMask = 0;
+    double dK;
+    double dA0;
+    double dVh;
+    double dVb;
+
+    if (!pWfx->nChannels || (pWfx->nChannels > CODEC_MAX_CHANNELS) || !pWfx->nSamplesPerSec) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    if ((pWfx->wFormatTag == WAVE_FORMAT_EXTENSIBLE) && (pWfx->cbSize >= sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX))) {
+        ulMask = ((PWAVEFORMATEXTENSIBLE) pWfx)->dwChannelMask;
+    }
+
+#if !defined(_M_AMD64)
+    KFLOATING_SAVE floatSave;
+
+    if (!NT_SUCCESS(KeSaveFloatingPointState(&floatSave))) {
+        return STATUS_UNSUCCESSFUL;
+    }
+#endif
+
+    // High shelf of about +4 dB above 1.5 kHz.
+    dK  = DspPrewarp(1681.974450955533, pWfx->nSamplesPerSec);
+    dVh = DspDecibelsToGain(3.999843853973347f);
+    dVb = DspDecibelsToGain(3.999843853973347f * 0.4996667741545416f);
+    dA0 = 1 + dK / 0.7071752369554196 + dK * dK;
+
+    m_aFilter[0].b0  = (FLOAT) ((dVh + dVb * dK / 0.7071752369554196 + dK * dK) / dA0);
+    m_aFilter[0].b1  = (FLOAT) (2 * (dK * dK - dVh) / dA0);
+    m_aFilter[0].b2  = (FLOAT) ((dVh - dVb * dK / 0.7071752369554196 + dK * dK) / dA0);
+    m_aFilter[0].na1 = (FLOAT) (-2 * (dK * dK - 1) / dA0);
+    m_aFilter[0].na2 = (FLOAT) (-(1 - dK / 0.7071752369554196 + dK * dK) / dA0);
+
+    // High-pass at 38 Hz.
+    dK  = DspPrewarp(38.13547087602444, pWfx->nSamplesPerSec);
+    dA0 = 1 + dK / 0.5003270373238773 + dK * dK;
+
+    m_aFilter[1].b0  = 1;
+    m_aFilter[1].b1  = -2;
+    m_aFilter[1].b2  = 1;
+    m_aFilter[1].na1 = (FLOAT) (-2 * (dK * dK - 1) / dA0);
+    m_aFilter[1].na2 = (FLOAT) (-(1 - dK / 0.5003270373238773 + dK * dK) / dA0);
+
+    for (ULONG c = 0; c < pWfx->nChannels; c++) {
+        ULONG ulSpeaker = ulMask & (0 - ulMask);
+
+        ulMask &= ulMask - 1;
+        if (!ulSpeaker && (pWfx->nChannels >= 6)) {
+            ulSpeaker = (c == 3) ? SPEAKER_LOW_FREQUENCY : (c > 3) ? SPEAKER_SIDE_LEFT : 0;
+        }
+
+        switch (ulSpeaker) {
+            case SPEAKER_LOW_FREQUENCY:
+                m_afWeight[c] = 0;
+                break;
+
+            case SPEAKER_BACK_LEFT:
+            case SPEAKER_BACK_RIGHT:
+            case SPEAKER_SIDE_LEFT:
+            case SPEAKER_SIDE_RIGHT:
+                m_afWeight[c] = 1.41f;
+                break;
+
+            default:
+                m_afWeight[c] = 1.0f;
+                break;
+        }
+    }
+
+    m_fNormalize = (pNormalization != NULL);
+    if (pNormalization) {
+        m_fTarget  = pNormalization->Target * (1.0f / 65536);
+        m_fMaxGain = pNormalization->MaxGain * (1.0f / 65536);
+    }
+    m_fGainDb     = 0;
+    m_fGain       = 1.0f;
+    m_fIntegrated = DSP_MIN_DECIBELS;
+
+#if !defined(_M_AMD64)
+    KeRestoreFloatingPointState(&floatSave);
+#endif
+
+    m_nChannels  = pWfx->nChannels;
+    m_ulSubBlock = max(pWfx->nSamplesPerSec * DSP_LOUDNESS_SUBBLOCK_MS / 1000, 1);
+    m_ulFrames   = 0;
+    m_ulPower    = 0;
+    m_ulPowers   = 0;
+    m_ulBlocks   = 0;
+
+    RtlZeroMemory(m_afState, sizeof(m_afState));
+    RtlZeroMemory(m_afSum, sizeof(m_afSum));
+    RtlZeroMemory(m_aulHistogram, sizeof(m_aulHistogram));
+    RtlZeroMemory(m_adHistogram, sizeof(m_adHistogram));
+
+    m_Loudness.Momentary  = AUDIONET_LOUDNESS_NONE;
+    m_Loudness.ShortTerm  = AUDIONET_LOUDNESS_NONE;
+    m_Loudness.Integrated = AUDIONET_LOUDNESS_NONE;
+    m_Loudness.Gain       = 0;
+
+    return STATUS_SUCCESS;
+} // Init
+#pragma code_seg()
+
+//=============================================================================
+void CLoudness::Filter(
+    IN  const FLOAT *           pfSamples,
+    IN  ULONG                   ulFrames
+)
+/*++
+Routine Description:
+  Runs both filters over the frames and adds the squares of their output
+  to the sums of the sub-block.
+
+Arguments:
+  pfSamples - interleaved frames.
+  ulFrames - number of frames.
+
+Return Value:
+  void
+--*/
+{
+    PDSP_BIQUAD pShelf    = &m_aFilter[0];
+    PDSP_BIQUAD pHighPass = &m_aFilter[1];
+    ULONG       i;
+
+#if defined(_M_AMD64)
+    __m128 b0     = _mm_set1_ps(pShelf->b0);
+    __m128 b1     = _mm_set1_ps(pShelf->b1);
+    __m128 b2     = _mm_set1_ps(pShelf->b2);
+    __m128 na1    = _mm_set1_ps(pShelf->na1);
+    __m128 na2    = _mm_set1_ps(pShelf->na2);
+    __m128 hna1   = _mm_set1_ps(pHighPass->na1);
+    __m128 hna2   = _mm_set1_ps(pHighPass->na2);
+    __m128 offset = _mm_set1_ps(DSP_DENORMAL_OFFSET);
+    __m128 square = _mm_set1_ps(DSP_LOUDNESS_OFFSET);
+
+    for (ULONG v = 0; v < m_nChannels; v += 4) {
+        ULONG         nLanes = min(m_nChannels - v, 4);
+        const FLOAT * pf     = pfSamples + v;
+        __m128        s1     = _mm_loadu_ps(m_afState[0][0] + v);
+        __m128        s2     = _mm_loadu_ps(m_afState[0][1] + v);
+        __m128        h1     = _mm_loadu_ps(m_afState[1][0] + v);
+        __m128        h2     = _mm_loadu_ps(m_afState[1][1] + v);
+        __m128        sum    = _mm_setzero_ps();
+
+        for (i = 0; i < ulFrames; i++) {
+            __m128 x = _mm_add_ps(DspLoadLanes(pf, nLanes), offset);
+            __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), s1);
+            __m128 z;
+
+            s1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b1, x), _mm_mul_ps(na1, y)), s2);
+            s2 = _mm_add_ps(_mm_mul_ps(b2, x), _mm_mul_ps(na2, y));
+
+            // The high-pass has b = 1, -2, 1.
+            y  = _mm_add_ps(y, offset);
+            z  = _mm_add_ps(y, h1);
+            h1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(hna1, z), _mm_add_ps(y, y)), h2);
+            h2 = _mm_add_ps(y, _mm_mul_ps(hna2, z));
+
+            z   = _mm_add_ps(z, square);
+            sum = _mm_add_ps(sum, _mm_mul_ps(z, z));
+            pf += m_nChannels;
+        }
+
+        _mm_storeu_ps(m_afState[0][0] + v, s1);
+        _mm_storeu_ps(m_afState[0][1] + v, s2);
+        _mm_storeu_ps(m_afState[1][0] + v, h1);
+        _mm_storeu_ps(m_afState[1][1] + v, h2);
+        _mm_storeu_ps(m_afSum + v, _mm_add_ps(_mm_loadu_ps(m_afSum + v), sum));
+    }
+#else
+    for (ULONG c = 0; c < m_nChannels; c++) {
+        const FLOAT * pf  = pfSamples + c;
+        FLOAT         s1  = m_afState[0][0][c];
+        FLOAT         s2  = m_afState[0][1][c];
+        FLOAT         h1  = m_afState[1][0][c];
+        FLOAT         h2  = m_afState[1][1][c];
+        FLOAT         sum = 0;
+
+        for (i = 0; i < ulFrames; i++) {
+            FLOAT x = *pf + DSP_DENORMAL_OFFSET;
+            FLOAT y = pShelf->b0 * x + s1;
+            FLOAT z;
+
+            s1 = pShelf->b1 * x + pShelf->na1 * y + s2;
+            s2 = pShelf->b2 * x + pShelf->na2 * y;
+
+            y += DSP_DENORMAL_OFFSET;
+            z  = y + h1;
+            h1 = pHighPass->na1 * z - 2 * y + h2;
+            h2 = y + pHighPass->na2 * z;
+
+            z   += DSP_LOUDNESS_OFFSET;
+            sum += z * z;
+            pf  += m_nChannels;
+        }
+
+        m_afState[0][0][c] = s1;
+        m_afState[0][1][c] = s2;
+        m_afState[1][0][c] = h1;
+        m_afState[1][1][c] = h2;
+        m_afSum[c]        += sum;
+    }
+#endif
+} // Filter
+
+//=============================================================================
+void CLoudness::UpdateIntegrated(void)
+/*++
+Routine Description:
+  Integrated loudness from the histogram of the blocks above the absolute
+  gate: the mean power of all of them gives the relative gate, and the
+  mean power of those in bins whose centre is above it the loudness.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    double dSum     = 0;
+    ULONG  ulBlocks = 0;
+    FLOAT  fGate;
+    ULONG  ulFirst;
+    ULONG  b;
+
+    for (b = 0; b < DSP_LOUDNESS_BINS; b++) {
+        dSum += m_adHistogram[b];
+    }
+
+    fGate   = (DspLufs((FLOAT) (dSum / m_ulBlocks)) - DSP_LOUDNESS_RELATIVE_GATE - DSP_LOUDNESS_MIN) * 10 - 0.5f;
+    ulFirst = (fGate < 0) ? 0 : min((ULONG) fGate + 1, DSP_LOUDNESS_BINS);
+
+    dSum = 0;
+    for (b = ulFirst; b < DSP_LOUDNESS_BINS; b++) {
+        dSum     += m_adHistogram[b];
+        ulBlocks += m_aulHistogram[b];
+    }
+
+    m_fIntegrated = ulBlocks ? DspLufs((FLOAT) (dSum / ulBlocks)) : DSP_MIN_DECIBELS;
+} // UpdateIntegrated
+
+//=============================================================================
+void CLoudness::EndSubBlock(void)
+/*++
+Routine Description:
+  Adds the power of the finished sub-block to the windows, updates the
+  loudness and moves the normalization gain a step towards the target.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    FLOAT fPower = 0;
+    FLOAT fMomentary;
+    FLOAT fShortTerm;
+    ULONG c;
+
+    for (c = 0; c < m_nChannels; c++) {
+        fPower    += m_afWeight[c] * m_afSum[c];
+        m_afSum[c] = 0;
+    }
+
+    m_afPower[m_ulPower] = fPower / m_ulFrames;
+    m_ulPower  = (m_ulPower + 1) % DSP_LOUDNESS_SHORT_TERM;
+    m_ulPowers = min(m_ulPowers + 1, DSP_LOUDNESS_SHORT_TERM);
+    m_ulFrames = 0;
+
+    if (m_ulPowers < DSP_LOUDNESS_MOMENTARY) {
+        return;
+    }
+
+    // The momentary window is a gating block.
+    fPower = 0;
+    for (c = 1; c <= DSP_LOUDNESS_MOMENTARY; c++) {
+        fPower += m_afPower[(m_ulPower + DSP_LOUDNESS_SHORT_TERM - c) % DSP_LOUDNESS_SHORT_TERM];
+    }
+    fPower    /= DSP_LOUDNESS_MOMENTARY;
+    fMomentary = DspLufs(fPower);
+
+    m_Loudness.Momentary = DspLufsToFixed(fMomentary);
+    if (fMomentary > DSP_LOUDNESS_MIN) {
+        ULONG ulBin = min((ULONG) ((fMomentary - DSP_LOUDNESS_MIN) * 10), DSP_LOUDNESS_BINS - 1);
+
+        m_aulHistogram[ulBin]++;
+        m_adHistogram[ulBin] += fPower;
+        m_ulBlocks++;
+        UpdateIntegrated();
+        m_Loudness.Integrated = DspLufsToFixed(m_fIntegrated);
+    }
+
+    if (m_ulPowers < DSP_LOUDNESS_SHORT_TERM) {
+        return;
+    }
+
+    fPower = 0;
+    for (c = 0; c < DSP_LOUDNESS_SHORT_TERM; c++) {
+        fPower += m_afPower[c];
+    }
+    fShortTerm = DspLufs(fPower / DSP_LOUDNESS_SHORT_TERM);
+
+    m_Loudness.ShortTerm = DspLufsToFixed(fShortTerm);
+
+    // Quiet passages keep the gain they have rather than being pulled up.
+    if (m_fNormalize && (fShortTerm > DSP_LOUDNESS_MIN) && (fShortTerm > m_fIntegrated - DSP_LOUDNESS_RELATIVE_GATE)) {
+        FLOAT fStep = min(max(m_fTarget - fShortTerm, -m_fMaxGain), m_fMaxGain) - m_fGainDb;
+
+        m_fGainDb += min(max(fStep, -DSP_LOUDNESS_SLEW), DSP_LOUDNESS_SLEW);
+        m_fGain    = DspDecibelsToGain(m_fGainDb);
+
+        m_Loudness.Gain = (LONG) (m_fGainDb * 65536);
+    }
+} // EndSubBlock
+
+//=============================================================================
+void CLoudness::Process(
+    IN  const FLOAT *           pfSamples,
+    IN  ULONG                   ulFrames
+)
+/*++
+Routine Description:
+  Measures the frames, a sub-block at a time.
+
+Arguments:
+  pfSamples - interleaved frames.
+  ulFrames - number of frames.
+
+Return Value:
+  void
+--*/
+{
+    while (ulFrames) {
+        ULONG ulCount = min(ulFrames, m_ulSubBlock - m_ulFrames);
+
+        Filter(pfSamples, ulCount);
+
+        pfSamples  += ulCount * m_nChannels;
+        ulFrames   -= ulCount;
+        m_ulFrames += ulCount;
+
+        if (m_ulFrames == m_ulSubBlock) {
+            EndSubBlock();
+        }
+    }
+} // Process
@@ -0,0 +1,199 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    meter.cpp
+
+Abstract:
+    Implementation of the stream meter.
+
+    The frames are measured by the MeterCopy kernel of their format while
+    WriteData copies them into the sender ring, so metering adds no pass
+    over the samples. Peaks and sums of squares are kept as floats for the
+    current period and turned into levels once it ends.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include "dsp.h"
+
+#if defined(_M_AMD64)
+#include <xmmintrin.h>
+#endif
+
+//-----------------------------------------------------------------------------
+// Square root without the C runtime. On x86 the exponent is halved for a
+// first guess within 6%, which four Newton steps take to full precision.
+//
+static FLOAT DspSqrt(IN FLOAT f)
+{
+#if defined(_M_AMD64)
+    return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(f)));
+#else
+    union {
+        FLOAT f;
+        LONG  l;
+    } u;
+    FLOAT g;
+
+    if (f <= 0) {
+        return 0;
+    }
+
+    u.f = f;
+    u.l = (u.l >> 1) + 0x1FC00000;
+    g   = u.f;
+    for (ULONG i = 0; i < 4; i++) {
+        g = 0.5f * (g + f / g);
+    }
+
+    return g;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Linear level of 1.0 full scale as a LONG, MAXLONG and above clipped.
+//
+static __forceinline LONG DspLevel(IN FLOAT f)
+{
+    return (f >= 1.0f) ? MAXLONG : (LONG) (f * 2147483520.0f);
+}
+
+//=============================================================================
+// CMeter
+//=============================================================================
+
+#pragma code_seg("PAGE")
+//=============================================================================
+CMeter::CMeter() : m_pKernels(NULL), m_nChannels(0), m_nBlockAlign(0), m_ulPeriod(1), m_ulFrames(0)
+{
+    PAGED_CODE();
+
+    RtlZeroMemory(m_afPeak, sizeof(m_afPeak));
+    RtlZeroMemory(m_afSquares, sizeof(m_afSquares));
+    RtlZeroMemory(m_alPeak, sizeof(m_alPeak));
+    RtlZeroMemory(m_alRms, sizeof(m_alRms));
+} // CMeter
+
+//=============================================================================
+NTSTATUS CMeter::Init(
+    IN  PWAVEFORMATEX           pWfx
+)
+/*++
+Routine Description:
+  Selects the kernel for the stream format and starts a new period. Must
+  not be called while CopyFrames runs.
+
+Arguments:
+  pWfx - stream format.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    m_pKernels = DspGetKernels(pWfx, pWfx->nChannels);
+    if (!m_pKernels) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    m_nChannels   = pWfx->nChannels;
+    m_nBlockAlign = pWfx->nBlockAlign;
+    m_ulPeriod    = max(pWfx->nSamplesPerSec * DSP_METER_PERIOD_MS / 1000, 1);
+    m_ulFrames    = 0;
+
+    RtlZeroMemory(m_afPeak, sizeof(m_afPeak));
+    RtlZeroMemory(m_afSquares, sizeof(m_afSquares));
+    RtlZeroMemory(m_alPeak, sizeof(m_alPeak));
+    RtlZeroMemory(m_alRms, sizeof(m_alRms));
+
+    return STATUS_SUCCESS;
+} // Init
+#pragma code_seg()
+
+//=============================================================================
+void CMeter::EndPeriod(void)
+/*++
+Routine Description:
+  Turns the peaks and sums of the period into levels and starts the next
+  period. Called with the floating point state saved.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    FLOAT fScale = 1.0f / m_ulFrames;
+
+    for (ULONG c = 0; c < m_nChannels; c++) {
+        m_alPeak[c]    = DspLevel(m_afPeak[c]);
+        m_alRms[c]     = DspLevel(DspSqrt(m_afSquares[c] * fScale));
+        m_afPeak[c]    = 0;
+        m_afSquares[c] = 0;
+    }
+
+    m_ulFrames = 0;
+} // EndPeriod
+
+//=============================================================================
+BOOL CMeter::CopyFrames(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput
+)
+/*++
+Routine Description:
+  Copies the frames and measures them, ending a period whenever it is
+  full. If the floating point state cannot be saved the frames are only
+  copied.
+
+Arguments:
+  pInput - frames in the stream format.
+  ulFrames - number of frames.
+  pOutput - receives the frames.
+
+Return Value:
+  TRUE if a period ended.
+--*/
+{
+    BOOL fEnded = FALSE;
+
+    if (!m_pKernels) {
+        RtlCopyMemory(pOutput, pInput, ulFrames * m_nBlockAlign);
+        return FALSE;
+    }
+
+#if !defined(_M_AMD64)
+    KFLOATING_SAVE floatSave;
+
+    if (!NT_SUCCESS(KeSaveFloatingPointState(&floatSave))) {
+        RtlCopyMemory(pOutput, pInput, ulFrames * m_nBlockAlign);
+        return FALSE;
+    }
+#endif
+
+    while (ulFrames) {
+        ULONG ulCount = min(ulFrames, m_ulPeriod - m_ulFrames);
+
+        m_pKernels->MeterCopy(pInput, ulCount, pOutput, m_afPeak, m_afSquares);
+
+        pInput     += ulCount * m_nBlockAlign;
+        pOutput    += ulCount * m_nBlockAlign;
+        ulFrames   -= ulCount;
+        m_ulFrames += ulCount;
+
+        if (m_ulFrames == m_ulPeriod) {
+            EndPeriod();
+            fEnded = TRUE;
+        }
+    }
+
+#if !defined(_M_AMD64)
+    KeRestoreFloatingPointState(&floatSave);
+#endif
+
+    return fEnded;
+} // CopyFrames
@@ -28,22 +28,26 @@ CMiniportWaveCyclicStream::CMiniportWaveCyclicStream(PUNKNOWN other) : CUnknown(
 
     m_pMiniport = NULL;
     m_fCapture = FALSE;
-    m_fFormat16Bit = FALSE;
+    m_fFormat8Bit = FALSE;
     m_usBlockAlign = 0;
     m_ksState = KSSTATE_STOP;
     m_ulPin = (ULONG)-1;
 
-    m_pDpc = NULL;
-    m_pTimer = NULL;
+    m_ulNotificationInterval = 0;
+    RtlZeroMemory(&m_TimerEntry, sizeof(m_TimerEntry));
+    m_fTimerRegistered = FALSE;
 
+    KeInitializeSpinLock(&m_PositionLock);
     m_fDmaActive = FALSE;
-    m_ulDmaPosition = 0;
-    m_ullElapsedTimeCarryForward = 0;
-    m_ulByteDisplacementCarryForward = 0;
     m_pvDmaBuffer = NULL;
     m_ulDmaBufferSize = 0;
-    m_ulDmaMovementRate = 0;
-    m_ullDmaTimeStamp = 0;
+    m_ulSampleRate = 0;
+    m_ulMilliRate = 0;
+    m_lRateTrim = 0;
+    m_ullQpcFrequency = 1;
+    m_ullQpcStart = 0;
+    m_ullMilliFrames = 0;
+    m_ulMixerInput = (ULONG)-1;
 }
 
 //=============================================================================
@@ -62,14 +66,7 @@ Return Value:
 
     DPF_ENTER(("[CMiniportWaveCyclicStream::~CMiniportWaveCyclicStream]"));
 
-    if (m_pTimer) {
-        KeCancelTimer(m_pTimer);
-        ExFreePoolWithTag(m_pTimer, MSVAD_POOLTAG);
-    }
-
-    if (m_pDpc) {
-        ExFreePoolWithTag( m_pDpc, MSVAD_POOLTAG );
-    }
+    StopTimer();
 
     // Free the DMA buffer
     FreeBuffer();
@@ -77,8 +74,8 @@ Return Value:
     if (NULL != m_pMiniport) {
         if (m_fCapture) {
             m_pMiniport->m_fCaptureAllocated = FALSE;
-        } else {
-            m_pMiniport->m_fRenderAllocated = FALSE;
+        } else if (m_ulMixerInput != (ULONG)-1) {
+            m_pMiniport->m_Mixer.RemoveInput(m_ulMixerInput);
         }
     }
 } // ~CMiniportWaveCyclicStream
@@ -92,7 +89,7 @@ NTSTATUS CMiniportWaveCyclicStream::Init(
 )
 /*++
 Routine Description:
-  Initializes the stream object. Allocate a DMA buffer, timer and DPC
+  Initializes the stream object. Allocate a DMA buffer.
 
 Arguments:
   Miniport_ -
@@ -126,21 +123,18 @@ Return Value:
         m_ulPin                           = Pin_;
         m_fCapture                        = Capture_;
         m_usBlockAlign                    = pWfx->nBlockAlign;
-        m_fFormat16Bit                    = (pWfx->wBitsPerSample == 16);
+        m_fFormat8Bit                     = (pWfx->wBitsPerSample == 8);
         m_ksState                         = KSSTATE_STOP;
-        m_ulDmaPosition                   = 0;
-        m_ullElapsedTimeCarryForward      = 0;
-        m_ulByteDisplacementCarryForward  = 0;
+        m_ullMilliFrames                  = 0;
         m_fDmaActive                      = FALSE;
-        m_pDpc                            = NULL;
-        m_pTimer                          = NULL;
         m_pvDmaBuffer                     = NULL;
 
-        // If this is not the capture stream, create the output file.
+        // If this is not the capture stream, claim an input of the mixer.
+        // SetFormat below sets it up.
         if (!m_fCapture) {
-            ntStatus = m_SaveData.SetDataFormat(DataFormat_);
-            if (NT_SUCCESS(ntStatus)) {
-                ntStatus = m_SaveData.Initialize();
+            ntStatus = m_pMiniport->m_Mixer.AddInput(&m_ulMixerInput);
+            if (!NT_SUCCESS(ntStatus)) {
+                DPF(D_TERSE, ("[Only %d render streams supported]", MAX_INPUT_STREAMS));
             }
         }
     }
@@ -166,27 +160,6 @@ Return Value:
         ntStatus = SetFormat(DataFormat_);
     }
 
-    if (NT_SUCCESS(ntStatus)) {
-        m_pDpc = (PRKDPC) ExAllocatePoolWithTag(NonPagedPool, sizeof(KDPC), MSVAD_POOLTAG);
-        if (!m_pDpc) {
-            DPF(D_TERSE, ("[Could not allocate memory for DPC]"));
-            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
-        }
-    }
-
-    if (NT_SUCCESS(ntStatus)) {
-        m_pTimer = (PKTIMER) ExAllocatePoolWithTag(NonPagedPool, sizeof(KTIMER), MSVAD_POOLTAG);
-        if (!m_pTimer) {
-            DPF(D_TERSE, ("[Could not allocate memory for Timer]"));
-            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
-        }
-    }
-
-    if (NT_SUCCESS(ntStatus)) {
-        KeInitializeDpc(m_pDpc, TimerNotify, m_pMiniport);
-        KeInitializeTimerEx(m_pTimer, NotificationTimer);
-    }
-
     return ntStatus;
 } // Init
 
@@ -229,6 +202,61 @@ Return Value:
     return STATUS_INVALID_PARAMETER;
 } // NonDelegatingQueryInterface
 
+#pragma code_seg()
+//=============================================================================
+void CMiniportWaveCyclicStream::AdvancePosition(
+    IN  ULONGLONG               ullNow
+)
+/*++
+Routine Description:
+  Adds the frames moved at the current rate up to ullNow to the base
+  position and counts from ullNow on. Called with m_PositionLock held.
+
+Arguments:
+  ullNow - performance counter.
+
+Return Value:
+  void
+--*/
+{
+    m_ullMilliFrames += ScaleRatio(ullNow - m_ullQpcStart, m_ulMilliRate, m_ullQpcFrequency);
+    m_ullQpcStart     = ullNow;
+} // AdvancePosition
+
+//=============================================================================
+ULONGLONG CMiniportWaveCyclicStream::GetFramePosition(void)
+/*++
+Routine Description:
+  Returns the frames moved since the stream was stopped. While running they
+  are the frames that fit the performance counter ticks since the rate was
+  last set, computed from then each time, so the position cannot drift.
+  The render rate follows the clock of the receivers: when the sender
+  trims it, the position reached so far is kept and the new rate counts
+  from now. Thousandths of frames are kept so trims lose nothing. Called
+  with m_PositionLock held.
+
+Arguments:
+
+Return Value:
+  Frame position.
+--*/
+{
+    if (m_fDmaActive) {
+        ULONGLONG ullNow  = (ULONGLONG) KeQueryPerformanceCounter(NULL).QuadPart;
+        LONG      lTrim   = m_fCapture ? 0 : m_pMiniport->m_Mixer.GetRateTrim();
+
+        if (lTrim != m_lRateTrim) {
+            AdvancePosition(ullNow);
+            m_lRateTrim   = lTrim;
+            m_ulMilliRate = (ULONG) (((ULONGLONG) m_ulSampleRate * (1000000000 - lTrim) + 500000) / 1000000);
+        }
+
+        return (m_ullMilliFrames + ScaleRatio(ullNow - m_ullQpcStart, m_ulMilliRate, m_ullQpcFrequency)) / 1000;
+    }
+
+    return m_ullMilliFrames / 1000;
+} // GetFramePosition
+
 //=============================================================================
 STDMETHODIMP CMiniportWaveCyclicStream::GetPosition(
     OUT PULONG                  Position
@@ -246,40 +274,18 @@ Return Value:
   NT status code.
 --*/
 {
-    if (m_fDmaActive) {
-        // Get the current time
-        ULONGLONG CurrentTime = KeQueryInterruptTime();
-
-        // Calculate the time elapsed since the last call to GetPosition() or since the
-        // DMA engine started.  Note that the division by 10000 to convert to milliseconds
-        // may cause us to lose some of the time, so we will carry the remainder forward 
-        // to the next GetPosition() call.
-        ULONG TimeElapsedInMS = ((ULONG) (CurrentTime - m_ullDmaTimeStamp + m_ullElapsedTimeCarryForward)) / 10000;
+    ASSERT(Position);
 
-        // Carry forward the remainder of this division so we don't fall behind with our position.
-        m_ullElapsedTimeCarryForward = (CurrentTime - m_ullDmaTimeStamp + m_ullElapsedTimeCarryForward) % 10000;
+    ULONG ulOffset = 0;
+    KIRQL irql;
 
-        // Calculate how many bytes in the DMA buffer would have been processed in the elapsed
-        // time.  Note that the division by 1000 to convert to milliseconds may cause us to 
-        // lose some bytes, so we will carry the remainder forward to the next GetPosition() call.
-        ULONG ByteDisplacement = ((m_ulDmaMovementRate * TimeElapsedInMS) + m_ulByteDisplacementCarryForward) / 1000;
-
-        // Carry forward the remainder of this division so we don't fall behind with our position.
-        m_ulByteDisplacementCarryForward = ((m_ulDmaMovementRate * TimeElapsedInMS) + m_ulByteDisplacementCarryForward) % 1000;
-
-        // Increment the DMA position by the number of bytes displaced since the last
-        // call to GetPosition() and ensure we properly wrap at buffer length.
-        m_ulDmaPosition = (m_ulDmaPosition + ByteDisplacement) % m_ulDmaBufferSize;
-
-        // Return the new DMA position
-        *Position = m_ulDmaPosition;
-
-        // Update the DMA time stamp for the next call to GetPosition()
-        m_ullDmaTimeStamp = CurrentTime;
-    } else {
-        // DMA is inactive so just return the current DMA position.
-        *Position = m_ulDmaPosition;
+    KeAcquireSpinLock(&m_PositionLock, &irql);
+    if (m_ulDmaBufferSize) {
+        ulOffset = (ULONG) ((GetFramePosition() * m_usBlockAlign) % m_ulDmaBufferSize);
     }
+    KeReleaseSpinLock(&m_PositionLock, irql);
+
+    *Position = ulOffset;
 
     return STATUS_SUCCESS;
 } // GetPosition
@@ -304,11 +310,12 @@ Return Value:
 {
     ASSERT(PhysicalPosition);
 
-    *PhysicalPosition = (_100NS_UNITS_PER_SECOND / m_usBlockAlign * *PhysicalPosition) / m_pMiniport->m_SamplingFrequency;
+    *PhysicalPosition = (LONGLONG) ScaleRatio((ULONGLONG) *PhysicalPosition / m_usBlockAlign, _100NS_UNITS_PER_SECOND, m_ulSampleRate);
     
     return STATUS_SUCCESS;
 } // NormalizePhysicalPosition
 
+#pragma code_seg("PAGE")
 //=============================================================================
 STDMETHODIMP_(NTSTATUS) CMiniportWaveCyclicStream::SetFormat(
     IN  PKSDATAFORMAT           Format
@@ -334,6 +341,7 @@ Return Value:
 
     NTSTATUS      ntStatus = STATUS_INVALID_DEVICE_REQUEST;
     PWAVEFORMATEX pWfx;
+    KIRQL         irql;
 
     if (m_ksState != KSSTATE_RUN) {
         // MSVAD does not validate the format.
@@ -342,13 +350,18 @@ Return Value:
             ntStatus = KeWaitForSingleObject(&m_pMiniport->m_SampleRateSync, Executive, KernelMode, FALSE, NULL);
             if (STATUS_SUCCESS == ntStatus) {
                 if (!m_fCapture) {
-                    ntStatus = m_SaveData.SetDataFormat(Format);
+                    ntStatus = m_pMiniport->m_Mixer.SetInputFormat(m_ulMixerInput, Format);
                 }
 
                 m_usBlockAlign = pWfx->nBlockAlign;
-                m_fFormat16Bit = (pWfx->wBitsPerSample == 16);
+                m_fFormat8Bit = (pWfx->wBitsPerSample == 8);
                 m_pMiniport->m_SamplingFrequency = pWfx->nSamplesPerSec;
-                m_ulDmaMovementRate = pWfx->nAvgBytesPerSec;
+
+                KeAcquireSpinLock(&m_PositionLock, &irql);
+                m_ulSampleRate = pWfx->nSamplesPerSec;
+                m_ulMilliRate = pWfx->nSamplesPerSec * 1000;
+                m_lRateTrim = 0;
+                KeReleaseSpinLock(&m_PositionLock, irql);
 
                 DPF(D_TERSE, ("New Format - SpS: %d - BpS: %d - aBypS: %d - C: %d", pWfx->nSamplesPerSec, pWfx->wBitsPerSample, pWfx->nAvgBytesPerSec, pWfx->nChannels));
             }
@@ -387,11 +400,11 @@ Return Value:
 
     DPF_ENTER(("[CMiniportWaveCyclicStream::SetNotificationFreq]"));
 
-    m_pMiniport->m_NotificationInterval = Interval;
+    m_ulNotificationInterval = Interval;
 
-    *FramingSize = m_usBlockAlign * m_pMiniport->m_SamplingFrequency * Interval / 1000;
+    *FramingSize = m_usBlockAlign * m_ulSampleRate * Interval / 1000;
 
-    return m_pMiniport->m_NotificationInterval;
+    return m_ulNotificationInterval;
 } // SetNotificationFreq
 
 //=============================================================================
@@ -414,7 +427,9 @@ Return Value:
 
     DPF_ENTER(("[CMiniportWaveCyclicStream::SetState]"));
 
-    NTSTATUS ntStatus = STATUS_SUCCESS;
+    NTSTATUS      ntStatus = STATUS_SUCCESS;
+    LARGE_INTEGER frequency;
+    KIRQL         irql;
 
     // The acquire state is not distinguishable from the stop state for our
     // purposes.
@@ -427,47 +442,96 @@ Return Value:
             case KSSTATE_PAUSE:
                 DPF(D_TERSE, ("KSSTATE_PAUSE"));
                 
+                // Keep the frames moved so far for the next run.
+                KeAcquireSpinLock(&m_PositionLock, &irql);
+                if (m_fDmaActive) {
+                    AdvancePosition((ULONGLONG) KeQueryPerformanceCounter(NULL).QuadPart);
+                }
                 m_fDmaActive = FALSE;
+                KeReleaseSpinLock(&m_PositionLock, irql);
                 break;
 
             case KSSTATE_RUN:
                 DPF(D_TERSE, ("KSSTATE_RUN"));
 
-                LARGE_INTEGER   delay;
-
-                // Set the timer for DPC.
-                m_ullDmaTimeStamp             = KeQueryInterruptTime();
-                m_ullElapsedTimeCarryForward  = 0;
+                // Count frames from now, and set the notification timer.
+                KeAcquireSpinLock(&m_PositionLock, &irql);
+                m_ullQpcStart                 = (ULONGLONG) KeQueryPerformanceCounter(&frequency).QuadPart;
+                m_ullQpcFrequency             = (ULONGLONG) frequency.QuadPart;
                 m_fDmaActive                  = TRUE;
-                delay.HighPart                = 0;
-                delay.LowPart                 = m_pMiniport->m_NotificationInterval;
+                KeReleaseSpinLock(&m_PositionLock, irql);
 
-                KeSetTimerEx(m_pTimer, delay, m_pMiniport->m_NotificationInterval, m_pDpc);
+                StartTimer();
                 break;
 
             case KSSTATE_STOP:
                 DPF(D_TERSE, ("KSSTATE_STOP"));
     
+                KeAcquireSpinLock(&m_PositionLock, &irql);
                 m_fDmaActive                      = FALSE;
-                m_ulDmaPosition                   = 0;
-                m_ullElapsedTimeCarryForward      = 0;
-                m_ulByteDisplacementCarryForward  = 0;
+                m_ullMilliFrames                  = 0;
+                KeReleaseSpinLock(&m_PositionLock, irql);
     
-                KeCancelTimer(m_pTimer);
-    
-                // Wait until all work items are completed.
-                /*if (!m_fCapture) {
-                    m_SaveData.WaitAllWorkItems();
-                }*/
+                StopTimer();
                 break;
         }
 
+        // The mixer input follows, with the period the port copies at.
+        if (!m_fCapture) {
+            m_pMiniport->m_Mixer.SetInputState(m_ulMixerInput, NewState, m_TimerEntry.Period);
+        }
+
         m_ksState = NewState;
     }
 
     return ntStatus;
 } // SetState
 
+//=============================================================================
+void CMiniportWaveCyclicStream::StartTimer(void)
+/*++
+Routine Description:
+  Registers the stream with the adapter timer wheel, to notify the port
+  every notification interval of this stream from now.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    StopTimer();
+
+    m_TimerEntry.pfnNotify = TimerNotify;
+    m_TimerEntry.Context   = m_pMiniport;
+    m_TimerEntry.Period    = max(m_ulNotificationInterval, 1);
+
+    m_fTimerRegistered = NT_SUCCESS(m_pMiniport->m_AdapterCommon->TimerRegister(&m_TimerEntry));
+} // StartTimer
+
+//=============================================================================
+void CMiniportWaveCyclicStream::StopTimer(void)
+/*++
+Routine Description:
+  Unregisters the stream from the adapter timer wheel.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    if (m_fTimerRegistered) {
+        m_pMiniport->m_AdapterCommon->TimerUnregister(&m_TimerEntry);
+        m_fTimerRegistered = FALSE;
+    }
+} // StopTimer
+#pragma code_seg()
+
 //=============================================================================
 STDMETHODIMP_(void) CMiniportWaveCyclicStream::Silence(
     __out_bcount(ByteCount) PVOID Buffer,
@@ -487,7 +551,7 @@ Return Value:
   NT status code.
 --*/
 {
-    RtlFillMemory(Buffer, ByteCount, m_fFormat16Bit ? 0 : 0x80);
+    RtlFillMemory(Buffer, ByteCount, m_fFormat8Bit ? 0x80 : 0);
 } // Silence
 
 
@@ -625,7 +689,7 @@ Return Value:
 {
     UNREFERENCED_PARAMETER(Destination);
 
-    m_SaveData.WriteData((PBYTE) Source, ByteCount);
+    m_pMiniport->m_Mixer.WriteInput(m_ulMixerInput, (PBYTE) Source, ByteCount);
 } // CopyTo
 
 //=============================================================================
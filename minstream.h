@@ -11,7 +11,7 @@ Abstract:
 #ifndef _MSVAD_MINSTREAM_H_
 #define _MSVAD_MINSTREAM_H_
 
-#include "savedata.h"
+#include "mixer.h"
 
 //=============================================================================
 // Referenced Forward
@@ -30,24 +30,29 @@ class CMiniportWaveCyclicStream : public IMiniportWaveCyclicStream, public IDmaC
 protected:
 	PCMiniportWaveCyclic        m_pMiniport;                        // Miniport that created us
     BOOLEAN                     m_fCapture;                         // Capture or render.
-    BOOLEAN                     m_fFormat16Bit;                     // 16- or 8-bit samples.
+    BOOLEAN                     m_fFormat8Bit;                      // Unsigned 8-bit samples.
     USHORT                      m_usBlockAlign;                     // Block alignment of current format.
     KSSTATE                     m_ksState;                          // Stop, pause, run.
     ULONG                       m_ulPin;                            // Pin Id.
 
-    PRKDPC                      m_pDpc;                             // Deferred procedure call object
-    PKTIMER                     m_pTimer;                           // Timer object
+    ULONG                       m_ulNotificationInterval;           // Milliseconds.
+    TIMER_WHEEL_ENTRY           m_TimerEntry;                       // Notification on the adapter timer wheel
+    BOOLEAN                     m_fTimerRegistered;
 
+    // Guards m_fDmaActive and the rate and position fields below, which
+    // GetPosition reads and trims from the port DPC.
+    KSPIN_LOCK                  m_PositionLock;
     BOOLEAN                     m_fDmaActive;                       // Dma currently active? 
-    ULONG                       m_ulDmaPosition;                    // Position in Dma
     PVOID                       m_pvDmaBuffer;                      // Dma buffer pointer
     ULONG                       m_ulDmaBufferSize;                  // Size of dma buffer
-    ULONG                       m_ulDmaMovementRate;                // Rate of transfer specific to system
-    ULONGLONG                   m_ullDmaTimeStamp;                  // Dma time elasped 
-    ULONGLONG                   m_ullElapsedTimeCarryForward;       // Time to carry forward in position calc.
-    ULONG                       m_ulByteDisplacementCarryForward;   // Bytes to carry forward to next calc.
+    ULONG                       m_ulSampleRate;                     // Frames per second of current format.
+    ULONG                       m_ulMilliRate;                      // Thousandths of frames per second, trimmed.
+    LONG                        m_lRateTrim;                        // Receiver clock trim in m_ulMilliRate, ppb.
+    ULONGLONG                   m_ullQpcFrequency;                  // Performance counter ticks per second.
+    ULONGLONG                   m_ullQpcStart;                      // Performance counter when the rate was set.
+    ULONGLONG                   m_ullMilliFrames;                   // Thousandths of frames moved before then.
 
-    CSaveData                   m_SaveData;                         // Object to save settings.
+    ULONG                       m_ulMixerInput;                     // Of a render stream, or -1.
 
 public:
     DECLARE_STD_UNKNOWN();
@@ -58,6 +63,10 @@ public:
     IMP_IDmaChannel;
 
     NTSTATUS Init(IN PCMiniportWaveCyclic Miniport, IN ULONG Channel, IN  BOOLEAN Capture, IN PKSDATAFORMAT DataFormat);
+    ULONGLONG GetFramePosition(void);
+    void AdvancePosition(IN ULONGLONG ullNow);
+    void StartTimer(void);
+    void StopTimer(void);
 
     // Friends
     friend class                CMiniportWaveCyclic;
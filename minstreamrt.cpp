@@ -0,0 +1,901 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    minstreamrt.cpp
+
+Abstract:
+    Implementation of wavert stream.
+
+    The audio engine writes into the cyclic buffer ahead of the position
+    and reads the position when it likes. The position is the frame count
+    of the performance counter, like that of the wavecyclic stream, and
+    follows the receiver clock the same way. The engine may refill any part
+    of the buffer the position has passed, so frames go to the mixer
+    straight from the buffer before the position reported for them: the
+    adapter timer wheel hands over the rest of the current period before it
+    signals the notification events for it, and GetPosition hands over the
+    frames up to the position it returns.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include <common.h>
+#include "simple.h"
+#include "minwavert.h"
+#include "minstreamrt.h"
+
+#pragma code_seg("PAGE")
+
+//=============================================================================
+// CMiniportWaveRTStream
+//=============================================================================
+CMiniportWaveRTStream::CMiniportWaveRTStream(PUNKNOWN other) : CUnknown(other)
+{
+    PAGED_CODE();
+
+    m_pMiniport = NULL;
+    m_pPortStream = NULL;
+    m_fFormat8Bit = FALSE;
+    m_usBlockAlign = 0;
+    m_ksState = KSSTATE_STOP;
+    m_ulPin = (ULONG)-1;
+
+    RtlZeroMemory(&m_TimerEntry, sizeof(m_TimerEntry));
+    m_fTimerRegistered = FALSE;
+
+    KeInitializeSpinLock(&m_PositionLock);
+    m_fDmaActive = FALSE;
+    m_pBufferMdl = NULL;
+    m_pbBuffer = NULL;
+    m_ulBufferSize = 0;
+    m_ulNotificationCount = 0;
+    InitializeListHead(&m_NotificationEvents);
+    m_ullFramesSent = 0;
+    m_ullPeriod = 0;
+
+    m_ulSampleRate = 0;
+    m_ulMilliRate = 0;
+    m_lRateTrim = 0;
+    m_ullQpcFrequency = 1;
+    m_ullQpcStart = 0;
+    m_ullMilliFrames = 0;
+    m_ulMixerInput = (ULONG)-1;
+}
+
+//=============================================================================
+CMiniportWaveRTStream::~CMiniportWaveRTStream(void)
+/*++
+Routine Description:
+  Destructor for wavertstream
+
+Arguments:
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    DPF_ENTER(("[CMiniportWaveRTStream::~CMiniportWaveRTStream]"));
+
+    StopTimer();
+
+    // The port frees the buffer before it closes the pin; this is in case
+    // it did not.
+    if (m_pbBuffer) {
+        FreeBufferWithNotification(m_pBufferMdl, m_ulBufferSize);
+    }
+
+    while (!IsListEmpty(&m_NotificationEvents)) {
+        ExFreePoolWithTag(CONTAINING_RECORD(RemoveHeadList(&m_NotificationEvents), NOTIFICATION_EVENT, ListEntry), MSVAD_POOLTAG);
+    }
+
+    if (m_pPortStream) {
+        m_pPortStream->Release();
+    }
+
+    if ((NULL != m_pMiniport) && (m_ulMixerInput != (ULONG)-1)) {
+        m_pMiniport->m_Mixer.RemoveInput(m_ulMixerInput);
+    }
+} // ~CMiniportWaveRTStream
+
+//=============================================================================
+NTSTATUS CMiniportWaveRTStream::Init(
+    IN PCMiniportWaveRT             Miniport_,
+    IN PPORTWAVERTSTREAM            PortStream_,
+    IN ULONG                        Pin_,
+    IN PKSDATAFORMAT                DataFormat_
+)
+/*++
+Routine Description:
+  Initializes the stream object. The buffer is allocated later, when the
+  audio engine asks for it.
+
+Arguments:
+  Miniport_ -
+  PortStream_ -
+  Pin_ -
+  DataFormat -
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(Miniport_);
+    ASSERT(PortStream_);
+    ASSERT(DataFormat_);
+
+    NTSTATUS      ntStatus = STATUS_SUCCESS;
+    PWAVEFORMATEX pWfx;
+
+    pWfx = GetWaveFormatEx(DataFormat_);
+    if (!pWfx) {
+        DPF(D_TERSE, ("Invalid DataFormat param in NewStream"));
+        ntStatus = STATUS_INVALID_PARAMETER;
+    }
+
+    if (NT_SUCCESS(ntStatus)) {
+        m_pMiniport                       = Miniport_;
+
+        m_pPortStream                     = PortStream_;
+        m_pPortStream->AddRef();
+
+        m_ulPin                           = Pin_;
+        m_usBlockAlign                    = pWfx->nBlockAlign;
+        m_fFormat8Bit                     = (pWfx->wBitsPerSample == 8);
+        m_ksState                         = KSSTATE_STOP;
+        m_ullMilliFrames                  = 0;
+        m_fDmaActive                      = FALSE;
+
+        // Claim an input of the mixer, which SetFormat below sets up.
+        ntStatus = m_pMiniport->m_Mixer.AddInput(&m_ulMixerInput);
+        if (!NT_SUCCESS(ntStatus)) {
+            DPF(D_TERSE, ("[Only %d render streams supported]", MAX_INPUT_STREAMS));
+        }
+    }
+
+    if (NT_SUCCESS(ntStatus)) {
+        ntStatus = SetFormat(DataFormat_);
+    }
+
+    return ntStatus;
+} // Init
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveRTStream::NonDelegatingQueryInterface(
+    IN  REFIID  Interface,
+    OUT PVOID * Object
+)
+/*++
+Routine Description:
+  QueryInterface. Answering IMiniportWaveRTStreamNotification is what makes
+  the port offer the event driven mode to the audio engine.
+
+Arguments:
+  Interface - GUID
+  Object - interface pointer to be returned
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(Object);
+
+    if (IsEqualGUIDAligned(Interface, IID_IUnknown)) {
+        *Object = PVOID(PUNKNOWN(PMINIPORTWAVERTSTREAM(this)));
+    } else if (IsEqualGUIDAligned(Interface, IID_IMiniportWaveRTStream)) {
+        *Object = PVOID(PMINIPORTWAVERTSTREAM(this));
+    } else if (IsEqualGUIDAligned(Interface, IID_IMiniportWaveRTStreamNotification)) {
+        *Object = PVOID(PMINIPORTWAVERTSTREAMNOTIFICATION(this));
+    } else {
+        *Object = NULL;
+    }
+
+    if (*Object) {
+        PUNKNOWN(*Object)->AddRef();
+        return STATUS_SUCCESS;
+    }
+
+    return STATUS_INVALID_PARAMETER;
+} // NonDelegatingQueryInterface
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveRTStream::AllocateAudioBuffer(
+    IN  ULONG                   RequestedSize,
+    OUT PMDL *                  AudioBufferMdl,
+    OUT ULONG *                 ActualSize,
+    OUT ULONG *                 OffsetFromFirstPage,
+    OUT MEMORY_CACHING_TYPE *   CacheType
+)
+/*++
+Routine Description:
+  Allocates the buffer for an audio engine that polls the position.
+
+Arguments:
+  See AllocateBufferWithNotification.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    return AllocateBufferWithNotification(0, RequestedSize, AudioBufferMdl, ActualSize, OffsetFromFirstPage, CacheType);
+} // AllocateAudioBuffer
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveRTStream::AllocateBufferWithNotification(
+    IN  ULONG                   NotificationCount,
+    IN  ULONG                   RequestedSize,
+    OUT PMDL *                  AudioBufferMdl,
+    OUT ULONG *                 ActualSize,
+    OUT ULONG *                 OffsetFromFirstPage,
+    OUT MEMORY_CACHING_TYPE *   CacheType
+)
+/*++
+Routine Description:
+  Allocates the cyclic buffer the audio engine maps. It is cut down to the
+  largest buffer supported and to whole frames for every period, and
+  starts out silent. Nothing but the processor touches it, so it can be
+  anywhere and cached.
+
+Arguments:
+  NotificationCount - notifications per pass over the buffer, or 0.
+  RequestedSize - bytes the engine asks for.
+  AudioBufferMdl - receives the pages of the buffer.
+  ActualSize - receives the size in bytes.
+  OffsetFromFirstPage - receives where the buffer starts in its first page.
+  CacheType - receives the caching of the buffer.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(AudioBufferMdl);
+    ASSERT(ActualSize);
+    ASSERT(OffsetFromFirstPage);
+    ASSERT(CacheType);
+
+    DPF_ENTER(("[CMiniportWaveRTStream::AllocateBufferWithNotification]"));
+
+    PHYSICAL_ADDRESS highAddress;
+    PMDL             pMdl;
+    PBYTE            pbBuffer;
+    ULONG            ulSize;
+    KIRQL            irql;
+
+    if (m_pbBuffer) {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    ulSize  = min(RequestedSize, m_pMiniport->m_MaxDmaBufferSize);
+    ulSize -= ulSize % (m_usBlockAlign * max(NotificationCount, 1));
+    if (!ulSize) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    highAddress.QuadPart = MAXLONGLONG;
+
+    pMdl = m_pPortStream->AllocatePagesForMdl(highAddress, ulSize);
+    if (!pMdl) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    pbBuffer = (PBYTE) m_pPortStream->MapAllocatedPages(pMdl, MmCached);
+    if (!pbBuffer) {
+        m_pPortStream->FreePagesFromMdl(pMdl);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlFillMemory(pbBuffer, ulSize, m_fFormat8Bit ? 0x80 : 0);
+
+    KeAcquireSpinLock(&m_PositionLock, &irql);
+    m_pBufferMdl          = pMdl;
+    m_pbBuffer            = pbBuffer;
+    m_ulBufferSize        = ulSize;
+    m_ulNotificationCount = NotificationCount;
+    KeReleaseSpinLock(&m_PositionLock, irql);
+
+    DPF(D_TERSE, ("Buffer %d bytes, %d notifications", ulSize, NotificationCount));
+
+    *AudioBufferMdl      = pMdl;
+    *ActualSize          = ulSize;
+    *OffsetFromFirstPage = 0;
+    *CacheType           = MmCached;
+
+    return STATUS_SUCCESS;
+} // AllocateBufferWithNotification
+
+//=============================================================================
+STDMETHODIMP_(VOID) CMiniportWaveRTStream::FreeAudioBuffer(
+    IN  PMDL                    AudioBufferMdl,
+    IN  ULONG                   BufferSize
+)
+/*++
+Routine Description:
+  Frees the buffer of AllocateAudioBuffer.
+
+Arguments:
+  See FreeBufferWithNotification.
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    FreeBufferWithNotification(AudioBufferMdl, BufferSize);
+} // FreeAudioBuffer
+
+//=============================================================================
+STDMETHODIMP_(VOID) CMiniportWaveRTStream::FreeBufferWithNotification(
+    IN  PMDL                    AudioBufferMdl,
+    IN  ULONG                   BufferSize
+)
+/*++
+Routine Description:
+  Frees the cyclic buffer. The timer no longer sees it once the lock is
+  released, so it can be unmapped right away.
+
+Arguments:
+  AudioBufferMdl - pages of the buffer.
+  BufferSize - size in bytes.
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    UNREFERENCED_PARAMETER(BufferSize);
+
+    DPF_ENTER(("[CMiniportWaveRTStream::FreeBufferWithNotification]"));
+
+    PBYTE pbBuffer;
+    KIRQL irql;
+
+    KeAcquireSpinLock(&m_PositionLock, &irql);
+    pbBuffer              = m_pbBuffer;
+    m_pBufferMdl          = NULL;
+    m_pbBuffer            = NULL;
+    m_ulBufferSize        = 0;
+    m_ulNotificationCount = 0;
+    KeReleaseSpinLock(&m_PositionLock, irql);
+
+    if (pbBuffer) {
+        m_pPortStream->UnmapAllocatedPages(pbBuffer, AudioBufferMdl);
+        m_pPortStream->FreePagesFromMdl(AudioBufferMdl);
+    }
+} // FreeBufferWithNotification
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveRTStream::RegisterNotificationEvent(
+    IN  PKEVENT                 NotificationEvent
+)
+/*++
+Routine Description:
+  Adds an event to signal at the start of every period.
+
+Arguments:
+  NotificationEvent - event of the audio engine.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(NotificationEvent);
+
+    PNOTIFICATION_EVENT pEntry;
+    KIRQL               irql;
+
+    pEntry = (PNOTIFICATION_EVENT) ExAllocatePoolWithTag(NonPagedPool, sizeof(NOTIFICATION_EVENT), MSVAD_POOLTAG);
+    if (!pEntry) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    pEntry->pEvent = NotificationEvent;
+
+    KeAcquireSpinLock(&m_PositionLock, &irql);
+    InsertTailList(&m_NotificationEvents, &pEntry->ListEntry);
+    KeReleaseSpinLock(&m_PositionLock, irql);
+
+    return STATUS_SUCCESS;
+} // RegisterNotificationEvent
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveRTStream::UnregisterNotificationEvent(
+    IN  PKEVENT                 NotificationEvent
+)
+/*++
+Routine Description:
+  Removes an event of RegisterNotificationEvent.
+
+Arguments:
+  NotificationEvent - event of the audio engine.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    PNOTIFICATION_EVENT pEntry = NULL;
+    KIRQL               irql;
+
+    KeAcquireSpinLock(&m_PositionLock, &irql);
+    for (PLIST_ENTRY pListEntry = m_NotificationEvents.Flink; pListEntry != &m_NotificationEvents; pListEntry = pListEntry->Flink) {
+        if (CONTAINING_RECORD(pListEntry, NOTIFICATION_EVENT, ListEntry)->pEvent == NotificationEvent) {
+            pEntry = CONTAINING_RECORD(pListEntry, NOTIFICATION_EVENT, ListEntry);
+            RemoveEntryList(pListEntry);
+            break;
+        }
+    }
+    KeReleaseSpinLock(&m_PositionLock, irql);
+
+    if (!pEntry) {
+        return STATUS_NOT_FOUND;
+    }
+
+    ExFreePoolWithTag(pEntry, MSVAD_POOLTAG);
+
+    return STATUS_SUCCESS;
+} // UnregisterNotificationEvent
+
+//=============================================================================
+STDMETHODIMP_(VOID) CMiniportWaveRTStream::GetHWLatency(
+    OUT KSRTAUDIO_HWLATENCY *   hwLatency
+)
+/*++
+Routine Description:
+  Reports the latency of the hardware. Frames are sent as soon as the
+  position passes them, so there is none.
+
+Arguments:
+  hwLatency - receives the latency.
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(hwLatency);
+
+    hwLatency->FifoSize     = 0;
+    hwLatency->ChipsetDelay = 0;
+    hwLatency->CodecDelay   = 0;
+} // GetHWLatency
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveRTStream::GetPositionRegister(
+    OUT KSRTAUDIO_HWREGISTER *  Register
+)
+/*++
+Routine Description:
+  There is no hardware register holding the position, so the port asks
+  GetPosition, which counts it from the performance counter.
+
+Arguments:
+  Register -
+
+Return Value:
+  STATUS_NOT_SUPPORTED
+--*/
+{
+    PAGED_CODE();
+
+    UNREFERENCED_PARAMETER(Register);
+
+    return STATUS_NOT_SUPPORTED;
+} // GetPositionRegister
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveRTStream::GetClockRegister(
+    OUT KSRTAUDIO_HWREGISTER *  Register
+)
+/*++
+Routine Description:
+  There is no hardware clock register either.
+
+Arguments:
+  Register -
+
+Return Value:
+  STATUS_NOT_SUPPORTED
+--*/
+{
+    PAGED_CODE();
+
+    UNREFERENCED_PARAMETER(Register);
+
+    return STATUS_NOT_SUPPORTED;
+} // GetClockRegister
+#pragma code_seg()
+
+//=============================================================================
+void CMiniportWaveRTStream::AdvancePosition(
+    IN  ULONGLONG               ullNow
+)
+/*++
+Routine Description:
+  Adds the frames moved at the current rate up to ullNow to the base
+  position and counts from ullNow on. Called with m_PositionLock held.
+
+Arguments:
+  ullNow - performance counter.
+
+Return Value:
+  void
+--*/
+{
+    m_ullMilliFrames += ScaleRatio(ullNow - m_ullQpcStart, m_ulMilliRate, m_ullQpcFrequency);
+    m_ullQpcStart     = ullNow;
+} // AdvancePosition
+
+//=============================================================================
+ULONGLONG CMiniportWaveRTStream::GetFramePosition(void)
+/*++
+Routine Description:
+  Returns the frames moved since the stream was stopped, counted as by
+  the wavecyclic stream and trimmed to the receiver clock. Called with
+  m_PositionLock held.
+
+Arguments:
+
+Return Value:
+  Frame position.
+--*/
+{
+    if (m_fDmaActive) {
+        ULONGLONG ullNow  = (ULONGLONG) KeQueryPerformanceCounter(NULL).QuadPart;
+        LONG      lTrim   = m_pMiniport->m_Mixer.GetRateTrim();
+
+        if (lTrim != m_lRateTrim) {
+            AdvancePosition(ullNow);
+            m_lRateTrim   = lTrim;
+            m_ulMilliRate = (ULONG) (((ULONGLONG) m_ulSampleRate * (1000000000 - lTrim) + 500000) / 1000000);
+        }
+
+        return (m_ullMilliFrames + ScaleRatio(ullNow - m_ullQpcStart, m_ulMilliRate, m_ullQpcFrequency)) / 1000;
+    }
+
+    return m_ullMilliFrames / 1000;
+} // GetFramePosition
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveRTStream::GetPosition(
+    OUT PKSAUDIO_POSITION       Position
+)
+/*++
+Routine Description:
+  Gets the offset in the buffer of the frame being played. The frames up to
+  it are handed to the mixer first, so the write position is the same.
+  Callers of GetPosition should run at IRQL <= DISPATCH_LEVEL.
+
+Arguments:
+  Position - receives the offsets.
+
+Return Value:
+  NT status code.
+--*/
+{
+    ASSERT(Position);
+
+    ULONG ulOffset = 0;
+    KIRQL irql;
+
+    KeAcquireSpinLock(&m_PositionLock, &irql);
+    if (m_ulBufferSize) {
+        ULONGLONG ullPosition = GetFramePosition();
+
+        if (m_fDmaActive && m_pbBuffer) {
+            CopyFrames(ullPosition);
+        }
+        ulOffset = (ULONG) ((ullPosition * m_usBlockAlign) % m_ulBufferSize);
+    }
+    KeReleaseSpinLock(&m_PositionLock, irql);
+
+    Position->PlayOffset  = ulOffset;
+    Position->WriteOffset = ulOffset;
+
+    return STATUS_SUCCESS;
+} // GetPosition
+
+//=============================================================================
+void CMiniportWaveRTStream::CopyFrames(
+    IN  ULONGLONG               ullEnd
+)
+/*++
+Routine Description:
+  Hands the frames from the last one given to the mixer up to ullEnd to
+  it, straight from the buffer. After a stall longer than the buffer only
+  the last buffer of frames is still there to send. Called with
+  m_PositionLock held and the buffer mapped.
+
+Arguments:
+  ullEnd - frame position to send up to.
+
+Return Value:
+  void
+--*/
+{
+    ULONG ulBufferFrames = m_ulBufferSize / m_usBlockAlign;
+    ULONG ulFrames;
+    ULONG ulOffset;
+
+    if (ullEnd <= m_ullFramesSent) {
+        return;
+    }
+
+    ulFrames = (ULONG) min(ullEnd - m_ullFramesSent, ulBufferFrames);
+    ulOffset = (ULONG) ((ullEnd - ulFrames) % ulBufferFrames);
+
+    while (ulFrames) {
+        ULONG ulCount = min(ulFrames, ulBufferFrames - ulOffset);
+
+        m_pMiniport->m_Mixer.WriteInput(m_ulMixerInput, m_pbBuffer + ulOffset * m_usBlockAlign, ulCount * m_usBlockAlign);
+
+        ulOffset  = 0;
+        ulFrames -= ulCount;
+    }
+    m_ullFramesSent = ullEnd;
+} // CopyFrames
+
+//=============================================================================
+void CMiniportWaveRTStream::SendFrames(void)
+/*++
+Routine Description:
+  Hands frames to the mixer before the engine may refill them. With
+  notifications the engine refills a period once it is signalled that the
+  position left it, so the rest of the current period, which it filled
+  before, is sent before the events are signalled for it. Without them
+  the engine writes ahead of the position it polls, so the frames up to
+  the position are sent. Called by the timer wheel at DISPATCH_LEVEL.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    KeAcquireSpinLockAtDpcLevel(&m_PositionLock);
+
+    if (m_fDmaActive && m_pbBuffer) {
+        ULONG     ulBufferFrames = m_ulBufferSize / m_usBlockAlign;
+        ULONGLONG ullPosition    = GetFramePosition();
+
+        if (m_ulNotificationCount) {
+            ULONG     ulPeriodFrames = ulBufferFrames / m_ulNotificationCount;
+            ULONGLONG ullPeriod      = ullPosition / ulPeriodFrames;
+
+            CopyFrames((ullPeriod + 1) * ulPeriodFrames);
+
+            if (ullPeriod != m_ullPeriod) {
+                m_ullPeriod = ullPeriod;
+
+                for (PLIST_ENTRY pListEntry = m_NotificationEvents.Flink; pListEntry != &m_NotificationEvents; pListEntry = pListEntry->Flink) {
+                    KeSetEvent(CONTAINING_RECORD(pListEntry, NOTIFICATION_EVENT, ListEntry)->pEvent, 0, FALSE);
+                }
+            }
+        } else {
+            CopyFrames(ullPosition);
+        }
+    }
+
+    KeReleaseSpinLockFromDpcLevel(&m_PositionLock);
+} // SendFrames
+
+#pragma code_seg("PAGE")
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveRTStream::SetFormat(
+    IN  PKSDATAFORMAT           Format
+)
+/*++
+Routine Description:
+  The SetFormat function changes the format associated with a stream.
+  Once the buffer is allocated its frames must keep their size. Callers of
+  SetFormat should run at IRQL PASSIVE_LEVEL
+
+Arguments:
+  Format - Pointer to a KSDATAFORMAT structure which indicates the new format
+           of the stream.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(Format);
+
+    DPF_ENTER(("[CMiniportWaveRTStream::SetFormat]"));
+
+    NTSTATUS      ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+    PWAVEFORMATEX pWfx;
+
+    pWfx = GetWaveFormatEx(Format);
+    if (pWfx && (m_ksState != KSSTATE_RUN) && (!m_pbBuffer || (pWfx->nBlockAlign == m_usBlockAlign))) {
+        ntStatus = KeWaitForSingleObject(&m_pMiniport->m_SampleRateSync, Executive, KernelMode, FALSE, NULL);
+        if (STATUS_SUCCESS == ntStatus) {
+            ntStatus = m_pMiniport->m_Mixer.SetInputFormat(m_ulMixerInput, Format);
+
+            m_usBlockAlign = pWfx->nBlockAlign;
+            m_fFormat8Bit  = (pWfx->wBitsPerSample == 8);
+            m_ulSampleRate = pWfx->nSamplesPerSec;
+            m_ulMilliRate  = pWfx->nSamplesPerSec * 1000;
+            m_lRateTrim    = 0;
+
+            DPF(D_TERSE, ("New Format - SpS: %d - BpS: %d - aBypS: %d - C: %d", pWfx->nSamplesPerSec, pWfx->wBitsPerSample, pWfx->nAvgBytesPerSec, pWfx->nChannels));
+
+            KeReleaseMutex(&m_pMiniport->m_SampleRateSync, FALSE);
+        }
+    }
+
+    return ntStatus;
+} // SetFormat
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveRTStream::SetState(
+    IN  KSSTATE                 NewState
+)
+/*++
+Routine Description:
+  The SetState function sets the new state of playback or recording for the
+  stream. SetState should run at IRQL PASSIVE_LEVEL
+
+Arguments:
+  NewState - KSSTATE indicating the new state for the stream.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    DPF_ENTER(("[CMiniportWaveRTStream::SetState]"));
+
+    LARGE_INTEGER frequency;
+    KIRQL         irql;
+
+    // The acquire state is not distinguishable from the stop state for our
+    // purposes.
+    if (NewState == KSSTATE_ACQUIRE) {
+        NewState = KSSTATE_STOP;
+    }
+
+    if (m_ksState != NewState) {
+        switch(NewState) {
+            case KSSTATE_PAUSE:
+                DPF(D_TERSE, ("KSSTATE_PAUSE"));
+
+                // Keep the frames moved so far for the next run.
+                StopTimer();
+
+                KeAcquireSpinLock(&m_PositionLock, &irql);
+                if (m_fDmaActive) {
+                    AdvancePosition((ULONGLONG) KeQueryPerformanceCounter(NULL).QuadPart);
+                }
+                m_fDmaActive = FALSE;
+                KeReleaseSpinLock(&m_PositionLock, irql);
+                break;
+
+            case KSSTATE_RUN:
+                DPF(D_TERSE, ("KSSTATE_RUN"));
+
+                // Count frames from now, and send them on the timer wheel.
+                KeAcquireSpinLock(&m_PositionLock, &irql);
+                m_ullQpcStart     = (ULONGLONG) KeQueryPerformanceCounter(&frequency).QuadPart;
+                m_ullQpcFrequency = (ULONGLONG) frequency.QuadPart;
+                m_fDmaActive      = TRUE;
+                KeReleaseSpinLock(&m_PositionLock, irql);
+
+                StartTimer();
+                break;
+
+            case KSSTATE_STOP:
+                DPF(D_TERSE, ("KSSTATE_STOP"));
+
+                StopTimer();
+
+                KeAcquireSpinLock(&m_PositionLock, &irql);
+                m_fDmaActive     = FALSE;
+                m_ullMilliFrames = 0;
+                m_ullFramesSent  = 0;
+                m_ullPeriod      = 0;
+                KeReleaseSpinLock(&m_PositionLock, irql);
+                break;
+        }
+
+        // The mixer input follows, with the period the frames are sent at.
+        m_pMiniport->m_Mixer.SetInputState(m_ulMixerInput, NewState, m_TimerEntry.Period);
+
+        m_ksState = NewState;
+    }
+
+    return STATUS_SUCCESS;
+} // SetState
+
+//=============================================================================
+void CMiniportWaveRTStream::StartTimer(void)
+/*++
+Routine Description:
+  Registers the stream with the adapter timer wheel. With notifications it
+  runs twice a period, so no event is more than half a period late.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    ULONG ulPeriodFrames;
+
+    StopTimer();
+
+    m_TimerEntry.pfnNotify = TimerNotifyRT;
+    m_TimerEntry.Context   = this;
+    m_TimerEntry.Period    = WAVERT_SEND_INTERVAL;
+
+    if (m_ulNotificationCount && m_ulSampleRate) {
+        ulPeriodFrames       = m_ulBufferSize / m_usBlockAlign / m_ulNotificationCount;
+        m_TimerEntry.Period  = max(ulPeriodFrames * 500 / m_ulSampleRate, 1);
+    }
+
+    m_fTimerRegistered = NT_SUCCESS(m_pMiniport->m_AdapterCommon->TimerRegister(&m_TimerEntry));
+} // StartTimer
+
+//=============================================================================
+void CMiniportWaveRTStream::StopTimer(void)
+/*++
+Routine Description:
+  Unregisters the stream from the adapter timer wheel.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    if (m_fTimerRegistered) {
+        m_pMiniport->m_AdapterCommon->TimerUnregister(&m_TimerEntry);
+        m_fTimerRegistered = FALSE;
+    }
+} // StopTimer
+#pragma code_seg()
+
+//=============================================================================
+VOID TimerNotifyRT(
+    IN  PVOID                   Context
+)
+/*++
+Routine Description:
+  Timer wheel callback, at DISPATCH_LEVEL. It takes the place of the
+  interrupt of a WaveRT device.
+
+Arguments:
+  Context - the stream
+
+Return Value:
+  void
+--*/
+{
+    PCMiniportWaveRTStream pStream = (PCMiniportWaveRTStream) Context;
+
+    if (pStream) {
+        pStream->SendFrames();
+    }
+} // TimerNotifyRT
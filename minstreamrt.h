@@ -0,0 +1,108 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    minstreamrt.h
+
+Abstract:
+    Definition of wavert stream class.
+--*/
+
+#ifndef _MSVAD_MINSTREAMRT_H_
+#define _MSVAD_MINSTREAMRT_H_
+
+#include "mixer.h"
+
+//=============================================================================
+// Referenced Forward
+//=============================================================================
+class CMiniportWaveRT;
+typedef CMiniportWaveRT *PCMiniportWaveRT;
+
+//=============================================================================
+// Defines
+//=============================================================================
+
+// Milliseconds between sends while the audio engine polls the position
+// instead of waiting for notifications.
+#define WAVERT_SEND_INTERVAL        10
+
+//=============================================================================
+// Typedefs
+//=============================================================================
+
+// Event the audio engine waits on for the next period.
+typedef struct _NOTIFICATION_EVENT {
+    LIST_ENTRY      ListEntry;
+    PKEVENT         pEvent;
+} NOTIFICATION_EVENT;
+typedef NOTIFICATION_EVENT *PNOTIFICATION_EVENT;
+
+//=============================================================================
+// Function Prototypes
+//=============================================================================
+VOID TimerNotifyRT(IN PVOID Context);
+
+//=============================================================================
+// Classes
+//=============================================================================
+///////////////////////////////////////////////////////////////////////////////
+// CMiniportWaveRTStream
+//   Render stream on a cyclic buffer mapped to the audio engine. Frames are
+//   sent before the engine may refill them: the adapter timer wheel sends
+//   the current period and then signals the engine, and GetPosition sends
+//   up to the position it reports.
+
+class CMiniportWaveRTStream : public IMiniportWaveRTStreamNotification, public CUnknown {
+protected:
+    PCMiniportWaveRT            m_pMiniport;                        // Miniport that created us
+    PPORTWAVERTSTREAM           m_pPortStream;                      // Allocates and maps the buffer
+    BOOLEAN                     m_fFormat8Bit;                      // Unsigned 8-bit samples.
+    USHORT                      m_usBlockAlign;                     // Block alignment of current format.
+    KSSTATE                     m_ksState;                          // Stop, pause, run.
+    ULONG                       m_ulPin;                            // Pin Id.
+
+    TIMER_WHEEL_ENTRY           m_TimerEntry;                       // Sends on the adapter timer wheel
+    BOOLEAN                     m_fTimerRegistered;
+
+    // Everything the timer reads is guarded by m_PositionLock.
+    KSPIN_LOCK                  m_PositionLock;
+    BOOLEAN                     m_fDmaActive;                       // Position moving?
+    PMDL                        m_pBufferMdl;                       // Pages of the buffer
+    PBYTE                       m_pbBuffer;                         // Buffer mapped to system space
+    ULONG                       m_ulBufferSize;                     // Bytes, whole notification periods
+    ULONG                       m_ulNotificationCount;              // Notifications per buffer, or 0
+    LIST_ENTRY                  m_NotificationEvents;               // NOTIFICATION_EVENT
+    ULONGLONG                   m_ullFramesSent;                    // Frames given to the mixer, up to a period ahead
+    ULONGLONG                   m_ullPeriod;                        // Period of the last notification
+
+    ULONG                       m_ulSampleRate;                     // Frames per second of current format.
+    ULONG                       m_ulMilliRate;                      // Thousandths of frames per second, trimmed.
+    LONG                        m_lRateTrim;                        // Receiver clock trim in m_ulMilliRate, ppb.
+    ULONGLONG                   m_ullQpcFrequency;                  // Performance counter ticks per second.
+    ULONGLONG                   m_ullQpcStart;                      // Performance counter when the rate was set.
+    ULONGLONG                   m_ullMilliFrames;                   // Thousandths of frames moved before then.
+
+    ULONG                       m_ulMixerInput;                     // Input of the mixer, or -1.
+
+public:
+    DECLARE_STD_UNKNOWN();
+    CMiniportWaveRTStream(PUNKNOWN other);
+    ~CMiniportWaveRTStream();
+
+    IMP_IMiniportWaveRTStreamNotification;
+
+    NTSTATUS Init(IN PCMiniportWaveRT Miniport, IN PPORTWAVERTSTREAM PortStream, IN ULONG Pin, IN PKSDATAFORMAT DataFormat);
+    ULONGLONG GetFramePosition(void);
+    void AdvancePosition(IN ULONGLONG ullNow);
+    void CopyFrames(IN ULONGLONG ullEnd);
+    void SendFrames(void);
+    void StartTimer(void);
+    void StopTimer(void);
+
+    // Friends
+    friend class                CMiniportWaveRT;
+};
+typedef CMiniportWaveRTStream *PCMiniportWaveRTStream;
+
+#endif
@@ -387,6 +387,14 @@ Return Value:
 
     NTSTATUS ntStatus = STATUS_INVALID_DEVICE_REQUEST;
 
+    // The only private property on a node is the RMS of the peak meter.
+    if (IsEqualGUIDAligned(*PropertyRequest->PropertyItem->Set, KSPROPSETID_AudioNet)) {
+        if (PropertyRequest->PropertyItem->Id == KSPROPERTY_AUDIONET_RMS_METER) {
+            ntStatus = PropertyHandlerPeakMeter(PropertyRequest);
+        }
+        return ntStatus;
+    }
+
     switch (PropertyRequest->PropertyItem->Id) {
         case KSPROPERTY_AUDIO_VOLUMELEVEL:
             ntStatus = PropertyHandlerVolume(PropertyRequest);
@@ -408,6 +416,10 @@ Return Value:
             ntStatus = PropertyHandlerDevSpecific(PropertyRequest);
             break;
 
+        case KSPROPERTY_AUDIO_PEAKMETER:
+            ntStatus = PropertyHandlerPeakMeter(PropertyRequest);
+            break;
+
         default:
             DPF(D_TERSE, ("[PropertyHandlerGeneric: Invalid Device Request]"));
     }
@@ -505,6 +517,56 @@ Return Value:
     return ntStatus;
 } // PropertyHandlerMuxSource
 
+//=============================================================================
+NTSTATUS CMiniportTopology::PropertyHandlerPeakMeter(IN PPCPROPERTY_REQUEST PropertyRequest)
+/*++
+Routine Description:
+  Property handler for KSPROPERTY_AUDIO_PEAKMETER and
+  KSPROPERTY_AUDIONET_RMS_METER. The render stream publishes the levels
+  without a lock, so reading them never waits for the audio path.
+
+Arguments:
+  PropertyRequest - property request structure
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    DPF_ENTER(("[%s]",__FUNCTION__));
+
+    NTSTATUS ntStatus;
+    LONG     lChannel;
+
+    if (PropertyRequest->Verb & KSPROPERTY_TYPE_BASICSUPPORT) {
+        ntStatus = PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_BASICSUPPORT, VT_I4);
+    } else {
+        // level is a LONG, instance is the channel number
+        ntStatus = ValidatePropertyParams(PropertyRequest, sizeof(LONG), sizeof(LONG));
+        if (NT_SUCCESS(ntStatus)) {
+            lChannel = * (PLONG (PropertyRequest->Instance));
+
+            if ((lChannel < 0) || (lChannel >= AUDIONET_MAX_CHANNELS)) {
+                ntStatus = STATUS_INVALID_PARAMETER;
+            } else if (PropertyRequest->Verb & KSPROPERTY_TYPE_GET) {
+                if (PropertyRequest->PropertyItem->Id == KSPROPERTY_AUDIO_PEAKMETER) {
+                    *(PLONG (PropertyRequest->Value)) = m_AdapterCommon->MeterPeakRead(lChannel);
+                } else {
+                    *(PLONG (PropertyRequest->Value)) = m_AdapterCommon->MeterRmsRead(lChannel);
+                }
+                PropertyRequest->ValueSize = sizeof(LONG);
+            } else {
+                ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+            }
+        } else {
+            DPF(D_TERSE, ("[%s - ntStatus=0x%08x]",__FUNCTION__,ntStatus));
+        }
+    }
+
+    return ntStatus;
+} // PropertyHandlerPeakMeter
+
 //=============================================================================
 NTSTATUS CMiniportTopology::PropertyHandlerVolume(IN PPCPROPERTY_REQUEST PropertyRequest)
 /*++
@@ -47,6 +47,7 @@ public:
     NTSTATUS PropertyHandlerGeneric(IN PPCPROPERTY_REQUEST PropertyRequest);
     NTSTATUS PropertyHandlerMute(IN PPCPROPERTY_REQUEST PropertyRequest);
     NTSTATUS PropertyHandlerMuxSource(IN PPCPROPERTY_REQUEST PropertyRequest);
+    NTSTATUS PropertyHandlerPeakMeter(IN PPCPROPERTY_REQUEST PropertyRequest);
     NTSTATUS PropertyHandlerVolume(IN PPCPROPERTY_REQUEST PropertyRequest);
     NTSTATUS PropertyHandlerDevSpecific(IN PPCPROPERTY_REQUEST PropertyRequest);
 };
@@ -8,7 +8,7 @@ Module Name:
 
 Abstract:
 
-    Implementation of wavecyclic miniport.
+    Implementation of the wave miniport base and the wavecyclic miniport.
 
 --*/
 
@@ -19,47 +19,23 @@ Abstract:
 #include "simple.h"
 #include "minstream.h"
 #include "minwave.h"
+#include "minwavert.h"
 #include "wavtable.h"
 
+#define CB_EXTENSIBLE (sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX))
+
 #pragma code_seg("PAGE")
 
 //=============================================================================
-// CMiniportWaveCyclic
-//=============================================================================
-
+// CMiniportWave
 //=============================================================================
-NTSTATUS CreateMiniportWaveCyclicMSVAD( 
-    OUT PUNKNOWN *              Unknown,
-    IN  REFCLSID,
-    IN  PUNKNOWN                UnknownOuter OPTIONAL,
-    IN  POOL_TYPE               PoolType 
-)
-/*++
-Routine Description:
-  Create the wavecyclic miniport.
-
-Arguments:
-  Unknown - 
-  RefClsId -
-  UnknownOuter -
-  PoolType -
-
-Return Value:
-  NT status code.
---*/
-{
-    PAGED_CODE();
-
-    ASSERT(Unknown);
-
-    STD_CREATE_BODY(CMiniportWaveCyclic, Unknown, UnknownOuter, PoolType);
-}
 
 //=============================================================================
-CMiniportWaveCyclic::CMiniportWaveCyclic(PUNKNOWN other) : CUnknown(other)
+CMiniportWave::CMiniportWave(PUNKNOWN other) : CUnknown(other)
 /*++
 Routine Description:
-  Constructor for wavecyclic miniport.
+  Constructor for the wave miniport base. Render streams start with the
+  default codec settings.
 
 Arguments:
 
@@ -68,18 +44,37 @@ Return Value:
 {
     PAGED_CODE();
 
-    DPF_ENTER(("[CMiniportWaveCyclic::CMiniportWaveCyclic]"));
+    DPF_ENTER(("[CMiniportWave::CMiniportWave]"));
 
     // Initialize members.
+    m_fCaptureAllocated    = FALSE;
+
     m_AdapterCommon        = NULL;
-    m_Port                 = NULL;
     m_FilterDescriptor     = NULL;
 
-    m_NotificationInterval = 0;
-    m_SamplingFrequency    = 0;
-
-    m_ServiceGroup         = NULL;
     m_MaxDmaBufferSize     = DMA_BUFFER_SIZE;
+    m_CodecSettings.CodecId       = AUDIONET_CODEC_PCM;
+    m_CodecSettings.Bitrate       = CODEC_DEFAULT_BITRATE;
+    m_CodecSettings.Complexity    = CODEC_DEFAULT_COMPLEXITY;
+    m_CodecSettings.FrameDuration = CODEC_DEFAULT_FRAME_DURATION;
+    m_CodecSettings.BitDepth      = CODEC_DEFAULT_BIT_DEPTH;
+    m_CodecSettings.NoiseShaping  = CODEC_DEFAULT_NOISE_SHAPING;
+    m_CodecSettings.SampleRate    = CODEC_DEFAULT_SAMPLE_RATE;
+    RtlZeroMemory(&m_CodecSettings.ChannelMatrix, sizeof(m_CodecSettings.ChannelMatrix));
+    RtlZeroMemory(&m_CodecSettings.Destinations, sizeof(m_CodecSettings.Destinations));
+    RtlZeroMemory(m_CodecSettings.Equalizer, sizeof(m_CodecSettings.Equalizer));
+    m_CodecSettings.EqualizerGeneration = 0;
+    RtlZeroMemory(m_CodecSettings.Delay, sizeof(m_CodecSettings.Delay));
+    m_CodecSettings.Limiter.Lookahead = 0;
+    m_CodecSettings.Limiter.Threshold = CODEC_DEFAULT_LIMITER_THRESHOLD;
+    m_CodecSettings.Limiter.Release   = CODEC_DEFAULT_LIMITER_RELEASE;
+    m_CodecSettings.Normalization.Target  = 0;
+    m_CodecSettings.Normalization.MaxGain = CODEC_DEFAULT_NORMALIZATION_GAIN;
+    m_CodecStatus.LimiterReduction    = 0;
+    m_CodecStatus.Loudness.Momentary  = AUDIONET_LOUDNESS_NONE;
+    m_CodecStatus.Loudness.ShortTerm  = AUDIONET_LOUDNESS_NONE;
+    m_CodecStatus.Loudness.Integrated = AUDIONET_LOUDNESS_NONE;
+    m_CodecStatus.Loudness.Gain       = 0;
 
     m_MaxOutputStreams     = 0;
     m_MaxInputStreams      = 0;
@@ -91,13 +86,13 @@ Return Value:
     m_MaxBitsPerSamplePcm  = 0;
     m_MinSampleRatePcm     = 0;
     m_MaxSampleRatePcm     = 0;
-} // CMiniportWaveCyclic
+} // CMiniportWave
 
 //=============================================================================
-CMiniportWaveCyclic::~CMiniportWaveCyclic(void)
+CMiniportWave::~CMiniportWave(void)
 /*++
 Routine Description:
-  Destructor for wavecyclic miniport
+  Destructor for the wave miniport base.
 
 Arguments:
 
@@ -107,24 +102,92 @@ Return Value:
 {
     PAGED_CODE();
 
-    DPF_ENTER(("[CMiniportWaveCyclic::~CMiniportWaveCyclic]"));
-    
-    if (m_Port) {
-        m_Port->Release();
-    }
-
-    if (m_ServiceGroup) {
-        m_ServiceGroup->Release();
-    }
+    DPF_ENTER(("[CMiniportWave::~CMiniportWave]"));
 
     if (m_AdapterCommon) {
         m_AdapterCommon->Release();
     }
-} // ~CMiniportWaveCyclic
+} // ~CMiniportWave
+
+//=============================================================================
+NTSTATUS CMiniportWave::InitCommon(
+    IN  PUNKNOWN                UnknownAdapter
+)
+/*++
+Routine Description:
+  Sets the stream and format caps, gets the adapter common object and
+  hands it to the mixer. Called from the Init of the derived miniport.
+
+Arguments:
+  UnknownAdapter - IUnknown of the adapter common object.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
 
+    ASSERT(UnknownAdapter);
+
+    m_MaxOutputStreams      = MAX_OUTPUT_STREAMS;
+    m_MaxInputStreams       = MAX_INPUT_STREAMS;
+    m_MaxTotalStreams       = MAX_TOTAL_STREAMS;
+
+    m_MinChannels           = MIN_CHANNELS;
+    m_MaxChannelsPcm        = MAX_CHANNELS_PCM;
+
+    m_MinBitsPerSamplePcm   = MIN_BITS_PER_SAMPLE_PCM;
+    m_MaxBitsPerSamplePcm   = MAX_BITS_PER_SAMPLE_PCM;
+    m_MinSampleRatePcm      = MIN_SAMPLE_RATE;
+    m_MaxSampleRatePcm      = MAX_SAMPLE_RATE;
+
+    KeInitializeMutex(&m_SampleRateSync, 1);
+    KeInitializeMutex(&m_EqualizerSync, 1);
+
+    // Set filter descriptor.
+    m_FilterDescriptor   = &MiniportFilterDescriptor;
+
+    m_fCaptureAllocated  = FALSE;
+
+    // We want the IAdapterCommon interface on the adapter common object,
+    // which is given to us as a IUnknown.  The QueryInterface call gives us
+    // an AddRefed pointer to the interface we want.
+    //
+    NTSTATUS ntStatus = UnknownAdapter->QueryInterface(IID_IAdapterCommon, (PVOID *) &m_AdapterCommon);
+
+    if (NT_SUCCESS(ntStatus)) {
+        ntStatus = m_Mixer.Init(m_AdapterCommon, &m_CodecSettings, &m_CodecStatus);
+    }
+
+    return ntStatus;
+} // InitCommon
+
+
+//-----------------------------------------------------------------------------
+// Speaker positions of 1 to 8 channels, as the audio engine lays them out.
+//
+static const ULONG g_aulChannelMask[MAX_CHANNELS_PCM] = {
+    KSAUDIO_SPEAKER_MONO,
+    KSAUDIO_SPEAKER_STEREO,
+    KSAUDIO_SPEAKER_STEREO | SPEAKER_FRONT_CENTER,
+    KSAUDIO_SPEAKER_QUAD,
+    KSAUDIO_SPEAKER_QUAD | SPEAKER_FRONT_CENTER,
+    KSAUDIO_SPEAKER_5POINT1,
+    KSAUDIO_SPEAKER_5POINT1 | SPEAKER_BACK_CENTER,
+    KSAUDIO_SPEAKER_7POINT1_SURROUND
+};
+C_ASSERT(MAX_CHANNELS_PCM == 8);
+
+//-----------------------------------------------------------------------------
+// Value in [ulMin, ulMax] closest to ulValue.
+//
+static ULONG ClampRange(IN ULONG ulValue, IN ULONG ulMin, IN ULONG ulMax)
+{
+    return (ulValue < ulMin) ? ulMin : (ulValue > ulMax) ? ulMax : ulValue;
+}
 
 //=============================================================================
-STDMETHODIMP_(NTSTATUS) CMiniportWaveCyclic::DataRangeIntersection( 
+NTSTATUS CMiniportWave::DataRangeIntersection( 
     IN  ULONG                       PinId,
     IN  PKSDATARANGE                ClientDataRange,
     IN  PKSDATARANGE                MyDataRange,
@@ -137,14 +200,20 @@ Routine Description:
   The DataRangeIntersection function determines the highest quality 
   intersection of two data ranges.
 
+  Within the intersection the format the render streams send is proposed:
+  the network sample rate, the depth the codec takes and the channels the
+  channel matrix or the destination maps read, so the common case needs
+  no conversion at all. Whatever is not configured falls back to
+  PREFERRED_SAMPLE_RATE and to the highest depth and channel count.
+  Ranges other than wave format audio are left to portcls.
+
 Arguments:
   PinId -           Pin for which data intersection is being determined. 
   ClientDataRange - Pointer to KSDATARANGE structure which contains the data 
                     range submitted by client in the data range intersection 
                     property request. 
   MyDataRange -         Pin's data range to be compared with client's data 
-                        range. In this case we actually ignore our own data 
-                        range, because we know that we only support one range.
+                        range.
   OutputBufferLength -  Size of the buffer pointed to by the resultant format 
                         parameter. 
   ResultantFormat -     Pointer to value where the resultant format should be 
@@ -158,22 +227,153 @@ Return Value:
 --*/
 {
     UNREFERENCED_PARAMETER(PinId);
-    UNREFERENCED_PARAMETER(ClientDataRange);
-    UNREFERENCED_PARAMETER(MyDataRange);
-    UNREFERENCED_PARAMETER(OutputBufferLength);
-    UNREFERENCED_PARAMETER(ResultantFormat);
-    UNREFERENCED_PARAMETER(ResultantFormatLength);
 
     PAGED_CODE();
 
-    // This driver only supports PCM formats.
-    // Portcls will handle the request for us.
+    ASSERT(ClientDataRange);
+    ASSERT(MyDataRange);
+    ASSERT(ResultantFormatLength);
+
+    DPF_ENTER(("[CMiniportWave::DataRangeIntersection]"));
+
+    PKSDATARANGE_AUDIO          pMyRange = (PKSDATARANGE_AUDIO) MyDataRange;
+    PKSDATARANGE_AUDIO          pClientRange = (PKSDATARANGE_AUDIO) ClientDataRange;
+    PKSDATAFORMAT               pKsFormat = (PKSDATAFORMAT) ResultantFormat;
+    PWAVEFORMATEXTENSIBLE       pWfx;
+    PCODEC_SETTINGS             pSettings = &m_CodecSettings;
+    BOOL                        fFloat;
+    ULONG                       ulMinRate, ulMaxRate, ulRate;
+    ULONG                       ulMinBits, ulMaxBits, ulBits;
+    ULONG                       ulMaxChannels, ulChannels;
+
+    // Only the wave format audio ranges of the stream pins are handled; a
+    // client range without limits is a wildcard.
+    if (!IsEqualGUIDAligned(MyDataRange->Specifier, KSDATAFORMAT_SPECIFIER_WAVEFORMATEX) ||
+        !IsEqualGUIDAligned(ClientDataRange->MajorFormat, KSDATAFORMAT_TYPE_AUDIO) ||
+        (!IsEqualGUIDAligned(ClientDataRange->Specifier, KSDATAFORMAT_SPECIFIER_WAVEFORMATEX) &&
+         !IsEqualGUIDAligned(ClientDataRange->Specifier, KSDATAFORMAT_SPECIFIER_WILDCARD))) {
+        return STATUS_NOT_IMPLEMENTED;
+    }
+
+    if (!IsEqualGUIDAligned(ClientDataRange->SubFormat, KSDATAFORMAT_SUBTYPE_WILDCARD) &&
+        !IsEqualGUIDAligned(ClientDataRange->SubFormat, MyDataRange->SubFormat)) {
+        return STATUS_NO_MATCH;
+    }
+
+    ulMinRate     = pMyRange->MinimumSampleFrequency;
+    ulMaxRate     = pMyRange->MaximumSampleFrequency;
+    ulMinBits     = pMyRange->MinimumBitsPerSample;
+    ulMaxBits     = pMyRange->MaximumBitsPerSample;
+    ulMaxChannels = pMyRange->MaximumChannels;
+
+    if (ClientDataRange->FormatSize >= sizeof(KSDATARANGE_AUDIO)) {
+        ulMinRate     = max(ulMinRate, pClientRange->MinimumSampleFrequency);
+        ulMaxRate     = min(ulMaxRate, pClientRange->MaximumSampleFrequency);
+        ulMinBits     = max(ulMinBits, pClientRange->MinimumBitsPerSample);
+        ulMaxBits     = min(ulMaxBits, pClientRange->MaximumBitsPerSample);
+        ulMaxChannels = min(ulMaxChannels, pClientRange->MaximumChannels);
+    } else if (IsEqualGUIDAligned(ClientDataRange->Specifier, KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)) {
+        return STATUS_NOT_IMPLEMENTED;
+    }
+
+    // Samples are whole bytes.
+    ulMaxBits -= ulMaxBits % 8;
+    if ((ulMinRate > ulMaxRate) || (ulMinBits > ulMaxBits) || (ulMaxChannels < m_MinChannels)) {
+        return STATUS_NO_MATCH;
+    }
+
+    // The rate the codec sends.
+    ulRate = pSettings->SampleRate ? pSettings->SampleRate : PREFERRED_SAMPLE_RATE;
+    ulRate = ClampRange(ulRate, ulMinRate, ulMaxRate);
+
+    // The depth the codec takes without requantizing: the packed depth in
+    // its container, 16 bits for the companding and compressing codecs,
+    // and for PCM sent as is the highest depth.
+    fFloat = IsEqualGUIDAligned(MyDataRange->SubFormat, KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
+    switch (fFloat ? AUDIONET_CODEC_PCM : pSettings->CodecId) {
+        case AUDIONET_CODEC_PCM:
+        case AUDIONET_CODEC_PCM_NETWORK:
+            ulBits = ulMaxBits;
+            break;
+
+        case AUDIONET_CODEC_PACKED_PCM:
+            ulBits = pSettings->BitDepth ? (pSettings->BitDepth + 7) / 8 * 8 : ulMaxBits;
+            break;
+
+        default:
+            ulBits = 16;
+            break;
+    }
+    ulBits = ClampRange(ulBits, ulMinBits, ulMaxBits);
+    ulBits = (ulBits + 7) / 8 * 8;
+    if (ulBits > ulMaxBits) {
+        return STATUS_NO_MATCH;
+    }
+
+    // The channels the channel matrix or the destination maps read. Opus
+    // sends at most two; otherwise every channel is sent as is.
+    ulChannels = 0;
+    if (pSettings->ChannelMatrix.OutputChannels) {
+        for (ULONG o = 0; o < min(pSettings->ChannelMatrix.OutputChannels, AUDIONET_MAX_CHANNELS); o++) {
+            for (ULONG i = 0; i < AUDIONET_MAX_CHANNELS; i++) {
+                if (pSettings->ChannelMatrix.Gain[o][i]) {
+                    ulChannels = max(ulChannels, i + 1);
+                }
+            }
+        }
+    } else if (pSettings->Destinations.Count) {
+        for (ULONG d = 0; d < min(pSettings->Destinations.Count, AUDIONET_MAX_DESTINATIONS); d++) {
+            PAUDIONET_DESTINATION pDestination = &pSettings->Destinations.Destination[d];
+
+            if (!pDestination->Channels) {
+                ulChannels = 0;
+                break;
+            }
+            for (ULONG c = 0; c < min(pDestination->Channels, AUDIONET_MAX_CHANNELS); c++) {
+                ulChannels = max(ulChannels, (ULONG) pDestination->ChannelMap[c] + 1);
+            }
+        }
+    }
+    if (!ulChannels) {
+        ulChannels = (pSettings->CodecId == AUDIONET_CODEC_OPUS) ? 2 : ulMaxChannels;
+    }
+    ulChannels = ClampRange(ulChannels, m_MinChannels, min(ulMaxChannels, m_MaxChannelsPcm));
+
+    if (!OutputBufferLength) {
+        *ResultantFormatLength = sizeof(KSDATAFORMAT) + sizeof(WAVEFORMATEXTENSIBLE);
+        return STATUS_BUFFER_OVERFLOW;
+    }
+    if (OutputBufferLength < sizeof(KSDATAFORMAT) + sizeof(WAVEFORMATEXTENSIBLE)) {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
 
-    return STATUS_NOT_IMPLEMENTED;
+    *pKsFormat = *MyDataRange;
+    pKsFormat->FormatSize = sizeof(KSDATAFORMAT) + sizeof(WAVEFORMATEXTENSIBLE);
+    pKsFormat->Flags      = 0;
+    pKsFormat->SampleSize = 0;
+    pKsFormat->Reserved   = 0;
+
+    pWfx = (PWAVEFORMATEXTENSIBLE) (pKsFormat + 1);
+    pWfx->Format.wFormatTag      = WAVE_FORMAT_EXTENSIBLE;
+    pWfx->Format.nChannels       = (WORD) ulChannels;
+    pWfx->Format.nSamplesPerSec  = ulRate;
+    pWfx->Format.wBitsPerSample  = (WORD) ulBits;
+    pWfx->Format.nBlockAlign     = (WORD) (ulChannels * ulBits / 8);
+    pWfx->Format.nAvgBytesPerSec = ulRate * pWfx->Format.nBlockAlign;
+    pWfx->Format.cbSize          = CB_EXTENSIBLE;
+    pWfx->Samples.wValidBitsPerSample = (WORD) ulBits;
+    pWfx->dwChannelMask          = g_aulChannelMask[ulChannels - 1];
+    pWfx->SubFormat              = MyDataRange->SubFormat;
+
+    *ResultantFormatLength = pKsFormat->FormatSize;
+
+    DPF(D_TERSE, ("Intersection %d Hz, %d bits, %d channels", ulRate, ulBits, ulChannels));
+
+    return STATUS_SUCCESS;
 } // DataRangeIntersection
 
 //=============================================================================
-STDMETHODIMP_(NTSTATUS) CMiniportWaveCyclic::GetDescription( 
+NTSTATUS CMiniportWave::GetDescription( 
     OUT PPCFILTER_DESCRIPTOR * OutFilterDescriptor 
 )
 /*++
@@ -195,7 +395,7 @@ Return Value:
 
     ASSERT(OutFilterDescriptor);
 
-    DPF_ENTER(("[CMiniportWaveCyclic::GetDescription]"));
+    DPF_ENTER(("[CMiniportWave::GetDescription]"));
 
     *OutFilterDescriptor = m_FilterDescriptor;
 
@@ -203,6 +403,119 @@ Return Value:
 
 } // GetDescription
 
+//=============================================================================
+// CMiniportWaveCyclic
+//=============================================================================
+
+//=============================================================================
+NTSTATUS CreateMiniportWaveCyclicMSVAD( 
+    OUT PUNKNOWN *              Unknown,
+    IN  REFCLSID,
+    IN  PUNKNOWN                UnknownOuter OPTIONAL,
+    IN  POOL_TYPE               PoolType 
+)
+/*++
+Routine Description:
+  Create the wavecyclic miniport.
+
+Arguments:
+  Unknown - 
+  RefClsId -
+  UnknownOuter -
+  PoolType -
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(Unknown);
+
+    STD_CREATE_BODY(CMiniportWaveCyclic, Unknown, UnknownOuter, PoolType);
+}
+
+//=============================================================================
+CMiniportWaveCyclic::CMiniportWaveCyclic(PUNKNOWN other) : CMiniportWave(other)
+/*++
+Routine Description:
+  Constructor for wavecyclic miniport.
+
+Arguments:
+
+Return Value:
+--*/
+{
+    PAGED_CODE();
+
+    DPF_ENTER(("[CMiniportWaveCyclic::CMiniportWaveCyclic]"));
+
+    // Initialize members.
+    m_Port                 = NULL;
+
+    m_SamplingFrequency    = 0;
+
+    m_ServiceGroup         = NULL;
+} // CMiniportWaveCyclic
+
+//=============================================================================
+CMiniportWaveCyclic::~CMiniportWaveCyclic(void)
+/*++
+Routine Description:
+  Destructor for wavecyclic miniport
+
+Arguments:
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    DPF_ENTER(("[CMiniportWaveCyclic::~CMiniportWaveCyclic]"));
+    
+    if (m_Port) {
+        m_Port->Release();
+    }
+
+    if (m_ServiceGroup) {
+        m_ServiceGroup->Release();
+    }
+} // ~CMiniportWaveCyclic
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveCyclic::DataRangeIntersection( 
+    IN  ULONG                       PinId,
+    IN  PKSDATARANGE                ClientDataRange,
+    IN  PKSDATARANGE                MyDataRange,
+    IN  ULONG                       OutputBufferLength,
+    OUT PVOID                       ResultantFormat,
+    OUT PULONG                      ResultantFormatLength 
+)
+/*++
+Routine Description:
+  See CMiniportWave::DataRangeIntersection.
+--*/
+{
+    PAGED_CODE();
+
+    return CMiniportWave::DataRangeIntersection(PinId, ClientDataRange, MyDataRange, OutputBufferLength, ResultantFormat, ResultantFormatLength);
+} // DataRangeIntersection
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveCyclic::GetDescription( 
+    OUT PPCFILTER_DESCRIPTOR *  OutFilterDescriptor 
+)
+/*++
+Routine Description:
+  See CMiniportWave::GetDescription.
+--*/
+{
+    PAGED_CODE();
+
+    return CMiniportWave::GetDescription(OutFilterDescriptor);
+} // GetDescription
+
 //=============================================================================
 STDMETHODIMP_(NTSTATUS) CMiniportWaveCyclic::Init( 
     IN  PUNKNOWN                UnknownAdapter_,
@@ -235,30 +548,13 @@ Return Value:
 
     DPF_ENTER(("[CMiniportWaveCyclic::Init]"));
 
-    m_MaxOutputStreams      = MAX_OUTPUT_STREAMS;
-    m_MaxInputStreams       = MAX_INPUT_STREAMS;
-    m_MaxTotalStreams       = MAX_TOTAL_STREAMS;
-
-    m_MinChannels           = MIN_CHANNELS;
-    m_MaxChannelsPcm        = MAX_CHANNELS_PCM;
-
-    m_MinBitsPerSamplePcm   = MIN_BITS_PER_SAMPLE_PCM;
-    m_MaxBitsPerSamplePcm   = MAX_BITS_PER_SAMPLE_PCM;
-    m_MinSampleRatePcm      = MIN_SAMPLE_RATE;
-    m_MaxSampleRatePcm      = MAX_SAMPLE_RATE;
-
     // AddRef() is required because we are keeping this pointer.
     m_Port = Port_;
     m_Port->AddRef();
 
-    // We want the IAdapterCommon interface on the adapter common object,
-    // which is given to us as a IUnknown.  The QueryInterface call gives us
-    // an AddRefed pointer to the interface we want.
-    //
-    NTSTATUS ntStatus = UnknownAdapter_->QueryInterface(IID_IAdapterCommon, (PVOID *) &m_AdapterCommon);
+    NTSTATUS ntStatus = InitCommon(UnknownAdapter_);
 
     if (NT_SUCCESS(ntStatus)) {
-        KeInitializeMutex(&m_SampleRateSync, 1);
         ntStatus = PcNewServiceGroup(&m_ServiceGroup, NULL);
 
         if (NT_SUCCESS(ntStatus)) {
@@ -266,13 +562,7 @@ Return Value:
         }
     }
 
-    if (NT_SUCCESS(ntStatus)) {
-        // Set filter descriptor.
-        m_FilterDescriptor = &MiniportFilterDescriptor;
-
-        m_fCaptureAllocated = FALSE;
-        m_fRenderAllocated = FALSE;
-    } else {
+    if (!NT_SUCCESS(ntStatus)) {
         // clean up AdapterCommon
         if (m_AdapterCommon) {
             // clean up the service group
@@ -282,139 +572,674 @@ Return Value:
                 m_ServiceGroup = NULL;
             }
 
-            m_AdapterCommon->Release();
-            m_AdapterCommon = NULL;
+            m_AdapterCommon->Release();
+            m_AdapterCommon = NULL;
+        }
+
+        // release the port
+        //
+        m_Port->Release();
+        m_Port = NULL;
+    }
+
+    return ntStatus;
+} // Init
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveCyclic::NewStream( 
+    OUT PMINIPORTWAVECYCLICSTREAM * OutStream,
+    IN  PUNKNOWN                OuterUnknown,
+    IN  POOL_TYPE               PoolType,
+    IN  ULONG                   Pin,
+    IN  BOOLEAN                 Capture,
+    IN  PKSDATAFORMAT           DataFormat,
+    OUT PDMACHANNEL *           OutDmaChannel,
+    OUT PSERVICEGROUP *         OutServiceGroup 
+)
+/*++
+Routine Description:
+  The NewStream function creates a new instance of a logical stream 
+  associated with a specified physical channel. Callers of NewStream should 
+  run at IRQL PASSIVE_LEVEL.
+
+Arguments:
+  OutStream -
+  OuterUnknown -
+  PoolType - 
+  Pin - 
+  Capture - 
+  DataFormat -
+  OutDmaChannel -
+  OutServiceGroup -
+
+Return Value:
+  NT status code.
+--*/
+{
+    UNREFERENCED_PARAMETER(PoolType);
+
+    PAGED_CODE();
+
+    ASSERT(OutStream);
+    ASSERT(DataFormat);
+    ASSERT(OutDmaChannel);
+    ASSERT(OutServiceGroup);
+
+    DPF_ENTER(("[CMiniportWaveCyclic::NewStream]"));
+
+    NTSTATUS                    ntStatus = STATUS_SUCCESS;
+    PCMiniportWaveCyclicStream  stream = NULL;
+
+    // Check if we have enough streams. Render streams are counted by the
+    // mixer inputs they claim in Init.
+    if (Capture && m_fCaptureAllocated) {
+        DPF(D_TERSE, ("[Only one capture stream supported]"));
+        ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    // Determine if the format is valid.
+    if (NT_SUCCESS(ntStatus)) {
+        ntStatus = ValidateFormat(DataFormat);
+    }
+
+    // Instantiate a stream. Stream must be in
+    // NonPagedPool because of file saving.
+    //
+    if (NT_SUCCESS(ntStatus)) {
+        stream = new (NonPagedPool, MSVAD_POOLTAG) CMiniportWaveCyclicStream(OuterUnknown);
+
+        if (stream) {
+            stream->AddRef();
+
+            ntStatus = stream->Init(this, Pin, Capture, DataFormat);
+        } else {
+            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    if (NT_SUCCESS(ntStatus)) {
+        if (Capture) {
+            m_fCaptureAllocated = TRUE;
+        }
+
+        *OutStream = PMINIPORTWAVECYCLICSTREAM(stream);
+        (*OutStream)->AddRef();
+        
+        *OutDmaChannel = PDMACHANNEL(stream);
+        (*OutDmaChannel)->AddRef();
+
+        *OutServiceGroup = m_ServiceGroup;
+        (*OutServiceGroup)->AddRef();
+
+        // The stream, the DMA channel, and the service group have
+        // references now for the caller.  The caller expects these
+        // references to be there.
+    }
+
+    // This is our private reference to the stream.  The caller has
+    // its own, so we can release in any case.
+    if (stream) {
+        stream->Release();
+    }
+    
+    return ntStatus;
+} // NewStream
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveCyclic::NonDelegatingQueryInterface( 
+    IN  REFIID  Interface,
+    OUT PVOID * Object 
+)
+/*++
+Routine Description:
+  QueryInterface
+
+Arguments:
+  Interface - GUID
+  Object - interface pointer to be returned.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(Object);
+
+    if (IsEqualGUIDAligned(Interface, IID_IUnknown)) {
+        *Object = PVOID(PUNKNOWN(PMINIPORTWAVECYCLIC(this)));
+    } else if (IsEqualGUIDAligned(Interface, IID_IMiniport)) {
+        *Object = PVOID(PMINIPORT(this));
+    } else if (IsEqualGUIDAligned(Interface, IID_IMiniportWaveCyclic)) {
+        *Object = PVOID(PMINIPORTWAVECYCLIC(this));
+    } else {
+        *Object = NULL;
+    }
+
+    if (*Object) {
+        // We reference the interface for the caller.
+
+        PUNKNOWN(*Object)->AddRef();
+        return STATUS_SUCCESS;
+    }
+
+    return STATUS_INVALID_PARAMETER;
+} // NonDelegatingQueryInterface
+
+//=============================================================================
+// CMiniportWave properties
+//=============================================================================
+
+//=============================================================================
+NTSTATUS CMiniportWave::PropertyHandlerComponentId(
+    IN PPCPROPERTY_REQUEST      PropertyRequest
+)
+/*++
+Routine Description:
+  Handles KSPROPERTY_GENERAL_COMPONENTID
+
+Arguments:
+  PropertyRequest - 
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    DPF_ENTER(("[PropertyHandlerComponentId]"));
+
+    NTSTATUS ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+
+    if (PropertyRequest->Verb & KSPROPERTY_TYPE_BASICSUPPORT) {
+        ntStatus = PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_BASICSUPPORT | KSPROPERTY_TYPE_GET, VT_ILLEGAL);
+    } else {
+        ntStatus = ValidatePropertyParams(PropertyRequest, sizeof(KSCOMPONENTID), 0);
+        if (NT_SUCCESS(ntStatus)) {
+            if (PropertyRequest->Verb & KSPROPERTY_TYPE_GET) {
+                PKSCOMPONENTID pComponentId = (PKSCOMPONENTID) PropertyRequest->Value;
+
+                INIT_MMREG_MID(&pComponentId->Manufacturer, MM_MICROSOFT);
+                pComponentId->Product   = PID_MSVAD;
+                pComponentId->Name      = NAME_MSVAD_SIMPLE;
+                pComponentId->Component = GUID_NULL; // Not used for extended caps.
+                pComponentId->Version   = MSVAD_VERSION;
+                pComponentId->Revision  = MSVAD_REVISION;
+
+                PropertyRequest->ValueSize = sizeof(KSCOMPONENTID);
+                ntStatus = STATUS_SUCCESS;
+            }
+        } else {
+            DPF(D_TERSE, ("[PropertyHandlerComponentId - Invalid parameter]"));
+            ntStatus = STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    return ntStatus;
+} // PropertyHandlerComponentId
+
+//=============================================================================
+NTSTATUS CMiniportWave::PropertyHandlerProposedFormat(
+    IN PPCPROPERTY_REQUEST      PropertyRequest
+)
+/*++
+Routine Description:
+  Handles KSPROPERTY_GENERAL_COMPONENTID
+
+Arguments:
+  PropertyRequest - 
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    DPF_ENTER(("[PropertyHandlerProposedFormat]"));
+
+    NTSTATUS ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+
+    if (PropertyRequest->Verb & KSPROPERTY_TYPE_BASICSUPPORT) {
+        ntStatus = PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_BASICSUPPORT | KSPROPERTY_TYPE_SET, VT_ILLEGAL);
+    } else {
+        ULONG cbMinSize = sizeof(KSDATAFORMAT_WAVEFORMATEX);
+
+        if (PropertyRequest->ValueSize == 0) {
+            PropertyRequest->ValueSize = cbMinSize;
+            ntStatus = STATUS_BUFFER_OVERFLOW;
+        } else if (PropertyRequest->ValueSize < cbMinSize) {
+            ntStatus = STATUS_BUFFER_TOO_SMALL;
+        } else {
+            if (PropertyRequest->Verb & KSPROPERTY_TYPE_SET) {
+                PKSDATAFORMAT pKsFormat = (PKSDATAFORMAT) PropertyRequest->Value;
+                PWAVEFORMATEX pWfx = GetWaveFormatEx(pKsFormat);
+
+                ntStatus = STATUS_NO_MATCH;
+
+                // Take the mix format of the audio engine whenever the
+                // stream pin can, so it needs no conversion pass.
+                if (pWfx && (PropertyRequest->ValueSize >= sizeof(KSDATAFORMAT) + sizeof(WAVEFORMATEX) + pWfx->cbSize)) {
+                    if (NT_SUCCESS(ValidateFormat(pKsFormat))) {
+                        ntStatus = STATUS_SUCCESS;
+                    }
+                }
+            } else {
+                ntStatus = STATUS_INVALID_PARAMETER;
+            }
+        }
+    }
+
+    return ntStatus;
+} // PropertyHandlerProposedFormat
+
+//=============================================================================
+NTSTATUS CMiniportWave::PropertyHandlerCpuResources(
+    IN  PPCPROPERTY_REQUEST     PropertyRequest
+)
+/*++
+Routine Description:
+  Processes KSPROPERTY_AUDIO_CPURESOURCES
+
+Arguments:
+  PropertyRequest - property request structure
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(PropertyRequest);
+
+    DPF_ENTER(("[CMiniportWave::PropertyHandlerCpuResources]"));
+
+    NTSTATUS ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+
+    if (PropertyRequest->Verb & KSPROPERTY_TYPE_BASICSUPPORT) {
+        ntStatus = PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_BASICSUPPORT, VT_I4);
+    } else if (PropertyRequest->Verb & KSPROPERTY_TYPE_GET) {
+        ntStatus = ValidatePropertyParams(PropertyRequest, sizeof(LONG), 0);
+        if (NT_SUCCESS(ntStatus)) {
+            *(PLONG(PropertyRequest->Value)) = KSAUDIO_CPU_RESOURCES_HOST_CPU;
+            PropertyRequest->ValueSize = sizeof(LONG);
+        }
+    } 
+
+    return ntStatus;
+} // PropertyHandlerCpuResources
+
+//=============================================================================
+NTSTATUS CMiniportWave::PropertyHandlerGeneric(
+    IN  PPCPROPERTY_REQUEST     PropertyRequest
+)
+/*++
+Routine Description:
+  Handles all properties for this miniport.
+
+Arguments:
+  PropertyRequest - property request structure
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(PropertyRequest);
+    ASSERT(PropertyRequest->PropertyItem);
+
+    NTSTATUS ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+
+    switch (PropertyRequest->PropertyItem->Id) {
+        case KSPROPERTY_AUDIO_CPU_RESOURCES:
+            ntStatus = PropertyHandlerCpuResources(PropertyRequest);
+            break;
+
+        default:
+            DPF(D_TERSE, ("[PropertyHandlerGeneric: Invalid Device Request]"));
+            ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    return ntStatus;
+} // PropertyHandlerGeneric
+
+//=============================================================================
+NTSTATUS CMiniportWave::PropertyHandlerAudioNet(
+    IN  PPCPROPERTY_REQUEST     PropertyRequest
+)
+/*++
+Routine Description:
+  Handles the KSPROPSETID_AudioNet properties. All but the channel matrix
+  are a ULONG in m_CodecSettings; see audionet.h for when render streams
+  pick them up.
+
+Arguments:
+  PropertyRequest - property request structure
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(PropertyRequest);
+
+    DPF_ENTER(("[CMiniportWave::PropertyHandlerAudioNet]"));
+
+    NTSTATUS ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+    PULONG   pulSetting;
+    BOOL     fValid;
+
+    switch (PropertyRequest->PropertyItem->Id) {
+        case KSPROPERTY_AUDIONET_CODEC:
+            pulSetting = &m_CodecSettings.CodecId;
+            break;
+
+        case KSPROPERTY_AUDIONET_BITRATE:
+            pulSetting = &m_CodecSettings.Bitrate;
+            break;
+
+        case KSPROPERTY_AUDIONET_COMPLEXITY:
+            pulSetting = &m_CodecSettings.Complexity;
+            break;
+
+        case KSPROPERTY_AUDIONET_FRAME_DURATION:
+            pulSetting = &m_CodecSettings.FrameDuration;
+            break;
+
+        case KSPROPERTY_AUDIONET_BIT_DEPTH:
+            pulSetting = &m_CodecSettings.BitDepth;
+            break;
+
+        case KSPROPERTY_AUDIONET_NOISE_SHAPING:
+            pulSetting = &m_CodecSettings.NoiseShaping;
+            break;
+
+        case KSPROPERTY_AUDIONET_SAMPLE_RATE:
+            pulSetting = &m_CodecSettings.SampleRate;
+            break;
+
+        case KSPROPERTY_AUDIONET_CHANNEL_MATRIX:
+            return PropertyHandlerChannelMatrix(PropertyRequest);
+
+        case KSPROPERTY_AUDIONET_DESTINATIONS:
+            return PropertyHandlerDestinations(PropertyRequest);
+
+        case KSPROPERTY_AUDIONET_EQUALIZER:
+            return PropertyHandlerEqualizer(PropertyRequest);
+
+        case KSPROPERTY_AUDIONET_LIMITER:
+            return PropertyHandlerLimiter(PropertyRequest);
+
+        case KSPROPERTY_AUDIONET_LIMITER_REDUCTION:
+            return PropertyHandlerLimiterReduction(PropertyRequest);
+
+        case KSPROPERTY_AUDIONET_NORMALIZATION:
+            return PropertyHandlerNormalization(PropertyRequest);
+
+        case KSPROPERTY_AUDIONET_LOUDNESS:
+            return PropertyHandlerLoudness(PropertyRequest);
+
+        case KSPROPERTY_AUDIONET_DELAY:
+            return PropertyHandlerDelay(PropertyRequest);
+
+        default:
+            DPF(D_TERSE, ("[PropertyHandlerAudioNet: Invalid Device Request]"));
+            return ntStatus;
+    }
+
+    if (PropertyRequest->Verb & KSPROPERTY_TYPE_BASICSUPPORT) {
+        ntStatus = PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_ALL, VT_UI4);
+    } else {
+        ntStatus = ValidatePropertyParams(PropertyRequest, sizeof(ULONG), 0);
+        if (NT_SUCCESS(ntStatus)) {
+            PULONG pulValue = PULONG(PropertyRequest->Value);
+
+            if (PropertyRequest->Verb & KSPROPERTY_TYPE_GET) {
+                *pulValue = *pulSetting;
+                PropertyRequest->ValueSize = sizeof(ULONG);
+            } else if (PropertyRequest->Verb & KSPROPERTY_TYPE_SET) {
+                switch (PropertyRequest->PropertyItem->Id) {
+                    case KSPROPERTY_AUDIONET_CODEC:
+                        fValid = (*pulValue < AUDIONET_CODEC_COUNT);
+                        break;
+
+                    case KSPROPERTY_AUDIONET_BITRATE:
+                        fValid = (*pulValue >= AUDIONET_MIN_BITRATE) && (*pulValue <= AUDIONET_MAX_BITRATE);
+                        break;
+
+                    case KSPROPERTY_AUDIONET_COMPLEXITY:
+                        fValid = (*pulValue <= AUDIONET_MAX_COMPLEXITY);
+                        break;
+
+                    case KSPROPERTY_AUDIONET_FRAME_DURATION:
+                        fValid = (*pulValue == 2500) || (*pulValue == 5000) || (*pulValue == 7500) || (*pulValue == 10000) || (*pulValue == 20000);
+                        break;
+
+                    case KSPROPERTY_AUDIONET_BIT_DEPTH:
+                        fValid = !*pulValue || ((*pulValue >= AUDIONET_MIN_BIT_DEPTH) && (*pulValue <= AUDIONET_MAX_BIT_DEPTH));
+                        break;
+
+                    case KSPROPERTY_AUDIONET_SAMPLE_RATE:
+                        fValid = !*pulValue || ((*pulValue >= MIN_SAMPLE_RATE) && (*pulValue <= MAX_SAMPLE_RATE));
+                        break;
+
+                    default:
+                        fValid = TRUE;
+                }
+
+                if (fValid) {
+                    *pulSetting = *pulValue;
+                } else {
+                    ntStatus = STATUS_INVALID_PARAMETER;
+                }
+            }
+        }
+    }
+
+    return ntStatus;
+} // PropertyHandlerAudioNet
+
+//=============================================================================
+NTSTATUS CMiniportWave::PropertyHandlerChannelMatrix(
+    IN  PPCPROPERTY_REQUEST     PropertyRequest
+)
+/*++
+Routine Description:
+  Handles KSPROPERTY_AUDIONET_CHANNEL_MATRIX.
+
+Arguments:
+  PropertyRequest - property request structure
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(PropertyRequest);
+
+    DPF_ENTER(("[CMiniportWave::PropertyHandlerChannelMatrix]"));
+
+    NTSTATUS                 ntStatus;
+    PAUDIONET_CHANNEL_MATRIX pMatrix;
+
+    if (PropertyRequest->Verb & KSPROPERTY_TYPE_BASICSUPPORT) {
+        return PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_ALL, VT_ILLEGAL);
+    }
+
+    ntStatus = ValidatePropertyParams(PropertyRequest, sizeof(AUDIONET_CHANNEL_MATRIX), 0);
+    if (NT_SUCCESS(ntStatus)) {
+        pMatrix = PAUDIONET_CHANNEL_MATRIX(PropertyRequest->Value);
+
+        if (PropertyRequest->Verb & KSPROPERTY_TYPE_GET) {
+            *pMatrix = m_CodecSettings.ChannelMatrix;
+            PropertyRequest->ValueSize = sizeof(AUDIONET_CHANNEL_MATRIX);
+        } else if (PropertyRequest->Verb & KSPROPERTY_TYPE_SET) {
+            if (pMatrix->OutputChannels > AUDIONET_MAX_CHANNELS) {
+                return STATUS_INVALID_PARAMETER;
+            }
+            for (ULONG o = 0; o < AUDIONET_MAX_CHANNELS; o++) {
+                for (ULONG i = 0; i < AUDIONET_MAX_CHANNELS; i++) {
+                    if ((pMatrix->Gain[o][i] > AUDIONET_MAX_MATRIX_GAIN) || (pMatrix->Gain[o][i] < -AUDIONET_MAX_MATRIX_GAIN)) {
+                        return STATUS_INVALID_PARAMETER;
+                    }
+                }
+            }
+
+            m_CodecSettings.ChannelMatrix = *pMatrix;
+        }
+    }
+
+    return ntStatus;
+} // PropertyHandlerChannelMatrix
+
+//=============================================================================
+NTSTATUS CMiniportWave::PropertyHandlerDestinations(
+    IN  PPCPROPERTY_REQUEST     PropertyRequest
+)
+/*++
+Routine Description:
+  Handles KSPROPERTY_AUDIONET_DESTINATIONS.
+
+Arguments:
+  PropertyRequest - property request structure
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(PropertyRequest);
+
+    DPF_ENTER(("[CMiniportWave::PropertyHandlerDestinations]"));
+
+    NTSTATUS               ntStatus;
+    PAUDIONET_DESTINATIONS pDestinations;
+
+    if (PropertyRequest->Verb & KSPROPERTY_TYPE_BASICSUPPORT) {
+        return PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_ALL, VT_ILLEGAL);
+    }
+
+    ntStatus = ValidatePropertyParams(PropertyRequest, sizeof(AUDIONET_DESTINATIONS), 0);
+    if (NT_SUCCESS(ntStatus)) {
+        pDestinations = PAUDIONET_DESTINATIONS(PropertyRequest->Value);
+
+        if (PropertyRequest->Verb & KSPROPERTY_TYPE_GET) {
+            *pDestinations = m_CodecSettings.Destinations;
+            PropertyRequest->ValueSize = sizeof(AUDIONET_DESTINATIONS);
+        } else if (PropertyRequest->Verb & KSPROPERTY_TYPE_SET) {
+            if (pDestinations->Count > AUDIONET_MAX_DESTINATIONS) {
+                return STATUS_INVALID_PARAMETER;
+            }
+            for (ULONG i = 0; i < pDestinations->Count; i++) {
+                PAUDIONET_DESTINATION pDestination = &pDestinations->Destination[i];
+
+                if (!pDestination->Port || (pDestination->Channels > AUDIONET_MAX_CHANNELS)) {
+                    return STATUS_INVALID_PARAMETER;
+                }
+                for (ULONG ch = 0; ch < pDestination->Channels; ch++) {
+                    if (pDestination->ChannelMap[ch] >= AUDIONET_MAX_CHANNELS) {
+                        return STATUS_INVALID_PARAMETER;
+                    }
+                }
+            }
+
+            m_CodecSettings.Destinations = *pDestinations;
         }
-
-        // release the port
-        //
-        m_Port->Release();
-        m_Port = NULL;
     }
 
     return ntStatus;
-} // Init
+} // PropertyHandlerDestinations
 
 //=============================================================================
-STDMETHODIMP_(NTSTATUS) CMiniportWaveCyclic::NewStream( 
-    OUT PMINIPORTWAVECYCLICSTREAM * OutStream,
-    IN  PUNKNOWN                OuterUnknown,
-    IN  POOL_TYPE               PoolType,
-    IN  ULONG                   Pin,
-    IN  BOOLEAN                 Capture,
-    IN  PKSDATAFORMAT           DataFormat,
-    OUT PDMACHANNEL *           OutDmaChannel,
-    OUT PSERVICEGROUP *         OutServiceGroup 
+NTSTATUS CMiniportWave::PropertyHandlerEqualizer(
+    IN  PPCPROPERTY_REQUEST     PropertyRequest
 )
 /*++
 Routine Description:
-  The NewStream function creates a new instance of a logical stream 
-  associated with a specified physical channel. Callers of NewStream should 
-  run at IRQL PASSIVE_LEVEL.
+  Handles KSPROPERTY_AUDIONET_EQUALIZER. Running streams poll the
+  generation, which is odd while the sections are being written, and pick
+  up the new sections once it is even again. That only works for one
+  writer at a time, so requests are serialized by m_EqualizerSync.
 
 Arguments:
-  OutStream -
-  OuterUnknown -
-  PoolType - 
-  Pin - 
-  Capture - 
-  DataFormat -
-  OutDmaChannel -
-  OutServiceGroup -
+  PropertyRequest - property request structure
 
 Return Value:
   NT status code.
 --*/
 {
-    UNREFERENCED_PARAMETER(PoolType);
-
     PAGED_CODE();
 
-    ASSERT(OutStream);
-    ASSERT(DataFormat);
-    ASSERT(OutDmaChannel);
-    ASSERT(OutServiceGroup);
-
-    DPF_ENTER(("[CMiniportWaveCyclic::NewStream]"));
+    ASSERT(PropertyRequest);
 
-    NTSTATUS                    ntStatus = STATUS_SUCCESS;
-    PCMiniportWaveCyclicStream  stream = NULL;
+    DPF_ENTER(("[CMiniportWave::PropertyHandlerEqualizer]"));
 
-    // Check if we have enough streams.
-    if (Capture) {
-        if (m_fCaptureAllocated) {
-            DPF(D_TERSE, ("[Only one capture stream supported]"));
-            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
-        }
-    } else {
-        if (m_fRenderAllocated) {
-            DPF(D_TERSE, ("[Only one render stream supported]"));
-            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
-        }
-    }
+    NTSTATUS            ntStatus;
+    PAUDIONET_EQUALIZER pEqualizer;
+    ULONG               ulDestination;
 
-    // Determine if the format is valid.
-    if (NT_SUCCESS(ntStatus)) {
-        ntStatus = ValidateFormat(DataFormat);
+    if (PropertyRequest->Verb & KSPROPERTY_TYPE_BASICSUPPORT) {
+        return PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_ALL, VT_ILLEGAL);
     }
 
-    // Instantiate a stream. Stream must be in
-    // NonPagedPool because of file saving.
-    //
+    ntStatus = ValidatePropertyParams(PropertyRequest, sizeof(AUDIONET_EQUALIZER), sizeof(ULONG));
     if (NT_SUCCESS(ntStatus)) {
-        stream = new (NonPagedPool, MSVAD_POOLTAG) CMiniportWaveCyclicStream(OuterUnknown);
-
-        if (stream) {
-            stream->AddRef();
+        pEqualizer    = PAUDIONET_EQUALIZER(PropertyRequest->Value);
+        ulDestination = *(PULONG(PropertyRequest->Instance));
 
-            ntStatus = stream->Init(this, Pin, Capture, DataFormat);
-        } else {
-            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+        if (ulDestination >= AUDIONET_MAX_DESTINATIONS) {
+            return STATUS_INVALID_PARAMETER;
         }
-    }
 
-    if (NT_SUCCESS(ntStatus)) {
-        if (Capture) {
-            m_fCaptureAllocated = TRUE;
-        } else {
-            m_fRenderAllocated = TRUE;
-        }
+        if (PropertyRequest->Verb & KSPROPERTY_TYPE_SET) {
+            if (pEqualizer->Sections > AUDIONET_MAX_BIQUADS) {
+                return STATUS_INVALID_PARAMETER;
+            }
 
-        *OutStream = PMINIPORTWAVECYCLICSTREAM(stream);
-        (*OutStream)->AddRef();
-        
-        *OutDmaChannel = PDMACHANNEL(stream);
-        (*OutDmaChannel)->AddRef();
+            // NaN and infinity have all exponent bits set. The bits are
+            // tested so no floating point state is needed.
+            for (ULONG s = 0; s < pEqualizer->Sections; s++) {
+                PULONG pulCoefs = (PULONG) &pEqualizer->Section[s];
 
-        *OutServiceGroup = m_ServiceGroup;
-        (*OutServiceGroup)->AddRef();
+                for (ULONG c = 0; c < sizeof(AUDIONET_BIQUAD) / sizeof(ULONG); c++) {
+                    if ((pulCoefs[c] & 0x7F800000) == 0x7F800000) {
+                        return STATUS_INVALID_PARAMETER;
+                    }
+                }
+            }
+        }
 
-        // The stream, the DMA channel, and the service group have
-        // references now for the caller.  The caller expects these
-        // references to be there.
+        ntStatus = KeWaitForSingleObject(&m_EqualizerSync, Executive, KernelMode, FALSE, NULL);
+        if (STATUS_SUCCESS == ntStatus) {
+            if (PropertyRequest->Verb & KSPROPERTY_TYPE_GET) {
+                *pEqualizer = m_CodecSettings.Equalizer[ulDestination];
+                PropertyRequest->ValueSize = sizeof(AUDIONET_EQUALIZER);
+            } else if (PropertyRequest->Verb & KSPROPERTY_TYPE_SET) {
+                InterlockedIncrement(&m_CodecSettings.EqualizerGeneration);
+                m_CodecSettings.Equalizer[ulDestination] = *pEqualizer;
+                InterlockedIncrement(&m_CodecSettings.EqualizerGeneration);
+            }
+            KeReleaseMutex(&m_EqualizerSync, FALSE);
+        }
     }
 
-    // This is our private reference to the stream.  The caller has
-    // its own, so we can release in any case.
-    if (stream) {
-        stream->Release();
-    }
-    
     return ntStatus;
-} // NewStream
+} // PropertyHandlerEqualizer
 
 //=============================================================================
-STDMETHODIMP_(NTSTATUS) CMiniportWaveCyclic::NonDelegatingQueryInterface( 
-    IN  REFIID  Interface,
-    OUT PVOID * Object 
+NTSTATUS CMiniportWave::PropertyHandlerDelay(
+    IN  PPCPROPERTY_REQUEST     PropertyRequest
 )
 /*++
 Routine Description:
-  QueryInterface
+  Handles KSPROPERTY_AUDIONET_DELAY. Running streams compare the delay of
+  their destinations with the one they use before every packet.
 
 Arguments:
-  Interface - GUID
-  Object - interface pointer to be returned.
+  PropertyRequest - property request structure
 
 Return Value:
   NT status code.
@@ -422,38 +1247,52 @@ Return Value:
 {
     PAGED_CODE();
 
-    ASSERT(Object);
+    ASSERT(PropertyRequest);
 
-    if (IsEqualGUIDAligned(Interface, IID_IUnknown)) {
-        *Object = PVOID(PUNKNOWN(PMINIPORTWAVECYCLIC(this)));
-    } else if (IsEqualGUIDAligned(Interface, IID_IMiniport)) {
-        *Object = PVOID(PMINIPORT(this));
-    } else if (IsEqualGUIDAligned(Interface, IID_IMiniportWaveCyclic)) {
-        *Object = PVOID(PMINIPORTWAVECYCLIC(this));
-    } else {
-        *Object = NULL;
+    DPF_ENTER(("[CMiniportWave::PropertyHandlerDelay]"));
+
+    NTSTATUS ntStatus;
+    PULONG   pulDelay;
+    ULONG    ulDestination;
+
+    if (PropertyRequest->Verb & KSPROPERTY_TYPE_BASICSUPPORT) {
+        return PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_ALL, VT_UI4);
     }
 
-    if (*Object) {
-        // We reference the interface for the caller.
+    ntStatus = ValidatePropertyParams(PropertyRequest, sizeof(ULONG), sizeof(ULONG));
+    if (NT_SUCCESS(ntStatus)) {
+        pulDelay      = PULONG(PropertyRequest->Value);
+        ulDestination = *(PULONG(PropertyRequest->Instance));
 
-        PUNKNOWN(*Object)->AddRef();
-        return STATUS_SUCCESS;
+        if (ulDestination >= AUDIONET_MAX_DESTINATIONS) {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        if (PropertyRequest->Verb & KSPROPERTY_TYPE_GET) {
+            *pulDelay = m_CodecSettings.Delay[ulDestination];
+            PropertyRequest->ValueSize = sizeof(ULONG);
+        } else if (PropertyRequest->Verb & KSPROPERTY_TYPE_SET) {
+            if (*pulDelay > AUDIONET_MAX_DELAY) {
+                return STATUS_INVALID_PARAMETER;
+            }
+
+            m_CodecSettings.Delay[ulDestination] = *pulDelay;
+        }
     }
 
-    return STATUS_INVALID_PARAMETER;
-} // NonDelegatingQueryInterface
+    return ntStatus;
+} // PropertyHandlerDelay
 
 //=============================================================================
-NTSTATUS CMiniportWaveCyclic::PropertyHandlerComponentId(
-    IN PPCPROPERTY_REQUEST      PropertyRequest
+NTSTATUS CMiniportWave::PropertyHandlerLimiter(
+    IN  PPCPROPERTY_REQUEST     PropertyRequest
 )
 /*++
 Routine Description:
-  Handles KSPROPERTY_GENERAL_COMPONENTID
+  Handles KSPROPERTY_AUDIONET_LIMITER.
 
 Arguments:
-  PropertyRequest - 
+  PropertyRequest - property request structure
 
 Return Value:
   NT status code.
@@ -461,49 +1300,53 @@ Return Value:
 {
     PAGED_CODE();
 
-    DPF_ENTER(("[PropertyHandlerComponentId]"));
+    ASSERT(PropertyRequest);
 
-    NTSTATUS ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+    DPF_ENTER(("[CMiniportWave::PropertyHandlerLimiter]"));
 
-    if (PropertyRequest->Verb & KSPROPERTY_TYPE_BASICSUPPORT) {
-        ntStatus = PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_BASICSUPPORT | KSPROPERTY_TYPE_GET, VT_ILLEGAL);
-    } else {
-        ntStatus = ValidatePropertyParams(PropertyRequest, sizeof(KSCOMPONENTID), 0);
-        if (NT_SUCCESS(ntStatus)) {
-            if (PropertyRequest->Verb & KSPROPERTY_TYPE_GET) {
-                PKSCOMPONENTID pComponentId = (PKSCOMPONENTID) PropertyRequest->Value;
+    NTSTATUS          ntStatus;
+    PAUDIONET_LIMITER pLimiter;
 
-                INIT_MMREG_MID(&pComponentId->Manufacturer, MM_MICROSOFT);
-                pComponentId->Product   = PID_MSVAD;
-                pComponentId->Name      = NAME_MSVAD_SIMPLE;
-                pComponentId->Component = GUID_NULL; // Not used for extended caps.
-                pComponentId->Version   = MSVAD_VERSION;
-                pComponentId->Revision  = MSVAD_REVISION;
+    if (PropertyRequest->Verb & KSPROPERTY_TYPE_BASICSUPPORT) {
+        return PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_ALL, VT_ILLEGAL);
+    }
 
-                PropertyRequest->ValueSize = sizeof(KSCOMPONENTID);
-                ntStatus = STATUS_SUCCESS;
+    ntStatus = ValidatePropertyParams(PropertyRequest, sizeof(AUDIONET_LIMITER), 0);
+    if (NT_SUCCESS(ntStatus)) {
+        pLimiter = PAUDIONET_LIMITER(PropertyRequest->Value);
+
+        if (PropertyRequest->Verb & KSPROPERTY_TYPE_GET) {
+            *pLimiter = m_CodecSettings.Limiter;
+            PropertyRequest->ValueSize = sizeof(AUDIONET_LIMITER);
+        } else if (PropertyRequest->Verb & KSPROPERTY_TYPE_SET) {
+            if (pLimiter->Lookahead && ((pLimiter->Lookahead < AUDIONET_MIN_LOOKAHEAD) || (pLimiter->Lookahead > AUDIONET_MAX_LOOKAHEAD))) {
+                return STATUS_INVALID_PARAMETER;
             }
-        } else {
-            DPF(D_TERSE, ("[PropertyHandlerComponentId - Invalid parameter]"));
-            ntStatus = STATUS_INVALID_PARAMETER;
+            if ((pLimiter->Threshold > 0) || (pLimiter->Threshold <= DSP_MIN_VOLUME)) {
+                return STATUS_INVALID_PARAMETER;
+            }
+            if ((pLimiter->Release < AUDIONET_MIN_RELEASE) || (pLimiter->Release > AUDIONET_MAX_RELEASE)) {
+                return STATUS_INVALID_PARAMETER;
+            }
+
+            m_CodecSettings.Limiter = *pLimiter;
         }
     }
 
     return ntStatus;
-} // PropertyHandlerComponentId
-
-#define CB_EXTENSIBLE (sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX))
+} // PropertyHandlerLimiter
 
 //=============================================================================
-NTSTATUS CMiniportWaveCyclic::PropertyHandlerProposedFormat(
-    IN PPCPROPERTY_REQUEST      PropertyRequest
+NTSTATUS CMiniportWave::PropertyHandlerLimiterReduction(
+    IN  PPCPROPERTY_REQUEST     PropertyRequest
 )
 /*++
 Routine Description:
-  Handles KSPROPERTY_GENERAL_COMPONENTID
+  Handles KSPROPERTY_AUDIONET_LIMITER_REDUCTION, the gain reduction the
+  limiter of the last render stream applied to its last packet.
 
 Arguments:
-  PropertyRequest - 
+  PropertyRequest - property request structure
 
 Return Value:
   NT status code.
@@ -511,60 +1354,36 @@ Return Value:
 {
     PAGED_CODE();
 
-    DPF_ENTER(("[PropertyHandlerProposedFormat]"));
+    ASSERT(PropertyRequest);
 
-    NTSTATUS ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+    DPF_ENTER(("[CMiniportWave::PropertyHandlerLimiterReduction]"));
+
+    NTSTATUS ntStatus;
 
     if (PropertyRequest->Verb & KSPROPERTY_TYPE_BASICSUPPORT) {
-        ntStatus = PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_BASICSUPPORT | KSPROPERTY_TYPE_SET, VT_ILLEGAL);
-    } else {
-        ULONG cbMinSize = sizeof(KSDATAFORMAT_WAVEFORMATEX);
+        return PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_BASICSUPPORT, VT_I4);
+    }
 
-        if (PropertyRequest->ValueSize == 0) {
-            PropertyRequest->ValueSize = cbMinSize;
-            ntStatus = STATUS_BUFFER_OVERFLOW;
-        } else if (PropertyRequest->ValueSize < cbMinSize) {
-            ntStatus = STATUS_BUFFER_TOO_SMALL;
+    ntStatus = ValidatePropertyParams(PropertyRequest, sizeof(LONG), 0);
+    if (NT_SUCCESS(ntStatus)) {
+        if (PropertyRequest->Verb & KSPROPERTY_TYPE_GET) {
+            *(PLONG(PropertyRequest->Value)) = m_CodecStatus.LimiterReduction;
+            PropertyRequest->ValueSize = sizeof(LONG);
         } else {
-            if (PropertyRequest->Verb & KSPROPERTY_TYPE_SET) {
-                KSDATAFORMAT_WAVEFORMATEX* pKsFormat = (KSDATAFORMAT_WAVEFORMATEX*)PropertyRequest->Value;
-
-                ntStatus = STATUS_NO_MATCH;
-
-                if ((pKsFormat->DataFormat.MajorFormat == KSDATAFORMAT_TYPE_AUDIO) && (pKsFormat->DataFormat.SubFormat == KSDATAFORMAT_SUBTYPE_PCM) && (pKsFormat->DataFormat.Specifier == KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)) {
-                    WAVEFORMATEX* pWfx = (WAVEFORMATEX*)&pKsFormat->WaveFormatEx;
-
-                    // make sure the WAVEFORMATEX part of the format makes sense
-                    if ((pWfx->wBitsPerSample == 16) && ((pWfx->nSamplesPerSec == 44100) || (pWfx->nSamplesPerSec == 48000)) && (pWfx->nBlockAlign == (pWfx->nChannels * 2)) && (pWfx->nAvgBytesPerSec == (pWfx->nSamplesPerSec * pWfx->nBlockAlign))) {
-                        if ((pWfx->wFormatTag == WAVE_FORMAT_PCM) && (pWfx->cbSize == 0)) {
-                            if (pWfx->nChannels == 2) {
-                                ntStatus = STATUS_SUCCESS;
-                            }
-                        } else if ((pWfx->wFormatTag == WAVE_FORMAT_EXTENSIBLE) && (pWfx->cbSize == CB_EXTENSIBLE)) {
-                            WAVEFORMATEXTENSIBLE* pWfxT = (WAVEFORMATEXTENSIBLE*)pWfx;
-
-                            if (((pWfx->nChannels == 2) && (pWfxT->dwChannelMask == KSAUDIO_SPEAKER_STEREO)) || ((pWfx->nChannels == 6) && (pWfxT->dwChannelMask == KSAUDIO_SPEAKER_5POINT1_SURROUND)) || ((pWfx->nChannels == 8) && (pWfxT->dwChannelMask == KSAUDIO_SPEAKER_7POINT1_SURROUND))) {
-                                ntStatus = STATUS_SUCCESS;
-                            }
-                        }
-                    }
-                }
-            } else {
-                ntStatus = STATUS_INVALID_PARAMETER;
-            }
+            ntStatus = STATUS_INVALID_DEVICE_REQUEST;
         }
     }
 
     return ntStatus;
-} // PropertyHandlerProposedFormat
+} // PropertyHandlerLimiterReduction
 
 //=============================================================================
-NTSTATUS CMiniportWaveCyclic::PropertyHandlerCpuResources(
+NTSTATUS CMiniportWave::PropertyHandlerNormalization(
     IN  PPCPROPERTY_REQUEST     PropertyRequest
 )
 /*++
 Routine Description:
-  Processes KSPROPERTY_AUDIO_CPURESOURCES
+  Handles KSPROPERTY_AUDIONET_NORMALIZATION.
 
 Arguments:
   PropertyRequest - property request structure
@@ -577,30 +1396,45 @@ Return Value:
 
     ASSERT(PropertyRequest);
 
-    DPF_ENTER(("[CMiniportWaveCyclic::PropertyHandlerCpuResources]"));
+    DPF_ENTER(("[CMiniportWave::PropertyHandlerNormalization]"));
 
-    NTSTATUS ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+    NTSTATUS                ntStatus;
+    PAUDIONET_NORMALIZATION pNormalization;
 
     if (PropertyRequest->Verb & KSPROPERTY_TYPE_BASICSUPPORT) {
-        ntStatus = PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_BASICSUPPORT, VT_I4);
-    } else if (PropertyRequest->Verb & KSPROPERTY_TYPE_GET) {
-        ntStatus = ValidatePropertyParams(PropertyRequest, sizeof(LONG), 0);
-        if (NT_SUCCESS(ntStatus)) {
-            *(PLONG(PropertyRequest->Value)) = KSAUDIO_CPU_RESOURCES_HOST_CPU;
-            PropertyRequest->ValueSize = sizeof(LONG);
+        return PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_ALL, VT_ILLEGAL);
+    }
+
+    ntStatus = ValidatePropertyParams(PropertyRequest, sizeof(AUDIONET_NORMALIZATION), 0);
+    if (NT_SUCCESS(ntStatus)) {
+        pNormalization = PAUDIONET_NORMALIZATION(PropertyRequest->Value);
+
+        if (PropertyRequest->Verb & KSPROPERTY_TYPE_GET) {
+            *pNormalization = m_CodecSettings.Normalization;
+            PropertyRequest->ValueSize = sizeof(AUDIONET_NORMALIZATION);
+        } else if (PropertyRequest->Verb & KSPROPERTY_TYPE_SET) {
+            if (pNormalization->Target && ((pNormalization->Target < AUDIONET_MIN_LOUDNESS_TARGET) || (pNormalization->Target > AUDIONET_MAX_LOUDNESS_TARGET))) {
+                return STATUS_INVALID_PARAMETER;
+            }
+            if (pNormalization->MaxGain > AUDIONET_MAX_NORMALIZATION_GAIN) {
+                return STATUS_INVALID_PARAMETER;
+            }
+
+            m_CodecSettings.Normalization = *pNormalization;
         }
-    } 
+    }
 
     return ntStatus;
-} // PropertyHandlerCpuResources
+} // PropertyHandlerNormalization
 
 //=============================================================================
-NTSTATUS CMiniportWaveCyclic::PropertyHandlerGeneric(
+NTSTATUS CMiniportWave::PropertyHandlerLoudness(
     IN  PPCPROPERTY_REQUEST     PropertyRequest
 )
 /*++
 Routine Description:
-  Handles all properties for this miniport.
+  Handles KSPROPERTY_AUDIONET_LOUDNESS, the loudness of the last render
+  stream as of its last packet.
 
 Arguments:
   PropertyRequest - property request structure
@@ -612,31 +1446,42 @@ Return Value:
     PAGED_CODE();
 
     ASSERT(PropertyRequest);
-    ASSERT(PropertyRequest->PropertyItem);
 
-    NTSTATUS ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+    DPF_ENTER(("[CMiniportWave::PropertyHandlerLoudness]"));
 
-    switch (PropertyRequest->PropertyItem->Id) {
-        case KSPROPERTY_AUDIO_CPU_RESOURCES:
-            ntStatus = PropertyHandlerCpuResources(PropertyRequest);
-            break;
+    NTSTATUS           ntStatus;
+    PAUDIONET_LOUDNESS pLoudness;
 
-        default:
-            DPF(D_TERSE, ("[PropertyHandlerGeneric: Invalid Device Request]"));
+    if (PropertyRequest->Verb & KSPROPERTY_TYPE_BASICSUPPORT) {
+        return PropertyHandler_BasicSupport(PropertyRequest, KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_BASICSUPPORT, VT_ILLEGAL);
+    }
+
+    ntStatus = ValidatePropertyParams(PropertyRequest, sizeof(AUDIONET_LOUDNESS), 0);
+    if (NT_SUCCESS(ntStatus)) {
+        if (PropertyRequest->Verb & KSPROPERTY_TYPE_GET) {
+            pLoudness = PAUDIONET_LOUDNESS(PropertyRequest->Value);
+
+            pLoudness->Momentary  = m_CodecStatus.Loudness.Momentary;
+            pLoudness->ShortTerm  = m_CodecStatus.Loudness.ShortTerm;
+            pLoudness->Integrated = m_CodecStatus.Loudness.Integrated;
+            pLoudness->Gain       = m_CodecStatus.Loudness.Gain;
+            PropertyRequest->ValueSize = sizeof(AUDIONET_LOUDNESS);
+        } else {
             ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+        }
     }
 
     return ntStatus;
-} // PropertyHandlerGeneric
+} // PropertyHandlerLoudness
 
 //=============================================================================
-NTSTATUS CMiniportWaveCyclic::ValidateFormat(
+NTSTATUS CMiniportWave::ValidateFormat(
     IN  PKSDATAFORMAT           pDataFormat
 )
 /*++
 Routine Description:
   Validates that the given dataformat is valid.
-  This version of the driver only supports PCM.
+  This version of the driver supports PCM and IEEE float.
 
 Arguments:
   pDataFormat - The dataformat for validation.
@@ -649,7 +1494,7 @@ Return Value:
 
     ASSERT(pDataFormat);
 
-    DPF_ENTER(("[CMiniportWaveCyclic::ValidateFormat]"));
+    DPF_ENTER(("[CMiniportWave::ValidateFormat]"));
 
     NTSTATUS      ntStatus = STATUS_INVALID_PARAMETER;
     PWAVEFORMATEX pwfx;
@@ -661,11 +1506,14 @@ Return Value:
 
             switch (wfxID) {
                 case WAVE_FORMAT_PCM:
+                case WAVE_FORMAT_IEEE_FLOAT:
                 {
                     switch (pwfx->wFormatTag) {
                         case WAVE_FORMAT_PCM:
+                        case WAVE_FORMAT_IEEE_FLOAT:
+                        case WAVE_FORMAT_EXTENSIBLE:
                         {
-                            ntStatus = ValidatePcm(pwfx);
+                            ntStatus = ValidatePcm(pwfx, (wfxID == WAVE_FORMAT_IEEE_FLOAT));
                             break;
                         }
                     }
@@ -685,16 +1533,20 @@ Return Value:
 } // ValidateFormat
 
 //-----------------------------------------------------------------------------
-NTSTATUS CMiniportWaveCyclic::ValidatePcm(
-    IN  PWAVEFORMATEX           pWfx
+NTSTATUS CMiniportWave::ValidatePcm(
+    IN  PWAVEFORMATEX           pWfx,
+    IN  BOOL                    fFloat
 )
 /*++
 Routine Description:
   Given a waveformatex and format size validates that the format is in device
-  datarange.
+  datarange. WAVEFORMATEXTENSIBLE must carry the matching subformat, valid
+  bits that fit the container and no more speakers than channels; any other
+  format tag must be the one of the subformat.
 
 Arguments:
   pWfx - wave format structure.
+  fFloat - whether the format is IEEE float rather than PCM.
 
 Return Value:
   NT status code.
@@ -702,16 +1554,61 @@ Return Value:
 {
     PAGED_CODE();
 
-    DPF_ENTER(("[CMiniportWaveCyclic::ValidatePcm]"));
+    DPF_ENTER(("[CMiniportWave::ValidatePcm]"));
+
+    if (!pWfx) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (pWfx->wFormatTag == WAVE_FORMAT_EXTENSIBLE) {
+        PWAVEFORMATEXTENSIBLE pWfxT = (PWAVEFORMATEXTENSIBLE) pWfx;
+        ULONG                 ulMask = pWfxT->dwChannelMask;
+        ULONG                 ulSpeakers = 0;
+
+        if (pWfx->cbSize < CB_EXTENSIBLE) {
+            DPF(D_TERSE, ("Invalid WAVEFORMATEXTENSIBLE size"));
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        if (!IsEqualGUIDAligned(pWfxT->SubFormat, fFloat ? KSDATAFORMAT_SUBTYPE_IEEE_FLOAT : KSDATAFORMAT_SUBTYPE_PCM) ||
+            !pWfxT->Samples.wValidBitsPerSample || (pWfxT->Samples.wValidBitsPerSample > pWfx->wBitsPerSample)) {
+            DPF(D_TERSE, ("Invalid WAVEFORMATEXTENSIBLE subformat"));
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        for (; ulMask; ulMask &= ulMask - 1) {
+            ulSpeakers++;
+        }
+        if (ulSpeakers > pWfx->nChannels) {
+            DPF(D_TERSE, ("Channel mask has more speakers than channels"));
+            return STATUS_INVALID_PARAMETER;
+        }
+    } else if (pWfx->wFormatTag != (fFloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM)) {
+        DPF(D_TERSE, ("Format tag does not match the subformat"));
+        return STATUS_INVALID_PARAMETER;
+    } else if (pWfx->cbSize != 0) {
+        DPF(D_TERSE, ("Invalid PCM format"));
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if(fFloat) {
+        if (pWfx->wBitsPerSample != BITS_PER_SAMPLE_FLOAT) {
+            DPF(D_TERSE, ("Invalid IEEE float format"));
+            return STATUS_INVALID_PARAMETER;
+        }
+    } else if ((pWfx->wBitsPerSample < m_MinBitsPerSamplePcm) ||
+               (pWfx->wBitsPerSample > m_MaxBitsPerSamplePcm) ||
+               (pWfx->wBitsPerSample % 8)) {
+        DPF(D_TERSE, ("Invalid PCM format"));
+        return STATUS_INVALID_PARAMETER;
+    }
 
-    if(pWfx                                               &&
-      (pWfx->cbSize == 0)                                 &&
-      (pWfx->nChannels >= m_MinChannels)                  &&
-      (pWfx->nChannels <= m_MaxChannelsPcm)               &&
-      (pWfx->nSamplesPerSec >= m_MinSampleRatePcm)        &&
-      (pWfx->nSamplesPerSec <= m_MaxSampleRatePcm)        &&
-      (pWfx->wBitsPerSample >= m_MinBitsPerSamplePcm)     &&
-      (pWfx->wBitsPerSample <= m_MaxBitsPerSamplePcm)) {
+    if((pWfx->nChannels >= m_MinChannels)                                   &&
+       (pWfx->nChannels <= m_MaxChannelsPcm)                                &&
+       (pWfx->nSamplesPerSec >= m_MinSampleRatePcm)                         &&
+       (pWfx->nSamplesPerSec <= m_MaxSampleRatePcm)                         &&
+       (pWfx->nBlockAlign == pWfx->nChannels * pWfx->wBitsPerSample / 8)    &&
+       (pWfx->nAvgBytesPerSec == pWfx->nSamplesPerSec * pWfx->nBlockAlign)) {
         return STATUS_SUCCESS;
     }
 
@@ -719,42 +1616,49 @@ Return Value:
 
     return STATUS_INVALID_PARAMETER;
 } // ValidatePcm
-
+#pragma code_seg()
 
 //=============================================================================
-void TimerNotify(
-    IN  PKDPC                   Dpc,
-    IN  PVOID                   DeferredContext,
-    IN  PVOID                   SA1,
-    IN  PVOID                   SA2
+VOID TimerNotify(
+    IN  PVOID                   Context
 )
 /*++
 Routine Description:
-  Dpc routine. This simulates an interrupt service routine. The Dpc will be
-  called whenever CMiniportWaveCyclicStreamMSVAD::m_pTimer triggers.
+  Timer wheel callback, at DISPATCH_LEVEL. This simulates an interrupt
+  service routine. The entries of all running streams share it, so the
+  service group is notified once in every tick that ends a notification
+  interval of any of them.
 
 Arguments:
-  Dpc - the Dpc object
-  DeferredContext - Pointer to a caller-supplied context to be passed to
-                    the DeferredRoutine when it is called
-  SA1 - System argument 1
-  SA2 - System argument 2
+  Context - the miniport
 
 Return Value:
-  NT status code.
+  void
 --*/
 {
-    UNREFERENCED_PARAMETER(Dpc);
-    UNREFERENCED_PARAMETER(SA1);
-    UNREFERENCED_PARAMETER(SA2);
-
-    PCMiniportWaveCyclic pMiniport = (PCMiniportWaveCyclic) DeferredContext;
+    PCMiniportWaveCyclic pMiniport = (PCMiniportWaveCyclic) Context;
 
     if (pMiniport && pMiniport->m_Port) {
         pMiniport->m_Port->Notify(pMiniport->m_ServiceGroup);
     }
 } // TimerNotify
+#pragma code_seg("PAGE")
 
+//-----------------------------------------------------------------------------
+// The miniport of a filter property request. MajorTarget is the port
+// interface of the miniport, which differs in where CMiniportWave starts.
+//
+static PCMiniportWave GetMiniportWave(IN PUNKNOWN MajorTarget)
+{
+    PMINIPORTWAVERT pMiniportRT;
+
+    if (NT_SUCCESS(MajorTarget->QueryInterface(IID_IMiniportWaveRT, (PVOID *) &pMiniportRT))) {
+        pMiniportRT->Release();
+        return (PCMiniportWaveRT) pMiniportRT;
+    }
+
+    return (PCMiniportWaveCyclic) MajorTarget;
+}
 
 //=============================================================================
 NTSTATUS PropertyHandler_WaveFilter( 
@@ -774,7 +1678,11 @@ Return Value:
     PAGED_CODE();
 
     NTSTATUS                    ntStatus = STATUS_INVALID_DEVICE_REQUEST;
-    PCMiniportWaveCyclic        pWave = (PCMiniportWaveCyclic) PropertyRequest->MajorTarget;
+    PCMiniportWave              pWave = GetMiniportWave(PropertyRequest->MajorTarget);
+
+    if (IsEqualGUIDAligned(*PropertyRequest->PropertyItem->Set, KSPROPSETID_AudioNet)) {
+        return pWave->PropertyHandlerAudioNet(PropertyRequest);
+    }
 
     switch (PropertyRequest->PropertyItem->Id) {
         case KSPROPERTY_GENERAL_COMPONENTID:
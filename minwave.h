@@ -8,44 +8,53 @@ Module Name:
 
 Abstract:
 
-    Definition of wavecyclic miniport class.
+    Definition of the wave miniport classes. CMiniportWave holds what the
+    wavecyclic and the wavert miniport share: formats, codec settings, the
+    mixer of the render streams and the filter properties.
 
 --*/
 
 #ifndef _MSVAD_MINWAVE_H_
 #define _MSVAD_MINWAVE_H_
 
+#include "codec.h"
+#include "mixer.h"
+
 //=============================================================================
 // Referenced Forward
 //=============================================================================
 class CMiniportWaveCyclicStream;
 typedef CMiniportWaveCyclicStream *PCMiniportWaveCyclicStream;
 
+//=============================================================================
+// Function Prototypes
+//=============================================================================
+VOID TimerNotify(IN PVOID Context);
+
 //=============================================================================
 // Classes
 //=============================================================================
 ///////////////////////////////////////////////////////////////////////////////
-// CMiniportWaveCyclic 
-//   
+// CMiniportWave
+//   Base of the wave miniports. The derived classes implement the port
+//   interface and forward GetDescription and DataRangeIntersection here.
 
-class CMiniportWaveCyclic : public IMiniportWaveCyclic, public CUnknown {
-private:
+class CMiniportWave : public CUnknown {
+protected:
     BOOL                        m_fCaptureAllocated;
-    BOOL                        m_fRenderAllocated;
 
-protected:
     PADAPTERCOMMON              m_AdapterCommon;    // Adapter common object
-    PPORTWAVECYCLIC             m_Port;             // Callback interface
     PPCFILTER_DESCRIPTOR        m_FilterDescriptor; // Filter descriptor
 
-    ULONG                       m_NotificationInterval; // milliseconds.
-    ULONG                       m_SamplingFrequency;    // Frames per second.
-
-    PSERVICEGROUP               m_ServiceGroup;     // For notification.
     KMUTEX                      m_SampleRateSync;   // Sync for sample rate 
+    KMUTEX                      m_EqualizerSync;    // One writer of the equalizer generation
 
     ULONG                       m_MaxDmaBufferSize; // Dma buffer size.
 
+    CODEC_SETTINGS              m_CodecSettings;    // Codec of new render streams.
+    CODEC_STATUS                m_CodecStatus;      // Written by the render streams.
+    CStreamMixer                m_Mixer;            // Mixes the render streams.
+
     // All the below members should be updated by the child classes
     ULONG                       m_MaxOutputStreams; // Max stream caps
     ULONG                       m_MaxInputStreams;
@@ -59,28 +68,56 @@ protected:
     ULONG                       m_MaxSampleRatePcm;
 
 protected:
+    NTSTATUS                    InitCommon(IN PUNKNOWN UnknownAdapter);
     NTSTATUS                    ValidateFormat(IN PKSDATAFORMAT pDataFormat);
-    NTSTATUS                    ValidatePcm(IN PWAVEFORMATEX pWfx);
+    NTSTATUS                    ValidatePcm(IN PWAVEFORMATEX pWfx, IN BOOL fFloat);
 
-public:
-    DECLARE_STD_UNKNOWN();
-    CMiniportWaveCyclic(PUNKNOWN other);
-    ~CMiniportWaveCyclic();
+    NTSTATUS                    GetDescription(OUT PPCFILTER_DESCRIPTOR *OutFilterDescriptor);
+    NTSTATUS                    DataRangeIntersection(IN ULONG PinId, IN PKSDATARANGE ClientDataRange, IN PKSDATARANGE MyDataRange, IN ULONG OutputBufferLength, OUT PVOID ResultantFormat, OUT PULONG ResultantFormatLength);
 
-    IMP_IMiniportWaveCyclic;
+public:
+    CMiniportWave(PUNKNOWN other);
+    ~CMiniportWave();
 
     NTSTATUS                    PropertyHandlerComponentId(IN PPCPROPERTY_REQUEST PropertyRequest);
     NTSTATUS                    PropertyHandlerProposedFormat(IN PPCPROPERTY_REQUEST PropertyRequest);
     NTSTATUS                    PropertyHandlerCpuResources(IN PPCPROPERTY_REQUEST PropertyRequest);
     NTSTATUS                    PropertyHandlerGeneric(IN PPCPROPERTY_REQUEST PropertyRequest);
-	
-	//STDMETHODIMP                GetDescription(OUT PPCFILTER_DESCRIPTOR *Description);
-    //STDMETHODIMP                Init(IN PUNKNOWN UnknownAdapter, IN PRESOURCELIST ResourceList, IN PPORTWAVECYCLIC Port);
+    NTSTATUS                    PropertyHandlerAudioNet(IN PPCPROPERTY_REQUEST PropertyRequest);
+    NTSTATUS                    PropertyHandlerChannelMatrix(IN PPCPROPERTY_REQUEST PropertyRequest);
+    NTSTATUS                    PropertyHandlerDestinations(IN PPCPROPERTY_REQUEST PropertyRequest);
+    NTSTATUS                    PropertyHandlerEqualizer(IN PPCPROPERTY_REQUEST PropertyRequest);
+    NTSTATUS                    PropertyHandlerLimiter(IN PPCPROPERTY_REQUEST PropertyRequest);
+    NTSTATUS                    PropertyHandlerLimiterReduction(IN PPCPROPERTY_REQUEST PropertyRequest);
+    NTSTATUS                    PropertyHandlerNormalization(IN PPCPROPERTY_REQUEST PropertyRequest);
+    NTSTATUS                    PropertyHandlerLoudness(IN PPCPROPERTY_REQUEST PropertyRequest);
+    NTSTATUS                    PropertyHandlerDelay(IN PPCPROPERTY_REQUEST PropertyRequest);
+};
+typedef CMiniportWave *PCMiniportWave;
+
+///////////////////////////////////////////////////////////////////////////////
+// CMiniportWaveCyclic 
+//   
+
+class CMiniportWaveCyclic : public IMiniportWaveCyclic, public CMiniportWave {
+protected:
+    PPORTWAVECYCLIC             m_Port;             // Callback interface
+
+    ULONG                       m_SamplingFrequency;    // Frames per second.
+
+    PSERVICEGROUP               m_ServiceGroup;     // For notification.
+
+public:
+    DECLARE_STD_UNKNOWN();
+    CMiniportWaveCyclic(PUNKNOWN other);
+    ~CMiniportWaveCyclic();
+
+    IMP_IMiniportWaveCyclic;
 
     // Friends
     friend class                CMiniportWaveCyclicStream;
     friend class                CMiniportTopology;
-    friend void                 TimerNotify(IN PKDPC Dpc, IN PVOID DeferredContext, IN PVOID SA1, IN PVOID SA2);
+    friend VOID                 TimerNotify(IN PVOID Context);
 };
 typedef CMiniportWaveCyclic *PCMiniportWaveCyclic;
 
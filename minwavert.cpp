@@ -0,0 +1,325 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    minwavert.cpp
+
+Abstract:
+    Implementation of wavert miniport. Formats, codec settings and the filter
+    properties are those of CMiniportWave; only the port interface and the
+    streams differ from the wavecyclic miniport.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include <common.h>
+#include "simple.h"
+#include "minwavert.h"
+#include "minstreamrt.h"
+
+#pragma code_seg("PAGE")
+
+//=============================================================================
+// CMiniportWaveRT
+//=============================================================================
+
+//=============================================================================
+NTSTATUS CreateMiniportWaveRTMSVAD(
+    OUT PUNKNOWN *              Unknown,
+    IN  REFCLSID,
+    IN  PUNKNOWN                UnknownOuter OPTIONAL,
+    IN  POOL_TYPE               PoolType
+)
+/*++
+Routine Description:
+  Create the wavert miniport.
+
+Arguments:
+  Unknown -
+  RefClsId -
+  UnknownOuter -
+  PoolType -
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(Unknown);
+
+    STD_CREATE_BODY(CMiniportWaveRT, Unknown, UnknownOuter, PoolType);
+}
+
+//=============================================================================
+CMiniportWaveRT::CMiniportWaveRT(PUNKNOWN other) : CMiniportWave(other)
+/*++
+Routine Description:
+  Constructor for wavert miniport.
+
+Arguments:
+
+Return Value:
+--*/
+{
+    PAGED_CODE();
+
+    DPF_ENTER(("[CMiniportWaveRT::CMiniportWaveRT]"));
+
+    m_Port = NULL;
+} // CMiniportWaveRT
+
+//=============================================================================
+CMiniportWaveRT::~CMiniportWaveRT(void)
+/*++
+Routine Description:
+  Destructor for wavert miniport
+
+Arguments:
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    DPF_ENTER(("[CMiniportWaveRT::~CMiniportWaveRT]"));
+
+    if (m_Port) {
+        m_Port->Release();
+    }
+} // ~CMiniportWaveRT
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveRT::DataRangeIntersection(
+    IN  ULONG                       PinId,
+    IN  PKSDATARANGE                ClientDataRange,
+    IN  PKSDATARANGE                MyDataRange,
+    IN  ULONG                       OutputBufferLength,
+    OUT PVOID                       ResultantFormat,
+    OUT PULONG                      ResultantFormatLength
+)
+/*++
+Routine Description:
+  See CMiniportWave::DataRangeIntersection.
+--*/
+{
+    PAGED_CODE();
+
+    return CMiniportWave::DataRangeIntersection(PinId, ClientDataRange, MyDataRange, OutputBufferLength, ResultantFormat, ResultantFormatLength);
+} // DataRangeIntersection
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveRT::GetDescription(
+    OUT PPCFILTER_DESCRIPTOR *  OutFilterDescriptor
+)
+/*++
+Routine Description:
+  See CMiniportWave::GetDescription.
+--*/
+{
+    PAGED_CODE();
+
+    return CMiniportWave::GetDescription(OutFilterDescriptor);
+} // GetDescription
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveRT::GetDeviceDescription(
+    OUT PDEVICE_DESCRIPTION     DmaDeviceDescription
+)
+/*++
+Routine Description:
+  Describes the DMA capabilities of the device. There is no DMA, so any
+  page of memory will do for the buffer.
+
+Arguments:
+  DmaDeviceDescription - receives the description.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(DmaDeviceDescription);
+
+    DPF_ENTER(("[CMiniportWaveRT::GetDeviceDescription]"));
+
+    RtlZeroMemory(DmaDeviceDescription, sizeof(DEVICE_DESCRIPTION));
+
+    DmaDeviceDescription->Master            = TRUE;
+    DmaDeviceDescription->ScatterGather     = TRUE;
+    DmaDeviceDescription->Dma32BitAddresses = TRUE;
+    DmaDeviceDescription->Dma64BitAddresses = TRUE;
+    DmaDeviceDescription->InterfaceType     = PCIBus;
+    DmaDeviceDescription->MaximumLength     = 0xFFFFFFFF;
+
+    return STATUS_SUCCESS;
+} // GetDeviceDescription
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveRT::Init(
+    IN  PUNKNOWN                UnknownAdapter_,
+    IN  PRESOURCELIST           ResourceList_,
+    IN  PPORTWAVERT             Port_
+)
+/*++
+Routine Description:
+  The Init function initializes the miniport. Callers of this function
+  should run at IRQL PASSIVE_LEVEL
+
+Arguments:
+  UnknownAdapter - A pointer to the Iuknown interface of the adapter object.
+  ResourceList - Pointer to the resource list to be supplied to the miniport
+                 during initialization.
+  Port - Pointer to the wavert port object that is linked with this miniport.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    UNREFERENCED_PARAMETER(ResourceList_);
+
+    ASSERT(UnknownAdapter_);
+    ASSERT(Port_);
+
+    DPF_ENTER(("[CMiniportWaveRT::Init]"));
+
+    // AddRef() is required because we are keeping this pointer.
+    m_Port = Port_;
+    m_Port->AddRef();
+
+    NTSTATUS ntStatus = InitCommon(UnknownAdapter_);
+
+    if (!NT_SUCCESS(ntStatus)) {
+        if (m_AdapterCommon) {
+            m_AdapterCommon->Release();
+            m_AdapterCommon = NULL;
+        }
+
+        m_Port->Release();
+        m_Port = NULL;
+    }
+
+    return ntStatus;
+} // Init
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveRT::NewStream(
+    OUT PMINIPORTWAVERTSTREAM * OutStream,
+    IN  PPORTWAVERTSTREAM       PortStream,
+    IN  ULONG                   Pin,
+    IN  BOOLEAN                 Capture,
+    IN  PKSDATAFORMAT           DataFormat
+)
+/*++
+Routine Description:
+  The NewStream function creates a new instance of a logical stream
+  associated with a specified physical channel. Callers of NewStream should
+  run at IRQL PASSIVE_LEVEL.
+
+Arguments:
+  OutStream -
+  PortStream - port stream, which allocates the buffer of the stream.
+  Pin -
+  Capture -
+  DataFormat -
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(OutStream);
+    ASSERT(PortStream);
+    ASSERT(DataFormat);
+
+    DPF_ENTER(("[CMiniportWaveRT::NewStream]"));
+
+    NTSTATUS                    ntStatus = STATUS_SUCCESS;
+    PCMiniportWaveRTStream      stream = NULL;
+
+    // The capture pin has no instances. Render streams are counted by the
+    // mixer inputs they claim in Init.
+    if (Capture) {
+        DPF(D_TERSE, ("[No capture stream supported]"));
+        ntStatus = STATUS_NOT_SUPPORTED;
+    }
+
+    // Determine if the format is valid.
+    if (NT_SUCCESS(ntStatus)) {
+        ntStatus = ValidateFormat(DataFormat);
+    }
+
+    // The stream is touched by the timer wheel, so it is nonpaged.
+    if (NT_SUCCESS(ntStatus)) {
+        stream = new (NonPagedPool, MSVAD_POOLTAG) CMiniportWaveRTStream(NULL);
+
+        if (stream) {
+            stream->AddRef();
+
+            ntStatus = stream->Init(this, PortStream, Pin, DataFormat);
+        } else {
+            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    if (NT_SUCCESS(ntStatus)) {
+        *OutStream = PMINIPORTWAVERTSTREAM(stream);
+        (*OutStream)->AddRef();
+    }
+
+    // This is our private reference to the stream.  The caller has
+    // its own, so we can release in any case.
+    if (stream) {
+        stream->Release();
+    }
+
+    return ntStatus;
+} // NewStream
+
+//=============================================================================
+STDMETHODIMP_(NTSTATUS) CMiniportWaveRT::NonDelegatingQueryInterface(
+    IN  REFIID  Interface,
+    OUT PVOID * Object
+)
+/*++
+Routine Description:
+  QueryInterface
+
+Arguments:
+  Interface - GUID
+  Object - interface pointer to be returned.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(Object);
+
+    if (IsEqualGUIDAligned(Interface, IID_IUnknown)) {
+        *Object = PVOID(PUNKNOWN(PMINIPORTWAVERT(this)));
+    } else if (IsEqualGUIDAligned(Interface, IID_IMiniport)) {
+        *Object = PVOID(PMINIPORT(this));
+    } else if (IsEqualGUIDAligned(Interface, IID_IMiniportWaveRT)) {
+        *Object = PVOID(PMINIPORTWAVERT(this));
+    } else {
+        *Object = NULL;
+    }
+
+    if (*Object) {
+        // We reference the interface for the caller.
+
+        PUNKNOWN(*Object)->AddRef();
+        return STATUS_SUCCESS;
+    }
+
+    return STATUS_INVALID_PARAMETER;
+} // NonDelegatingQueryInterface
+#pragma code_seg()
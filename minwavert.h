@@ -0,0 +1,47 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    minwavert.h
+
+Abstract:
+    Definition of wavert miniport class.
+--*/
+
+#ifndef _MSVAD_MINWAVERT_H_
+#define _MSVAD_MINWAVERT_H_
+
+#include "minwave.h"
+
+//=============================================================================
+// Referenced Forward
+//=============================================================================
+class CMiniportWaveRTStream;
+typedef CMiniportWaveRTStream *PCMiniportWaveRTStream;
+
+//=============================================================================
+// Classes
+//=============================================================================
+///////////////////////////////////////////////////////////////////////////////
+// CMiniportWaveRT
+//   Gives the audio engine the cyclic buffer itself. The engine writes the
+//   frames into it and the streams send them from there, so portcls does
+//   not copy them and no DPC is needed to move them.
+
+class CMiniportWaveRT : public IMiniportWaveRT, public CMiniportWave {
+protected:
+    PPORTWAVERT                 m_Port;             // Port interface
+
+public:
+    DECLARE_STD_UNKNOWN();
+    CMiniportWaveRT(PUNKNOWN other);
+    ~CMiniportWaveRT();
+
+    IMP_IMiniportWaveRT;
+
+    // Friends
+    friend class                CMiniportWaveRTStream;
+};
+typedef CMiniportWaveRT *PCMiniportWaveRT;
+
+#endif
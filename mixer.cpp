@@ -0,0 +1,852 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    mixer.cpp
+
+Abstract:
+    Implementation of the render stream mixer.
+
+    Streams hand over their frames when they have them: the wavecyclic
+    streams ahead of the position as the port copies them, the wavert
+    streams as the position passes them. Each input converts them to float
+    in the mix channels and rate and queues them. The mix clock counts the
+    frames due like the stream positions do, from the performance counter
+    and trimmed to the receiver clock, so all inputs fill at the rate it
+    empties them. Inputs are summed in float and clipped once, by the
+    conversion to the mix format.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include <common.h>
+#include "simple.h"
+#include "mixer.h"
+
+#if defined(_M_AMD64)
+#include <xmmintrin.h>
+#endif
+
+//-----------------------------------------------------------------------------
+// Fits frames to the mix channels by position. A mono stream goes to the
+// front pair and a mono mix gets the mean of the stream channels; other
+// channels the mix does not have are left out.
+//
+static void MixerMapChannels(IN const FLOAT *pfInput, IN USHORT nInput, IN ULONG ulFrames, OUT FLOAT *pfOutput, IN USHORT nOutput)
+{
+    FLOAT fScale = 1.0f / nInput;
+
+    for (ULONG i = 0; i < ulFrames; i++) {
+        const FLOAT * pfIn  = pfInput + i * nInput;
+        FLOAT *       pfOut = pfOutput + i * nOutput;
+
+        if (nOutput == 1) {
+            FLOAT fSum = 0;
+
+            for (ULONG c = 0; c < nInput; c++) {
+                fSum += pfIn[c];
+            }
+            pfOut[0] = fSum * fScale;
+        } else if (nInput == 1) {
+            pfOut[0] = pfIn[0];
+            pfOut[1] = pfIn[0];
+            for (ULONG c = 2; c < nOutput; c++) {
+                pfOut[c] = 0;
+            }
+        } else {
+            for (ULONG c = 0; c < nOutput; c++) {
+                pfOut[c] = (c < nInput) ? pfIn[c] : 0;
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Adds ulSamples samples of pfInput to pfMix, eight per step on AMD64.
+//
+static void MixerAccumulate(IN OUT FLOAT *pfMix, IN const FLOAT *pfInput, IN ULONG ulSamples)
+{
+    ULONG i = 0;
+
+#if defined(_M_AMD64)
+    for (; i + 8 <= ulSamples; i += 8) {
+        _mm_storeu_ps(pfMix + i,     _mm_add_ps(_mm_loadu_ps(pfMix + i),     _mm_loadu_ps(pfInput + i)));
+        _mm_storeu_ps(pfMix + i + 4, _mm_add_ps(_mm_loadu_ps(pfMix + i + 4), _mm_loadu_ps(pfInput + i + 4)));
+    }
+#endif
+
+    for (; i < ulSamples; i++) {
+        pfMix[i] += pfInput[i];
+    }
+}
+
+//=============================================================================
+// CStreamMixer
+//=============================================================================
+
+#pragma code_seg("PAGE")
+//=============================================================================
+CStreamMixer::CStreamMixer() : m_pAdapterCommon(NULL), m_ulRunning(0), m_pKernels(NULL), m_ulRate(0), m_nChannels(0), m_nBlockAlign(0),
+    m_ulMaxFrames(0), m_ulQueueFrames(0), m_pfMix(NULL), m_pbOutput(NULL), m_fTimerRegistered(FALSE), m_ulMilliRate(0), m_lRateTrim(0), m_ullQpcFrequency(1),
+    m_ullQpcStart(0), m_ullMilliFrames(0), m_ullFramesMixed(0)
+{
+    PAGED_CODE();
+
+    KeInitializeMutex(&m_InputSync, 1);
+    KeInitializeSpinLock(&m_Lock);
+    RtlZeroMemory(m_Inputs, sizeof(m_Inputs));
+    RtlZeroMemory(&m_TimerEntry, sizeof(m_TimerEntry));
+} // CStreamMixer
+
+//=============================================================================
+CStreamMixer::~CStreamMixer()
+{
+    PAGED_CODE();
+
+    StopTimer();
+
+    for (ULONG i = 0; i < MAX_INPUT_STREAMS; i++) {
+        FreeInput(&m_Inputs[i]);
+    }
+
+    if (m_pfMix) {
+        ExFreePoolWithTag(m_pfMix, MSVAD_POOLTAG);
+    }
+    if (m_pbOutput) {
+        ExFreePoolWithTag(m_pbOutput, MSVAD_POOLTAG);
+    }
+} // ~CStreamMixer
+
+//=============================================================================
+NTSTATUS CStreamMixer::Init(
+    IN  PADAPTERCOMMON          pAdapterCommon,
+    IN  PCODEC_SETTINGS         pSettings,
+    IN  PCODEC_STATUS           pStatus
+)
+/*++
+Routine Description:
+  Gives the sender the settings of the miniport. The codec is created when
+  the first stream sets the mix format.
+
+Arguments:
+  pAdapterCommon - adapter common object, for the timer wheel and the
+                   topology volume.
+  pSettings - settings of the miniport, which outlives the mixer.
+  pStatus - status of the miniport the sender reports to.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(pAdapterCommon);
+
+    m_pAdapterCommon = pAdapterCommon;
+    m_SaveData.SetAdapterCommon(pAdapterCommon);
+
+    return m_SaveData.SetCodecSettings(pSettings, pStatus);
+} // Init
+
+//=============================================================================
+void CStreamMixer::FreeInput(
+    IN  PMIXER_INPUT            pInput
+)
+/*++
+Routine Description:
+  Frees the buffers and the resampler of an input that is not ready.
+
+Arguments:
+  pInput - the input.
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(!pInput->fReady);
+
+    if (pInput->pResampler) {
+        delete pInput->pResampler;
+        pInput->pResampler = NULL;
+    }
+    if (pInput->pBuffers) {
+        ExFreePoolWithTag(pInput->pBuffers, MSVAD_POOLTAG);
+        pInput->pBuffers = NULL;
+    }
+} // FreeInput
+
+//=============================================================================
+NTSTATUS CStreamMixer::AddInput(
+    OUT PULONG                  pulInput
+)
+/*++
+Routine Description:
+  Claims a free input for a new stream. It takes no frames until the
+  stream sets its format.
+
+Arguments:
+  pulInput - receives the input.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(pulInput);
+
+    NTSTATUS ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+
+    KeWaitForSingleObject(&m_InputSync, Executive, KernelMode, FALSE, NULL);
+
+    for (ULONG i = 0; i < MAX_INPUT_STREAMS; i++) {
+        if (!m_Inputs[i].fAllocated) {
+            m_Inputs[i].fAllocated = TRUE;
+            *pulInput = i;
+            ntStatus  = STATUS_SUCCESS;
+            break;
+        }
+    }
+
+    KeReleaseMutex(&m_InputSync, FALSE);
+
+    return ntStatus;
+} // AddInput
+
+//=============================================================================
+NTSTATUS CStreamMixer::SetMixFormat(
+    IN  PKSDATAFORMAT           pDataFormat
+)
+/*++
+Routine Description:
+  Makes the format of a stream the mix format. The sender creates the codec
+  anew for it with the current settings, as it did for every new stream
+  before there was a mixer. Called with m_InputSync held and no input
+  ready, so none runs and the mix clock is stopped. The new buffers are
+  allocated first and swapped in under m_Lock; on failure the mixer is
+  left without a format.
+
+Arguments:
+  pDataFormat - format of the stream.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(!m_ulRunning && !m_fTimerRegistered);
+
+    NTSTATUS      ntStatus = STATUS_SUCCESS;
+    PWAVEFORMATEX pWfx = GetWaveFormatEx(pDataFormat);
+    PCDSP_KERNELS pKernels;
+    ULONG         ulMaxFrames = 0;
+    FLOAT *       pfMix = NULL;
+    PBYTE         pbOutput = NULL;
+    FLOAT *       pfOldMix;
+    PBYTE         pbOldOutput;
+    KIRQL         irql;
+
+    pKernels = DspGetKernels(pWfx, pWfx->nChannels);
+    if (!pKernels) {
+        ntStatus = STATUS_NOT_SUPPORTED;
+    }
+
+    if (NT_SUCCESS(ntStatus)) {
+        ulMaxFrames = max(pWfx->nSamplesPerSec * MIXER_INTERVAL / 1000, 1);
+
+        pfMix    = (FLOAT *) ExAllocatePoolWithTag(NonPagedPool, ulMaxFrames * pWfx->nChannels * sizeof(FLOAT), MSVAD_POOLTAG);
+        pbOutput = (PBYTE) ExAllocatePoolWithTag(NonPagedPool, ulMaxFrames * pWfx->nBlockAlign, MSVAD_POOLTAG);
+        if (!pfMix || !pbOutput) {
+            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    // The socket and the sender thread stay for the life of the mixer once
+    // they are up. Until then every new mix format tries again, e.g. when
+    // WSK was not ready for the first stream after boot.
+    if (NT_SUCCESS(ntStatus)) {
+        ntStatus = m_SaveData.SetDataFormat(pDataFormat);
+    }
+    if (NT_SUCCESS(ntStatus)) {
+        ntStatus = m_SaveData.Initialize();
+    }
+
+    if (!NT_SUCCESS(ntStatus)) {
+        pKernels    = NULL;
+        ulMaxFrames = 0;
+        if (pfMix) {
+            ExFreePoolWithTag(pfMix, MSVAD_POOLTAG);
+            pfMix = NULL;
+        }
+        if (pbOutput) {
+            ExFreePoolWithTag(pbOutput, MSVAD_POOLTAG);
+            pbOutput = NULL;
+        }
+    }
+
+    // Swap in the new format; the old buffers are freed below.
+    KeAcquireSpinLock(&m_Lock, &irql);
+    m_pKernels      = pKernels;
+    m_ulRate        = pKernels ? pWfx->nSamplesPerSec : 0;
+    m_nChannels     = pKernels ? pWfx->nChannels : 0;
+    m_nBlockAlign   = pKernels ? pWfx->nBlockAlign : 0;
+    m_ulMaxFrames   = ulMaxFrames;
+    m_ulQueueFrames = max(m_ulRate * MIXER_QUEUE_MS / 1000, 2 * ulMaxFrames);
+    m_ulMilliRate   = m_ulRate * 1000;
+    m_lRateTrim     = 0;
+    pfOldMix        = m_pfMix;
+    pbOldOutput     = m_pbOutput;
+    m_pfMix         = pfMix;
+    m_pbOutput      = pbOutput;
+    KeReleaseSpinLock(&m_Lock, irql);
+
+    if (pfOldMix) {
+        ExFreePoolWithTag(pfOldMix, MSVAD_POOLTAG);
+    }
+    if (pbOldOutput) {
+        ExFreePoolWithTag(pbOldOutput, MSVAD_POOLTAG);
+    }
+
+    if (NT_SUCCESS(ntStatus)) {
+        DPF(D_TERSE, ("Mixing at %d Hz, %d channels", m_ulRate, m_nChannels));
+    }
+
+    return ntStatus;
+} // SetMixFormat
+
+//=============================================================================
+NTSTATUS CStreamMixer::SetInputFormat(
+    IN  ULONG                   ulInput,
+    IN  PKSDATAFORMAT           pDataFormat
+)
+/*++
+Routine Description:
+  Sets up an input for the format of its stream. The input leaves the mix
+  while its buffers change and starts over with an empty queue. A stream
+  without other ready inputs sets the mix format: no input runs then, so
+  the mix clock is stopped. Otherwise its rate must be one the resampler
+  can convert to the mix rate. Must not be called while the stream runs.
+
+Arguments:
+  ulInput - input of the stream.
+  pDataFormat - new format of the stream.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(ulInput < MAX_INPUT_STREAMS);
+    ASSERT(pDataFormat);
+
+    NTSTATUS      ntStatus = STATUS_SUCCESS;
+    PMIXER_INPUT  pInput = &m_Inputs[ulInput];
+    PWAVEFORMATEX pWfx;
+    BOOL          fAlone = TRUE;
+    ULONG         ulMaxOutput;
+    FLOAT *       pfBuffers;
+    KIRQL         irql;
+
+    pWfx = GetWaveFormatEx(pDataFormat);
+    if (!pWfx) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    KeWaitForSingleObject(&m_InputSync, Executive, KernelMode, FALSE, NULL);
+
+    ASSERT(pInput->fAllocated && !pInput->fRunning);
+
+    KeAcquireSpinLock(&m_Lock, &irql);
+    pInput->fReady = FALSE;
+    KeReleaseSpinLock(&m_Lock, irql);
+
+    FreeInput(pInput);
+
+    for (ULONG i = 0; i < MAX_INPUT_STREAMS; i++) {
+        if ((i != ulInput) && m_Inputs[i].fReady) {
+            fAlone = FALSE;
+        }
+    }
+
+    if (fAlone) {
+        ntStatus = SetMixFormat(pDataFormat);
+    }
+
+    if (NT_SUCCESS(ntStatus)) {
+        pInput->pKernels    = DspGetKernels(pWfx, pWfx->nChannels);
+        pInput->nChannels   = pWfx->nChannels;
+        pInput->nBlockAlign = pWfx->nBlockAlign;
+        pInput->ulMaxFrames = max(pWfx->nSamplesPerSec * MIXER_INTERVAL / 1000, 1);
+        if (!pInput->pKernels || !m_pKernels) {
+            ntStatus = STATUS_NOT_SUPPORTED;
+        }
+    }
+
+    if (NT_SUCCESS(ntStatus) && (pWfx->nSamplesPerSec != m_ulRate)) {
+        pInput->pResampler = new (NonPagedPool, MSVAD_POOLTAG) CResampler();
+        if (pInput->pResampler) {
+            ntStatus = pInput->pResampler->Init(pWfx->nSamplesPerSec, m_ulRate, m_nChannels, pInput->ulMaxFrames);
+            if (!NT_SUCCESS(ntStatus)) {
+                DPF(D_TERSE, ("Cannot mix %d Hz into %d Hz", pWfx->nSamplesPerSec, m_ulRate));
+            }
+        } else {
+            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    if (NT_SUCCESS(ntStatus)) {
+        ulMaxOutput = pInput->pResampler ? pInput->pResampler->GetMaxOutputFrames(pInput->ulMaxFrames) : pInput->ulMaxFrames;
+
+        pInput->pBuffers = ExAllocatePoolWithTag(NonPagedPool,
+                                                 (pInput->ulMaxFrames * (pInput->nChannels + m_nChannels) + (ulMaxOutput + m_ulQueueFrames) * m_nChannels) * sizeof(FLOAT),
+                                                 MSVAD_POOLTAG);
+        if (pInput->pBuffers) {
+            pfBuffers           = (FLOAT *) pInput->pBuffers;
+            pInput->pfConvert   = pfBuffers;
+            pInput->pfMapped    = pInput->pfConvert + pInput->ulMaxFrames * pInput->nChannels;
+            pInput->pfResampled = pInput->pfMapped + pInput->ulMaxFrames * m_nChannels;
+            pInput->pfQueue     = pInput->pfResampled + ulMaxOutput * m_nChannels;
+        } else {
+            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    if (NT_SUCCESS(ntStatus)) {
+        KeAcquireSpinLock(&m_Lock, &irql);
+        pInput->ulRead  = 0;
+        pInput->ulCount = 0;
+        pInput->fMixing = FALSE;
+        pInput->fReady  = TRUE;
+        KeReleaseSpinLock(&m_Lock, irql);
+    } else {
+        FreeInput(pInput);
+    }
+
+    KeReleaseMutex(&m_InputSync, FALSE);
+
+    return ntStatus;
+} // SetInputFormat
+
+//=============================================================================
+void CStreamMixer::SetInputState(
+    IN  ULONG                   ulInput,
+    IN  KSSTATE                 State,
+    IN  ULONG                   ulPeriod
+)
+/*++
+Routine Description:
+  Follows the state of a stream. A running input is mixed once it queued
+  its prebuffer; a paused one keeps its queue for the next run and a
+  stopped one drops it. An input whose format failed does not run, so
+  while none is ready none runs and the mix format can change. The mix
+  clock starts with the first input that runs and stops with the last.
+
+Arguments:
+  ulInput - input of the stream.
+  State - new state of the stream.
+  ulPeriod - milliseconds between the writes of the stream while it runs.
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(ulInput < MAX_INPUT_STREAMS);
+
+    PMIXER_INPUT  pInput = &m_Inputs[ulInput];
+    LARGE_INTEGER frequency;
+    BOOL          fStart = FALSE;
+    BOOL          fStop  = FALSE;
+    KIRQL         irql;
+
+    KeWaitForSingleObject(&m_InputSync, Executive, KernelMode, FALSE, NULL);
+
+    KeAcquireSpinLock(&m_Lock, &irql);
+    if (State == KSSTATE_RUN) {
+        if (!pInput->fReady) {
+            DPF(D_TERSE, ("Mixer input %d has no format, not mixed", ulInput));
+        } else if (!pInput->fRunning) {
+            pInput->fRunning    = TRUE;
+            pInput->fMixing     = FALSE;
+            pInput->ulPrebuffer = min((ULONG) ((ULONGLONG) (ulPeriod + MIXER_INTERVAL) * m_ulRate / 1000), m_ulQueueFrames / 2);
+
+            if (m_ulRunning++ == 0) {
+                m_ullQpcStart     = (ULONGLONG) KeQueryPerformanceCounter(&frequency).QuadPart;
+                m_ullQpcFrequency = (ULONGLONG) frequency.QuadPart;
+                m_ullMilliFrames  = 0;
+                m_ullFramesMixed  = 0;
+                fStart = TRUE;
+            }
+        }
+    } else {
+        if (pInput->fRunning) {
+            pInput->fRunning = FALSE;
+            fStop = (--m_ulRunning == 0);
+        }
+        if (State == KSSTATE_STOP) {
+            pInput->ulRead  = 0;
+            pInput->ulCount = 0;
+        }
+    }
+    KeReleaseSpinLock(&m_Lock, irql);
+
+    if (fStart) {
+        StartTimer();
+    }
+    if (fStop) {
+        StopTimer();
+    }
+
+    KeReleaseMutex(&m_InputSync, FALSE);
+} // SetInputState
+
+//=============================================================================
+void CStreamMixer::RemoveInput(
+    IN  ULONG                   ulInput
+)
+/*++
+Routine Description:
+  Frees the input of a closed stream.
+
+Arguments:
+  ulInput - input of the stream.
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(ulInput < MAX_INPUT_STREAMS);
+
+    PMIXER_INPUT pInput = &m_Inputs[ulInput];
+    BOOL         fStop  = FALSE;
+    KIRQL        irql;
+
+    KeWaitForSingleObject(&m_InputSync, Executive, KernelMode, FALSE, NULL);
+
+    KeAcquireSpinLock(&m_Lock, &irql);
+    if (pInput->fRunning) {
+        pInput->fRunning = FALSE;
+        fStop = (--m_ulRunning == 0);
+    }
+    pInput->fReady = FALSE;
+    KeReleaseSpinLock(&m_Lock, irql);
+
+    if (fStop) {
+        StopTimer();
+    }
+
+    FreeInput(pInput);
+    pInput->fAllocated = FALSE;
+
+    KeReleaseMutex(&m_InputSync, FALSE);
+} // RemoveInput
+
+//=============================================================================
+void CStreamMixer::StartTimer(void)
+/*++
+Routine Description:
+  Registers the mixer with the adapter timer wheel, to mix every
+  MIXER_INTERVAL milliseconds from now.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    StopTimer();
+
+    m_TimerEntry.pfnNotify = MixerTimerNotify;
+    m_TimerEntry.Context   = this;
+    m_TimerEntry.Period    = MIXER_INTERVAL;
+
+    m_fTimerRegistered = NT_SUCCESS(m_pAdapterCommon->TimerRegister(&m_TimerEntry));
+} // StartTimer
+
+//=============================================================================
+void CStreamMixer::StopTimer(void)
+/*++
+Routine Description:
+  Unregisters the mixer from the adapter timer wheel.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    if (m_fTimerRegistered) {
+        m_pAdapterCommon->TimerUnregister(&m_TimerEntry);
+        m_fTimerRegistered = FALSE;
+    }
+} // StopTimer
+#pragma code_seg()
+
+//=============================================================================
+void CStreamMixer::QueueFrames(
+    IN  PMIXER_INPUT            pInput,
+    IN  const FLOAT *           pfFrames,
+    IN  ULONG                   ulFrames
+)
+/*++
+Routine Description:
+  Appends converted frames to the queue of an input, in up to two parts.
+  Frames that do not fit are dropped. Called with m_Lock held.
+
+Arguments:
+  pInput - the input.
+  pfFrames - frames in the mix channels at the mix rate.
+  ulFrames - number of frames.
+
+Return Value:
+  void
+--*/
+{
+    ULONG ulFree = m_ulQueueFrames - pInput->ulCount;
+    ULONG ulWrite;
+    ULONG ulFirst;
+
+    if (ulFrames > ulFree) {
+        DPF(D_VERBOSE, ("Mixer queue full, %d frames dropped", ulFrames - ulFree));
+        ulFrames = ulFree;
+    }
+
+    ulWrite = (pInput->ulRead + pInput->ulCount) % m_ulQueueFrames;
+    ulFirst = min(ulFrames, m_ulQueueFrames - ulWrite);
+
+    RtlCopyMemory(pInput->pfQueue + ulWrite * m_nChannels, pfFrames, ulFirst * m_nChannels * sizeof(FLOAT));
+    RtlCopyMemory(pInput->pfQueue, pfFrames + ulFirst * m_nChannels, (ulFrames - ulFirst) * m_nChannels * sizeof(FLOAT));
+
+    pInput->ulCount += ulFrames;
+} // QueueFrames
+
+//=============================================================================
+void CStreamMixer::WriteInput(
+    IN  ULONG                   ulInput,
+    IN  PBYTE                   pBuffer,
+    IN  ULONG                   ulByteCount
+)
+/*++
+Routine Description:
+  Converts frames of a stream to float, fits them to the mix channels and
+  rate and queues them, one MIXER_INTERVAL of them at a time. Frames of an
+  input that is not ready, or that come when the floating point state
+  cannot be saved, are dropped.
+
+Arguments:
+  ulInput - input of the stream.
+  pBuffer - frames in the stream format.
+  ulByteCount - size of pBuffer, a multiple of the block alignment.
+
+Return Value:
+  void
+--*/
+{
+    ASSERT(ulInput < MAX_INPUT_STREAMS);
+    ASSERT(pBuffer);
+
+    PMIXER_INPUT pInput = &m_Inputs[ulInput];
+    KIRQL        irql;
+
+    KeAcquireSpinLock(&m_Lock, &irql);
+
+    if (pInput->fReady) {
+        ULONG ulFrames = ulByteCount / pInput->nBlockAlign;
+
+#if !defined(_M_AMD64)
+        KFLOATING_SAVE floatSave;
+
+        if (!NT_SUCCESS(KeSaveFloatingPointState(&floatSave))) {
+            KeReleaseSpinLock(&m_Lock, irql);
+            return;
+        }
+#endif
+
+        while (ulFrames) {
+            ULONG   ulCount  = min(ulFrames, pInput->ulMaxFrames);
+            ULONG   ulOutput = ulCount;
+            FLOAT * pfFrames = pInput->pfConvert;
+
+            pInput->pKernels->ToFloat(pBuffer, ulCount, pInput->pfConvert);
+
+            if (pInput->nChannels != m_nChannels) {
+                MixerMapChannels(pfFrames, pInput->nChannels, ulCount, pInput->pfMapped, m_nChannels);
+                pfFrames = pInput->pfMapped;
+            }
+
+            if (pInput->pResampler) {
+                ulOutput = pInput->pResampler->Process(pfFrames, ulCount, pInput->pfResampled);
+                pfFrames = pInput->pfResampled;
+            }
+
+            QueueFrames(pInput, pfFrames, ulOutput);
+
+            pBuffer  += ulCount * pInput->nBlockAlign;
+            ulFrames -= ulCount;
+        }
+
+#if !defined(_M_AMD64)
+        KeRestoreFloatingPointState(&floatSave);
+#endif
+    }
+
+    KeReleaseSpinLock(&m_Lock, irql);
+} // WriteInput
+
+//=============================================================================
+BOOL CStreamMixer::MixFrames(
+    IN  ULONG                   ulFrames
+)
+/*++
+Routine Description:
+  Sums the next frames of every running input into m_pbOutput. An input is
+  only mixed once it holds its prebuffer; when it runs dry it is silent
+  for the rest and waits for its prebuffer again. Integer mix formats clip
+  the sum. Called with m_Lock held.
+
+Arguments:
+  ulFrames - frames to mix, at most m_ulMaxFrames.
+
+Return Value:
+  FALSE if no input was mixed or the floating point state could not be
+  saved; m_pbOutput is then not set.
+--*/
+{
+    ASSERT(ulFrames <= m_ulMaxFrames);
+
+    BOOL fMixed = FALSE;
+
+#if !defined(_M_AMD64)
+    KFLOATING_SAVE floatSave;
+
+    if (!NT_SUCCESS(KeSaveFloatingPointState(&floatSave))) {
+        return FALSE;
+    }
+#endif
+
+    RtlZeroMemory(m_pfMix, ulFrames * m_nChannels * sizeof(FLOAT));
+
+    for (ULONG i = 0; i < MAX_INPUT_STREAMS; i++) {
+        PMIXER_INPUT pInput = &m_Inputs[i];
+        ULONG        ulCount;
+        ULONG        ulFirst;
+
+        if (!pInput->fReady || !pInput->fRunning) {
+            continue;
+        }
+        if (!pInput->fMixing) {
+            if (pInput->ulCount < pInput->ulPrebuffer) {
+                continue;
+            }
+            pInput->fMixing = TRUE;
+        }
+
+        ulCount = min(pInput->ulCount, ulFrames);
+        ulFirst = min(ulCount, m_ulQueueFrames - pInput->ulRead);
+
+        MixerAccumulate(m_pfMix, pInput->pfQueue + pInput->ulRead * m_nChannels, ulFirst * m_nChannels);
+        MixerAccumulate(m_pfMix + ulFirst * m_nChannels, pInput->pfQueue, (ulCount - ulFirst) * m_nChannels);
+
+        pInput->ulRead   = (pInput->ulRead + ulCount) % m_ulQueueFrames;
+        pInput->ulCount -= ulCount;
+        fMixed           = TRUE;
+
+        if (ulCount < ulFrames) {
+            DPF(D_VERBOSE, ("Mixer input %d ran dry", i));
+            pInput->fMixing = FALSE;
+        }
+    }
+
+    if (fMixed) {
+        m_pKernels->FromFloat(m_pfMix, ulFrames, m_pbOutput);
+    }
+
+#if !defined(_M_AMD64)
+    KeRestoreFloatingPointState(&floatSave);
+#endif
+
+    return fMixed;
+} // MixFrames
+
+//=============================================================================
+void CStreamMixer::Mix(void)
+/*++
+Routine Description:
+  Mixes the frames the mix clock has passed since the last call and queues
+  them for the sender. Frames no input was mixed into are not sent. When
+  the sender trims the rate the frames due so far are kept and the new
+  rate counts from now, as in the streams. After a stall no more is mixed
+  than the inputs can have queued. Called by the timer wheel at
+  DISPATCH_LEVEL.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    KeAcquireSpinLockAtDpcLevel(&m_Lock);
+
+    if (m_ulRunning && m_pfMix) {
+        ULONGLONG ullNow = (ULONGLONG) KeQueryPerformanceCounter(NULL).QuadPart;
+        LONG      lTrim  = m_SaveData.GetRateTrim();
+        ULONGLONG ullDue;
+
+        if (lTrim != m_lRateTrim) {
+            m_ullMilliFrames += ScaleRatio(ullNow - m_ullQpcStart, m_ulMilliRate, m_ullQpcFrequency);
+            m_ullQpcStart     = ullNow;
+            m_lRateTrim       = lTrim;
+            m_ulMilliRate     = (ULONG) (((ULONGLONG) m_ulRate * (1000000000 - lTrim) + 500000) / 1000000);
+        }
+
+        ullDue = (m_ullMilliFrames + ScaleRatio(ullNow - m_ullQpcStart, m_ulMilliRate, m_ullQpcFrequency)) / 1000;
+        if (ullDue - m_ullFramesMixed > m_ulQueueFrames) {
+            m_ullFramesMixed = ullDue - m_ulQueueFrames;
+        }
+
+        while (m_ullFramesMixed < ullDue) {
+            ULONG ulFrames = (ULONG) min(ullDue - m_ullFramesMixed, m_ulMaxFrames);
+
+            if (MixFrames(ulFrames)) {
+                m_SaveData.WriteData(m_pbOutput, ulFrames * m_nBlockAlign);
+            }
+            m_ullFramesMixed += ulFrames;
+        }
+    }
+
+    KeReleaseSpinLockFromDpcLevel(&m_Lock);
+} // Mix
+
+//=============================================================================
+VOID MixerTimerNotify(
+    IN  PVOID                   Context
+)
+/*++
+Routine Description:
+  Timer wheel callback, at DISPATCH_LEVEL.
+
+Arguments:
+  Context - the mixer
+
+Return Value:
+  void
+--*/
+{
+    PCStreamMixer pMixer = (PCStreamMixer) Context;
+
+    if (pMixer) {
+        pMixer->Mix();
+    }
+} // MixerTimerNotify
@@ -0,0 +1,134 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    mixer.h
+
+Abstract:
+    Declaration of the render stream mixer. Every render stream queues its
+    frames on an input of the mixer, converted to float in the mix format;
+    the adapter timer wheel sums the inputs at the render rate and hands
+    the mix to the one CSaveData that sends it. MAX_INPUT_STREAMS of
+    simple.h is the number of inputs.
+--*/
+
+#ifndef _MSVAD_MIXER_H_
+#define _MSVAD_MIXER_H_
+
+#include "savedata.h"
+
+//=============================================================================
+// Defines
+//=============================================================================
+
+// Milliseconds mixed per timer tick at most, and converted per step of an
+// input. An input queues at most a quarter second, like the sender ring,
+// and is only mixed once it holds its own send period and one tick more,
+// so it does not run dry between its sends.
+#define MIXER_INTERVAL              10
+#define MIXER_QUEUE_MS              250
+
+//=============================================================================
+// Typedefs
+//=============================================================================
+
+// One render stream. Only the mixer lock holder touches an input that is
+// ready; the buffers are set up while it is not.
+typedef struct _MIXER_INPUT {
+    BOOL            fAllocated;             // Claimed by a stream
+    BOOL            fReady;                 // Format set and buffers allocated
+    BOOL            fRunning;               // Stream in KSSTATE_RUN
+    BOOL            fMixing;                // Queued enough since it ran dry
+    PCDSP_KERNELS   pKernels;               // Of the stream format
+    USHORT          nChannels;              // Of the stream
+    USHORT          nBlockAlign;
+    ULONG           ulMaxFrames;            // Stream frames converted at once
+    ULONG           ulPrebuffer;            // Mix frames queued before mixing
+    PCResampler     pResampler;             // To the mix rate, or NULL
+    PVOID           pBuffers;               // Allocation behind the pointers below
+    FLOAT *         pfConvert;              // ulMaxFrames stream frames
+    FLOAT *         pfMapped;               // In the mix channels
+    FLOAT *         pfResampled;            // At the mix rate
+    FLOAT *         pfQueue;                // Mix frames, m_ulQueueFrames of them
+    ULONG           ulRead;                 // Frames
+    ULONG           ulCount;
+} MIXER_INPUT;
+typedef MIXER_INPUT *PMIXER_INPUT;
+
+//=============================================================================
+// Function Prototypes
+//=============================================================================
+VOID MixerTimerNotify(IN PVOID Context);
+
+//=============================================================================
+// Classes
+//=============================================================================
+///////////////////////////////////////////////////////////////////////////////
+// CStreamMixer
+//   Mixes the render streams of a miniport into its network stream. The
+//   mix format is that of the first stream since all inputs were closed,
+//   so one stream alone is sent as it always was. Others are converted to
+//   it: channels by position, the rate by CResampler.
+//
+
+class CStreamMixer {
+protected:
+    PADAPTERCOMMON              m_pAdapterCommon;   // Owned by the miniport
+    KMUTEX                      m_InputSync;        // Input setup at PASSIVE_LEVEL
+    KSPIN_LOCK                  m_Lock;             // Inputs and the mix
+    MIXER_INPUT                 m_Inputs[MAX_INPUT_STREAMS];
+    ULONG                       m_ulRunning;        // Inputs running
+
+    // Mix format
+    PCDSP_KERNELS               m_pKernels;
+    ULONG                       m_ulRate;
+    USHORT                      m_nChannels;
+    USHORT                      m_nBlockAlign;
+    ULONG                       m_ulMaxFrames;      // Mixed at once
+    ULONG                       m_ulQueueFrames;    // Per input
+    FLOAT *                     m_pfMix;            // m_ulMaxFrames float frames
+    PBYTE                       m_pbOutput;         // m_ulMaxFrames frames
+
+    // Mix clock, running while any input runs and trimmed like the streams.
+    TIMER_WHEEL_ENTRY           m_TimerEntry;
+    BOOLEAN                     m_fTimerRegistered;
+    ULONG                       m_ulMilliRate;
+    LONG                        m_lRateTrim;
+    ULONGLONG                   m_ullQpcFrequency;
+    ULONGLONG                   m_ullQpcStart;
+    ULONGLONG                   m_ullMilliFrames;
+    ULONGLONG                   m_ullFramesMixed;
+
+    CSaveData                   m_SaveData;         // Sends the mix
+
+    void                        FreeInput(IN PMIXER_INPUT pInput);
+    NTSTATUS                    SetMixFormat(IN PKSDATAFORMAT pDataFormat);
+    void                        QueueFrames(IN PMIXER_INPUT pInput, IN const FLOAT *pfFrames, IN ULONG ulFrames);
+    BOOL                        MixFrames(IN ULONG ulFrames);
+    void                        Mix(void);
+    void                        StartTimer(void);
+    void                        StopTimer(void);
+
+public:
+    CStreamMixer();
+    ~CStreamMixer();
+
+    NTSTATUS                    Init(IN PADAPTERCOMMON pAdapterCommon, IN PCODEC_SETTINGS pSettings, IN PCODEC_STATUS pStatus);
+
+    // Inputs are claimed by NewStream, get their format from the stream
+    // and follow its state. All at PASSIVE_LEVEL.
+    NTSTATUS                    AddInput(OUT PULONG pulInput);
+    NTSTATUS                    SetInputFormat(IN ULONG ulInput, IN PKSDATAFORMAT pDataFormat);
+    void                        SetInputState(IN ULONG ulInput, IN KSSTATE State, IN ULONG ulPeriod);
+    void                        RemoveInput(IN ULONG ulInput);
+
+    // Queues frames in the stream format. Callable at IRQL <= DISPATCH_LEVEL.
+    void                        WriteInput(IN ULONG ulInput, IN PBYTE pBuffer, IN ULONG ulByteCount);
+
+    LONG                        GetRateTrim(void)   { return m_SaveData.GetRateTrim(); }
+
+    friend VOID                 MixerTimerNotify(IN PVOID Context);
+};
+typedef CStreamMixer *PCStreamMixer;
+
+#endif
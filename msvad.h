@@ -53,7 +53,7 @@ DEFINE_GUIDSTRUCT("5B722BF8-F0AB-47ee-B9C8-8D61D31375A1", PID_MSVAD);
 #define CHAN_MASTER                 (-1)
 
 // Dma Settings.
-#define DMA_BUFFER_SIZE             0x16000
+#define DMA_BUFFER_SIZE             0x60000 // 60 ms of 8 channel float at 192 kHz
 
 #define KSPROPERTY_TYPE_ALL         KSPROPERTY_TYPE_BASICSUPPORT | KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET
                                     
@@ -74,6 +74,34 @@ typedef struct _PHYSICALCONNECTIONTABLE {
     ULONG       ulWaveOut;
 } PHYSICALCONNECTIONTABLE, *PPHYSICALCONNECTIONTABLE;
 
+// High resolution timers of Windows 8.1 and later. They are looked up at
+// run time, so the declarations are given here for older headers.
+#ifndef EX_TIMER_HIGH_RESOLUTION
+#define EX_TIMER_HIGH_RESOLUTION    0x4
+typedef struct _EX_TIMER *PEX_TIMER;
+typedef VOID EXT_CALLBACK(IN PEX_TIMER Timer, IN PVOID Context);
+typedef EXT_CALLBACK *PEXT_CALLBACK;
+#endif
+
+typedef PEX_TIMER (NTAPI *PFN_EX_ALLOCATE_TIMER)(IN PEXT_CALLBACK Callback, IN PVOID CallbackContext, IN ULONG Attributes);
+typedef BOOLEAN (NTAPI *PFN_EX_SET_TIMER)(IN PEX_TIMER Timer, IN LONGLONG DueTime, IN LONGLONG Period, IN PVOID Parameters);
+typedef BOOLEAN (NTAPI *PFN_EX_CANCEL_TIMER)(IN PEX_TIMER Timer, IN PVOID Parameters);
+typedef BOOLEAN (NTAPI *PFN_EX_DELETE_TIMER)(IN PEX_TIMER Timer, IN BOOLEAN Cancel, IN BOOLEAN Wait, IN PVOID Parameters);
+
+//=============================================================================
+// Inlines
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+// ullValue * ulNumerator / ullDenominator, rounded down. The quotient and
+// remainder by the denominator are scaled apart, so the result is exact
+// as long as ulNumerator * ullDenominator fits 64 bits.
+//
+static __forceinline ULONGLONG ScaleRatio(IN ULONGLONG ullValue, IN ULONG ulNumerator, IN ULONGLONG ullDenominator)
+{
+    return (ullValue / ullDenominator) * ulNumerator + (ullValue % ullDenominator) * ulNumerator / ullDenominator;
+}
+
 //=============================================================================
 // Externs
 //=============================================================================
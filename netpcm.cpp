@@ -0,0 +1,450 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    netpcm.cpp
+
+Abstract:
+    Implementation of the network byte order PCM codec.
+
+    The conversion is done while copying from the ring buffer into the
+    datagram, so it costs no extra pass over the samples. There is a kernel
+    per sample size and instruction set; Init picks the best one the
+    processor has. 16 and 32 bit samples are swapped with byte shuffles
+    (or shifts on plain SSE2), 24 bit samples with a shuffle that reverses
+    every three byte group, and 8 bit samples only flip the sign bit.
+
+    The AVX2 kernels use the upper halves of the ymm registers, so Encode
+    saves the extended processor state around them. They are only built by
+    compilers that know AVX2, and only used where the system has the
+    extended state routines of Windows 7. Those are looked up at run time,
+    so the driver still loads on older systems.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include "codec.h"
+
+#if defined(_M_AMD64)
+#include <intrin.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#if (_MSC_VER >= 1700)
+#define NETPCM_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+//=============================================================================
+// Defines
+//=============================================================================
+#define CPU_FEATURE_SSSE3           0x00000001
+#define CPU_FEATURE_AVX2            0x00000002
+
+#if defined(NETPCM_AVX2)
+typedef ULONG64 (NTAPI *PFN_RTL_GET_ENABLED_EXTENDED_FEATURES)(IN ULONG64 FeatureMask);
+typedef NTSTATUS (NTAPI *PFN_KE_SAVE_EXTENDED_PROCESSOR_STATE)(IN ULONG64 Mask, OUT PXSTATE_SAVE XStateSave);
+typedef VOID (NTAPI *PFN_KE_RESTORE_EXTENDED_PROCESSOR_STATE)(IN PXSTATE_SAVE XStateSave);
+
+//-----------------------------------------------------------------------------
+// Extended processor state routines, NULL where the system has none.
+//
+static PFN_RTL_GET_ENABLED_EXTENDED_FEATURES   g_pfnRtlGetEnabledExtendedFeatures = NULL;
+static PFN_KE_SAVE_EXTENDED_PROCESSOR_STATE    g_pfnKeSaveExtendedProcessorState = NULL;
+static PFN_KE_RESTORE_EXTENDED_PROCESSOR_STATE g_pfnKeRestoreExtendedProcessorState = NULL;
+#endif
+
+//=============================================================================
+// Scalar kernels
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+static void Sign8(IN PBYTE pInput, IN ULONG ulSamples, OUT PBYTE pOutput)
+{
+    for (ULONG i = 0; i < ulSamples; i++) {
+        pOutput[i] = pInput[i] ^ 0x80;
+    }
+}
+
+//-----------------------------------------------------------------------------
+static void Swap16(IN PBYTE pInput, IN ULONG ulSamples, OUT PBYTE pOutput)
+{
+    for (ULONG i = 0; i < ulSamples; i++) {
+        pOutput[2 * i]     = pInput[2 * i + 1];
+        pOutput[2 * i + 1] = pInput[2 * i];
+    }
+}
+
+//-----------------------------------------------------------------------------
+static void Swap24(IN PBYTE pInput, IN ULONG ulSamples, OUT PBYTE pOutput)
+{
+    for (ULONG i = 0; i < ulSamples; i++) {
+        pOutput[3 * i]     = pInput[3 * i + 2];
+        pOutput[3 * i + 1] = pInput[3 * i + 1];
+        pOutput[3 * i + 2] = pInput[3 * i];
+    }
+}
+
+//-----------------------------------------------------------------------------
+static void Swap32(IN PBYTE pInput, IN ULONG ulSamples, OUT PBYTE pOutput)
+{
+    for (ULONG i = 0; i < ulSamples; i++) {
+        pOutput[4 * i]     = pInput[4 * i + 3];
+        pOutput[4 * i + 1] = pInput[4 * i + 2];
+        pOutput[4 * i + 2] = pInput[4 * i + 1];
+        pOutput[4 * i + 3] = pInput[4 * i];
+    }
+}
+
+#if defined(_M_AMD64)
+//=============================================================================
+// SSE2 kernels
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+static void Sign8Sse2(IN PBYTE pInput, IN ULONG ulSamples, OUT PBYTE pOutput)
+{
+    const __m128i sign = _mm_set1_epi8((CHAR) 0x80);
+    ULONG         i;
+
+    for (i = 0; i + 16 <= ulSamples; i += 16) {
+        _mm_storeu_si128((__m128i *)(pOutput + i), _mm_xor_si128(_mm_loadu_si128((const __m128i *)(pInput + i)), sign));
+    }
+
+    Sign8(pInput + i, ulSamples - i, pOutput + i);
+}
+
+//-----------------------------------------------------------------------------
+static void Swap16Sse2(IN PBYTE pInput, IN ULONG ulSamples, OUT PBYTE pOutput)
+{
+    ULONG i;
+
+    for (i = 0; i + 8 <= ulSamples; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(pInput + 2 * i));
+
+        _mm_storeu_si128((__m128i *)(pOutput + 2 * i), _mm_or_si128(_mm_slli_epi16(s, 8), _mm_srli_epi16(s, 8)));
+    }
+
+    Swap16(pInput + 2 * i, ulSamples - i, pOutput + 2 * i);
+}
+
+//-----------------------------------------------------------------------------
+static void Swap32Sse2(IN PBYTE pInput, IN ULONG ulSamples, OUT PBYTE pOutput)
+{
+    ULONG i;
+
+    for (i = 0; i + 4 <= ulSamples; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(pInput + 4 * i));
+
+        // Swap the bytes of every word, then the words of every dword.
+        s = _mm_or_si128(_mm_slli_epi16(s, 8), _mm_srli_epi16(s, 8));
+        s = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+
+        _mm_storeu_si128((__m128i *)(pOutput + 4 * i), s);
+    }
+
+    Swap32(pInput + 4 * i, ulSamples - i, pOutput + 4 * i);
+}
+
+//=============================================================================
+// SSSE3 kernels
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+static void Swap16Ssse3(IN PBYTE pInput, IN ULONG ulSamples, OUT PBYTE pOutput)
+{
+    const __m128i shuffle = _mm_set_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+    ULONG         i;
+
+    for (i = 0; i + 8 <= ulSamples; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(pInput + 2 * i));
+
+        _mm_storeu_si128((__m128i *)(pOutput + 2 * i), _mm_shuffle_epi8(s, shuffle));
+    }
+
+    Swap16(pInput + 2 * i, ulSamples - i, pOutput + 2 * i);
+}
+
+//-----------------------------------------------------------------------------
+// Five samples (15 bytes) per iteration. Loads and stores are 16 bytes
+// wide, so the last group that fits whole is left to the scalar tail.
+//
+static void Swap24Ssse3(IN PBYTE pInput, IN ULONG ulSamples, OUT PBYTE pOutput)
+{
+    const __m128i shuffle = _mm_set_epi8(15, 12, 13, 14, 9, 10, 11, 6, 7, 8, 3, 4, 5, 0, 1, 2);
+    ULONG         i;
+
+    for (i = 0; i + 6 <= ulSamples; i += 5) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(pInput + 3 * i));
+
+        _mm_storeu_si128((__m128i *)(pOutput + 3 * i), _mm_shuffle_epi8(s, shuffle));
+    }
+
+    Swap24(pInput + 3 * i, ulSamples - i, pOutput + 3 * i);
+}
+
+//-----------------------------------------------------------------------------
+static void Swap32Ssse3(IN PBYTE pInput, IN ULONG ulSamples, OUT PBYTE pOutput)
+{
+    const __m128i shuffle = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    ULONG         i;
+
+    for (i = 0; i + 4 <= ulSamples; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(pInput + 4 * i));
+
+        _mm_storeu_si128((__m128i *)(pOutput + 4 * i), _mm_shuffle_epi8(s, shuffle));
+    }
+
+    Swap32(pInput + 4 * i, ulSamples - i, pOutput + 4 * i);
+}
+
+#if defined(NETPCM_AVX2)
+//=============================================================================
+// AVX2 kernels, called with the extended processor state saved
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+static void Sign8Avx2(IN PBYTE pInput, IN ULONG ulSamples, OUT PBYTE pOutput)
+{
+    const __m256i sign = _mm256_set1_epi8((CHAR) 0x80);
+    ULONG         i;
+
+    for (i = 0; i + 32 <= ulSamples; i += 32) {
+        _mm256_storeu_si256((__m256i *)(pOutput + i), _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(pInput + i)), sign));
+    }
+
+    Sign8(pInput + i, ulSamples - i, pOutput + i);
+}
+
+//-----------------------------------------------------------------------------
+static void Swap16Avx2(IN PBYTE pInput, IN ULONG ulSamples, OUT PBYTE pOutput)
+{
+    const __m256i shuffle = _mm256_set_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1,
+                                            14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+    ULONG         i;
+
+    for (i = 0; i + 16 <= ulSamples; i += 16) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(pInput + 2 * i));
+
+        _mm256_storeu_si256((__m256i *)(pOutput + 2 * i), _mm256_shuffle_epi8(s, shuffle));
+    }
+
+    Swap16(pInput + 2 * i, ulSamples - i, pOutput + 2 * i);
+}
+
+//-----------------------------------------------------------------------------
+static void Swap32Avx2(IN PBYTE pInput, IN ULONG ulSamples, OUT PBYTE pOutput)
+{
+    const __m256i shuffle = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                            12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    ULONG         i;
+
+    for (i = 0; i + 8 <= ulSamples; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(pInput + 4 * i));
+
+        _mm256_storeu_si256((__m256i *)(pOutput + 4 * i), _mm256_shuffle_epi8(s, shuffle));
+    }
+
+    Swap32(pInput + 4 * i, ulSamples - i, pOutput + 4 * i);
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// SSSE3, and AVX2 where the OS saves the ymm registers.
+//
+static ULONG GetCpuFeatures(void)
+{
+    int   info[4];
+    ULONG ulFeatures = 0;
+
+    __cpuid(info, 1);
+    if (info[2] & (1 << 9)) {
+        ulFeatures |= CPU_FEATURE_SSSE3;
+    }
+
+#if defined(NETPCM_AVX2)
+    if ((info[2] & (1 << 27)) && (info[2] & (1 << 28)) && g_pfnRtlGetEnabledExtendedFeatures &&
+        (g_pfnRtlGetEnabledExtendedFeatures(XSTATE_MASK_AVX) & XSTATE_MASK_AVX)) {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5)) {
+            ulFeatures |= CPU_FEATURE_AVX2;
+        }
+    }
+#endif
+
+    return ulFeatures;
+}
+#endif
+
+#if defined(NETPCM_AVX2)
+#pragma code_seg("PAGE")
+//-----------------------------------------------------------------------------
+// Looks up the extended state routines once. All three are needed, and
+// g_pfnRtlGetEnabledExtendedFeatures is set last so it tells whether they
+// are there.
+//
+static void LookupExtendedState(void)
+{
+    PAGED_CODE();
+
+    UNICODE_STRING  name;
+    PVOID           pfnFeatures, pfnSave, pfnRestore;
+
+    if (g_pfnRtlGetEnabledExtendedFeatures) {
+        return;
+    }
+
+    RtlInitUnicodeString(&name, L"RtlGetEnabledExtendedFeatures");
+    pfnFeatures = MmGetSystemRoutineAddress(&name);
+    RtlInitUnicodeString(&name, L"KeSaveExtendedProcessorState");
+    pfnSave = MmGetSystemRoutineAddress(&name);
+    RtlInitUnicodeString(&name, L"KeRestoreExtendedProcessorState");
+    pfnRestore = MmGetSystemRoutineAddress(&name);
+
+    if (pfnFeatures && pfnSave && pfnRestore) {
+        g_pfnKeSaveExtendedProcessorState    = (PFN_KE_SAVE_EXTENDED_PROCESSOR_STATE) pfnSave;
+        g_pfnKeRestoreExtendedProcessorState = (PFN_KE_RESTORE_EXTENDED_PROCESSOR_STATE) pfnRestore;
+        g_pfnRtlGetEnabledExtendedFeatures   = (PFN_RTL_GET_ENABLED_EXTENDED_FEATURES) pfnFeatures;
+    }
+}
+#pragma code_seg()
+#endif
+
+//=============================================================================
+// CNetworkPcmCodec
+//=============================================================================
+
+#pragma code_seg("PAGE")
+//=============================================================================
+NTSTATUS CNetworkPcmCodec::Init(
+    IN  PWAVEFORMATEX           pWfx,
+    IN  PCODEC_SETTINGS         pSettings
+)
+/*++
+Routine Description:
+  Takes PCM in containers of 8, 16, 24 or 32 bits and picks the conversion
+  kernel for it.
+
+Arguments:
+  pWfx - stream format.
+  pSettings - codec settings.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    NTSTATUS ntStatus;
+    ULONG    ulFeatures = 0;
+
+    ntStatus = CAudioCodec::Init(pWfx, pSettings);
+    if (!NT_SUCCESS(ntStatus)) {
+        return ntStatus;
+    }
+
+#if defined(NETPCM_AVX2)
+    LookupExtendedState();
+#endif
+#if defined(_M_AMD64)
+    ulFeatures = GetCpuFeatures();
+#endif
+
+    m_fExtendedState = FALSE;
+
+    switch (m_nBlockAlign / m_nChannels) {
+        case 1:
+            m_pfnConvert = Sign8;
+#if defined(_M_AMD64)
+            m_pfnConvert = Sign8Sse2;
+#endif
+#if defined(NETPCM_AVX2)
+            if (ulFeatures & CPU_FEATURE_AVX2) {
+                m_pfnConvert     = Sign8Avx2;
+                m_fExtendedState = TRUE;
+            }
+#endif
+            break;
+
+        case 2:
+            m_pfnConvert = Swap16;
+#if defined(_M_AMD64)
+            m_pfnConvert = (ulFeatures & CPU_FEATURE_SSSE3) ? Swap16Ssse3 : Swap16Sse2;
+#endif
+#if defined(NETPCM_AVX2)
+            if (ulFeatures & CPU_FEATURE_AVX2) {
+                m_pfnConvert     = Swap16Avx2;
+                m_fExtendedState = TRUE;
+            }
+#endif
+            break;
+
+        case 3:
+            m_pfnConvert = Swap24;
+#if defined(_M_AMD64)
+            if (ulFeatures & CPU_FEATURE_SSSE3) {
+                m_pfnConvert = Swap24Ssse3;
+            }
+#endif
+            break;
+
+        case 4:
+            m_pfnConvert = Swap32;
+#if defined(_M_AMD64)
+            m_pfnConvert = (ulFeatures & CPU_FEATURE_SSSE3) ? Swap32Ssse3 : Swap32Sse2;
+#endif
+#if defined(NETPCM_AVX2)
+            if (ulFeatures & CPU_FEATURE_AVX2) {
+                m_pfnConvert     = Swap32Avx2;
+                m_fExtendedState = TRUE;
+            }
+#endif
+            break;
+
+        default:
+            DPF(D_TERSE, ("Network PCM does not support %d byte samples", m_nBlockAlign / m_nChannels));
+            return STATUS_NOT_SUPPORTED;
+    }
+
+    UNREFERENCED_PARAMETER(ulFeatures);
+
+    return STATUS_SUCCESS;
+} // Init
+#pragma code_seg()
+
+//=============================================================================
+ULONG CNetworkPcmCodec::GetMaxOutputSize(
+    IN  ULONG                   ulFrames
+)
+{
+    return ulFrames * m_nBlockAlign;
+} // GetMaxOutputSize
+
+//=============================================================================
+ULONG CNetworkPcmCodec::Encode(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput
+)
+{
+#if defined(NETPCM_AVX2)
+    XSTATE_SAVE xstateSave;
+
+    if (m_fExtendedState) {
+        if (!NT_SUCCESS(g_pfnKeSaveExtendedProcessorState(XSTATE_MASK_AVX, &xstateSave))) {
+            return 0;
+        }
+    }
+#endif
+
+    m_pfnConvert(pInput, ulFrames * m_nChannels, pOutput);
+
+#if defined(NETPCM_AVX2)
+    if (m_fExtendedState) {
+        g_pfnKeRestoreExtendedProcessorState(&xstateSave);
+    }
+#endif
+
+    return ulFrames * m_nBlockAlign;
+} // Encode
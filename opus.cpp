@@ -0,0 +1,365 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    opus.cpp
+
+Abstract:
+    Implementation of the Opus codec wrapper.
+
+    The encoder normally runs in the restricted low delay application, which
+    is CELT only with 2.5 ms of look-ahead. In-band FEC is a SILK feature, so
+    when the receiver reports loss the encoder is reset into the audio
+    application with FEC enabled, and back once the loss is gone. Calls into
+    libopus are bracketed by an extended processor state save because the
+    library may use SSE and AVX.
+
+    Only built when the sources file finds a libopus, see OPUS_ROOT there.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include "codec.h"
+
+#if defined(MSVAD_OPUS)
+
+#include <opus.h>
+
+//=============================================================================
+// Defines
+//=============================================================================
+#define OPUS_MAX_PACKET             1275    // Largest single frame packet
+#define OPUS_FEC_MIN_LOSS           2       // Percent loss that turns FEC on
+#define OPUS_XSTATE_MASK            (XSTATE_MASK_LEGACY | XSTATE_MASK_AVX)
+
+#pragma code_seg("PAGE")
+//=============================================================================
+// COpusCodec
+//=============================================================================
+
+//=============================================================================
+COpusCodec::~COpusCodec()
+{
+    PAGED_CODE();
+
+    if (m_pEncoder) {
+        ExFreePoolWithTag(m_pEncoder, MSVAD_POOLTAG);
+        m_pEncoder = NULL;
+    }
+} // ~COpusCodec
+
+//=============================================================================
+NTSTATUS COpusCodec::Init(
+    IN  PWAVEFORMATEX           pWfx,
+    IN  PCODEC_SETTINGS         pSettings
+)
+/*++
+Routine Description:
+  Opus takes 16 bit mono or stereo at 8, 12, 16, 24 or 48 kHz in frames of
+  2.5, 5, 10 or 20 ms.
+
+Arguments:
+  pWfx - stream format.
+  pSettings - codec settings.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    NTSTATUS ntStatus;
+
+    if ((pWfx->wBitsPerSample != 16) || (pWfx->nChannels > 2)) {
+        DPF(D_TERSE, ("Opus needs 16 bit mono or stereo input"));
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    switch (pWfx->nSamplesPerSec) {
+        case 8000:
+        case 12000:
+        case 16000:
+        case 24000:
+        case 48000:
+            break;
+
+        default:
+            DPF(D_TERSE, ("Opus does not support %d Hz", pWfx->nSamplesPerSec));
+            return STATUS_NOT_SUPPORTED;
+    }
+
+    switch (pSettings->FrameDuration) {
+        case 2500:
+        case 5000:
+        case 10000:
+        case 20000:
+            break;
+
+        default:
+            return STATUS_NOT_SUPPORTED;
+    }
+
+    ntStatus = CAudioCodec::Init(pWfx, pSettings);
+    if (!NT_SUCCESS(ntStatus)) {
+        return ntStatus;
+    }
+
+    m_ulFrameSize   = m_nSamplesPerSec / (1000000 / pSettings->FrameDuration);
+    m_ulBitrate     = pSettings->Bitrate;
+    m_ulComplexity  = pSettings->Complexity;
+    m_ulLossPercent = 0;
+    m_fDtx          = FALSE;
+
+    m_pEncoder = (struct OpusEncoder *) ExAllocatePoolWithTag(NonPagedPool, opus_encoder_get_size(m_nChannels), MSVAD_POOLTAG);
+    if (!m_pEncoder) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    return Reset(FALSE);
+} // Init
+
+//=============================================================================
+NTSTATUS COpusCodec::Reset(
+    IN  BOOL                    fFec
+)
+/*++
+Routine Description:
+  (Re)initializes the encoder in the low delay or the FEC capable mode and
+  applies the current settings.
+
+Arguments:
+  fFec - whether to use in-band FEC.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    NTSTATUS    ntStatus;
+    XSTATE_SAVE xstateSave;
+    int         err;
+
+    ntStatus = KeSaveExtendedProcessorState(OPUS_XSTATE_MASK, &xstateSave);
+    if (!NT_SUCCESS(ntStatus)) {
+        return ntStatus;
+    }
+
+    err = opus_encoder_init(m_pEncoder, m_nSamplesPerSec, m_nChannels, fFec ? OPUS_APPLICATION_AUDIO : OPUS_APPLICATION_RESTRICTED_LOWDELAY);
+    if (err == OPUS_OK) {
+        opus_encoder_ctl(m_pEncoder, OPUS_SET_BITRATE((opus_int32) m_ulBitrate));
+        opus_encoder_ctl(m_pEncoder, OPUS_SET_COMPLEXITY((opus_int32) m_ulComplexity));
+        opus_encoder_ctl(m_pEncoder, OPUS_SET_INBAND_FEC(fFec ? 1 : 0));
+        opus_encoder_ctl(m_pEncoder, OPUS_SET_PACKET_LOSS_PERC((opus_int32) m_ulLossPercent));
+        opus_encoder_ctl(m_pEncoder, OPUS_SET_DTX(m_fDtx ? 1 : 0));
+    }
+
+    KeRestoreExtendedProcessorState(&xstateSave);
+
+    if (err != OPUS_OK) {
+        DPF(D_TERSE, ("opus_encoder_init failed: %d", err));
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    m_fFec = fFec;
+
+    return STATUS_SUCCESS;
+} // Reset
+
+//=============================================================================
+ULONG COpusCodec::GetFramesPerPacket(
+    IN  ULONG                   ulMaxPayload
+)
+{
+    PAGED_CODE();
+
+    return (ulMaxPayload >= OPUS_MAX_PACKET) ? m_ulFrameSize : 0;
+} // GetFramesPerPacket
+
+//=============================================================================
+ULONG COpusCodec::GetFrameSize(void)
+{
+    PAGED_CODE();
+
+    return m_ulFrameSize;
+} // GetFrameSize
+
+//=============================================================================
+ULONG COpusCodec::GetAlgorithmicDelay(void)
+/*++
+Routine Description:
+  The encoder look-ahead plus the frame being collected.
+
+Arguments:
+
+Return Value:
+  Delay in frames.
+--*/
+{
+    PAGED_CODE();
+
+    XSTATE_SAVE xstateSave;
+    opus_int32  lLookahead = 0;
+
+    if (NT_SUCCESS(KeSaveExtendedProcessorState(OPUS_XSTATE_MASK, &xstateSave))) {
+        opus_encoder_ctl(m_pEncoder, OPUS_GET_LOOKAHEAD(&lLookahead));
+        KeRestoreExtendedProcessorState(&xstateSave);
+    }
+
+    return m_ulFrameSize + lLookahead;
+} // GetAlgorithmicDelay
+
+//=============================================================================
+void COpusCodec::SetBitrate(
+    IN  ULONG                   ulBitrate
+)
+/*++
+Routine Description:
+  Changes the bitrate. If the processor state cannot be saved the encoder
+  keeps the old one until it is reset.
+
+Arguments:
+  ulBitrate - bits per second.
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    XSTATE_SAVE xstateSave;
+
+    m_ulBitrate = ulBitrate;
+
+    if (NT_SUCCESS(KeSaveExtendedProcessorState(OPUS_XSTATE_MASK, &xstateSave))) {
+        opus_encoder_ctl(m_pEncoder, OPUS_SET_BITRATE((opus_int32) ulBitrate));
+        KeRestoreExtendedProcessorState(&xstateSave);
+    }
+} // SetBitrate
+
+//=============================================================================
+void COpusCodec::SetComplexity(
+    IN  ULONG                   ulComplexity
+)
+/*++
+Routine Description:
+  Changes the complexity, like SetBitrate.
+
+Arguments:
+  ulComplexity - 0 to AUDIONET_MAX_COMPLEXITY.
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    XSTATE_SAVE xstateSave;
+
+    m_ulComplexity = ulComplexity;
+
+    if (NT_SUCCESS(KeSaveExtendedProcessorState(OPUS_XSTATE_MASK, &xstateSave))) {
+        opus_encoder_ctl(m_pEncoder, OPUS_SET_COMPLEXITY((opus_int32) ulComplexity));
+        KeRestoreExtendedProcessorState(&xstateSave);
+    }
+} // SetComplexity
+
+//=============================================================================
+void COpusCodec::SetLossFeedback(
+    IN  ULONG                   ulLossPercent,
+    IN  BOOL                    fDtx
+)
+/*++
+Routine Description:
+  Applies a receiver report. FEC is turned on at OPUS_FEC_MIN_LOSS percent
+  and off again when no loss is reported; it needs frames of 10 ms or more.
+
+Arguments:
+  ulLossPercent - recent datagram loss.
+  fDtx - whether the receiver conceals frames that are not sent.
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    XSTATE_SAVE xstateSave;
+    BOOL        fFec = m_fFec ? (ulLossPercent != 0) : (ulLossPercent >= OPUS_FEC_MIN_LOSS);
+
+    m_ulLossPercent = ulLossPercent;
+    m_fDtx          = fDtx;
+
+    if ((fFec != m_fFec) && (m_ulFrameSize * 100 >= m_nSamplesPerSec)) {
+        DPF(D_TERSE, ("Opus FEC %s at %d%% loss", fFec ? "on" : "off", ulLossPercent));
+        if (NT_SUCCESS(Reset(fFec))) {
+            return;
+        }
+    }
+
+    if (NT_SUCCESS(KeSaveExtendedProcessorState(OPUS_XSTATE_MASK, &xstateSave))) {
+        opus_encoder_ctl(m_pEncoder, OPUS_SET_PACKET_LOSS_PERC((opus_int32) ulLossPercent));
+        opus_encoder_ctl(m_pEncoder, OPUS_SET_DTX(fDtx ? 1 : 0));
+        KeRestoreExtendedProcessorState(&xstateSave);
+    }
+} // SetLossFeedback
+#pragma code_seg()
+
+//=============================================================================
+ULONG COpusCodec::GetMaxOutputSize(
+    IN  ULONG                   ulFrames
+)
+{
+    UNREFERENCED_PARAMETER(ulFrames);
+
+    return OPUS_MAX_PACKET;
+} // GetMaxOutputSize
+
+//=============================================================================
+ULONG COpusCodec::Encode(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput
+)
+/*++
+Routine Description:
+  Encodes one Opus frame.
+
+Arguments:
+  pInput - interleaved 16 bit samples.
+  ulFrames - frames to encode, always GetFrameSize().
+  pOutput - receives the Opus packet.
+
+Return Value:
+  Payload length, 0 if there is nothing to send.
+--*/
+{
+    ASSERT(ulFrames == m_ulFrameSize);
+
+    XSTATE_SAVE xstateSave;
+    opus_int32  lBytes;
+
+    if (!NT_SUCCESS(KeSaveExtendedProcessorState(OPUS_XSTATE_MASK, &xstateSave))) {
+        return 0;
+    }
+
+    lBytes = opus_encode(m_pEncoder, (const opus_int16 *) pInput, ulFrames, pOutput, OPUS_MAX_PACKET);
+
+    KeRestoreExtendedProcessorState(&xstateSave);
+
+    if (lBytes < 0) {
+        DPF(D_TERSE, ("opus_encode failed: %d", lBytes));
+        return 0;
+    }
+
+    // In DTX a frame of at most two bytes carries nothing the receiver would
+    // not conceal anyway.
+    if (m_fDtx && (lBytes <= 2)) {
+        return 0;
+    }
+
+    return (ULONG) lBytes;
+} // Encode
+
+#endif
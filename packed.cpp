@@ -0,0 +1,341 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    packed.cpp
+
+Abstract:
+    Implementation of the packed PCM codec.
+
+    Samples are first brought to the packed depth, then packed without
+    padding. At or above the stream depth this is a shift. Below it the
+    samples are requantized with TPDF dither, and with noise shaping the
+    requantization error is fed back through a second order filter, which
+    moves the noise from the low and mid band to the top octave.
+
+    On x64 depths that are a multiple of four bits are packed two samples
+    per 64-bit lane with SSE2, each lane holding a whole number of bytes.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include "codec.h"
+
+#if defined(_M_AMD64)
+#include <emmintrin.h>
+#endif
+
+//=============================================================================
+// Defines
+//=============================================================================
+
+// Error feedback coefficients in Q12. The noise transfer function is
+// 1 - 1.5 z^-1 + 0.6 z^-2: -20 dB at DC, +10 dB at Nyquist.
+#define PACKED_SHAPING_C1           6144
+#define PACKED_SHAPING_C2           (-2458)
+#define PACKED_SHAPING_SHIFT        12
+
+#if defined(_M_AMD64)
+//-----------------------------------------------------------------------------
+// Four samples per iteration, two per 64-bit lane, ulBits a multiple of four.
+// Every store writes eight bytes of which only the first ulBits / 4 are
+// valid, the rest are zero and overwritten by the next store.
+//
+static ULONG PackSse2(IN const LONG *plIn, IN ULONG ulSamples, IN ULONG ulBits, OUT PBYTE pOut)
+{
+    const __m128i mask  = _mm_set_epi32(0, (1 << ulBits) - 1, 0, (1 << ulBits) - 1);
+    const __m128i shift = _mm_cvtsi32_si128(ulBits);
+    const ULONG   ulLane = ulBits / 4;
+    ULONG         ulTotal = (ulSamples * ulBits + 7) / 8;
+    ULONG         ulOut = 0;
+    ULONG         i;
+
+    for (i = 0; (i + 4 <= ulSamples) && (ulOut + ulLane + 8 <= ulTotal); i += 4) {
+        __m128i v    = _mm_loadu_si128((const __m128i *)(plIn + i));
+        __m128i even = _mm_and_si128(v, mask);
+        __m128i odd  = _mm_and_si128(_mm_srli_epi64(v, 32), mask);
+        __m128i lane = _mm_or_si128(even, _mm_sll_epi64(odd, shift));
+
+        _mm_storel_epi64((__m128i *)(pOut + ulOut), lane);
+        _mm_storel_epi64((__m128i *)(pOut + ulOut + ulLane), _mm_srli_si128(lane, 8));
+        ulOut += 2 * ulLane;
+    }
+
+    return i;
+}
+
+//-----------------------------------------------------------------------------
+// 16 bit input at a packed depth of 16 bits or more, eight samples per
+// iteration.
+//
+static ULONG Convert16Sse2(IN const SHORT *pIn, IN ULONG ulCount, IN ULONG ulShift, OUT PLONG plOut)
+{
+    const __m128i shift = _mm_cvtsi32_si128(ulShift);
+    ULONG         i;
+
+    for (i = 0; i + 8 <= ulCount; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(pIn + i));
+
+        _mm_storeu_si128((__m128i *)(plOut + i), _mm_sra_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), s), shift));
+        _mm_storeu_si128((__m128i *)(plOut + i + 4), _mm_sra_epi32(_mm_unpackhi_epi16(_mm_setzero_si128(), s), shift));
+    }
+
+    return i;
+}
+#endif
+
+//=============================================================================
+// CPackedPcmCodec
+//=============================================================================
+
+#pragma code_seg("PAGE")
+//=============================================================================
+CPackedPcmCodec::~CPackedPcmCodec()
+{
+    PAGED_CODE();
+
+    if (m_plBuffer) {
+        ExFreePoolWithTag(m_plBuffer, MSVAD_POOLTAG);
+        m_plBuffer = NULL;
+    }
+} // ~CPackedPcmCodec
+
+//=============================================================================
+NTSTATUS CPackedPcmCodec::Init(
+    IN  PWAVEFORMATEX           pWfx,
+    IN  PCODEC_SETTINGS         pSettings
+)
+/*++
+Routine Description:
+  Takes integer PCM of 8 to 32 bits. The packed depth is the BitDepth
+  setting, or the stream depth up to 24 bits.
+
+Arguments:
+  pWfx - stream format.
+  pSettings - codec settings.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    NTSTATUS ntStatus;
+    USHORT   wBits;
+
+    if (IsFloatFormat(pWfx) || (pWfx->wBitsPerSample % 8)) {
+        DPF(D_TERSE, ("Packed PCM needs integer input"));
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    ntStatus = CAudioCodec::Init(pWfx, pSettings);
+    if (!NT_SUCCESS(ntStatus)) {
+        return ntStatus;
+    }
+
+    wBits = (USHORT) pSettings->BitDepth;
+    if (!wBits) {
+        wBits = (USHORT) min(m_wBitsPerSample, AUDIONET_MAX_BIT_DEPTH);
+    }
+    if ((wBits < AUDIONET_MIN_BIT_DEPTH) || (wBits > AUDIONET_MAX_BIT_DEPTH)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    m_wPackedBits    = wBits;
+    m_fRequantize    = (wBits < m_wBitsPerSample);
+    m_fNoiseShaping  = (pSettings->NoiseShaping != 0);
+    m_ulSeed         = 0x12345678;
+    RtlZeroMemory(m_lError, sizeof(m_lError));
+
+    m_ulMaxFrames = GetFramesPerPacket(AUDIONET_MAX_DATAGRAM - sizeof(AUDIONET_PACKET_HEADER));
+
+    m_plBuffer = (PLONG) ExAllocatePoolWithTag(NonPagedPool, m_ulMaxFrames * m_nChannels * sizeof(LONG), MSVAD_POOLTAG);
+    if (!m_plBuffer) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    DPF(D_TERSE, ("Packed PCM %d to %d bits%s", m_wBitsPerSample, wBits, m_fRequantize ? (m_fNoiseShaping ? ", shaped dither" : ", dither") : ""));
+
+    return STATUS_SUCCESS;
+} // Init
+
+//=============================================================================
+ULONG CPackedPcmCodec::GetFramesPerPacket(
+    IN  ULONG                   ulMaxPayload
+)
+{
+    PAGED_CODE();
+
+    return (ulMaxPayload * 8) / (m_nChannels * m_wPackedBits);
+} // GetFramesPerPacket
+#pragma code_seg()
+
+//=============================================================================
+ULONG CPackedPcmCodec::GetMaxOutputSize(
+    IN  ULONG                   ulFrames
+)
+{
+    return (ulFrames * m_nChannels * m_wPackedBits + 7) / 8;
+} // GetMaxOutputSize
+
+//=============================================================================
+void CPackedPcmCodec::Requantize(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames
+)
+/*++
+Routine Description:
+  Requantizes the input to the packed depth with TPDF dither of one step
+  peak, the difference of two uniform values. The total error, dither
+  included, is fed back when noise shaping is on.
+
+Arguments:
+  pInput - interleaved input.
+  ulFrames - number of frames.
+
+Return Value:
+  void
+--*/
+{
+    ULONG    ulShift = 32 - m_wPackedBits;
+    LONGLONG llStep  = (LONGLONG) 1 << ulShift;
+    LONGLONG llMax   = ((LONGLONG) 1 << (m_wPackedBits - 1)) - 1;
+    LONGLONG llMin   = -llMax - 1;
+    ULONG    ulSeed  = m_ulSeed;
+    PLONG    plOut   = m_plBuffer;
+
+    for (ULONG ulFrame = 0; ulFrame < ulFrames; ulFrame++) {
+        for (ULONG ch = 0; ch < m_nChannels; ch++) {
+            LONGLONG llValue = GetSample32(pInput, ulFrame * m_nChannels + ch);
+            LONGLONG llDither;
+            LONGLONG llQuant;
+            LONGLONG llError;
+
+            if (m_fNoiseShaping) {
+                llValue -= ((LONGLONG) m_lError[ch][0] * PACKED_SHAPING_C1 + (LONGLONG) m_lError[ch][1] * PACKED_SHAPING_C2) >> PACKED_SHAPING_SHIFT;
+            }
+
+            ulSeed   = ulSeed * 1664525 + 1013904223;
+            llDither = ulSeed >> m_wPackedBits;
+            ulSeed   = ulSeed * 1664525 + 1013904223;
+            llDither -= ulSeed >> m_wPackedBits;
+
+            llQuant = (llValue + llDither + (llStep >> 1)) >> ulShift;
+            if (llQuant > llMax) {
+                llQuant = llMax;
+            } else if (llQuant < llMin) {
+                llQuant = llMin;
+            }
+
+            // Clipping leaves an error beyond the dither range, which must
+            // not be fed back in full.
+            llError = (llQuant << ulShift) - llValue;
+            llError = min(max(llError, -2 * llStep), 2 * llStep);
+
+            m_lError[ch][1] = m_lError[ch][0];
+            m_lError[ch][0] = (LONG) llError;
+
+            *plOut++ = (LONG) llQuant;
+        }
+    }
+
+    m_ulSeed = ulSeed;
+} // Requantize
+
+//=============================================================================
+void CPackedPcmCodec::Convert(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulSamples
+)
+/*++
+Routine Description:
+  Brings the input to the packed depth when that is at least the stream
+  depth, which loses nothing.
+
+Arguments:
+  pInput - interleaved input.
+  ulSamples - number of samples.
+
+Return Value:
+  void
+--*/
+{
+    ULONG ulShift = 32 - m_wPackedBits;
+    ULONG i = 0;
+
+#if defined(_M_AMD64)
+    if (m_wBitsPerSample == 16) {
+        i = Convert16Sse2((const SHORT *) pInput, ulSamples, ulShift, m_plBuffer);
+    }
+#endif
+
+    for (; i < ulSamples; i++) {
+        m_plBuffer[i] = GetSample32(pInput, i) >> ulShift;
+    }
+} // Convert
+
+//=============================================================================
+ULONG CPackedPcmCodec::Pack(
+    IN  ULONG                   ulSamples,
+    OUT PBYTE                   pOutput
+)
+/*++
+Routine Description:
+  Packs the samples of m_plBuffer least significant bit first.
+
+Arguments:
+  ulSamples - number of samples.
+  pOutput - receives the packed samples.
+
+Return Value:
+  Bytes written.
+--*/
+{
+    ULONG     ulBits    = m_wPackedBits;
+    ULONG     ulMask    = ((ULONG) 1 << ulBits) - 1;
+    PBYTE     pOut      = pOutput;
+    ULONGLONG ullPending = 0;
+    ULONG     ulPending = 0;
+    ULONG     i = 0;
+
+#if defined(_M_AMD64)
+    if (!(ulBits & 3)) {
+        i = PackSse2(m_plBuffer, ulSamples, ulBits, pOut);
+        pOut += i * ulBits / 8;
+    }
+#endif
+
+    for (; i < ulSamples; i++) {
+        ullPending |= (ULONGLONG) ((ULONG) m_plBuffer[i] & ulMask) << ulPending;
+        ulPending  += ulBits;
+        while (ulPending >= 8) {
+            *pOut++      = (BYTE) ullPending;
+            ullPending >>= 8;
+            ulPending   -= 8;
+        }
+    }
+    if (ulPending) {
+        *pOut++ = (BYTE) ullPending;
+    }
+
+    return (ULONG) (pOut - pOutput);
+} // Pack
+
+//=============================================================================
+ULONG CPackedPcmCodec::Encode(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput
+)
+{
+    ASSERT(ulFrames <= m_ulMaxFrames);
+
+    if (m_fRequantize) {
+        Requantize(pInput, ulFrames);
+    } else {
+        Convert(pInput, ulFrames * m_nChannels);
+    }
+
+    return Pack(ulFrames * m_nChannels, pOutput);
+} // Encode
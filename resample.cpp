@@ -0,0 +1,367 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    resample.cpp
+
+Abstract:
+    Implementation of the polyphase resampler.
+
+    Conceptually the input is upsampled by m_ulUp with zeros, low pass
+    filtered and every m_ulDown-th sample kept. Only the products with the
+    non-zero samples are computed: an output that falls m_ulPhase / m_ulUp
+    after an input sample is the dot product of the m_ulPhase-th subfilter
+    with the last m_ulTaps inputs. The prototype is a Kaiser windowed sinc,
+    designed once in Init without the C runtime.
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <msvad.h>
+#include "dsp.h"
+
+#if defined(_M_AMD64)
+#include <xmmintrin.h>
+#endif
+
+//-----------------------------------------------------------------------------
+static ULONG DspGcd(IN ULONG a, IN ULONG b)
+{
+    while (b) {
+        ULONG t = a % b;
+
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+//-----------------------------------------------------------------------------
+// Modified Bessel function of the first kind, order 0, of sqrt(x2).
+//
+static double DspBesselI0(IN double x2)
+{
+    double dSum  = 1;
+    double dTerm = 1;
+
+    for (ULONG k = 1; k < 64; k++) {
+        dTerm *= x2 / (4.0 * k * k);
+        dSum  += dTerm;
+        if (dTerm < dSum * 1e-12) {
+            break;
+        }
+    }
+
+    return dSum;
+}
+
+//-----------------------------------------------------------------------------
+// Dot product of ulCount floats, ulCount a multiple of four.
+//
+static __forceinline FLOAT DspDot(IN const FLOAT *pfA, IN const FLOAT *pfB, IN ULONG ulCount)
+{
+#if defined(_M_AMD64)
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    ULONG  i;
+
+    for (i = 0; i + 8 <= ulCount; i += 8) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(pfA + i), _mm_loadu_ps(pfB + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(pfA + i + 4), _mm_loadu_ps(pfB + i + 4)));
+    }
+    if (i < ulCount) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(pfA + i), _mm_loadu_ps(pfB + i)));
+    }
+
+    sum0 = _mm_add_ps(sum0, sum1);
+    sum0 = _mm_add_ps(sum0, _mm_movehl_ps(sum0, sum0));
+    sum0 = _mm_add_ss(sum0, _mm_shuffle_ps(sum0, sum0, 1));
+
+    return _mm_cvtss_f32(sum0);
+#else
+    FLOAT fSum = 0;
+
+    for (ULONG i = 0; i < ulCount; i++) {
+        fSum += pfA[i] * pfB[i];
+    }
+
+    return fSum;
+#endif
+}
+
+//=============================================================================
+// CResampler
+//=============================================================================
+
+#pragma code_seg("PAGE")
+//=============================================================================
+CResampler::CResampler() : m_ulUp(1), m_ulDown(1), m_ulTaps(0), m_nChannels(0), m_pfCoefficients(NULL), m_pfHistory(NULL), m_ulHistorySize(0), m_ulFill(0), m_ulIndex(0), m_ulPhase(0)
+{
+    PAGED_CODE();
+} // CResampler
+
+//=============================================================================
+CResampler::~CResampler()
+{
+    PAGED_CODE();
+
+    Free();
+} // ~CResampler
+
+//=============================================================================
+void CResampler::Free(void)
+{
+    PAGED_CODE();
+
+    if (m_pfCoefficients) {
+        ExFreePoolWithTag(m_pfCoefficients, MSVAD_POOLTAG);
+        m_pfCoefficients = NULL;
+    }
+    if (m_pfHistory) {
+        ExFreePoolWithTag(m_pfHistory, MSVAD_POOLTAG);
+        m_pfHistory = NULL;
+    }
+} // Free
+
+//=============================================================================
+BOOL CResampler::IsSupported(
+    IN  ULONG                   ulInputRate,
+    IN  ULONG                   ulOutputRate
+)
+/*++
+Routine Description:
+  Whether the ratio of the rates needs no more than DSP_RESAMPLER_MAX_PHASES
+  phases. That holds between the common rates, e.g. 44.1 and 48 kHz take
+  160 phases, 11.025 and 48 kHz 640.
+
+Arguments:
+  ulInputRate - stream rate.
+  ulOutputRate - network rate.
+
+Return Value:
+  BOOL
+--*/
+{
+    PAGED_CODE();
+
+    if (!ulInputRate || !ulOutputRate) {
+        return FALSE;
+    }
+
+    return (ulOutputRate / DspGcd(ulInputRate, ulOutputRate)) <= DSP_RESAMPLER_MAX_PHASES;
+} // IsSupported
+
+//=============================================================================
+NTSTATUS CResampler::Init(
+    IN  ULONG                   ulInputRate,
+    IN  ULONG                   ulOutputRate,
+    IN  USHORT                  nChannels,
+    IN  ULONG                   ulMaxFrames
+)
+/*++
+Routine Description:
+  Designs the filter for the rates and allocates the history. The filter
+  gets longer with the decimation factor so that its transition band stays
+  the same fraction of the output rate.
+
+Arguments:
+  ulInputRate - stream rate.
+  ulOutputRate - network rate.
+  nChannels - number of channels.
+  ulMaxFrames - most input frames of one Process call.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    ULONG    ulGcd;
+
+    Free();
+
+    if (!IsSupported(ulInputRate, ulOutputRate) || !nChannels || !ulMaxFrames) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    ulGcd       = DspGcd(ulInputRate, ulOutputRate);
+    m_ulUp      = ulOutputRate / ulGcd;
+    m_ulDown    = ulInputRate / ulGcd;
+    m_nChannels = nChannels;
+
+    m_ulTaps = DSP_RESAMPLER_TAPS * ((m_ulDown + m_ulUp - 1) / m_ulUp);
+    m_ulTaps = min(m_ulTaps, DSP_RESAMPLER_MAX_TAPS);
+
+    m_ulHistorySize = m_ulTaps - 1 + ulMaxFrames;
+    m_ulFill        = m_ulTaps - 1;
+    m_ulIndex       = m_ulTaps - 1;
+    m_ulPhase       = 0;
+
+    m_pfCoefficients = (FLOAT *) ExAllocatePoolWithTag(NonPagedPool, m_ulUp * m_ulTaps * sizeof(FLOAT), MSVAD_POOLTAG);
+    m_pfHistory      = (FLOAT *) ExAllocatePoolWithTag(NonPagedPool, m_ulHistorySize * m_nChannels * sizeof(FLOAT), MSVAD_POOLTAG);
+    if (!m_pfCoefficients || !m_pfHistory) {
+        Free();
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    // The history starts as silence.
+    RtlZeroMemory(m_pfHistory, m_ulHistorySize * m_nChannels * sizeof(FLOAT));
+
+#if !defined(_M_AMD64)
+    KFLOATING_SAVE floatSave;
+
+    ntStatus = KeSaveFloatingPointState(&floatSave);
+    if (!NT_SUCCESS(ntStatus)) {
+        Free();
+        return ntStatus;
+    }
+#endif
+
+    Design();
+
+#if !defined(_M_AMD64)
+    KeRestoreFloatingPointState(&floatSave);
+#endif
+
+    DPF(D_TERSE, ("Resampling %d to %d Hz, %d phases of %d taps", ulInputRate, ulOutputRate, m_ulUp, m_ulTaps));
+
+    return ntStatus;
+} // Init
+
+//=============================================================================
+void CResampler::Design(void)
+/*++
+Routine Description:
+  Computes the prototype low pass at the upsampled rate and stores it as
+  m_ulUp time reversed phases. The prototype is scaled so that every phase
+  has about unity gain at DC.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    ULONG  ulLength = m_ulUp * m_ulTaps;
+    double dCenter  = (ulLength - 1) / 2.0;
+    double dBeta2   = DSP_RESAMPLER_KAISER_BETA * DSP_RESAMPLER_KAISER_BETA;
+    double dI0Beta  = DspBesselI0(dBeta2);
+    double dOmega;
+    double dSum = 0;
+    double dScale;
+    ULONG  j;
+
+    // Cutoff in radians per upsampled sample.
+    dOmega = DSP_PI * DSP_RESAMPLER_CUTOFF / max(m_ulUp, m_ulDown);
+
+    for (j = 0; j < ulLength; j++) {
+        double t = j - dCenter;
+        double r = t / dCenter;
+        double h = (t == 0) ? dOmega / DSP_PI : DspSin(dOmega * t) / (DSP_PI * t);
+
+        h    *= DspBesselI0(dBeta2 * (1 - r * r)) / dI0Beta;
+        dSum += h;
+
+        // Tap k of phase p is prototype sample p + k * m_ulUp.
+        m_pfCoefficients[(j % m_ulUp) * m_ulTaps + (m_ulTaps - 1 - j / m_ulUp)] = (FLOAT) h;
+    }
+
+    dScale = m_ulUp / dSum;
+    for (j = 0; j < ulLength; j++) {
+        m_pfCoefficients[j] = (FLOAT) (m_pfCoefficients[j] * dScale);
+    }
+} // Design
+
+//=============================================================================
+ULONG CResampler::GetMaxOutputFrames(
+    IN  ULONG                   ulFrames
+)
+/*++
+Routine Description:
+  Most frames one Process call of ulFrames can return.
+
+Arguments:
+  ulFrames - input frames.
+
+Return Value:
+  Output frames.
+--*/
+{
+    PAGED_CODE();
+
+    return (ULONG) ((ULONGLONG) ulFrames * m_ulUp / m_ulDown) + 2;
+} // GetMaxOutputFrames
+#pragma code_seg()
+
+//=============================================================================
+ULONG CResampler::Process(
+    IN  const FLOAT *           pfInput,
+    IN  ULONG                   ulFrames,
+    OUT FLOAT *                 pfOutput
+)
+/*++
+Routine Description:
+  Appends the input to the history of each channel and computes every
+  output whose filter window it completes. The last m_ulTaps - 1 samples
+  before the next output are kept for the next call.
+
+Arguments:
+  pfInput - interleaved input.
+  ulFrames - number of frames, at most the maximum given to Init.
+  pfOutput - receives the interleaved output.
+
+Return Value:
+  Frames written.
+--*/
+{
+    ULONG ulOutput = 0;
+    ULONG ulShift;
+    ULONG c;
+
+    ASSERT(m_ulFill + ulFrames <= m_ulHistorySize);
+
+    for (c = 0; c < m_nChannels; c++) {
+        FLOAT *pfHistory = m_pfHistory + c * m_ulHistorySize + m_ulFill;
+
+        for (ULONG i = 0; i < ulFrames; i++) {
+            pfHistory[i] = pfInput[i * m_nChannels + c];
+        }
+    }
+    m_ulFill += ulFrames;
+
+    while (m_ulIndex < m_ulFill) {
+        const FLOAT *pfPhase = m_pfCoefficients + m_ulPhase * m_ulTaps;
+        const FLOAT *pfWindow = m_pfHistory + m_ulIndex + 1 - m_ulTaps;
+
+        for (c = 0; c < m_nChannels; c++) {
+            pfOutput[c] = DspDot(pfPhase, pfWindow + c * m_ulHistorySize, m_ulTaps);
+        }
+        pfOutput += m_nChannels;
+        ulOutput++;
+
+        m_ulPhase += m_ulDown;
+        while (m_ulPhase >= m_ulUp) {
+            m_ulPhase -= m_ulUp;
+            m_ulIndex++;
+        }
+    }
+
+    // The next output may lie past the input we have, but by less than a
+    // filter length, so the shift never passes m_ulFill.
+    ulShift = m_ulIndex + 1 - m_ulTaps;
+    if (ulShift) {
+        for (c = 0; c < m_nChannels; c++) {
+            FLOAT *pfHistory = m_pfHistory + c * m_ulHistorySize;
+
+            RtlMoveMemory(pfHistory, pfHistory + ulShift, (m_ulFill - ulShift) * sizeof(FLOAT));
+        }
+        m_ulFill  -= ulShift;
+        m_ulIndex -= ulShift;
+    }
+
+    return ulOutput;
+} // Process
@@ -20,6 +20,7 @@ Abstract:
 
 #include <msvad.h>
 #include "savedata.h"
+#include "simple.h"
 #include <ntstrsafe.h>   // This is for using RtlStringcbPrintf
 
 //=============================================================================
@@ -85,12 +86,65 @@ WskSampleSyncIrpCompletionRoutine(
 }
 
 #pragma code_seg("PAGE")
+//-----------------------------------------------------------------------------
+// Copies the channels a destination gets out of the interleaved frames, in
+// one pass. A map of adjacent channels in order is one copy per frame.
+//
+static void GatherChannels(IN PBYTE pInput, IN ULONG ulFrames, IN ULONG ulInputAlign, IN PSAVEDATA_DESTINATION pDestination, OUT PBYTE pOutput)
+{
+    ULONG ulOutputAlign = pDestination->nBlockAlign;
+    ULONG ulSampleBytes = ulOutputAlign / pDestination->nChannels;
+    ULONG i;
+    ULONG ch;
+
+    if (pDestination->ulFirstChannel != (ULONG) -1) {
+        pInput += pDestination->ulFirstChannel * ulSampleBytes;
+        for (i = 0; i < ulFrames; i++) {
+            RtlCopyMemory(pOutput, pInput, ulOutputAlign);
+            pInput  += ulInputAlign;
+            pOutput += ulOutputAlign;
+        }
+        return;
+    }
+
+    switch (ulSampleBytes) {
+        case 2:
+            for (i = 0; i < ulFrames; i++) {
+                for (ch = 0; ch < pDestination->nChannels; ch++) {
+                    ((SHORT *) pOutput)[ch] = ((SHORT *) pInput)[pDestination->ChannelMap[ch]];
+                }
+                pInput  += ulInputAlign;
+                pOutput += ulOutputAlign;
+            }
+            break;
+
+        case 4:
+            for (i = 0; i < ulFrames; i++) {
+                for (ch = 0; ch < pDestination->nChannels; ch++) {
+                    ((LONG *) pOutput)[ch] = ((LONG *) pInput)[pDestination->ChannelMap[ch]];
+                }
+                pInput  += ulInputAlign;
+                pOutput += ulOutputAlign;
+            }
+            break;
+
+        default:
+            for (i = 0; i < ulFrames; i++) {
+                for (ch = 0; ch < pDestination->nChannels; ch++) {
+                    RtlCopyMemory(pOutput + ch * ulSampleBytes, pInput + pDestination->ChannelMap[ch] * ulSampleBytes, ulSampleBytes);
+                }
+                pInput  += ulInputAlign;
+                pOutput += ulOutputAlign;
+            }
+    }
+}
+
 //=============================================================================
 // CSaveData
 //=============================================================================
 
 //=============================================================================
-CSaveData::CSaveData() : m_socket(NULL), m_dataBuffer(NULL), m_dataMdl(NULL), m_bufferLength(2048), m_fWriteDisabled(FALSE), m_bInitialized(FALSE), m_dataLength(0) {
+CSaveData::CSaveData() : m_socket(NULL), m_dataBuffer(NULL), m_dataMdl(NULL), m_bufferLength(AUDIONET_MAX_DATAGRAM), m_waveFormat(NULL), m_ulDestinations(0), m_pGather(NULL), m_pSettings(NULL), m_pStatus(NULL), m_ulBitrate(0), m_ulComplexity(0), m_ulFramesPerPacket(0), m_ulFrameSize(0), m_lEqualizerGeneration(0), m_pAdapterCommon(NULL), m_ulMixerGeneration(0), m_ulTimestamp(0), m_pRing(NULL), m_ulRingSize(0), m_ulRingRead(0), m_ulRingWrite(0), m_pStaging(NULL), m_ulInputFrames(0), m_ulPending(0), m_pSenderThread(NULL), m_fStopping(FALSE), m_feedbackIrp(NULL), m_feedbackMdl(NULL), m_pFeedback(NULL), m_fFeedbackValid(FALSE), m_lRateTrim(0), m_llRateIntegral(0), m_ullRateReportTime(0), m_fWriteDisabled(FALSE), m_bInitialized(FALSE) {
     PAGED_CODE();
     
     DPF_ENTER(("[CSaveData::CSaveData]"));
@@ -104,6 +158,12 @@ CSaveData::CSaveData() : m_socket(NULL), m_dataBuffer(NULL), m_dataMdl(NULL), m_
     // initialize io completion sychronization event
     KeInitializeEvent(&m_syncEvent, SynchronizationEvent, FALSE);
 
+    KeInitializeMutex(&m_codecSync, 0);
+    KeInitializeEvent(&m_wakeEvent, SynchronizationEvent, FALSE);
+    KeInitializeEvent(&m_feedbackIdle, NotificationEvent, TRUE);
+
+    RtlZeroMemory(m_Destinations, sizeof(m_Destinations));
+
     // Register with WSK.
     wskClientNpi.ClientContext = NULL;
     wskClientNpi.Dispatch = &WskSampleClientDispatch;
@@ -117,6 +177,14 @@ CSaveData::~CSaveData() {
     PAGED_CODE();
 
     DPF_ENTER(("[CSaveData::~CSaveData]"));
+
+    // Stop the sender thread before the socket and the codec go away.
+    if (m_pSenderThread) {
+        m_fStopping = TRUE;
+        KeSetEvent(&m_wakeEvent, 0, FALSE);
+        KeWaitForSingleObject(m_pSenderThread, Executive, KernelMode, FALSE, NULL);
+        ObDereferenceObject(m_pSenderThread);
+    }
     
     if(m_socket) {
         // close socket
@@ -127,6 +195,9 @@ CSaveData::~CSaveData() {
         KeWaitForSingleObject(&m_syncEvent, Executive, KernelMode, FALSE, NULL);
     }
 
+    // Closing the socket completes a pending feedback receive.
+    KeWaitForSingleObject(&m_feedbackIdle, Executive, KernelMode, FALSE, NULL);
+
     // Deregister with WSK. This call will wait until all the references to
     // the WSK provider NPI are released and all the sockets are closed. Note
     // that if the worker thread has not started yet, then when it eventually
@@ -135,10 +206,33 @@ CSaveData::~CSaveData() {
     WskDeregister(&m_wskSampleRegistration);
     
     // clean-up internal buffer
+    if (m_dataMdl) {
+        IoFreeMdl(m_dataMdl);
+    }
     if (m_dataBuffer) {
         ExFreePoolWithTag(m_dataBuffer, MSVAD_POOLTAG);
     }
-    
+
+    if (m_feedbackMdl) {
+        IoFreeMdl(m_feedbackMdl);
+    }
+    if (m_pFeedback) {
+        ExFreePoolWithTag(m_pFeedback, MSVAD_POOLTAG);
+    }
+    if (m_feedbackIrp) {
+        IoFreeIrp(m_feedbackIrp);
+    }
+
+    FreeCodecs();
+    if (m_pRing) {
+        ExFreePoolWithTag(m_pRing, MSVAD_POOLTAG);
+    }
+    if (m_pStaging) {
+        ExFreePoolWithTag(m_pStaging, MSVAD_POOLTAG);
+    }
+    if (m_waveFormat) {
+        ExFreePoolWithTag(m_waveFormat, MSVAD_POOLTAG);
+    }
 } // CSaveData
 
 //=============================================================================
@@ -171,32 +265,62 @@ PDEVICE_OBJECT CSaveData::GetDeviceObject(void) {
 }
 
 //=============================================================================
-NTSTATUS CSaveData::Initialize(void) {
+NTSTATUS CSaveData::Initialize(void)
+/*++
+Routine Description:
+  Creates the socket and starts the sender thread. Every step that already
+  succeeded is kept, so after a failure, e.g. while WSK is not up yet at
+  boot, the next call picks up where this one stopped. Once the sender
+  thread runs further calls do nothing.
+
+Arguments:
+
+Return Value:
+  NT status code.
+--*/
+{
     PAGED_CODE();
 
     NTSTATUS         ntStatus = STATUS_SUCCESS;
     WSK_PROVIDER_NPI wskProviderNpi;
 
     DPF_ENTER(("[CSaveData::Initialize]"));
+
+    if (m_pSenderThread) {
+        return STATUS_SUCCESS;
+    }
     
     // get us a buffer
-    m_dataBuffer = ExAllocatePoolWithTag(NonPagedPool, m_bufferLength, MSVAD_POOLTAG);
-    if(m_dataBuffer == NULL) {
-        DPF(D_TERSE, ("Failed to allocate buffer"));
+    if (!m_dataBuffer) {
+        m_dataBuffer = ExAllocatePoolWithTag(NonPagedPool, m_bufferLength, MSVAD_POOLTAG);
+        if(m_dataBuffer == NULL) {
+            DPF(D_TERSE, ("Failed to allocate buffer"));
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+        RtlZeroMemory(m_dataBuffer, m_bufferLength);
     }
-    RtlZeroMemory(m_dataBuffer, m_bufferLength);
     
     // create MDL for buffer
-    m_dataMdl = IoAllocateMdl(m_dataBuffer, m_bufferLength, FALSE, FALSE, NULL);
-    if(m_dataMdl == NULL) {
-        DPF(D_TERSE, ("Failed to allocate MDL"));
+    if (!m_dataMdl) {
+        m_dataMdl = IoAllocateMdl(m_dataBuffer, m_bufferLength, FALSE, FALSE, NULL);
+        if(m_dataMdl == NULL) {
+            DPF(D_TERSE, ("Failed to allocate MDL"));
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+        MmBuildMdlForNonPagedPool(m_dataMdl);
     }
-    MmBuildMdlForNonPagedPool(m_dataMdl);
     
     // Capture the WSK Provider NPI
-    ntStatus = WskCaptureProviderNPI(&m_wskSampleRegistration, WSK_NO_WAIT, &wskProviderNpi);
+    if (!m_socket) {
+        ntStatus = WskCaptureProviderNPI(&m_wskSampleRegistration, WSK_NO_WAIT, &wskProviderNpi);
+        if (!NT_SUCCESS(ntStatus)) {
+            DPF(D_TERSE, ("Failed to capture the WSK provider: %x", ntStatus));
+        }
+    }
     
-    if(NT_SUCCESS(ntStatus)) {
+    if(!m_socket && NT_SUCCESS(ntStatus)) {
+        PWSK_SOCKET pSocket;
+
         // create datagram socket
         IoReuseIrp(m_irp, STATUS_UNSUCCESSFUL);        
         IoSetCompletionRoutine(m_irp, WskSampleSyncIrpCompletionRoutine, &m_syncEvent, TRUE, TRUE, TRUE);
@@ -218,17 +342,15 @@ NTSTATUS CSaveData::Initialize(void) {
         
         KeWaitForSingleObject(&m_syncEvent, Executive, KernelMode, FALSE, NULL);
         
+        pSocket = (PWSK_SOCKET)m_irp->IoStatus.Information;
         if(NT_SUCCESS(m_irp->IoStatus.Status)) {
             DPF(D_TERSE, ("Successfully created socket"));
-            
-            // save created socket
-            m_socket = (PWSK_SOCKET)m_irp->IoStatus.Information;
         
             // Bind the socket to the wildcard address. Once bind is completed,
             // WSK provider will make WskAcceptEvent callbacks as connections arrive.
             IoReuseIrp(m_irp, STATUS_UNSUCCESSFUL);
             IoSetCompletionRoutine(m_irp, WskSampleSyncIrpCompletionRoutine, &m_syncEvent, TRUE, TRUE, TRUE);
-            ((PWSK_PROVIDER_CONNECTION_DISPATCH)m_socket->Dispatch)->WskBind(m_socket, (PSOCKADDR)&IPv4LocalAddress, 0, m_irp);
+            ((PWSK_PROVIDER_CONNECTION_DISPATCH)pSocket->Dispatch)->WskBind(pSocket, (PSOCKADDR)&IPv4LocalAddress, 0, m_irp);
             KeWaitForSingleObject(&m_syncEvent, Executive, KernelMode, FALSE, NULL);
             
             if(!NT_SUCCESS(m_irp->IoStatus.Status)) {
@@ -236,22 +358,59 @@ NTSTATUS CSaveData::Initialize(void) {
                 DPF(D_TERSE, ("Failed to bind socket: %x", IPv4LocalAddress.sin_addr.S_un.S_addr));
             } else {
                 DPF(D_TERSE, ("Successfully bound socket"));
+
+                // save created socket
+                m_socket = pSocket;
             }
         } else {
             DPF(D_TERSE, ("Failed to create socket: %x", m_irp->IoStatus.Status));
-            if(m_irp->IoStatus.Information) {
-                IoReuseIrp(m_irp, STATUS_UNSUCCESSFUL);
-                IoSetCompletionRoutine(m_irp, WskSampleSyncIrpCompletionRoutine, &m_syncEvent, TRUE, TRUE, TRUE);
-                ((PWSK_PROVIDER_BASIC_DISPATCH)((PWSK_SOCKET)m_irp->IoStatus.Information)->Dispatch)->WskCloseSocket((PWSK_SOCKET)m_irp->IoStatus.Information, m_irp);
-                KeWaitForSingleObject(&m_syncEvent, Executive, KernelMode, FALSE, NULL);
-            }
         }
         ntStatus = m_irp->IoStatus.Status;
+
+        // A socket that could not be bound is closed, the next call makes a
+        // new one.
+        if(!m_socket && pSocket) {
+            IoReuseIrp(m_irp, STATUS_UNSUCCESSFUL);
+            IoSetCompletionRoutine(m_irp, WskSampleSyncIrpCompletionRoutine, &m_syncEvent, TRUE, TRUE, TRUE);
+            ((PWSK_PROVIDER_BASIC_DISPATCH)pSocket->Dispatch)->WskCloseSocket(pSocket, m_irp);
+            KeWaitForSingleObject(&m_syncEvent, Executive, KernelMode, FALSE, NULL);
+        }
         
         // Release the WSK provider NPI since we won't use it anymore
         WskReleaseProviderNPI(&m_wskSampleRegistration);
     }
 
+    // Start the sender thread, which also receives the receiver feedback.
+    if (NT_SUCCESS(ntStatus) && m_socket) {
+        HANDLE hThread;
+
+        if (!m_feedbackIrp) {
+            m_feedbackIrp = IoAllocateIrp(1, FALSE);
+        }
+        if (!m_pFeedback) {
+            m_pFeedback = (PAUDIONET_FEEDBACK) ExAllocatePoolWithTag(NonPagedPool, sizeof(AUDIONET_FEEDBACK), MSVAD_POOLTAG);
+        }
+        if (m_pFeedback && !m_feedbackMdl) {
+            m_feedbackMdl = IoAllocateMdl(m_pFeedback, sizeof(AUDIONET_FEEDBACK), FALSE, FALSE, NULL);
+            if (m_feedbackMdl) {
+                MmBuildMdlForNonPagedPool(m_feedbackMdl);
+            }
+        }
+        if (!m_feedbackIrp || !m_feedbackMdl) {
+            DPF(D_TERSE, ("Failed to allocate feedback buffer"));
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        ntStatus = PsCreateSystemThread(&hThread, THREAD_ALL_ACCESS, NULL, NULL, NULL, SenderThreadRoutine, this);
+        if (NT_SUCCESS(ntStatus)) {
+            ntStatus = ObReferenceObjectByHandle(hThread, THREAD_ALL_ACCESS, NULL, KernelMode, (PVOID *) &m_pSenderThread, NULL);
+            ZwClose(hThread);
+        }
+        if (!NT_SUCCESS(ntStatus)) {
+            DPF(D_TERSE, ("Failed to start sender thread: %x", ntStatus));
+        }
+    }
+
     return ntStatus;
 } // Initialize
 
@@ -284,6 +443,14 @@ NTSTATUS CSaveData::SetDataFormat(
         m_waveFormat = (PWAVEFORMATEX) ExAllocatePoolWithTag(NonPagedPool, (pwfx->wFormatTag == WAVE_FORMAT_PCM) ? sizeof(PCMWAVEFORMAT) : sizeof(WAVEFORMATEX) + pwfx->cbSize, MSVAD_POOLTAG);
         if(m_waveFormat) {
             RtlCopyMemory(m_waveFormat, pwfx,(pwfx->wFormatTag == WAVE_FORMAT_PCM) ? sizeof(PCMWAVEFORMAT) : sizeof(WAVEFORMATEX) + pwfx->cbSize);
+
+            // A format without kernels is still sent, just not metered.
+            m_Meter.Init(m_waveFormat);
+
+            // Without settings the codec is created by SetCodecSettings.
+            if (m_pSettings) {
+                ntStatus = CreateCodec();
+            }
         } else {
             ntStatus = STATUS_INSUFFICIENT_RESOURCES;
         }
@@ -291,50 +458,948 @@ NTSTATUS CSaveData::SetDataFormat(
     return ntStatus;
 } // SetDataFormat
 
+//=============================================================================
+NTSTATUS CSaveData::SetCodecSettings(
+    IN PCODEC_SETTINGS          pSettings,
+    IN PCODEC_STATUS            pStatus
+)
+/*++
+Routine Description:
+  Selects the codec settings. The codec and frame duration are taken when
+  the codec is created, bitrate and complexity are followed while the stream
+  runs. Must not be called while the stream runs.
+
+Arguments:
+  pSettings - settings of the miniport, which outlives the stream.
+  pStatus - status of the miniport the sender reports to.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(pSettings);
+    ASSERT(pStatus);
+
+    DPF_ENTER(("[CSaveData::SetCodecSettings]"));
+
+    if (pSettings->CodecId >= AUDIONET_CODEC_COUNT) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    m_pSettings = pSettings;
+    m_pStatus   = pStatus;
+
+    // Without a format the codec is created by SetDataFormat.
+    if (m_waveFormat) {
+        return CreateCodec();
+    }
+
+    return STATUS_SUCCESS;
+} // SetCodecSettings
+
+//=============================================================================
+void CSaveData::SetAdapterCommon(
+    IN  PADAPTERCOMMON          pAdapterCommon
+)
+/*++
+Routine Description:
+  Sets the adapter common object whose topology volume and mute are
+  applied to the stream. Must be called before SetDataFormat.
+
+Arguments:
+  pAdapterCommon - adapter common object, owned by the miniport.
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    m_pAdapterCommon = pAdapterCommon;
+} // SetAdapterCommon
+
+//=============================================================================
+NTSTATUS CSaveData::CreateCodec(void)
+/*++
+Routine Description:
+  (Re)creates the codec for the current format and settings, sizes the
+  datagrams for it and allocates the ring buffer of the sender thread.
+  With a network sample rate or a channel matrix set the codec gets the
+  stream format at that rate and with the matrix outputs, and the
+  processor converts to it.
+
+Arguments:
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    NTSTATUS             ntStatus;
+    ULONG                ulBlockAlign;
+    ULONG                ulPacketBytes;
+    ULONG                ulStagingFrames;
+    ULONG                ulRate;
+    WAVEFORMATEXTENSIBLE wfxNetwork;
+    PAUDIONET_CHANNEL_MATRIX pMatrix;
+    AUDIONET_DESTINATION defaultDestination;
+    ULONG                ulGatherAlign;
+
+    ASSERT(m_waveFormat);
+    ASSERT(m_pSettings);
+
+    // The first destination may be another receiver now.
+    m_lRateTrim         = 0;
+    m_llRateIntegral    = 0;
+    m_ullRateReportTime = 0;
+
+    ulRate = m_waveFormat->nSamplesPerSec;
+    if (m_pSettings->SampleRate && (m_pSettings->SampleRate != ulRate)) {
+        if (CResampler::IsSupported(ulRate, m_pSettings->SampleRate)) {
+            ulRate = m_pSettings->SampleRate;
+        } else {
+            DPF(D_TERSE, ("Cannot resample %d to %d Hz", ulRate, m_pSettings->SampleRate));
+        }
+    }
+
+    pMatrix = m_pSettings->ChannelMatrix.OutputChannels ? &m_pSettings->ChannelMatrix : NULL;
+
+    // The codecs only latch the format, so a copy at the network rate will
+    // do. Extensible formats keep their SubFormat; a matrix output has no
+    // speaker positions.
+    RtlZeroMemory(&wfxNetwork, sizeof(wfxNetwork));
+    RtlCopyMemory(&wfxNetwork, m_waveFormat, min(sizeof(WAVEFORMATEX) + m_waveFormat->cbSize, sizeof(wfxNetwork)));
+    wfxNetwork.Format.cbSize          = (WORD) min(m_waveFormat->cbSize, sizeof(wfxNetwork) - sizeof(WAVEFORMATEX));
+    wfxNetwork.Format.nSamplesPerSec  = ulRate;
+    if (pMatrix) {
+        wfxNetwork.Format.nChannels   = (WORD) pMatrix->OutputChannels;
+        wfxNetwork.Format.nBlockAlign = (WORD) (m_waveFormat->nBlockAlign / m_waveFormat->nChannels * pMatrix->OutputChannels);
+        if (wfxNetwork.Format.cbSize >= sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)) {
+            wfxNetwork.dwChannelMask = 0;
+        }
+    }
+    wfxNetwork.Format.nAvgBytesPerSec = ulRate * wfxNetwork.Format.nBlockAlign;
+
+    KeWaitForSingleObject(&m_codecSync, Executive, KernelMode, FALSE, NULL);
+
+    FreeCodecs();
+    if (m_pRing) {
+        ExFreePoolWithTag(m_pRing, MSVAD_POOLTAG);
+        m_pRing = NULL;
+    }
+    if (m_pStaging) {
+        ExFreePoolWithTag(m_pStaging, MSVAD_POOLTAG);
+        m_pStaging = NULL;
+    }
+    m_ulFramesPerPacket = 0;
+    m_ulFrameSize       = 0;
+    m_ulInputFrames     = 0;
+    m_ulPending         = 0;
+    m_ulRingRead        = 0;
+    m_ulRingWrite       = 0;
+
+    // Without destinations everything goes to the default receiver.
+    if (m_pSettings->Destinations.Count) {
+        for (ULONG i = 0; i < m_pSettings->Destinations.Count; i++) {
+            ntStatus = AddDestination(&m_pSettings->Destinations.Destination[i], i, &wfxNetwork);
+        }
+    } else {
+        RtlZeroMemory(&defaultDestination, sizeof(defaultDestination));
+        defaultDestination.Address = IPv4RemoteAddress.sin_addr.S_un.S_addr;
+        defaultDestination.Port    = IPv4RemoteAddress.sin_port;
+
+        ntStatus = AddDestination(&defaultDestination, 0, &wfxNetwork);
+    }
+
+    // Destinations the codec cannot serve are left out, but one must remain.
+    // The codecs only differ in channels, so they share the frame size; the
+    // packet is what fits for the widest one.
+    if (m_ulDestinations) {
+        m_ulBitrate         = m_pSettings->Bitrate;
+        m_ulComplexity      = m_pSettings->Complexity;
+        m_ulFramesPerPacket = MAXUSHORT;
+        m_ulFrameSize       = m_Destinations[0].pCodec->GetFrameSize();
+        ulGatherAlign       = 0;
+
+        ntStatus = STATUS_SUCCESS;
+        for (ULONG i = 0; i < m_ulDestinations; i++) {
+            m_ulFramesPerPacket = min(m_ulFramesPerPacket, m_Destinations[i].pCodec->GetFramesPerPacket(m_bufferLength - sizeof(AUDIONET_PACKET_HEADER)));
+            if (m_Destinations[i].pCodec->GetFrameSize() != m_ulFrameSize) {
+                ntStatus = STATUS_NOT_SUPPORTED;
+            }
+            ulGatherAlign = max(ulGatherAlign, m_Destinations[i].nBlockAlign);
+        }
+        if (m_ulFrameSize > m_ulFramesPerPacket) {
+            ntStatus = STATUS_NOT_SUPPORTED;
+        }
+
+        // Every destination can be equalized and delayed, into the gather
+        // buffer.
+        if (NT_SUCCESS(ntStatus)) {
+            m_pGather = (PBYTE) ExAllocatePoolWithTag(NonPagedPool, m_ulFramesPerPacket * ulGatherAlign, MSVAD_POOLTAG);
+            if (!m_pGather) {
+                ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+            }
+        }
+        for (ULONG i = 0; NT_SUCCESS(ntStatus) && (i < m_ulDestinations); i++) {
+            m_Destinations[i].pEqualizer = new (NonPagedPool, MSVAD_POOLTAG) CEqualizer();
+            if (m_Destinations[i].pEqualizer) {
+                ntStatus = m_Destinations[i].pEqualizer->Init(&wfxNetwork.Format, m_Destinations[i].nChannels, m_ulFramesPerPacket);
+            } else {
+                ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+            }
+            if (NT_SUCCESS(ntStatus)) {
+                m_Destinations[i].pDelay = new (NonPagedPool, MSVAD_POOLTAG) CDelay();
+                if (m_Destinations[i].pDelay) {
+                    ntStatus = m_Destinations[i].pDelay->Init(&wfxNetwork.Format, m_Destinations[i].nChannels, m_ulFramesPerPacket);
+                } else {
+                    ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+                }
+            }
+        }
+
+        DPF(D_TERSE, ("Codec %d - %d destinations, %d frames per packet", m_pSettings->CodecId, m_ulDestinations, m_ulFramesPerPacket));
+    } else if (NT_SUCCESS(ntStatus)) {
+        ntStatus = STATUS_NOT_SUPPORTED;
+    }
+
+    // The ring is read a packet at a time; when resampling that is the
+    // stream frames of about one packet at the network rate.
+    if (NT_SUCCESS(ntStatus)) {
+        m_ulInputFrames = m_ulFramesPerPacket;
+        if (ulRate != m_waveFormat->nSamplesPerSec) {
+            m_ulInputFrames = max((ULONG) ((ULONGLONG) m_ulFramesPerPacket * m_waveFormat->nSamplesPerSec / ulRate), 1);
+        }
+
+        ntStatus = m_Processor.SetFormat(m_waveFormat, m_ulInputFrames, ulRate, pMatrix, m_pSettings->Limiter.Lookahead ? &m_pSettings->Limiter : NULL,
+                                         m_pSettings->Normalization.Target ? &m_pSettings->Normalization : NULL);
+    }
+
+    // A quarter second of frames, and at least a few packets. Converted
+    // frames collect in the staging buffer until they fill a packet; a
+    // wrapped read is two Process calls, which may give one frame more.
+    if (NT_SUCCESS(ntStatus)) {
+        ulBlockAlign  = m_waveFormat->nBlockAlign;
+        ulPacketBytes = m_ulInputFrames * ulBlockAlign;
+        m_ulRingSize  = max(m_waveFormat->nAvgBytesPerSec / 4, 4 * ulPacketBytes);
+        m_ulRingSize -= m_ulRingSize % ulBlockAlign;
+
+        ulStagingFrames = m_ulFramesPerPacket;
+        if (m_Processor.IsConverting()) {
+            ulStagingFrames += m_Processor.GetMaxOutputFrames(m_ulInputFrames) + 1;
+        }
+
+        m_pRing    = (PBYTE) ExAllocatePoolWithTag(NonPagedPool, m_ulRingSize, MSVAD_POOLTAG);
+        m_pStaging = (PBYTE) ExAllocatePoolWithTag(NonPagedPool, ulStagingFrames * max(ulBlockAlign, m_Processor.GetOutputBlockAlign()), MSVAD_POOLTAG);
+        if (!m_pRing || !m_pStaging) {
+            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    // The processor starts at unity gain; make the next block pick up the
+    // mixer state whether it changed or not.
+    if (m_pAdapterCommon) {
+        m_ulMixerGeneration = m_pAdapterCommon->MixerGenerationRead() - 1;
+    }
+    m_lEqualizerGeneration = m_pSettings->EqualizerGeneration - 1;
+
+    if (!NT_SUCCESS(ntStatus)) {
+        m_ulFramesPerPacket = 0;
+    }
+
+    KeReleaseMutex(&m_codecSync, FALSE);
+
+    return ntStatus;
+} // CreateCodec
+
+//=============================================================================
+NTSTATUS CSaveData::AddDestination(
+    IN  PAUDIONET_DESTINATION   pDestination,
+    IN  ULONG                   ulIndex,
+    IN  PWAVEFORMATEXTENSIBLE   pWfx
+)
+/*++
+Routine Description:
+  Creates the codec of a destination for the channels its map selects.
+  Called by CreateCodec with m_codecSync held.
+
+Arguments:
+  pDestination - destination from the settings, or the default receiver.
+  ulIndex - index of the destination in the settings.
+  pWfx - format of the network stream, after the processor.
+
+Return Value:
+  NT status code.
+--*/
+{
+    PAGED_CODE();
+
+    PSAVEDATA_DESTINATION pEntry = &m_Destinations[m_ulDestinations];
+    WAVEFORMATEXTENSIBLE  wfx    = *pWfx;
+    USHORT                nSampleBytes = pWfx->Format.nBlockAlign / pWfx->Format.nChannels;
+    NTSTATUS              ntStatus;
+
+    ASSERT(m_ulDestinations < AUDIONET_MAX_DESTINATIONS);
+
+    RtlZeroMemory(pEntry, sizeof(*pEntry));
+    pEntry->ulIndex                      = ulIndex;
+    pEntry->Address.sin_family           = AF_INET;
+    pEntry->Address.sin_port             = pDestination->Port;
+    pEntry->Address.sin_addr.S_un.S_addr = pDestination->Address;
+
+    // A map in stream order that starts anywhere is copied a frame at a time.
+    pEntry->nChannels      = pDestination->Channels ? pDestination->Channels : pWfx->Format.nChannels;
+    pEntry->nBlockAlign    = pEntry->nChannels * nSampleBytes;
+    pEntry->fGather        = (pEntry->nChannels != pWfx->Format.nChannels);
+    pEntry->ulFirstChannel = pDestination->Channels ? pDestination->ChannelMap[0] : 0;
+
+    for (ULONG ch = 0; ch < pEntry->nChannels; ch++) {
+        pEntry->ChannelMap[ch] = pDestination->Channels ? pDestination->ChannelMap[ch] : (UCHAR) ch;
+        if (pEntry->ChannelMap[ch] >= pWfx->Format.nChannels) {
+            DPF(D_TERSE, ("Destination %d needs channel %d of %d", m_ulDestinations, pEntry->ChannelMap[ch], pWfx->Format.nChannels));
+            return STATUS_NOT_SUPPORTED;
+        }
+        if (pEntry->ChannelMap[ch] != ch) {
+            pEntry->fGather = TRUE;
+        }
+        if (pEntry->ChannelMap[ch] != pEntry->ulFirstChannel + ch) {
+            pEntry->ulFirstChannel = (ULONG) -1;
+        }
+    }
+
+    if (pEntry->fGather) {
+        wfx.Format.nChannels       = pEntry->nChannels;
+        wfx.Format.nBlockAlign     = pEntry->nBlockAlign;
+        wfx.Format.nAvgBytesPerSec = wfx.Format.nSamplesPerSec * pEntry->nBlockAlign;
+        if (wfx.Format.cbSize >= sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)) {
+            wfx.dwChannelMask = 0;
+        }
+    }
+
+    ntStatus = NewAudioCodec(&pEntry->pCodec, m_pSettings, &wfx.Format);
+    if (!NT_SUCCESS(ntStatus)) {
+        DPF(D_TERSE, ("Failed to create codec %d: %x", m_pSettings->CodecId, ntStatus));
+        return ntStatus;
+    }
+
+    m_ulDestinations++;
+
+    return STATUS_SUCCESS;
+} // AddDestination
+
+//=============================================================================
+void CSaveData::FreeCodecs(void)
+{
+    PAGED_CODE();
+
+    for (ULONG i = 0; i < m_ulDestinations; i++) {
+        delete m_Destinations[i].pCodec;
+        m_Destinations[i].pCodec = NULL;
+        if (m_Destinations[i].pEqualizer) {
+            delete m_Destinations[i].pEqualizer;
+            m_Destinations[i].pEqualizer = NULL;
+        }
+        if (m_Destinations[i].pDelay) {
+            delete m_Destinations[i].pDelay;
+            m_Destinations[i].pDelay = NULL;
+        }
+    }
+    m_ulDestinations = 0;
+
+    if (m_pGather) {
+        ExFreePoolWithTag(m_pGather, MSVAD_POOLTAG);
+        m_pGather = NULL;
+    }
+} // FreeCodecs
+
+//=============================================================================
+VOID SenderThreadRoutine(
+    IN  PVOID                   StartContext
+)
+{
+    PAGED_CODE();
+
+    ((PCSaveData) StartContext)->SenderThread();
+
+    PsTerminateSystemThread(STATUS_SUCCESS);
+} // SenderThreadRoutine
+
+//=============================================================================
+void CSaveData::SenderThread(void)
+/*++
+Routine Description:
+  Body of the sender thread. Wakes up whenever WriteData queued frames or
+  feedback arrived, and runs until the object is destroyed.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    KeSetPriorityThread(KeGetCurrentThread(), LOW_REALTIME_PRIORITY);
+
+    ReceiveFeedback();
+
+    while (TRUE) {
+        KeWaitForSingleObject(&m_wakeEvent, Executive, KernelMode, FALSE, NULL);
+        if (m_fStopping) {
+            break;
+        }
+
+        // The feedback buffer is only stable while no receive is pending.
+        if (KeReadStateEvent(&m_feedbackIdle)) {
+            if (m_fFeedbackValid) {
+                m_fFeedbackValid = FALSE;
+
+                KeWaitForSingleObject(&m_codecSync, Executive, KernelMode, FALSE, NULL);
+                for (ULONG i = 0; i < m_ulDestinations; i++) {
+                    if ((m_feedbackAddress.sin_addr.S_un.S_addr == m_Destinations[i].Address.sin_addr.S_un.S_addr) &&
+                        (m_feedbackAddress.sin_port == m_Destinations[i].Address.sin_port)) {
+                        m_Destinations[i].pCodec->SetLossFeedback(min(m_pFeedback->LossPercent, 100), (m_pFeedback->Flags & AUDIONET_FEEDBACK_DTX) != 0);
+                        if ((i == 0) && (m_pFeedback->Flags & AUDIONET_FEEDBACK_BUFFER)) {
+                            UpdateRateTrim(m_pFeedback, m_Destinations[0].pCodec->GetSampleRate());
+                        }
+                        break;
+                    }
+                }
+                KeReleaseMutex(&m_codecSync, FALSE);
+            }
+            ReceiveFeedback();
+        }
+
+        SendQueuedData();
+    }
+} // SenderThread
+
+//=============================================================================
+void CSaveData::UpdateRateTrim(
+    IN  PAUDIONET_FEEDBACK      pFeedback,
+    IN  ULONG                   ulRate
+)
+/*++
+Routine Description:
+  Steers the render clock to the clock of the first destination. Its buffer
+  depth against its target is the phase error of the two clocks; a
+  proportional and an integral term turn it into a trim that the stream
+  position applies, so a growing buffer slows the render rate down. The
+  integral settles on the frequency offset of the clocks, leaving no
+  standing error, in about a minute. Called with m_codecSync held.
+
+Arguments:
+  pFeedback - report with AUDIONET_FEEDBACK_BUFFER set.
+  ulRate - network frames per second.
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    ULONGLONG ullNow = KeQueryInterruptTime();
+    LONGLONG  llError;
+    LONGLONG  llTrim;
+    ULONG     ulInterval;
+
+    if (!ulRate) {
+        return;
+    }
+
+    // Microseconds of buffer above the target.
+    llError = ((LONGLONG) pFeedback->BufferedFrames - (LONGLONG) pFeedback->TargetFrames) * 1000000 / ulRate;
+    llError = max(min(llError, SAVEDATA_MAX_RATE_ERROR), -SAVEDATA_MAX_RATE_ERROR);
+
+    // The first report only starts the interval.
+    if (m_ullRateReportTime) {
+        ulInterval = (ULONG) min((ullNow - m_ullRateReportTime) / 10000, SAVEDATA_MAX_RATE_INTERVAL);
+
+        m_llRateIntegral += llError * ulInterval / SAVEDATA_RATE_KI_DIVISOR;
+        m_llRateIntegral  = max(min(m_llRateIntegral, (LONGLONG) SAVEDATA_MAX_RATE_TRIM * 1000), -(LONGLONG) SAVEDATA_MAX_RATE_TRIM * 1000);
+    }
+    m_ullRateReportTime = ullNow;
+
+    llTrim = m_llRateIntegral / 1000 + llError * SAVEDATA_RATE_KP;
+    llTrim = max(min(llTrim, SAVEDATA_MAX_RATE_TRIM), -SAVEDATA_MAX_RATE_TRIM);
+
+    InterlockedExchange(&m_lRateTrim, (LONG) llTrim);
+} // UpdateRateTrim
+
+//=============================================================================
+void CSaveData::UpdateMixer(void)
+/*++
+Routine Description:
+  Passes the wave out and line out volume and the wave out mute to the
+  processor when they changed. The controls are read without a lock; the
+  mixer generation is read before and after, and if it moved in between
+  they are read again.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    LONG  lVolume[CODEC_MAX_CHANNELS];
+    BOOL  fMute;
+    ULONG ulGeneration;
+
+    if (!m_pAdapterCommon || (m_pAdapterCommon->MixerGenerationRead() == m_ulMixerGeneration)) {
+        return;
+    }
+
+    do {
+        ulGeneration = m_pAdapterCommon->MixerGenerationRead();
+        KeMemoryBarrier();
+
+        fMute = m_pAdapterCommon->MixerMuteRead(KSNODE_TOPO_WAVEOUT_MUTE);
+        for (LONG ch = 0; ch < m_waveFormat->nChannels; ch++) {
+            lVolume[ch] = m_pAdapterCommon->MixerVolumeRead(KSNODE_TOPO_WAVEOUT_VOLUME, ch) +
+                          m_pAdapterCommon->MixerVolumeRead(KSNODE_TOPO_LINEOUT_VOLUME, ch);
+        }
+
+        KeMemoryBarrier();
+    } while (m_pAdapterCommon->MixerGenerationRead() != ulGeneration);
+
+    m_ulMixerGeneration = ulGeneration;
+    m_Processor.SetGain(lVolume, fMute);
+} // UpdateMixer
+
+//=============================================================================
+void CSaveData::UpdateEqualizers(void)
+/*++
+Routine Description:
+  Passes changed equalizer sections to the destinations, which fade over
+  to them. The sections are copied without a lock and only used if the
+  generation was even and did not move meanwhile; otherwise the next call
+  tries again.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    AUDIONET_EQUALIZER equalizers[AUDIONET_MAX_DESTINATIONS];
+    LONG               lGeneration;
+
+    lGeneration = m_pSettings->EqualizerGeneration;
+    if (lGeneration & 1) {
+        return;
+    }
+    KeMemoryBarrier();
+
+    RtlCopyMemory(equalizers, m_pSettings->Equalizer, sizeof(equalizers));
+
+    KeMemoryBarrier();
+    if (m_pSettings->EqualizerGeneration != lGeneration) {
+        return;
+    }
+
+    m_lEqualizerGeneration = lGeneration;
+    for (ULONG i = 0; i < m_ulDestinations; i++) {
+        m_Destinations[i].pEqualizer->SetSections(&equalizers[m_Destinations[i].ulIndex], TRUE);
+    }
+} // UpdateEqualizers
+
+//=============================================================================
+void CSaveData::SendQueuedData(void)
+/*++
+Routine Description:
+  Applies changed settings and sends what WriteData queued. Codecs with a
+  fixed frame size only get whole frames, the rest get up to a packet.
+  Resampled or mixed streams go through SendConvertedData.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    KeWaitForSingleObject(&m_codecSync, Executive, KernelMode, FALSE, NULL);
+
+    if (m_ulDestinations && m_pRing && m_ulFramesPerPacket) {
+        ULONG ulBlockAlign = m_waveFormat->nBlockAlign;
+        ULONG ulFrameSize  = m_ulFrameSize;
+
+        if (m_pSettings->Bitrate != m_ulBitrate) {
+            m_ulBitrate = m_pSettings->Bitrate;
+            for (ULONG i = 0; i < m_ulDestinations; i++) {
+                m_Destinations[i].pCodec->SetBitrate(m_ulBitrate);
+            }
+        }
+        if (m_pSettings->Complexity != m_ulComplexity) {
+            m_ulComplexity = m_pSettings->Complexity;
+            for (ULONG i = 0; i < m_ulDestinations; i++) {
+                m_Destinations[i].pCodec->SetComplexity(m_ulComplexity);
+            }
+        }
+        if (m_pSettings->EqualizerGeneration != m_lEqualizerGeneration) {
+            UpdateEqualizers();
+        }
+        for (ULONG i = 0; i < m_ulDestinations; i++) {
+            ULONG ulDelay = m_pSettings->Delay[m_Destinations[i].ulIndex];
+
+            if (ulDelay != m_Destinations[i].pDelay->GetDelay()) {
+                m_Destinations[i].pDelay->SetDelay(ulDelay);
+            }
+        }
+
+        if (m_Processor.IsConverting()) {
+            SendConvertedData();
+        } else {
+            while (TRUE) {
+                ULONG ulRead   = m_ulRingRead;
+                ULONG ulBytes  = (m_ulRingWrite + m_ulRingSize - ulRead) % m_ulRingSize;
+                ULONG ulFrames = ulBytes / ulBlockAlign;
+                PBYTE pFrames;
+
+                // Read the frames only after the write offset.
+                KeMemoryBarrier();
+
+                if (ulFrameSize) {
+                    if (ulFrames < ulFrameSize) {
+                        break;
+                    }
+                    ulFrames = ulFrameSize;
+                } else {
+                    if (!ulFrames) {
+                        break;
+                    }
+                    ulFrames = min(ulFrames, m_ulFramesPerPacket);
+                }
+
+                UpdateMixer();
+
+                // The ring holds whole frames, so both parts of a wrapped read
+                // do as well. Processed frames always go to the staging buffer
+                // so the ring is never written by this thread.
+                ulBytes = ulFrames * ulBlockAlign;
+                if (m_Processor.IsActive()) {
+                    ULONG ulFirst = min(ulBytes, m_ulRingSize - ulRead);
+
+                    m_Processor.Process(m_pRing + ulRead, ulFirst / ulBlockAlign, m_pStaging);
+                    if (ulFirst < ulBytes) {
+                        m_Processor.Process(m_pRing, (ulBytes - ulFirst) / ulBlockAlign, m_pStaging + ulFirst);
+                    }
+                    pFrames = m_pStaging;
+                } else if (ulRead + ulBytes <= m_ulRingSize) {
+                    pFrames = m_pRing + ulRead;
+                    m_Processor.Measure(pFrames, ulFrames);
+                } else {
+                    ULONG ulFirst = m_ulRingSize - ulRead;
+
+                    RtlCopyMemory(m_pStaging, m_pRing + ulRead, ulFirst);
+                    RtlCopyMemory(m_pStaging + ulFirst, m_pRing, ulBytes - ulFirst);
+                    pFrames = m_pStaging;
+                    m_Processor.Measure(pFrames, ulFrames);
+                }
+
+                SendPacket(pFrames, ulFrames);
+
+                KeMemoryBarrier();
+                m_ulRingRead = (ulRead + ulBytes) % m_ulRingSize;
+            }
+        }
+    }
+
+    KeReleaseMutex(&m_codecSync, FALSE);
+} // SendQueuedData
+
+//=============================================================================
+void CSaveData::SendConvertedData(void)
+/*++
+Routine Description:
+  Converts what WriteData queued into the staging buffer and sends it a
+  packet at a time. Codecs without a fixed frame size also get the rest
+  once the ring is empty, so the latency matches unconverted streams.
+  Called with m_codecSync held.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    ULONG ulBlockAlign  = m_waveFormat->nBlockAlign;
+    ULONG ulOutputAlign = m_Processor.GetOutputBlockAlign();
+    ULONG ulFrameSize   = m_ulFrameSize;
+    ULONG ulPacket      = ulFrameSize ? ulFrameSize : m_ulFramesPerPacket;
+
+    while (TRUE) {
+        ULONG ulRead;
+        ULONG ulBytes;
+        ULONG ulFrames;
+        ULONG ulFirst;
+
+        if (m_ulPending >= ulPacket) {
+            SendPacket(m_pStaging, ulPacket);
+
+            m_ulPending -= ulPacket;
+            RtlMoveMemory(m_pStaging, m_pStaging + ulPacket * ulOutputAlign, m_ulPending * ulOutputAlign);
+            continue;
+        }
+
+        ulRead   = m_ulRingRead;
+        ulBytes  = (m_ulRingWrite + m_ulRingSize - ulRead) % m_ulRingSize;
+        ulFrames = ulBytes / ulBlockAlign;
+
+        // Read the frames only after the write offset.
+        KeMemoryBarrier();
+
+        if (!ulFrames) {
+            if (!ulFrameSize && m_ulPending) {
+                SendPacket(m_pStaging, m_ulPending);
+                m_ulPending = 0;
+            }
+            break;
+        }
+
+        UpdateMixer();
+
+        ulFrames = min(ulFrames, m_ulInputFrames);
+        ulBytes  = ulFrames * ulBlockAlign;
+        ulFirst  = min(ulBytes, m_ulRingSize - ulRead);
+
+        m_ulPending += m_Processor.Process(m_pRing + ulRead, ulFirst / ulBlockAlign, m_pStaging + m_ulPending * ulOutputAlign);
+        if (ulFirst < ulBytes) {
+            m_ulPending += m_Processor.Process(m_pRing, (ulBytes - ulFirst) / ulBlockAlign, m_pStaging + m_ulPending * ulOutputAlign);
+        }
+
+        KeMemoryBarrier();
+        m_ulRingRead = (ulRead + ulBytes) % m_ulRingSize;
+    }
+} // SendConvertedData
+
+//=============================================================================
+void CSaveData::SendPacket(
+    IN  PBYTE                   pFrames,
+    IN  ULONG                   ulFrames
+)
+/*++
+Routine Description:
+  Encodes up to m_ulFramesPerPacket frames behind a packet header and sends
+  the datagram, once per destination with the channels it gets. Nothing is
+  sent if a codec produced no payload; the timestamp still advances. Also
+  reports the limiter reduction of the frames processed since the last
+  packet and the loudness to the miniport.
+
+Arguments:
+  pFrames - frames in the network format.
+  ulFrames - number of frames.
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    PAUDIONET_PACKET_HEADER pHeader = (PAUDIONET_PACKET_HEADER) m_dataBuffer;
+    WSK_BUF                 wskbuf;
+    ULONG                   ulPayload;
+    AUDIONET_LOUDNESS       loudness;
+
+    for (ULONG i = 0; i < m_ulDestinations; i++) {
+        PSAVEDATA_DESTINATION pDestination = &m_Destinations[i];
+        PBYTE                 pInput       = pFrames;
+
+        if (pDestination->fGather) {
+            GatherChannels(pFrames, ulFrames, m_Processor.GetOutputBlockAlign(), pDestination, m_pGather);
+            pInput = m_pGather;
+        }
+        if (pDestination->pEqualizer->IsActive()) {
+            pDestination->pEqualizer->Process(pInput, ulFrames, m_pGather);
+            pInput = m_pGather;
+        }
+        if (pDestination->pDelay->IsActive()) {
+            pDestination->pDelay->Process(pInput, ulFrames, m_pGather);
+            pInput = m_pGather;
+        }
+
+        ulPayload = pDestination->pCodec->Encode(pInput, ulFrames, (PBYTE) (pHeader + 1));
+        if (!ulPayload) {
+            continue;
+        }
+
+        pHeader->Version       = AUDIONET_PACKET_VERSION;
+        pHeader->Codec         = (UCHAR) pDestination->pCodec->GetCodecId();
+        pHeader->Channels      = (UCHAR) pDestination->pCodec->GetChannels();
+        pHeader->BitsPerSample = (UCHAR) pDestination->pCodec->GetBitsPerSample();
+        pHeader->SampleRate    = pDestination->pCodec->GetSampleRate();
+        pHeader->Sequence      = pDestination->ulSequence++;
+        pHeader->Timestamp     = m_ulTimestamp;
+        pHeader->Frames        = (USHORT) ulFrames;
+        pHeader->PayloadLength = (USHORT) ulPayload;
+
+        wskbuf.Mdl    = m_dataMdl;
+        wskbuf.Offset = 0;
+        wskbuf.Length = sizeof(AUDIONET_PACKET_HEADER) + ulPayload;
+
+        IoReuseIrp(m_irp, STATUS_UNSUCCESSFUL);
+        IoSetCompletionRoutine(m_irp, WskSampleSyncIrpCompletionRoutine, &m_syncEvent, TRUE, TRUE, TRUE);
+
+        ((PWSK_PROVIDER_DATAGRAM_DISPATCH)m_socket->Dispatch)->WskSendTo(m_socket, &wskbuf, 0, (PSOCKADDR)&pDestination->Address, 0, NULL, m_irp);
+        KeWaitForSingleObject(&m_syncEvent, Executive, KernelMode, FALSE, NULL);
+
+        if (!NT_SUCCESS(m_irp->IoStatus.Status)) {
+            DPF(D_TERSE, ("Failed to write data to destination %d: %x", i, m_irp->IoStatus.Status));
+        }
+    }
+
+    m_ulTimestamp += ulFrames;
+    m_pStatus->LimiterReduction = m_Processor.ReadLimiterReduction();
+    m_Processor.GetLoudness(&loudness);
+    m_pStatus->Loudness.Momentary  = loudness.Momentary;
+    m_pStatus->Loudness.ShortTerm  = loudness.ShortTerm;
+    m_pStatus->Loudness.Integrated = loudness.Integrated;
+    m_pStatus->Loudness.Gain       = loudness.Gain;
+} // SendPacket
+
+//=============================================================================
+void CSaveData::ReceiveFeedback(void)
+/*++
+Routine Description:
+  Posts a receive for the next receiver report on the bound socket.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    PAGED_CODE();
+
+    WSK_BUF wskbuf;
+
+    if (!m_socket || m_fStopping) {
+        return;
+    }
+
+    wskbuf.Mdl    = m_feedbackMdl;
+    wskbuf.Offset = 0;
+    wskbuf.Length = sizeof(AUDIONET_FEEDBACK);
+
+    KeClearEvent(&m_feedbackIdle);
+
+    IoReuseIrp(m_feedbackIrp, STATUS_UNSUCCESSFUL);
+    IoSetCompletionRoutine(m_feedbackIrp, FeedbackCompletionRoutine, this, TRUE, TRUE, TRUE);
+
+    ((PWSK_PROVIDER_DATAGRAM_DISPATCH)m_socket->Dispatch)->WskReceiveFrom(m_socket, &wskbuf, 0, (PSOCKADDR)&m_feedbackAddress, NULL, NULL, NULL, m_feedbackIrp);
+} // ReceiveFeedback
+
 #pragma code_seg()
+//=============================================================================
+NTSTATUS FeedbackCompletionRoutine(
+    IN  PDEVICE_OBJECT          DeviceObject,
+    IN  PIRP                    Irp,
+    IN  PVOID                   Context
+)
+{
+    UNREFERENCED_PARAMETER(DeviceObject);
+    UNREFERENCED_PARAMETER(Irp);
+
+    ((PCSaveData) Context)->FeedbackComplete();
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+} // FeedbackCompletionRoutine
+
+//=============================================================================
+void CSaveData::FeedbackComplete(void)
+/*++
+Routine Description:
+  Completion of a feedback receive. Reports wake the sender thread, which
+  applies them to the destination they came from and posts the next
+  receive.
+
+Arguments:
+
+Return Value:
+  void
+--*/
+{
+    if (NT_SUCCESS(m_feedbackIrp->IoStatus.Status)                                       &&
+        (m_feedbackIrp->IoStatus.Information >= AUDIONET_FEEDBACK_MIN_SIZE)             &&
+        (m_pFeedback->Version == AUDIONET_PACKET_VERSION)) {
+        if (m_feedbackIrp->IoStatus.Information < sizeof(AUDIONET_FEEDBACK)) {
+            m_pFeedback->Flags &= ~AUDIONET_FEEDBACK_BUFFER;
+        }
+        m_fFeedbackValid = TRUE;
+        KeSetEvent(&m_feedbackIdle, 0, FALSE);
+        KeSetEvent(&m_wakeEvent, 0, FALSE);
+    } else {
+        // Errors are retried on the next wake up rather than right away.
+        KeSetEvent(&m_feedbackIdle, 0, FALSE);
+    }
+} // FeedbackComplete
+
 //=============================================================================
 void CSaveData::WriteData(
     IN  PBYTE                   pBuffer,
     IN  ULONG                   ulByteCount
 )
+/*++
+Routine Description:
+  Queues the given frames for the sender thread and meters them on the
+  way. Frames that do not fit in the ring buffer are dropped.
+
+Arguments:
+  pBuffer - frames in the stream format.
+  ulByteCount - size of pBuffer, a multiple of the block alignment.
+
+Return Value:
+  void
+--*/
 {
     ASSERT(pBuffer);
 
-    WSK_BUF     wskbuf;
-    char        sendstr[] = "testing\n";
-
     // If stream writing is disabled, then exit.
     if (m_fWriteDisabled) {
         return;
     }
-    
-    if( m_dataLength != 0) {
-        return;
-    }
 
     DPF_ENTER(("[CSaveData::WriteData ulByteCount=%lu]", ulByteCount));
 
-    if( 0 == ulByteCount ) {
+    if (!m_pSenderThread || !m_pRing) {
         return;
     }
-    
-    //wskbuf.Mdl = m_dataMdl;
-    //wskbuf.Offset = 0;
-    //wskbuf.Length = 16;
-    wskbuf.Mdl = IoAllocateMdl(sendstr, sizeof(sendstr), FALSE, FALSE, NULL);
-    MmBuildMdlForNonPagedPool(wskbuf.Mdl);
-    wskbuf.Offset = 0;
-	wskbuf.Length = sizeof(sendstr);
 
-    IoReuseIrp(m_irp, STATUS_UNSUCCESSFUL);
-    IoSetCompletionRoutine(m_irp, WskSampleSyncIrpCompletionRoutine, &m_syncEvent, TRUE, TRUE, TRUE);
+    ULONG ulWrite = m_ulRingWrite;
+    ULONG ulFree  = (m_ulRingRead + m_ulRingSize - ulWrite - m_waveFormat->nBlockAlign) % m_ulRingSize;
+    ULONG ulBlockAlign = m_waveFormat->nBlockAlign;
+    ULONG ulFirst;
+    BOOL  fMetered;
 
-    //((PWSK_PROVIDER_DATAGRAM_DISPATCH)m_socket->Dispatch)->WskReceiveFrom(m_socket, &wskbuf, 0, NULL, 0, NULL, NULL, m_irp);
-    ((PWSK_PROVIDER_DATAGRAM_DISPATCH)m_socket->Dispatch)->WskSendTo(m_socket, &wskbuf, 0, (PSOCKADDR)&IPv4RemoteAddress, 0, NULL, m_irp);
-    KeWaitForSingleObject(&m_syncEvent, Executive, KernelMode, FALSE, NULL);
+    if (ulByteCount > ulFree) {
+        DPF(D_VERBOSE, ("Sender ring full, %d bytes dropped", ulByteCount - ulFree));
+        ulByteCount = ulFree;
+    }
 
-    m_dataLength = 1;
-    DPF(D_TERSE, ("Failed to write data: %x", m_irp->IoStatus.Status));
-} // WriteData
+    // The ring holds whole frames, so both parts are whole frames too.
+    ulFirst  = min(ulByteCount, m_ulRingSize - ulWrite);
+    fMetered = m_Meter.CopyFrames(pBuffer, ulFirst / ulBlockAlign, m_pRing + ulWrite);
+    fMetered = m_Meter.CopyFrames(pBuffer + ulFirst, (ulByteCount - ulFirst) / ulBlockAlign, m_pRing) || fMetered;
+
+    if (fMetered && m_pAdapterCommon) {
+        for (LONG ch = 0; ch < m_Meter.GetChannels(); ch++) {
+            m_pAdapterCommon->MeterWrite(ch, m_Meter.GetPeak(ch), m_Meter.GetRms(ch));
+        }
+    }
 
+    // Publish the frames before the write offset.
+    KeMemoryBarrier();
+    m_ulRingWrite = (ulWrite + ulByteCount) % m_ulRingSize;
 
+    KeSetEvent(&m_wakeEvent, 0, FALSE);
+} // WriteData
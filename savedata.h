@@ -25,12 +25,29 @@ Abstract:
 
 #pragma warning(pop)
 
+#include "codec.h"
+#include "common.h"
+#include "dsp.h"
+
 //-----------------------------------------------------------------------------
 //  Forward declaration
 //-----------------------------------------------------------------------------
 class CSaveData;
 typedef CSaveData *PCSaveData;
 
+//-----------------------------------------------------------------------------
+//  Constants
+//-----------------------------------------------------------------------------
+
+// Receiver clock lock. The trim slows the render clock in parts per billion;
+// an error of one microsecond of buffer adds SAVEDATA_RATE_KP to it and
+// integrates to one part per trillion per SAVEDATA_RATE_KI_DIVISOR ms.
+#define SAVEDATA_RATE_KP            20
+#define SAVEDATA_RATE_KI_DIVISOR    5
+#define SAVEDATA_MAX_RATE_TRIM      1000000     // 1000 ppm
+#define SAVEDATA_MAX_RATE_ERROR     1000000     // Microseconds of buffer
+#define SAVEDATA_MAX_RATE_INTERVAL  1000        // Milliseconds between reports
+
 //-----------------------------------------------------------------------------
 //  Structs
 //-----------------------------------------------------------------------------
@@ -67,15 +84,34 @@ typedef OUTPUT_DATA_HEADER *POUTPUT_DATA_HEADER;
 
 #include <poppack.h>
 
+// A receiver of the stream, with the codec for the channels it gets.
+typedef struct _SAVEDATA_DESTINATION {
+    SOCKADDR_IN     Address;
+    ULONG           ulIndex;                // In the destinations of the settings
+    PCAudioCodec    pCodec;
+    PCEqualizer     pEqualizer;
+    PCDelay         pDelay;
+    ULONG           ulSequence;
+    USHORT          nChannels;              // Channels sent
+    USHORT          nBlockAlign;            // Of the channels sent
+    BOOL            fGather;                // Not all channels, or reordered
+    ULONG           ulFirstChannel;         // First channel of a contiguous map, else -1
+    UCHAR           ChannelMap[CODEC_MAX_CHANNELS];    // Channel of the network stream
+} SAVEDATA_DESTINATION;
+typedef SAVEDATA_DESTINATION *PSAVEDATA_DESTINATION;
+
 //-----------------------------------------------------------------------------
 //  Classes
 //-----------------------------------------------------------------------------
 
 ///////////////////////////////////////////////////////////////////////////////
 // CSaveData
-//   Saves the wave data to disk.
+//   Sends the wave data to the network. WriteData queues the frames in a
+//   ring buffer; a sender thread encodes and sends them at PASSIVE_LEVEL.
 //
 IO_WORKITEM_ROUTINE SaveFrameWorkerCallback;
+KSTART_ROUTINE SenderThreadRoutine;
+IO_COMPLETION_ROUTINE FeedbackCompletionRoutine;
 
 class CSaveData {
 protected:
@@ -89,9 +125,55 @@ protected:
     PVOID						m_dataBuffer;
     PMDL						m_dataMdl;
     ULONG						m_bufferLength;
-	ULONG						m_dataLength;
 	
 	PWAVEFORMATEX               m_waveFormat;
+
+	// Payload encoding, one codec per destination. All of them take the
+	// same number of frames per packet.
+	SAVEDATA_DESTINATION        m_Destinations[AUDIONET_MAX_DESTINATIONS];
+	ULONG                       m_ulDestinations;
+	PBYTE                       m_pGather;          // Channels of one destination, equalized
+	PCODEC_SETTINGS             m_pSettings;        // Owned by the miniport
+	PCODEC_STATUS               m_pStatus;          // Owned by the miniport
+	ULONG                       m_ulBitrate;        // Settings applied to the codecs
+	ULONG                       m_ulComplexity;
+	ULONG                       m_ulFramesPerPacket;
+	ULONG                       m_ulFrameSize;      // Of every codec, or 0
+	LONG                        m_lEqualizerGeneration; // Last equalizers given to the destinations
+	CAudioProcessor             m_Processor;        // Runs on the frames before the codec
+	CMeter                      m_Meter;            // Measures the frames WriteData queues
+	PADAPTERCOMMON              m_pAdapterCommon;   // Owned by the miniport, for the mixer
+	ULONG                       m_ulMixerGeneration; // Last mixer state given to m_Processor
+	ULONG                       m_ulTimestamp;
+	KMUTEX                      m_codecSync;        // Codec and ring against the sender thread
+
+	// Frames queued by WriteData, written at DISPATCH_LEVEL and read by the
+	// sender thread. Offsets are in bytes; one frame always stays free.
+	PBYTE                       m_pRing;
+	ULONG                       m_ulRingSize;
+	volatile ULONG              m_ulRingRead;
+	volatile ULONG              m_ulRingWrite;
+	PBYTE                       m_pStaging;         // One packet when the ring wraps, or resampled frames
+	ULONG                       m_ulInputFrames;    // Most ring frames processed at once
+	ULONG                       m_ulPending;        // Resampled frames in m_pStaging
+
+	// Sender thread
+	PKTHREAD                    m_pSenderThread;
+	KEVENT                      m_wakeEvent;
+	volatile BOOL               m_fStopping;
+
+	// Receiver feedback, received into its own buffer
+	PIRP                        m_feedbackIrp;
+	PMDL                        m_feedbackMdl;
+	PAUDIONET_FEEDBACK          m_pFeedback;
+	SOCKADDR_IN                 m_feedbackAddress;
+	KEVENT                      m_feedbackIdle;     // No receive pending
+	volatile BOOL               m_fFeedbackValid;
+
+	// Receiver clock lock, from the buffer depth of the first destination
+	volatile LONG               m_lRateTrim;        // Parts per billion slower
+	LONGLONG                    m_llRateIntegral;   // Parts per trillion
+	ULONGLONG                   m_ullRateReportTime; // Interrupt time of the last report, or 0
 	
     static PDEVICE_OBJECT       m_pDeviceObject;
     static ULONG                m_ulStreamId;
@@ -106,12 +188,32 @@ public:
 
 	NTSTATUS                    Initialize(void);
 	NTSTATUS                    SetDataFormat(IN  PKSDATAFORMAT pDataFormat);
+	NTSTATUS                    SetCodecSettings(IN PCODEC_SETTINGS pSettings, IN PCODEC_STATUS pStatus);
+	void                        SetAdapterCommon(IN PADAPTERCOMMON pAdapterCommon);
 	void                        Disable(BOOL fDisable);
 		
 	static NTSTATUS             SetDeviceObject(IN PDEVICE_OBJECT DeviceObject);
 	static PDEVICE_OBJECT       GetDeviceObject(void);
     
     void                        WriteData(IN PBYTE pBuffer, IN ULONG ulByteCount);
+    LONG                        GetRateTrim(void)   { return m_lRateTrim; }
+
+private:
+	NTSTATUS                    CreateCodec(void);
+	void                        FreeCodecs(void);
+	NTSTATUS                    AddDestination(IN PAUDIONET_DESTINATION pDestination, IN ULONG ulIndex, IN PWAVEFORMATEXTENSIBLE pWfx);
+	void                        SenderThread(void);
+	void                        UpdateMixer(void);
+	void                        UpdateEqualizers(void);
+	void                        SendQueuedData(void);
+	void                        SendConvertedData(void);
+	void                        SendPacket(IN PBYTE pFrames, IN ULONG ulFrames);
+	void                        ReceiveFeedback(void);
+	void                        FeedbackComplete(void);
+	void                        UpdateRateTrim(IN PAUDIONET_FEEDBACK pFeedback, IN ULONG ulRate);
+
+	friend VOID                 SenderThreadRoutine(IN PVOID StartContext);
+	friend NTSTATUS             FeedbackCompletionRoutine(IN PDEVICE_OBJECT DeviceObject, IN PIRP Irp, IN PVOID Context);
 };
 typedef CSaveData *PCSaveData;
 
@@ -20,16 +20,20 @@ DEFINE_GUIDSTRUCT("946A7B1A-EBBC-422a-A81F-F07C8D40D3B4", NAME_MSVAD_SIMPLE);
 
 // Pin properties.
 #define MAX_OUTPUT_STREAMS          0       // Number of capture streams.
-#define MAX_INPUT_STREAMS           1       // Number of render streams.
+#define MAX_INPUT_STREAMS           8       // Number of render streams, mixed in the driver.
 #define MAX_TOTAL_STREAMS           MAX_OUTPUT_STREAMS + MAX_INPUT_STREAMS                      
 
 // PCM Info
 #define MIN_CHANNELS                1       // Min Channels.
-#define MAX_CHANNELS_PCM            2       // Max Channels.
+#define MAX_CHANNELS_PCM            8       // Max Channels.
 #define MIN_BITS_PER_SAMPLE_PCM     8       // Min Bits Per Sample
-#define MAX_BITS_PER_SAMPLE_PCM     16      // Max Bits Per Sample
+#define MAX_BITS_PER_SAMPLE_PCM     32      // Max Bits Per Sample
 #define MIN_SAMPLE_RATE             4000    // Min Sample Rate
-#define MAX_SAMPLE_RATE             64000   // Max Sample Rate
+#define MAX_SAMPLE_RATE             192000  // Max Sample Rate
+#define PREFERRED_SAMPLE_RATE       48000   // Proposed when no network rate is set
+
+// IEEE float Info, channels and rates as for PCM
+#define BITS_PER_SAMPLE_FLOAT       32      // Bits Per Sample
 
 // Wave pins
 enum {
@@ -69,7 +73,9 @@ enum {
 
     KSNODE_TOPO_DEV_SPECIFIC_BOOL, //9
     KSNODE_TOPO_DEV_SPECIFIC_INT,  //10
-    KSNODE_TOPO_DEV_SPECIFIC_UINT  //11
+    KSNODE_TOPO_DEV_SPECIFIC_UINT, //11
+
+    KSNODE_TOPO_WAVEOUT_PEAKMETER  //12
 };
 
 #endif
@@ -0,0 +1,1573 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    codectest.cpp
+
+Abstract:
+    User-mode round-trip tests and benchmarks of the payload codecs. The
+    driver sources are built unchanged against the stand-in msvad.h of
+    this directory; payloads are decoded with the receiver side decoders
+    of decoder.cpp and compared with the input.
+
+    Exits with a non-zero status if any check fails.
+--*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+#include <math.h>
+
+#include <msvad.h>
+#include "codec.h"
+#include "dsp.h"
+#include "decoder.h"
+
+//=============================================================================
+// Defines
+//=============================================================================
+#define TEST_MAX_PAYLOAD            (AUDIONET_MAX_DATAGRAM - sizeof(AUDIONET_PACKET_HEADER))
+#define TEST_RATE                   48000
+#define TEST_SECONDS                10      // Of the benchmark signals
+#define TEST_PI                     3.14159265358979323846
+#define KERNEL_PACKET_FRAMES        480     // 10 ms
+
+// Signals of the corpus.
+typedef enum {
+    SIGNAL_SILENCE = 0,
+    SIGNAL_FULL_SCALE,                      // Square wave between the extremes
+    SIGNAL_NOISE,                           // Uniform over the full range
+    SIGNAL_QUIET_NOISE,                     // Uniform, 1/64 of full scale
+    SIGNAL_WALK,                            // Noise summed one to four times
+    SIGNAL_AR,                              // Autoregressive of order one to eight
+    SIGNAL_MUSIC,                           // Tones with decaying envelopes and noise
+    SIGNAL_COUNT
+} SIGNAL_TYPE;
+
+static const char * const SignalNames[SIGNAL_COUNT] = {
+    "silence", "full scale", "noise", "quiet noise", "walk", "ar", "music"
+};
+
+//=============================================================================
+// Globals
+//=============================================================================
+static ULONG    g_ulFailures;
+static ULONG    g_ulSeed = 1;
+
+//=============================================================================
+// Helper Functions
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+static void Fail(IN const char *pszFormat, ...)
+{
+    va_list args;
+
+    va_start(args, pszFormat);
+    printf("FAIL: ");
+    vprintf(pszFormat, args);
+    printf("\n");
+    va_end(args);
+
+    g_ulFailures++;
+}
+
+//-----------------------------------------------------------------------------
+static double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//-----------------------------------------------------------------------------
+// Uniform in [0, 1).
+//
+static double Random(void)
+{
+    g_ulSeed = g_ulSeed * 1664525 + 1013904223;
+
+    return (g_ulSeed >> 8) * (1.0 / 16777216);
+}
+
+//-----------------------------------------------------------------------------
+// FNV-1a of the payloads of a test. The SSE2 and scalar builds print the
+// same digests if their kernels produce the same payloads.
+//
+static ULONG Digest(IN ULONG ulHash, IN const BYTE *pData, IN ULONG ulLength)
+{
+    for (ULONG i = 0; i < ulLength; i++) {
+        ulHash = (ulHash ^ pData[i]) * 16777619;
+    }
+
+    return ulHash;
+}
+
+#define DIGEST_INIT                 2166136261u
+
+//-----------------------------------------------------------------------------
+// Stream format of integer PCM.
+//
+static void InitFormat(OUT PWAVEFORMATEX pWfx, IN USHORT nChannels, IN USHORT wBits)
+{
+    RtlZeroMemory(pWfx, sizeof(*pWfx));
+    pWfx->wFormatTag      = WAVE_FORMAT_PCM;
+    pWfx->nChannels       = nChannels;
+    pWfx->nSamplesPerSec  = TEST_RATE;
+    pWfx->wBitsPerSample  = wBits;
+    pWfx->nBlockAlign     = (WORD) (nChannels * wBits / 8);
+    pWfx->nAvgBytesPerSec = pWfx->nBlockAlign * TEST_RATE;
+}
+
+//-----------------------------------------------------------------------------
+static PCAudioCodec CreateCodec(IN ULONG ulCodecId, IN PWAVEFORMATEX pWfx, IN ULONG ulBitDepth, IN BOOL fNoiseShaping)
+{
+    static CODEC_SETTINGS settings;
+    PCAudioCodec          pCodec;
+
+    RtlZeroMemory(&settings, sizeof(settings));
+    settings.CodecId      = ulCodecId;
+    settings.BitDepth     = ulBitDepth;
+    settings.NoiseShaping = fNoiseShaping;
+
+    if (!NT_SUCCESS(NewAudioCodec(&pCodec, &settings, pWfx))) {
+        Fail("codec %u does not take %u channels of %u bits", ulCodecId, pWfx->nChannels, pWfx->wBitsPerSample);
+        return NULL;
+    }
+
+    return pCodec;
+}
+
+//-----------------------------------------------------------------------------
+// Stores right aligned samples of wBits bits in the container of the same
+// size, 8 bit unsigned and everything else little-endian signed.
+//
+static void StoreSamples(IN const LONG *plSamples, IN ULONG ulCount, IN USHORT wBits, OUT PBYTE pOutput)
+{
+    for (ULONG i = 0; i < ulCount; i++) {
+        LONG lSample = plSamples[i];
+
+        switch (wBits) {
+            case 8:
+                pOutput[i] = (BYTE) (lSample + 0x80);
+                break;
+            case 16:
+                ((SHORT *) pOutput)[i] = (SHORT) lSample;
+                break;
+            case 24:
+                pOutput[3 * i]     = (BYTE) lSample;
+                pOutput[3 * i + 1] = (BYTE) (lSample >> 8);
+                pOutput[3 * i + 2] = (BYTE) (lSample >> 16);
+                break;
+            default:
+                ((LONG *) pOutput)[i] = lSample;
+                break;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Sample ulIndex of the input as 32 bit signed, left aligned.
+//
+static LONG LoadSample32(IN const BYTE *pInput, IN ULONG ulIndex, IN USHORT wBits)
+{
+    switch (wBits) {
+        case 8:
+            return ((LONG) pInput[ulIndex] - 0x80) << 24;
+        case 16:
+            return (LONG) ((const SHORT *) pInput)[ulIndex] << 16;
+        case 24:
+            pInput += 3 * ulIndex;
+            return (LONG) (((ULONG) pInput[0] << 8) | ((ULONG) pInput[1] << 16) | ((ULONG) pInput[2] << 24));
+        default:
+            return ((const LONG *) pInput)[ulIndex];
+    }
+}
+
+//-----------------------------------------------------------------------------
+// One channel of a corpus signal as doubles in [-1, 1]. ulOrder is the
+// order of SIGNAL_WALK and SIGNAL_AR.
+//
+static void GenerateChannel(IN SIGNAL_TYPE type, IN ULONG ulOrder, IN ULONG ulFrames, OUT double *pdOutput)
+{
+    double dState[8] = { 0 };
+    double dCoefs[8] = { 0 };
+    ULONG  i;
+    ULONG  j;
+
+    switch (type) {
+        case SIGNAL_SILENCE:
+            for (i = 0; i < ulFrames; i++) {
+                pdOutput[i] = 0;
+            }
+            break;
+
+        case SIGNAL_FULL_SCALE:
+            for (i = 0; i < ulFrames; i++) {
+                pdOutput[i] = ((i / 37) & 1) ? -1.0 : 1.0;
+            }
+            break;
+
+        case SIGNAL_NOISE:
+        case SIGNAL_QUIET_NOISE:
+            for (i = 0; i < ulFrames; i++) {
+                pdOutput[i] = (2 * Random() - 1) / ((type == SIGNAL_NOISE) ? 1 : 64);
+            }
+            break;
+
+        case SIGNAL_WALK:
+            // A leaky sum, so the walk stays in range.
+            for (i = 0; i < ulFrames; i++) {
+                double d = (2 * Random() - 1) / 1024;
+
+                for (j = 0; j < ulOrder; j++) {
+                    dState[j] = 0.9995 * dState[j] + d;
+                    d = dState[j] / ((j < ulOrder - 1) ? 64 : 1);
+                }
+                pdOutput[i] = d;
+            }
+            break;
+
+        case SIGNAL_AR:
+            {
+                // Resonators at spread out frequencies, and a real pole for
+                // odd orders; the polynomial of their product.
+                double dPoly[9] = { 1 };
+                ULONG  ulDegree = 0;
+
+                for (j = 0; j + 2 <= ulOrder; j += 2) {
+                    double dAngle  = 0.15 + 0.6 * j / 8;
+                    double dRadius = 0.97;
+                    double d1 = -2 * dRadius * cos(dAngle);
+                    double d2 = dRadius * dRadius;
+
+                    for (LONG k = ulDegree + 2; k >= 0; k--) {
+                        dPoly[k] = dPoly[k] + ((k >= 1) ? d1 * dPoly[k - 1] : 0) + ((k >= 2) ? d2 * dPoly[k - 2] : 0);
+                    }
+                    ulDegree += 2;
+                }
+                if (ulOrder & 1) {
+                    for (LONG k = ulDegree + 1; k >= 1; k--) {
+                        dPoly[k] += -0.9 * dPoly[k - 1];
+                    }
+                    ulDegree++;
+                }
+                for (j = 0; j < ulOrder; j++) {
+                    dCoefs[j] = -dPoly[j + 1];
+                }
+
+                double dPeak = 1e-9;
+
+                for (i = 0; i < ulFrames; i++) {
+                    double d = 2 * Random() - 1;
+
+                    for (j = 0; j < ulOrder; j++) {
+                        d += dCoefs[j] * dState[j];
+                    }
+                    for (j = ulOrder; j > 1; j--) {
+                        dState[j - 1] = dState[j - 2];
+                    }
+                    dState[0] = d;
+                    pdOutput[i] = d;
+                    dPeak = max(dPeak, fabs(d));
+                }
+                for (i = 0; i < ulFrames; i++) {
+                    pdOutput[i] *= 0.5 / dPeak;
+                }
+            }
+            break;
+
+        default:
+            {
+                static const double Notes[4] = { 220.0, 277.18, 329.63, 440.0 };
+
+                for (i = 0; i < ulFrames; i++) {
+                    double dTime  = (double) i / TEST_RATE;
+                    double dPhase = fmod(dTime, 0.5);
+                    double d      = 0;
+
+                    for (j = 0; j < 4; j++) {
+                        d += sin(2 * TEST_PI * Notes[(j + ulOrder) & 3] * (1 + 0.5 * j) * dTime) * exp(-4 * dPhase) / (2 + j);
+                    }
+                    pdOutput[i] = 0.6 * d + (2 * Random() - 1) / 4096;
+                }
+            }
+            break;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Right aligned samples of wBits bits from doubles, clipped.
+//
+static LONG Quantize(IN double dValue, IN USHORT wBits)
+{
+    double dScale = (double) ((LONGLONG) 1 << (wBits - 1));
+    double d      = floor(dValue * dScale + 0.5);
+
+    return (LONG) min(max(d, -dScale), dScale - 1);
+}
+
+//=============================================================================
+// Lossless
+//=============================================================================
+
+// Stereo pairs of the corpus, one per channel assignment the encoder
+// should pick.
+typedef enum {
+    PAIR_INDEPENDENT = 0,                   // Unrelated channels
+    PAIR_LEFT_SIDE,                         // Smooth left, noisy right
+    PAIR_SIDE_RIGHT,                        // Noisy left, smooth right
+    PAIR_MID_SIDE,                          // Smooth mid, both noisy
+    PAIR_EXTREMES,                          // Left and right at opposite full scale
+    PAIR_COUNT
+} PAIR_TYPE;
+
+typedef struct _LOSSLESS_COVERAGE {
+    ULONG       Assignments[4];
+    ULONG       Types[4];
+    ULONG       FixedOrders[5];
+    ULONG       LpcOrders[9];
+} LOSSLESS_COVERAGE;
+typedef LOSSLESS_COVERAGE *PLOSSLESS_COVERAGE;
+
+//-----------------------------------------------------------------------------
+// Encodes ulFrames interleaved frames in payloads of the largest size, or of
+// each of the given sizes in turn, decodes every payload and compares it
+// with its input. Returns the payload bytes.
+//
+static ULONG LosslessRoundTrip
+(
+    IN  const char *            pszName,
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    IN  PWAVEFORMATEX           pWfx,
+    IN  const ULONG *           pulSizes OPTIONAL,
+    IN  ULONG                   ulSizes,
+    IN OUT PLOSSLESS_COVERAGE   pCoverage
+)
+{
+    static BYTE         payload[AUDIONET_MAX_DATAGRAM];
+    static BYTE         decoded[AUDIONET_MAX_DATAGRAM * 8];
+    PCAudioCodec        pCodec = CreateCodec(AUDIONET_CODEC_LOSSLESS, pWfx, 0, FALSE);
+    LOSSLESS_FRAME_INFO info;
+    ULONG               ulMax;
+    ULONG               ulBytes = 0;
+    ULONG               ulPacket = 0;
+
+    if (!pCodec) {
+        return 0;
+    }
+
+    ulMax = pCodec->GetFramesPerPacket(TEST_MAX_PAYLOAD);
+
+    for (ULONG ulFrame = 0; ulFrame < ulFrames; ulPacket++) {
+        ULONG ulCount = pulSizes ? pulSizes[ulPacket % ulSizes] : ulMax;
+        PBYTE pFrames = pInput + ulFrame * pWfx->nBlockAlign;
+
+        ulCount = min(min(ulCount, ulMax), ulFrames - ulFrame);
+
+        ULONG ulLength = pCodec->Encode(pFrames, ulCount, payload);
+
+        if (ulLength > pCodec->GetMaxOutputSize(ulCount)) {
+            Fail("lossless %s: payload of %u bytes exceeds its bound", pszName, ulLength);
+            break;
+        }
+        if (!LosslessDecode(payload, ulLength, pWfx->nChannels, pWfx->wBitsPerSample, ulCount, decoded, &info)) {
+            Fail("lossless %s: packet %u of %u frames does not decode", pszName, ulPacket, ulCount);
+            break;
+        }
+        if (memcmp(decoded, pFrames, ulCount * pWfx->nBlockAlign)) {
+            Fail("lossless %s: packet %u of %u frames decodes differently", pszName, ulPacket, ulCount);
+            break;
+        }
+
+        // Any truncation must be caught.
+        if ((ulLength > 1) && LosslessDecode(payload, ulLength - 1, pWfx->nChannels, pWfx->wBitsPerSample, ulCount, decoded, NULL)) {
+            Fail("lossless %s: packet %u decodes without its last byte", pszName, ulPacket);
+            break;
+        }
+
+        pCoverage->Assignments[info.ChannelAssignment]++;
+        for (ULONG c = 0; c < pWfx->nChannels; c++) {
+            pCoverage->Types[info.Type[c]]++;
+            if (info.Type[c] == AUDIONET_LOSSLESS_SUBFRAME_FIXED) {
+                pCoverage->FixedOrders[info.Order[c]]++;
+            } else if (info.Type[c] == AUDIONET_LOSSLESS_SUBFRAME_LPC) {
+                pCoverage->LpcOrders[info.Order[c]]++;
+            }
+        }
+
+        ulBytes += ulLength;
+        ulFrame += ulCount;
+    }
+
+    delete pCodec;
+
+    return ulBytes;
+}
+
+//-----------------------------------------------------------------------------
+// Interleaved frames of the corpus signal, every channel generated on its
+// own, or a stereo pair.
+//
+static void GenerateFrames(IN SIGNAL_TYPE type, IN ULONG ulOrder, IN LONG lPair, IN ULONG ulFrames, IN PWAVEFORMATEX pWfx, OUT PBYTE pOutput)
+{
+    double *pdSignal = new double[ulFrames * 2];
+    LONG   *plFrames = new LONG[ulFrames * pWfx->nChannels];
+    ULONG   i;
+
+    if (lPair < 0) {
+        for (ULONG c = 0; c < pWfx->nChannels; c++) {
+            GenerateChannel(type, ulOrder ? ulOrder : c + 1, ulFrames, pdSignal);
+            for (i = 0; i < ulFrames; i++) {
+                plFrames[i * pWfx->nChannels + c] = Quantize(pdSignal[i], pWfx->wBitsPerSample);
+            }
+        }
+    } else {
+        double *pdSmooth = pdSignal;
+        double *pdNoise  = pdSignal + ulFrames;
+
+        GenerateChannel(SIGNAL_AR, 2, ulFrames, pdSmooth);
+        GenerateChannel(SIGNAL_NOISE, 0, ulFrames, pdNoise);
+
+        for (i = 0; i < ulFrames; i++) {
+            double dLeft;
+            double dRight;
+            double dNoise = pdNoise[i] / 16;
+
+            switch (lPair) {
+                case PAIR_INDEPENDENT:
+                    dLeft  = pdSmooth[i];
+                    dRight = pdNoise[i];
+                    break;
+                case PAIR_LEFT_SIDE:
+                    dLeft  = pdSmooth[i];
+                    dRight = pdSmooth[i] + dNoise;
+                    break;
+                case PAIR_SIDE_RIGHT:
+                    dLeft  = pdSmooth[i] + dNoise;
+                    dRight = pdSmooth[i];
+                    break;
+                case PAIR_MID_SIDE:
+                    dLeft  = pdSmooth[i] + dNoise / 2;
+                    dRight = pdSmooth[i] - dNoise / 2;
+                    break;
+                default:
+                    dLeft  = (pdNoise[i] < 0) ? -1.0 : 1.0;
+                    dRight = -dLeft;
+                    break;
+            }
+            plFrames[2 * i]     = Quantize(dLeft, pWfx->wBitsPerSample);
+            plFrames[2 * i + 1] = Quantize(dRight, pWfx->wBitsPerSample);
+        }
+    }
+
+    StoreSamples(plFrames, ulFrames * pWfx->nChannels, pWfx->wBitsPerSample, pOutput);
+
+    delete [] plFrames;
+    delete [] pdSignal;
+}
+
+//-----------------------------------------------------------------------------
+// Bit-exact round trip of the corpus in mono, stereo and multichannel, at
+// 8 and 16 bits, in full packets and in packets of every size around the
+// thresholds of the subframe types. Checks that every channel assignment,
+// subframe type, fixed order and LPC order was used.
+//
+static void TestLossless(void)
+{
+    static const ULONG  Sizes[] = { 1, 2, 3, 8, 9, 16, 32, 33, 100, 255, 256, 257, 511 };
+    static const USHORT Channels[] = { 1, 2, 3, 6, 8 };
+    const ULONG         ulFrames = TEST_RATE / 2;
+    PBYTE               pInput = new BYTE[ulFrames * 8 * 2];
+    LOSSLESS_COVERAGE   coverage;
+    WAVEFORMATEX        wfx;
+    ULONG               i;
+
+    RtlZeroMemory(&coverage, sizeof(coverage));
+
+    printf("Lossless round trip, payload / PCM size\n");
+    printf("  %-12s %-6s %8s %8s %8s %8s\n", "signal", "bits", "mono", "stereo", "3 ch", "8 ch");
+
+    for (USHORT wBits = 8; wBits <= 16; wBits += 8) {
+        for (LONG type = 0; type < SIGNAL_COUNT; type++) {
+            ULONG ulOrders = ((type == SIGNAL_WALK) ? 4 : (type == SIGNAL_AR) ? 8 : 1);
+
+            for (ULONG ulOrder = 1; ulOrder <= ulOrders; ulOrder++) {
+                char szName[32];
+
+                snprintf(szName, sizeof(szName), (ulOrders > 1) ? "%s %u" : "%s", SignalNames[type], ulOrder);
+                printf("  %-12s %-6u", szName, wBits);
+
+                for (i = 0; i < sizeof(Channels) / sizeof(Channels[0]); i++) {
+                    ULONG ulBytes;
+
+                    InitFormat(&wfx, Channels[i], wBits);
+                    GenerateFrames((SIGNAL_TYPE) type, ulOrder, -1, ulFrames, &wfx, pInput);
+
+                    ulBytes = LosslessRoundTrip(SignalNames[type], pInput, ulFrames, &wfx, NULL, 0, &coverage);
+                    LosslessRoundTrip(SignalNames[type], pInput, ulFrames / 8, &wfx, Sizes, sizeof(Sizes) / sizeof(Sizes[0]), &coverage);
+
+                    if (Channels[i] != 6) {
+                        printf(" %8.3f", (double) ulBytes / (ulFrames * wfx.nBlockAlign));
+                    }
+                }
+                printf("\n");
+            }
+        }
+
+        static const char * const PairNames[PAIR_COUNT] = { "independent", "left/side", "side/right", "mid/side", "extremes" };
+
+        for (LONG lPair = 0; lPair < PAIR_COUNT; lPair++) {
+            ULONG ulBytes;
+
+            InitFormat(&wfx, 2, wBits);
+            GenerateFrames(SIGNAL_AR, 0, lPair, ulFrames, &wfx, pInput);
+
+            ulBytes = LosslessRoundTrip(PairNames[lPair], pInput, ulFrames, &wfx, NULL, 0, &coverage);
+            LosslessRoundTrip(PairNames[lPair], pInput, ulFrames / 8, &wfx, Sizes, sizeof(Sizes) / sizeof(Sizes[0]), &coverage);
+
+            printf("  %-12s %-6u %8s %8.3f\n", PairNames[lPair], wBits, "", (double) ulBytes / (ulFrames * wfx.nBlockAlign));
+        }
+    }
+
+    for (i = 0; i < 4; i++) {
+        if (!coverage.Assignments[i]) {
+            Fail("lossless: channel assignment %u never used", i);
+        }
+        if (!coverage.Types[i]) {
+            Fail("lossless: subframe type %u never used", i);
+        }
+    }
+    for (i = 0; i <= 4; i++) {
+        if (!coverage.FixedOrders[i]) {
+            Fail("lossless: fixed order %u never used", i);
+        }
+    }
+    for (i = 1; i <= 8; i++) {
+        if (!coverage.LpcOrders[i]) {
+            Fail("lossless: LPC order %u never used", i);
+        }
+    }
+
+    printf("  assignments %u/%u/%u/%u, subframes %u/%u/%u/%u, fixed orders",
+           coverage.Assignments[0], coverage.Assignments[1], coverage.Assignments[2], coverage.Assignments[3],
+           coverage.Types[0], coverage.Types[1], coverage.Types[2], coverage.Types[3]);
+    for (i = 0; i <= 4; i++) {
+        printf(" %u", coverage.FixedOrders[i]);
+    }
+    printf(", LPC orders");
+    for (i = 1; i <= 8; i++) {
+        printf(" %u", coverage.LpcOrders[i]);
+    }
+    printf("\n\n");
+
+    delete [] pInput;
+}
+
+//=============================================================================
+// IMA ADPCM
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+// Encodes ulFrames frames in packets of the given sizes, up to the largest,
+// and decodes them. Returns the SNR in dB of the decoded signal against the
+// 16 bit input, or a negative value if a payload is wrong.
+//
+static double ImaAdpcmRoundTrip
+(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    IN  PWAVEFORMATEX           pWfx,
+    IN  const ULONG *           pulSizes OPTIONAL,
+    IN  ULONG                   ulSizes,
+    IN OUT PULONG               pulDigest
+)
+{
+    static BYTE  payload[AUDIONET_MAX_DATAGRAM];
+    static SHORT decoded[AUDIONET_MAX_DATAGRAM * 2];
+    PCAudioCodec pCodec = CreateCodec(AUDIONET_CODEC_IMA_ADPCM, pWfx, 0, FALSE);
+    double       dSignal = 0;
+    double       dError = 0;
+    ULONG        ulPacket = 0;
+    ULONG        ulMax;
+
+    if (!pCodec) {
+        return -1;
+    }
+
+    ulMax = pCodec->GetFramesPerPacket(TEST_MAX_PAYLOAD);
+    if (pCodec->GetMaxOutputSize(ulMax) > TEST_MAX_PAYLOAD) {
+        Fail("adpcm: %u frames need %u bytes", ulMax, pCodec->GetMaxOutputSize(ulMax));
+    }
+
+    for (ULONG ulFrame = 0; ulFrame < ulFrames; ulPacket++) {
+        ULONG ulCount = pulSizes ? pulSizes[ulPacket % ulSizes] : ulMax;
+        PBYTE pFrames = pInput + ulFrame * pWfx->nBlockAlign;
+
+        ulCount = min(min(ulCount, ulMax), ulFrames - ulFrame);
+
+        ULONG ulLength = pCodec->Encode(pFrames, ulCount, payload);
+
+        if (!ImaAdpcmDecode(payload, ulLength, pWfx->nChannels, ulCount, decoded)) {
+            Fail("adpcm: packet %u of %u frames does not decode", ulPacket, ulCount);
+            delete pCodec;
+            return -1;
+        }
+
+        for (ULONG i = 0; i < ulCount * pWfx->nChannels; i++) {
+            LONG lInput = (pWfx->wBitsPerSample == 8) ? ((LONG) pFrames[i] - 0x80) << 8 : ((SHORT *) pFrames)[i];
+
+            if ((i < pWfx->nChannels) && (decoded[i] != lInput)) {
+                Fail("adpcm: packet %u does not start with its first frame", ulPacket);
+                delete pCodec;
+                return -1;
+            }
+            dSignal += (double) lInput * lInput;
+            dError  += (double) (decoded[i] - lInput) * (decoded[i] - lInput);
+        }
+
+        *pulDigest = Digest(*pulDigest, payload, ulLength);
+        ulFrame += ulCount;
+    }
+
+    delete pCodec;
+
+    return (dError > 0) ? 10 * log10(dSignal / dError) : INFINITY;
+}
+
+//-----------------------------------------------------------------------------
+// Decodes the payloads of every channel count at 8 and 16 bits, checks
+// that every packet starts with its first frame exactly and that tonal
+// signals keep their SNR.
+//
+static void TestImaAdpcm(void)
+{
+    static const ULONG       Sizes[] = { 1, 2, 8, 9, 10, 17, 100, 255 };
+    static const SIGNAL_TYPE Signals[] = { SIGNAL_SILENCE, SIGNAL_FULL_SCALE, SIGNAL_NOISE, SIGNAL_AR, SIGNAL_MUSIC };
+    static const double      MinSnr[] = { 0, 0, 0, 20, 20 };
+    const ULONG              ulFrames = TEST_RATE / 2;
+    PBYTE                    pInput = new BYTE[ulFrames * 8 * 2];
+    ULONG                    ulDigest = DIGEST_INIT;
+    WAVEFORMATEX             wfx;
+
+    printf("IMA ADPCM round trip, SNR in dB\n");
+    printf("  %-12s %-6s %8s %8s %8s %8s\n", "signal", "bits", "mono", "stereo", "5 ch", "8 ch");
+
+    for (USHORT wBits = 8; wBits <= 16; wBits += 8) {
+        for (ULONG s = 0; s < sizeof(Signals) / sizeof(Signals[0]); s++) {
+            printf("  %-12s %-6u", SignalNames[Signals[s]], wBits);
+
+            for (USHORT nChannels = 1; nChannels <= 8; nChannels++) {
+                double dSnr;
+
+                InitFormat(&wfx, nChannels, wBits);
+                GenerateFrames(Signals[s], (Signals[s] == SIGNAL_AR) ? 2 : 0, -1, ulFrames, &wfx, pInput);
+
+                dSnr = ImaAdpcmRoundTrip(pInput, ulFrames, &wfx, NULL, 0, &ulDigest);
+                if (ImaAdpcmRoundTrip(pInput, ulFrames / 8, &wfx, Sizes, sizeof(Sizes) / sizeof(Sizes[0]), &ulDigest) < 0) {
+                    dSnr = -1;
+                }
+
+                if ((dSnr < 0) || (dSnr < MinSnr[s])) {
+                    Fail("adpcm: %s at %u bits, %u channels, SNR %.1f dB", SignalNames[Signals[s]], wBits, nChannels, dSnr);
+                }
+                if ((nChannels == 1) || (nChannels == 2) || (nChannels == 5) || (nChannels == 8)) {
+                    printf(" %8.1f", dSnr);
+                }
+            }
+            printf("\n");
+        }
+    }
+
+    printf("digest adpcm %08x\n\n", ulDigest);
+
+    delete [] pInput;
+}
+
+//=============================================================================
+// Packed PCM
+//=============================================================================
+
+typedef struct _PACKED_RESULT {
+    double      MaxError;                   // Largest error in steps of the packed depth
+    double      Noise;                      // Error power in dB below a full scale sine
+    double      LowNoise;                   // Same, of the error summed over 16 samples
+} PACKED_RESULT;
+typedef PACKED_RESULT *PPACKED_RESULT;
+
+//-----------------------------------------------------------------------------
+// Encodes ulFrames frames in packets of the given sizes, up to the largest,
+// unpacks them and measures the error against the input. Returns FALSE if
+// a payload is wrong.
+//
+static BOOL PackedRoundTrip
+(
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    IN  PWAVEFORMATEX           pWfx,
+    IN  USHORT                  wPackedBits,
+    IN  BOOL                    fNoiseShaping,
+    IN  const ULONG *           pulSizes OPTIONAL,
+    IN  ULONG                   ulSizes,
+    IN OUT PULONG               pulDigest,
+    OUT PPACKED_RESULT          pResult
+)
+{
+    static BYTE  payload[AUDIONET_MAX_DATAGRAM];
+    static LONG  unpacked[AUDIONET_MAX_DATAGRAM];
+    PCAudioCodec pCodec = CreateCodec(AUDIONET_CODEC_PACKED_PCM, pWfx, wPackedBits, fNoiseShaping);
+    double       dStep = (double) (1 << (32 - wPackedBits));
+    double       dNoise = 0;
+    double       dLow = 0;
+    double       dSum[AUDIONET_MAX_CHANNELS] = { 0 };
+    ULONG        ulSamples = 0;
+    ULONG        ulPacket = 0;
+    ULONG        ulMax;
+
+    RtlZeroMemory(pResult, sizeof(*pResult));
+
+    if (!pCodec) {
+        return FALSE;
+    }
+    if (pCodec->GetBitsPerSample() != wPackedBits) {
+        Fail("packed: %u bits sent as %u", wPackedBits, pCodec->GetBitsPerSample());
+    }
+
+    ulMax = pCodec->GetFramesPerPacket(TEST_MAX_PAYLOAD);
+
+    for (ULONG ulFrame = 0; ulFrame < ulFrames; ulPacket++) {
+        ULONG ulCount = pulSizes ? pulSizes[ulPacket % ulSizes] : ulMax;
+        PBYTE pFrames = pInput + ulFrame * pWfx->nBlockAlign;
+
+        ulCount = min(min(ulCount, ulMax), ulFrames - ulFrame);
+
+        ULONG ulLength = pCodec->Encode(pFrames, ulCount, payload);
+
+        if ((ulLength != pCodec->GetMaxOutputSize(ulCount)) ||
+            !PackedPcmUnpack(payload, ulLength, pWfx->nChannels, wPackedBits, ulCount, unpacked)) {
+            Fail("packed: packet %u of %u frames at %u bits does not unpack", ulPacket, ulCount, wPackedBits);
+            delete pCodec;
+            return FALSE;
+        }
+
+        for (ULONG i = 0; i < ulCount * pWfx->nChannels; i++) {
+            double dError = ((double) unpacked[i] * dStep - LoadSample32(pFrames, i, pWfx->wBitsPerSample)) / dStep;
+            ULONG  c = i % pWfx->nChannels;
+
+            pResult->MaxError = max(pResult->MaxError, fabs(dError));
+            dNoise += dError * dError;
+
+            dSum[c] += dError;
+            if ((ulSamples + i) / pWfx->nChannels % 16 == 15) {
+                dLow += dSum[c] * dSum[c] / 16;
+                dSum[c] = 0;
+            }
+        }
+
+        *pulDigest = Digest(*pulDigest, payload, ulLength);
+        ulSamples += ulCount * pWfx->nChannels;
+        ulFrame += ulCount;
+    }
+
+    delete pCodec;
+
+    // Steps of the packed depth against a full scale sine of it.
+    double dFullScale = (double) (1 << (wPackedBits - 1)) * (1 << (wPackedBits - 1)) / 2;
+
+    pResult->Noise    = 10 * log10(max(dNoise / ulSamples, 1e-30) / dFullScale);
+    pResult->LowNoise = 10 * log10(max(dLow / ulSamples, 1e-30) / dFullScale);
+
+    return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Packs every stream depth to every packed depth, with and without noise
+// shaping. At or above the stream depth the samples must come back
+// exactly; below it the error must stay within the dither and shaping
+// bounds, and shaping must lower the noise of the low band.
+//
+static void TestPackedPcm(void)
+{
+    static const ULONG  Sizes[] = { 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 64, 100 };
+    static const USHORT StreamBits[] = { 8, 16, 24, 32 };
+    const ULONG         ulFrames = TEST_RATE / 4;
+    PBYTE               pInput = new BYTE[ulFrames * 8 * 4];
+    ULONG               ulDigest = DIGEST_INIT;
+    WAVEFORMATEX        wfx;
+    PACKED_RESULT       result;
+    PACKED_RESULT       shaped;
+
+    printf("Packed PCM round trip of music, exact at or above the stream depth;\n");
+    printf("requantized error in steps and noise in dBFS\n");
+    printf("  %-10s %9s %8s %8s %9s %8s %8s\n", "bits", "max", "noise", "low", "shaped", "noise", "low");
+
+    for (ULONG s = 0; s < sizeof(StreamBits) / sizeof(StreamBits[0]); s++) {
+        for (USHORT wPacked = AUDIONET_MIN_BIT_DEPTH; wPacked <= AUDIONET_MAX_BIT_DEPTH; wPacked++) {
+            BOOL fExact = (wPacked >= StreamBits[s]);
+            BOOL fOk = TRUE;
+
+            for (USHORT nChannels = 1; nChannels <= 8; nChannels += (nChannels < 2) ? 1 : 3) {
+                InitFormat(&wfx, nChannels, StreamBits[s]);
+                GenerateFrames(SIGNAL_MUSIC, 0, -1, ulFrames, &wfx, pInput);
+
+                fOk = PackedRoundTrip(pInput, ulFrames, &wfx, wPacked, FALSE, NULL, 0, &ulDigest, &result) &&
+                      PackedRoundTrip(pInput, ulFrames, &wfx, wPacked, TRUE, NULL, 0, &ulDigest, &shaped) &&
+                      PackedRoundTrip(pInput, ulFrames / 16, &wfx, wPacked, TRUE, Sizes, sizeof(Sizes) / sizeof(Sizes[0]), &ulDigest, &shaped) &&
+                      PackedRoundTrip(pInput, ulFrames, &wfx, wPacked, TRUE, NULL, 0, &ulDigest, &shaped);
+                if (!fOk) {
+                    break;
+                }
+
+                if (fExact) {
+                    if (result.MaxError || shaped.MaxError) {
+                        Fail("packed: %u to %u bits is not exact", StreamBits[s], wPacked);
+                    }
+                    continue;
+                }
+
+                // TPDF dither of one step peak and rounding give 1.5 steps,
+                // the shaping filter feeds back at most 2.1 times 2 steps.
+                if (result.MaxError > 1.5) {
+                    Fail("packed: %u to %u bits is off by %.2f steps", StreamBits[s], wPacked, result.MaxError);
+                }
+                if (shaped.MaxError > 5.7) {
+                    Fail("packed: %u to %u bits shaped is off by %.2f steps", StreamBits[s], wPacked, shaped.MaxError);
+                }
+                if (shaped.LowNoise >= result.LowNoise) {
+                    Fail("packed: %u to %u bits, shaping does not lower the low band noise", StreamBits[s], wPacked);
+                }
+            }
+
+            if (fOk && !fExact && !(wPacked % 4)) {
+                char szName[16];
+
+                snprintf(szName, sizeof(szName), "%u > %u", StreamBits[s], wPacked);
+                printf("  %-10s %9.2f %8.1f %8.1f %9.2f %8.1f %8.1f\n", szName,
+                       result.MaxError, result.Noise, result.LowNoise, shaped.MaxError, shaped.Noise, shaped.LowNoise);
+            }
+        }
+    }
+
+    printf("digest packed %08x\n\n", ulDigest);
+
+    delete [] pInput;
+}
+
+//=============================================================================
+// G.711
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+// Whether the G.711 code ucCode of the 16 bit input lInput decodes to
+// within half a step of its segment, or to the largest magnitude if the
+// input is beyond it.
+//
+static BOOL G711InStep(IN ULONG ulCodecId, IN UCHAR ucCode, IN LONG lInput, IN LONG lDecoded)
+{
+    ULONG ulMagnitude;
+    ULONG ulSegment;
+    LONG  lHalfStep;
+
+    if (ulCodecId == AUDIONET_CODEC_G711_ULAW) {
+        ulMagnitude = (UCHAR) ~ucCode & 0x7F;
+        ulSegment   = ulMagnitude >> 4;
+        lHalfStep   = 4 << ulSegment;
+    } else {
+        ulMagnitude = (ucCode ^ 0x55) & 0x7F;
+        ulSegment   = ulMagnitude >> 4;
+        lHalfStep   = ulSegment ? 8 << (ulSegment - 1) : 8;
+    }
+
+    if (abs(lDecoded - lInput) <= lHalfStep) {
+        return TRUE;
+    }
+
+    return (ulMagnitude == 0x7F) && (abs(lInput) > abs(lDecoded)) && ((lInput < 0) == (lDecoded < 0));
+}
+
+//-----------------------------------------------------------------------------
+// Encodes ulFrames frames in packets of the given sizes, up to the largest,
+// decodes them and checks every sample against its step. Returns the SNR
+// in dB against the 16 bit input, or a negative value if a sample is off.
+//
+static double G711RoundTrip
+(
+    IN  ULONG                   ulCodecId,
+    IN  PBYTE                   pInput,
+    IN  ULONG                   ulFrames,
+    IN  PWAVEFORMATEX           pWfx,
+    IN  const ULONG *           pulSizes OPTIONAL,
+    IN  ULONG                   ulSizes,
+    IN OUT PULONG               pulDigest
+)
+{
+    static BYTE  payload[AUDIONET_MAX_DATAGRAM];
+    static SHORT decoded[AUDIONET_MAX_DATAGRAM];
+    PCAudioCodec pCodec = CreateCodec(ulCodecId, pWfx, 0, FALSE);
+    const char * pszName = (ulCodecId == AUDIONET_CODEC_G711_ULAW) ? "ulaw" : "alaw";
+    double       dSignal = 0;
+    double       dError = 0;
+    ULONG        ulPacket = 0;
+    ULONG        ulMax;
+
+    if (!pCodec) {
+        return -1;
+    }
+
+    ulMax = pCodec->GetFramesPerPacket(TEST_MAX_PAYLOAD);
+
+    for (ULONG ulFrame = 0; ulFrame < ulFrames; ulPacket++) {
+        ULONG ulCount = pulSizes ? pulSizes[ulPacket % ulSizes] : ulMax;
+        PBYTE pFrames = pInput + ulFrame * pWfx->nBlockAlign;
+
+        ulCount = min(min(ulCount, ulMax), ulFrames - ulFrame);
+
+        ULONG ulLength = pCodec->Encode(pFrames, ulCount, payload);
+
+        if ((ulLength != ulCount * pWfx->nChannels) || !G711Decode(payload, ulLength, ulCodecId, decoded)) {
+            Fail("%s: packet %u of %u frames has %u bytes", pszName, ulPacket, ulCount, ulLength);
+            delete pCodec;
+            return -1;
+        }
+
+        for (ULONG i = 0; i < ulLength; i++) {
+            LONG lInput = (pWfx->wBitsPerSample == 8) ? ((LONG) pFrames[i] - 0x80) << 8 : ((SHORT *) pFrames)[i];
+
+            if (!G711InStep(ulCodecId, payload[i], lInput, decoded[i])) {
+                Fail("%s: %d is coded as %02x, which decodes to %d", pszName, lInput, payload[i], decoded[i]);
+                delete pCodec;
+                return -1;
+            }
+            dSignal += (double) lInput * lInput;
+            dError  += (double) (decoded[i] - lInput) * (decoded[i] - lInput);
+        }
+
+        *pulDigest = Digest(*pulDigest, payload, ulLength);
+        ulFrame += ulCount;
+    }
+
+    delete pCodec;
+
+    return (dError > 0) ? 10 * log10(dSignal / dError) : INFINITY;
+}
+
+//-----------------------------------------------------------------------------
+// Codes every 8 and 16 bit input value, checks that each decodes within
+// its step and that the codes are monotonic and decode to fixed points,
+// then codes the corpus in odd packet sizes for the SIMD tails.
+//
+static void TestG711(void)
+{
+    static const ULONG       Codecs[] = { AUDIONET_CODEC_G711_ULAW, AUDIONET_CODEC_G711_ALAW };
+    static const ULONG       Sizes[] = { 1, 2, 7, 8, 9, 15, 16, 17, 100, 255 };
+    static const SIGNAL_TYPE Signals[] = { SIGNAL_FULL_SCALE, SIGNAL_NOISE, SIGNAL_QUIET_NOISE, SIGNAL_MUSIC };
+    const ULONG              ulFrames = TEST_RATE / 2;
+    PBYTE                    pInput = new BYTE[max(ulFrames * 8 * 2, 65536 * 2)];
+    ULONG                    ulDigest = DIGEST_INIT;
+    WAVEFORMATEX             wfx;
+
+    printf("G.711 round trip, SNR in dB\n");
+    printf("  %-12s %-12s %-6s %8s %8s %8s %8s\n", "codec", "signal", "bits", "mono", "stereo", "5 ch", "8 ch");
+
+    for (ULONG l = 0; l < sizeof(Codecs) / sizeof(Codecs[0]); l++) {
+        const char * pszName = (Codecs[l] == AUDIONET_CODEC_G711_ULAW) ? "ulaw" : "alaw";
+        PCAudioCodec pCodec;
+        BYTE         codes[256];
+        SHORT        values[256];
+        SHORT        recoded[256];
+
+        // Every input value, in ascending order.
+        for (LONG i = 0; i < 65536; i++) {
+            ((SHORT *) pInput)[i] = (SHORT) (i - 32768);
+        }
+        InitFormat(&wfx, 1, 16);
+        G711RoundTrip(Codecs[l], pInput, 65536, &wfx, NULL, 0, &ulDigest);
+
+        for (LONG i = 0; i < 256; i++) {
+            pInput[i] = (BYTE) i;
+        }
+        InitFormat(&wfx, 1, 8);
+        G711RoundTrip(Codecs[l], pInput, 256, &wfx, NULL, 0, &ulDigest);
+
+        // Larger inputs never decode smaller, and every code decodes to a
+        // value that is coded as the same value again.
+        for (LONG i = 0; i < 65536; i++) {
+            ((SHORT *) pInput)[i] = (SHORT) (i - 32768);
+        }
+        InitFormat(&wfx, 1, 16);
+        pCodec = CreateCodec(Codecs[l], &wfx, 0, FALSE);
+        if (pCodec) {
+            static BYTE  payload[65536];
+            static SHORT decoded[65536];
+
+            for (ULONG i = 0; i < 65536; i += 256) {
+                pCodec->Encode(pInput + 2 * i, 256, payload + i);
+            }
+            G711Decode(payload, 65536, Codecs[l], decoded);
+            for (ULONG i = 1; i < 65536; i++) {
+                if (decoded[i] < decoded[i - 1]) {
+                    Fail("%s: %d decodes to %d, %d to %d", pszName, i - 32769, decoded[i - 1], i - 32768, decoded[i]);
+                    break;
+                }
+            }
+
+            for (ULONG i = 0; i < 256; i++) {
+                codes[i] = (BYTE) i;
+            }
+            G711Decode(codes, 256, Codecs[l], values);
+            pCodec->Encode((PBYTE) values, 256, codes);
+            G711Decode(codes, 256, Codecs[l], recoded);
+            for (ULONG i = 0; i < 256; i++) {
+                if (recoded[i] != values[i]) {
+                    Fail("%s: code %02x decodes to %d, which decodes to %d", pszName, i, values[i], recoded[i]);
+                }
+            }
+
+            delete pCodec;
+        }
+
+        for (USHORT wBits = 8; wBits <= 16; wBits += 8) {
+            for (ULONG s = 0; s < sizeof(Signals) / sizeof(Signals[0]); s++) {
+                printf("  %-12s %-12s %-6u", pszName, SignalNames[Signals[s]], wBits);
+
+                for (USHORT nChannels = 1; nChannels <= 8; nChannels++) {
+                    double dSnr;
+
+                    InitFormat(&wfx, nChannels, wBits);
+                    GenerateFrames(Signals[s], 0, -1, ulFrames, &wfx, pInput);
+
+                    dSnr = G711RoundTrip(Codecs[l], pInput, ulFrames, &wfx, NULL, 0, &ulDigest);
+                    if (G711RoundTrip(Codecs[l], pInput, ulFrames / 8, &wfx, Sizes, sizeof(Sizes) / sizeof(Sizes[0]), &ulDigest) < 0) {
+                        dSnr = -1;
+                    }
+
+                    if ((nChannels == 1) || (nChannels == 2) || (nChannels == 5) || (nChannels == 8)) {
+                        printf(" %8.1f", dSnr);
+                    }
+                }
+                printf("\n");
+            }
+        }
+    }
+
+    printf("digest g711 %08x\n\n", ulDigest);
+
+    delete [] pInput;
+}
+
+//=============================================================================
+// PCM
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+// Checks that PCM payloads are the input and that network PCM payloads
+// convert back to it, for every sample size and packet size.
+//
+static void TestNetworkPcm(void)
+{
+    static const ULONG  Sizes[] = { 1, 2, 3, 5, 8, 15, 16, 17, 31, 33, 100, 255 };
+    static const USHORT Channels[] = { 1, 2, 3, 8 };
+    static BYTE         payload[AUDIONET_MAX_DATAGRAM];
+    static BYTE         decoded[AUDIONET_MAX_DATAGRAM];
+    const ULONG         ulFrames = TEST_RATE / 8;
+    PBYTE               pInput = new BYTE[ulFrames * 8 * 4];
+    ULONG               ulDigest = DIGEST_INIT;
+    WAVEFORMATEX        wfx;
+
+    printf("PCM and network PCM round trip\n");
+
+    for (ULONG ulCodecId = AUDIONET_CODEC_PCM; ulCodecId <= AUDIONET_CODEC_PCM_NETWORK; ulCodecId += AUDIONET_CODEC_PCM_NETWORK) {
+        const char *pszName = (ulCodecId == AUDIONET_CODEC_PCM) ? "pcm" : "netpcm";
+
+        for (USHORT wBits = 8; wBits <= 32; wBits += 8) {
+            for (ULONG c = 0; c < sizeof(Channels) / sizeof(Channels[0]); c++) {
+                PCAudioCodec pCodec;
+                ULONG        ulMax;
+                ULONG        ulPacket = 0;
+
+                InitFormat(&wfx, Channels[c], wBits);
+                GenerateFrames(SIGNAL_NOISE, 0, -1, ulFrames, &wfx, pInput);
+
+                pCodec = CreateCodec(ulCodecId, &wfx, 0, FALSE);
+                if (!pCodec) {
+                    continue;
+                }
+                ulMax = pCodec->GetFramesPerPacket(TEST_MAX_PAYLOAD);
+
+                for (ULONG ulFrame = 0; ulFrame < ulFrames; ulPacket++) {
+                    ULONG ulCount = min(min(Sizes[ulPacket % (sizeof(Sizes) / sizeof(Sizes[0]))], ulMax), ulFrames - ulFrame);
+                    PBYTE pFrames = pInput + ulFrame * wfx.nBlockAlign;
+                    ULONG ulLength = pCodec->Encode(pFrames, ulCount, payload);
+                    BOOL  fDecoded;
+
+                    if (ulCodecId == AUDIONET_CODEC_PCM) {
+                        RtlCopyMemory(decoded, payload, ulLength);
+                        fDecoded = TRUE;
+                    } else {
+                        fDecoded = NetworkPcmDecode(payload, ulLength, wBits, decoded);
+                        ulDigest = Digest(ulDigest, payload, ulLength);
+                    }
+
+                    if ((ulLength != ulCount * wfx.nBlockAlign) || !fDecoded || !RtlEqualMemory(decoded, pFrames, ulLength)) {
+                        Fail("%s: packet %u of %u frames of %u channels of %u bits differs", pszName, ulPacket, ulCount, Channels[c], wBits);
+                        break;
+                    }
+                    ulFrame += ulCount;
+                }
+
+                delete pCodec;
+            }
+        }
+    }
+
+    printf("digest netpcm %08x\n\n", ulDigest);
+
+    delete [] pInput;
+}
+
+//=============================================================================
+// DSP kernels
+//=============================================================================
+
+static const char * const SampleNames[DSP_SAMPLE_COUNT] = {
+    "u8", "s16", "s24", "s32", "f32"
+};
+
+static const USHORT SampleBits[DSP_SAMPLE_COUNT] = {
+    8, 16, 24, 32, 32
+};
+
+//-----------------------------------------------------------------------------
+// Stream format of a sample type.
+//
+static void InitSampleFormat(OUT PWAVEFORMATEX pWfx, IN DSP_SAMPLE_TYPE sampleType, IN USHORT nChannels)
+{
+    InitFormat(pWfx, nChannels, SampleBits[sampleType]);
+    if (sampleType == DSP_SAMPLE_F32) {
+        pWfx->wFormatTag = WAVE_FORMAT_IEEE_FLOAT;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Interleaved frames of a corpus signal in a sample type. 32 bit integers
+// have 24 valid bits, which is what a float holds exactly.
+//
+static void GenerateSamples(IN SIGNAL_TYPE type, IN DSP_SAMPLE_TYPE sampleType, IN USHORT nChannels, IN ULONG ulFrames, OUT PBYTE pOutput)
+{
+    double *pdSignal = new double[ulFrames];
+    LONG   *plFrames = new LONG[ulFrames * nChannels];
+
+    for (ULONG c = 0; c < nChannels; c++) {
+        GenerateChannel(type, c + 1, ulFrames, pdSignal);
+        for (ULONG i = 0; i < ulFrames; i++) {
+            switch (sampleType) {
+                case DSP_SAMPLE_F32:
+                    ((FLOAT *) pOutput)[i * nChannels + c] = (FLOAT) pdSignal[i];
+                    break;
+                case DSP_SAMPLE_S32:
+                    plFrames[i * nChannels + c] = (LONG) ((ULONG) Quantize(pdSignal[i], 24) << 8);
+                    break;
+                default:
+                    plFrames[i * nChannels + c] = Quantize(pdSignal[i], SampleBits[sampleType]);
+                    break;
+            }
+        }
+    }
+
+    if (sampleType != DSP_SAMPLE_F32) {
+        StoreSamples(plFrames, ulFrames * nChannels, SampleBits[sampleType], pOutput);
+    }
+
+    delete [] plFrames;
+    delete [] pdSignal;
+}
+
+//-----------------------------------------------------------------------------
+// Checks every sample type and channel count: conversion to float and back
+// is exact, out of range floats clip to the extremes, and MeterCopy copies
+// the frames and measures the same peak and power as the float samples.
+//
+static void TestKernels(void)
+{
+    const ULONG  ulFrames = 1001;               // Not a multiple of the vector width
+    PBYTE        pInput = new BYTE[ulFrames * AUDIONET_MAX_CHANNELS * 4];
+    PBYTE        pOutput = new BYTE[ulFrames * AUDIONET_MAX_CHANNELS * 4];
+    FLOAT *      pfSamples = new FLOAT[ulFrames * AUDIONET_MAX_CHANNELS];
+    ULONG        ulDigest = DIGEST_INIT;
+    WAVEFORMATEX wfx;
+
+    for (ULONG t = 0; t < DSP_SAMPLE_COUNT; t++) {
+        DSP_SAMPLE_TYPE sampleType = (DSP_SAMPLE_TYPE) t;
+
+        for (USHORT nChannels = 1; nChannels <= AUDIONET_MAX_CHANNELS; nChannels++) {
+            PCDSP_KERNELS pKernels;
+            FLOAT         afPeak[AUDIONET_MAX_CHANNELS] = { 0 };
+            FLOAT         afSquares[AUDIONET_MAX_CHANNELS] = { 0 };
+            ULONG         ulBytes;
+
+            InitSampleFormat(&wfx, sampleType, nChannels);
+            ulBytes = ulFrames * wfx.nBlockAlign;
+
+            pKernels = DspGetKernels(&wfx, nChannels);
+            if (!pKernels) {
+                Fail("kernels: no %s kernels for %u channels", SampleNames[t], nChannels);
+                continue;
+            }
+
+            GenerateSamples(SIGNAL_NOISE, sampleType, nChannels, ulFrames, pInput);
+            pKernels->ToFloat(pInput, ulFrames, pfSamples);
+            pKernels->FromFloat(pfSamples, ulFrames, pOutput);
+            if (!RtlEqualMemory(pOutput, pInput, ulBytes)) {
+                Fail("kernels: %s with %u channels does not convert back from float", SampleNames[t], nChannels);
+            }
+
+            RtlZeroMemory(pOutput, ulBytes);
+            pKernels->MeterCopy(pInput, ulFrames, pOutput, afPeak, afSquares);
+            if (!RtlEqualMemory(pOutput, pInput, ulBytes)) {
+                Fail("kernels: %s with %u channels is not copied by MeterCopy", SampleNames[t], nChannels);
+            }
+            for (ULONG c = 0; c < nChannels; c++) {
+                FLOAT  fPeak = 0;
+                double dSquares = 0;
+
+                for (ULONG i = 0; i < ulFrames; i++) {
+                    FLOAT f = pfSamples[i * nChannels + c];
+
+                    fPeak     = max(fPeak, fabsf(f));
+                    dSquares += (double) f * f;
+                }
+                if ((afPeak[c] != fPeak) || (fabs(afSquares[c] - dSquares) > 1e-5 * dSquares)) {
+                    Fail("kernels: %s channel %u of %u measures %g and %g rather than %g and %g", SampleNames[t], c, nChannels,
+                         afPeak[c], afSquares[c], fPeak, dSquares);
+                }
+            }
+
+            // Twice full scale, so half of the integer samples clip. 32 bit
+            // integers clip to the largest float below 2^31.
+            LONG lMax = (LONG) (0x7FFFFFFF & ~((1u << (32 - min(wfx.wBitsPerSample, 25))) - 1));
+
+            for (ULONG i = 0; i < ulFrames * nChannels; i++) {
+                pfSamples[i] = (FLOAT) (4 * Random() - 2);
+            }
+            pfSamples[0] = 2.0f;
+            pfSamples[ulFrames * nChannels - 1] = -2.0f;
+            pKernels->FromFloat(pfSamples, ulFrames, pOutput);
+            if ((sampleType != DSP_SAMPLE_F32) &&
+                ((LoadSample32(pOutput, 0, wfx.wBitsPerSample) != lMax) ||
+                 (LoadSample32(pOutput, ulFrames * nChannels - 1, wfx.wBitsPerSample) != (LONG) 0x80000000))) {
+                Fail("kernels: %s with %u channels does not clip", SampleNames[t], nChannels);
+            }
+            ulDigest = Digest(ulDigest, pOutput, ulBytes);
+        }
+    }
+
+    printf("DSP kernels round trip\n");
+    printf("digest kernels %08x\n\n", ulDigest);
+
+    delete [] pfSamples;
+    delete [] pOutput;
+    delete [] pInput;
+}
+
+//=============================================================================
+// Benchmarks
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+// Encodes TEST_SECONDS of the music signal in full packets and returns the
+// encoder throughput in MB of PCM per second. *pdRatio receives the payload
+// to PCM size ratio.
+//
+static double BenchmarkEncode(IN ULONG ulCodecId, IN PWAVEFORMATEX pWfx, IN ULONG ulBitDepth, IN BOOL fNoiseShaping, OUT double *pdRatio)
+{
+    static BYTE  payload[AUDIONET_MAX_DATAGRAM];
+    ULONG        ulFrames = TEST_RATE * TEST_SECONDS;
+    PBYTE        pInput = new BYTE[ulFrames * pWfx->nBlockAlign];
+    PCAudioCodec pCodec;
+    ULONGLONG    ullBytes = 0;
+    double       dStart;
+    double       dTime;
+
+    *pdRatio = 0;
+
+    GenerateFrames(SIGNAL_MUSIC, 0, -1, ulFrames, pWfx, pInput);
+
+    pCodec = CreateCodec(ulCodecId, pWfx, ulBitDepth, fNoiseShaping);
+    if (!pCodec) {
+        delete [] pInput;
+        return 0;
+    }
+
+    ULONG ulPacket = pCodec->GetFramesPerPacket(TEST_MAX_PAYLOAD);
+    ULONG ulFrame;
+
+    dStart = Now();
+    for (ulFrame = 0; ulFrame + ulPacket <= ulFrames; ulFrame += ulPacket) {
+        ullBytes += pCodec->Encode(pInput + ulFrame * pWfx->nBlockAlign, ulPacket, payload);
+    }
+    dTime = Now() - dStart;
+
+    *pdRatio = (double) ullBytes / (ulFrame * pWfx->nBlockAlign);
+
+    delete pCodec;
+    delete [] pInput;
+
+    return ulFrame * pWfx->nBlockAlign / dTime / 1e6;
+}
+
+//-----------------------------------------------------------------------------
+// Encoder throughput and cost per codec and format. The bandwidth is that
+// of the payloads, and the cost the share of one core the encoder takes,
+// both at the real time rate of the format.
+//
+static void BenchmarkCodecs(void)
+{
+    typedef struct _BENCHMARK {
+        const char *    Name;
+        ULONG           CodecId;
+        USHORT          Channels;
+        USHORT          Bits;
+        USHORT          PackedBits;             // Packed PCM only
+        BOOL            NoiseShaping;
+    } BENCHMARK;
+
+    static const BENCHMARK Benchmarks[] = {
+        { "pcm",        AUDIONET_CODEC_PCM,         2, 16, 0,  FALSE },
+        { "g711 ulaw",  AUDIONET_CODEC_G711_ULAW,   1, 8,  0,  FALSE },
+        { "g711 ulaw",  AUDIONET_CODEC_G711_ULAW,   1, 16, 0,  FALSE },
+        { "g711 ulaw",  AUDIONET_CODEC_G711_ULAW,   2, 16, 0,  FALSE },
+        { "g711 alaw",  AUDIONET_CODEC_G711_ALAW,   1, 8,  0,  FALSE },
+        { "g711 alaw",  AUDIONET_CODEC_G711_ALAW,   1, 16, 0,  FALSE },
+        { "g711 alaw",  AUDIONET_CODEC_G711_ALAW,   2, 16, 0,  FALSE },
+        { "ima adpcm",  AUDIONET_CODEC_IMA_ADPCM,   1, 16, 0,  FALSE },
+        { "ima adpcm",  AUDIONET_CODEC_IMA_ADPCM,   2, 16, 0,  FALSE },
+        { "ima adpcm",  AUDIONET_CODEC_IMA_ADPCM,   8, 16, 0,  FALSE },
+        { "lossless",   AUDIONET_CODEC_LOSSLESS,    1, 8,  0,  FALSE },
+        { "lossless",   AUDIONET_CODEC_LOSSLESS,    1, 16, 0,  FALSE },
+        { "lossless",   AUDIONET_CODEC_LOSSLESS,    2, 8,  0,  FALSE },
+        { "lossless",   AUDIONET_CODEC_LOSSLESS,    2, 16, 0,  FALSE },
+        { "packed",     AUDIONET_CODEC_PACKED_PCM,  2, 16, 16, FALSE },
+        { "packed",     AUDIONET_CODEC_PACKED_PCM,  2, 24, 24, FALSE },
+        { "packed",     AUDIONET_CODEC_PACKED_PCM,  2, 32, 24, FALSE },
+        { "packed",     AUDIONET_CODEC_PACKED_PCM,  2, 32, 20, FALSE },
+        { "packed",     AUDIONET_CODEC_PACKED_PCM,  2, 24, 20, FALSE },
+        { "packed",     AUDIONET_CODEC_PACKED_PCM,  2, 24, 20, TRUE },
+        { "packed",     AUDIONET_CODEC_PACKED_PCM,  2, 16, 14, FALSE },
+        { "packed",     AUDIONET_CODEC_PACKED_PCM,  2, 16, 14, TRUE },
+        { "packed",     AUDIONET_CODEC_PACKED_PCM,  2, 16, 12, FALSE },
+        { "packed",     AUDIONET_CODEC_PACKED_PCM,  2, 16, 12, TRUE },
+        { "packed",     AUDIONET_CODEC_PACKED_PCM,  8, 24, 20, FALSE },
+        { "packed",     AUDIONET_CODEC_PACKED_PCM,  8, 24, 16, TRUE },
+        { "netpcm",     AUDIONET_CODEC_PCM_NETWORK, 2, 8,  0,  FALSE },
+        { "netpcm",     AUDIONET_CODEC_PCM_NETWORK, 2, 16, 0,  FALSE },
+        { "netpcm",     AUDIONET_CODEC_PCM_NETWORK, 2, 24, 0,  FALSE },
+        { "netpcm",     AUDIONET_CODEC_PCM_NETWORK, 2, 32, 0,  FALSE },
+        { "netpcm",     AUDIONET_CODEC_PCM_NETWORK, 8, 24, 0,  FALSE },
+    };
+    WAVEFORMATEX wfx;
+
+    printf("Encode, %u s of music at %u Hz\n", TEST_SECONDS, TEST_RATE);
+    printf("  %-12s %-20s %8s %8s %8s %10s\n", "codec", "format", "ratio", "kbit/s", "MB/s", "% of core");
+
+    for (ULONG i = 0; i < sizeof(Benchmarks) / sizeof(Benchmarks[0]); i++) {
+        const BENCHMARK *pBenchmark = &Benchmarks[i];
+        double           dRatio;
+        double           dRate;
+        char             szFormat[32];
+
+        InitFormat(&wfx, pBenchmark->Channels, pBenchmark->Bits);
+        dRate = BenchmarkEncode(pBenchmark->CodecId, &wfx, pBenchmark->PackedBits, pBenchmark->NoiseShaping, &dRatio);
+
+        if (pBenchmark->PackedBits) {
+            snprintf(szFormat, sizeof(szFormat), "%u ch %u>%u bit%s", wfx.nChannels, wfx.wBitsPerSample, pBenchmark->PackedBits,
+                     (pBenchmark->PackedBits >= wfx.wBitsPerSample) ? "" : pBenchmark->NoiseShaping ? " ns" : " tpdf");
+        } else {
+            snprintf(szFormat, sizeof(szFormat), "%u ch %u bit", wfx.nChannels, wfx.wBitsPerSample);
+        }
+        printf("  %-12s %-20s %8.3f %8.0f %8.1f %10.3f\n", pBenchmark->Name, szFormat,
+               dRatio, dRatio * wfx.nAvgBytesPerSec * 8 / 1000, dRate, 100.0 * wfx.nAvgBytesPerSec / (dRate * 1e6));
+    }
+    printf("\n");
+}
+
+//-----------------------------------------------------------------------------
+// Receiver cost of unpacking stereo packed PCM at each depth, as the share
+// of one core at 48 kHz.
+//
+static void BenchmarkUnpack(void)
+{
+    static const USHORT Depths[] = { 12, 14, 16, 20, 24 };
+    ULONG               ulFrames = TEST_RATE * TEST_SECONDS;
+    PBYTE               pInput = new BYTE[ulFrames * 2 * 4];
+    PBYTE               pPayloads = new BYTE[ulFrames * 2 * 4];
+    PLONG               plOutput = new LONG[AUDIONET_MAX_DATAGRAM];
+    WAVEFORMATEX        wfx;
+
+    InitFormat(&wfx, 2, 32);
+    GenerateFrames(SIGNAL_MUSIC, 0, -1, ulFrames, &wfx, pInput);
+
+    printf("Unpack, %u s of stereo at %u Hz\n", TEST_SECONDS, TEST_RATE);
+    printf("  %-12s %8s %10s\n", "bits", "MB/s", "% of core");
+
+    for (ULONG d = 0; d < sizeof(Depths) / sizeof(Depths[0]); d++) {
+        PCAudioCodec pCodec = CreateCodec(AUDIONET_CODEC_PACKED_PCM, &wfx, Depths[d], FALSE);
+        ULONG        ulPacket;
+        ULONG        ulLength;
+        ULONG        ulPackets = 0;
+        ULONG        ulFrame;
+        PBYTE        pPayload = pPayloads;
+        double       dStart;
+        double       dTime;
+
+        if (!pCodec) {
+            continue;
+        }
+
+        ulPacket = pCodec->GetFramesPerPacket(TEST_MAX_PAYLOAD);
+        ulLength = pCodec->GetMaxOutputSize(ulPacket);
+        for (ulFrame = 0; ulFrame + ulPacket <= ulFrames; ulFrame += ulPacket) {
+            pCodec->Encode(pInput + ulFrame * wfx.nBlockAlign, ulPacket, pPayload);
+            pPayload += ulLength;
+            ulPackets++;
+        }
+        delete pCodec;
+
+        dStart = Now();
+        for (ULONG p = 0; p < ulPackets; p++) {
+            if (!PackedPcmUnpack(pPayloads + p * ulLength, ulLength, 2, Depths[d], ulPacket, plOutput)) {
+                Fail("packed: %u bit payload does not unpack", Depths[d]);
+                break;
+            }
+        }
+        dTime = Now() - dStart;
+
+        // Throughput in bytes of 32 bit output.
+        double dRate = (double) ulPackets * ulPacket * 2 * sizeof(LONG) / dTime / 1e6;
+
+        printf("  %-12u %8.1f %10.3f\n", Depths[d], dRate, 100.0 * TEST_RATE * 2 * sizeof(LONG) / (dRate * 1e6));
+    }
+    printf("\n");
+
+    delete [] plOutput;
+    delete [] pPayloads;
+    delete [] pInput;
+}
+
+//-----------------------------------------------------------------------------
+// Throughput of the conversion kernels for every sample type and channel
+// count, in MB of stream format per second, run on packets of
+// KERNEL_PACKET_FRAMES frames.
+//
+static void BenchmarkKernels(void)
+{
+    const ULONG  ulFrames = TEST_RATE * TEST_SECONDS;
+    PBYTE        pInput = new BYTE[ulFrames * AUDIONET_MAX_CHANNELS * 4];
+    PBYTE        pOutput = new BYTE[ulFrames * AUDIONET_MAX_CHANNELS * 4];
+    FLOAT *      pfSamples = new FLOAT[KERNEL_PACKET_FRAMES * AUDIONET_MAX_CHANNELS];
+    WAVEFORMATEX wfx;
+
+    printf("DSP kernels, %u s of music at %u Hz in %u frame packets, MB/s\n", TEST_SECONDS, TEST_RATE, KERNEL_PACKET_FRAMES);
+    printf("  %-6s %-8s %10s %10s %10s\n", "type", "channels", "to float", "from float", "meter copy");
+
+    for (ULONG t = 0; t < DSP_SAMPLE_COUNT; t++) {
+        DSP_SAMPLE_TYPE sampleType = (DSP_SAMPLE_TYPE) t;
+
+        for (USHORT nChannels = 1; nChannels <= AUDIONET_MAX_CHANNELS; nChannels++) {
+            PCDSP_KERNELS pKernels;
+            FLOAT         afPeak[AUDIONET_MAX_CHANNELS] = { 0 };
+            FLOAT         afSquares[AUDIONET_MAX_CHANNELS] = { 0 };
+            double        adTime[3] = { 0 };
+            double        dStart;
+            ULONG         ulFrame;
+
+            InitSampleFormat(&wfx, sampleType, nChannels);
+            pKernels = DspGetKernels(&wfx, nChannels);
+            if (!pKernels) {
+                continue;
+            }
+
+            GenerateSamples(SIGNAL_MUSIC, sampleType, nChannels, ulFrames, pInput);
+
+            // Each packet is converted to float and back as the sender
+            // does, so the float samples stay in the cache.
+            for (ulFrame = 0; ulFrame + KERNEL_PACKET_FRAMES <= ulFrames; ulFrame += KERNEL_PACKET_FRAMES) {
+                ULONG ulOffset = ulFrame * wfx.nBlockAlign;
+
+                dStart = Now();
+                pKernels->ToFloat(pInput + ulOffset, KERNEL_PACKET_FRAMES, pfSamples);
+                adTime[0] += Now() - dStart;
+
+                dStart = Now();
+                pKernels->FromFloat(pfSamples, KERNEL_PACKET_FRAMES, pOutput + ulOffset);
+                adTime[1] += Now() - dStart;
+            }
+
+            dStart = Now();
+            for (ulFrame = 0; ulFrame + KERNEL_PACKET_FRAMES <= ulFrames; ulFrame += KERNEL_PACKET_FRAMES) {
+                ULONG ulOffset = ulFrame * wfx.nBlockAlign;
+
+                pKernels->MeterCopy(pInput + ulOffset, KERNEL_PACKET_FRAMES, pOutput + ulOffset, afPeak, afSquares);
+            }
+            adTime[2] = Now() - dStart;
+
+            printf("  %-6s %-8u", SampleNames[t], nChannels);
+            for (ULONG k = 0; k < 3; k++) {
+                printf(" %10.0f", ulFrame * wfx.nBlockAlign / adTime[k] / 1e6);
+            }
+            printf("\n");
+        }
+    }
+    printf("\n");
+
+    delete [] pfSamples;
+    delete [] pOutput;
+    delete [] pInput;
+}
+
+//=============================================================================
+// Main
+//=============================================================================
+int main(int argc, char **argv)
+{
+    BOOL fBenchmark = TRUE;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--no-benchmark")) {
+            fBenchmark = FALSE;
+        } else {
+            fprintf(stderr, "usage: %s [--no-benchmark]\n", argv[0]);
+            return 2;
+        }
+    }
+
+#if defined(_M_AMD64)
+    printf("SSE2 kernels\n\n");
+#else
+    printf("Scalar kernels\n\n");
+#endif
+
+    TestLossless();
+    TestImaAdpcm();
+    TestPackedPcm();
+    TestG711();
+    TestNetworkPcm();
+    TestKernels();
+
+    if (fBenchmark) {
+        BenchmarkCodecs();
+        BenchmarkUnpack();
+        BenchmarkKernels();
+    }
+
+    if (g_ulFailures) {
+        printf("%u checks failed\n", g_ulFailures);
+        return 1;
+    }
+
+    printf("All checks passed\n");
+
+    return 0;
+}
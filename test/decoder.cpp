@@ -0,0 +1,668 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    decoder.cpp
+
+Abstract:
+    Receiver side decoders of the payload formats.
+
+    The lossless decoder follows the bit stream description in audionet.h
+    rather than the encoder, so the round trip checks the format as well
+    as the codec. Predictions wrap in 32 bits like the encoder's, and
+    every decoded sample is range checked, so no input can overflow.
+
+    The IMA ADPCM decoder is the standard one; it tracks the encoder's
+    predictor exactly, so its output is what the encoder predicted.
+
+    Packed PCM is unpacked like the sender packs it: on x64 depths that are
+    a multiple of four bits two samples per 64-bit lane with SSE2, the rest
+    through a bit accumulator.
+
+    G.711 is expanded like the reference decoders, and network PCM is
+    swapped back byte by byte, so they check the sender's SIMD kernels
+    against the plain definition of the formats.
+--*/
+
+#include <msvad.h>
+#include "decoder.h"
+
+#if defined(_M_AMD64)
+#include <emmintrin.h>
+#endif
+
+//=============================================================================
+// Defines
+//=============================================================================
+#define LOSSLESS_MAX_FIXED_ORDER    4
+
+#define G711_ULAW_BIAS              0x84
+
+#define IMA_MAX_STEP_INDEX          88
+#define IMA_SAMPLES_PER_WORD        8
+
+// No payload sample is narrower than 8 bits, so no payload carries more
+// frames than this.
+#define DECODER_MAX_FRAMES          AUDIONET_MAX_DATAGRAM
+
+//=============================================================================
+// Structs
+//=============================================================================
+typedef struct _BIT_READER {
+    const BYTE *    pInput;
+    ULONG           ulBits;                 // Bits in pInput
+    ULONG           ulPosition;             // Bits read
+} BIT_READER;
+typedef BIT_READER *PBIT_READER;
+
+//=============================================================================
+// Statics
+//=============================================================================
+static const LONG FixedCoefs[LOSSLESS_MAX_FIXED_ORDER + 1][LOSSLESS_MAX_FIXED_ORDER] = {
+    { 0,  0, 0,  0 },
+    { 1,  0, 0,  0 },
+    { 2, -1, 0,  0 },
+    { 3, -3, 1,  0 },
+    { 4, -6, 4, -1 }
+};
+
+static const LONG ImaStepTable[IMA_MAX_STEP_INDEX + 1] = {
+        7,     8,     9,    10,    11,    12,    13,    14,    16,    17,
+       19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+       50,    55,    60,    66,    73,    80,    88,    97,   107,   118,
+      130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+      337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+      876,   963,  1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+     2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+     5894,  6484,  7132,  7845,  8630,  9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const LONG ImaIndexTable[8] = {
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+//=============================================================================
+// Helper Functions
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+// Reads ulCount (at most 32) bits, most significant first.
+//
+static __forceinline BOOL GetBits(IN OUT PBIT_READER pReader, IN ULONG ulCount, OUT PULONG pulValue)
+{
+    ULONGLONG ullValue = 0;
+
+    if (ulCount > pReader->ulBits - pReader->ulPosition) {
+        return FALSE;
+    }
+
+    while (ulCount) {
+        ULONG ulOffset = pReader->ulPosition & 7;
+        ULONG ulTake   = min(8 - ulOffset, ulCount);
+        ULONG ulChunk  = (pReader->pInput[pReader->ulPosition >> 3] >> (8 - ulOffset - ulTake)) & ((1 << ulTake) - 1);
+
+        ullValue = (ullValue << ulTake) | ulChunk;
+        pReader->ulPosition += ulTake;
+        ulCount -= ulTake;
+    }
+
+    *pulValue = (ULONG) ullValue;
+
+    return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Reads a two's complement value of ulCount (1 to 32) bits.
+//
+static __forceinline BOOL GetSigned(IN OUT PBIT_READER pReader, IN ULONG ulCount, OUT PLONG plValue)
+{
+    ULONG ulValue;
+
+    if (!GetBits(pReader, ulCount, &ulValue)) {
+        return FALSE;
+    }
+
+    *plValue = (LONG) (ulValue << (32 - ulCount)) >> (32 - ulCount);
+
+    return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Reads a Rice coded, zigzag mapped residual.
+//
+static __forceinline BOOL GetRice(IN OUT PBIT_READER pReader, IN ULONG ulParameter, OUT PLONG plValue)
+{
+    ULONG ulZeros = 0;
+    ULONG ulBit;
+    ULONG ulLow;
+
+    for (;;) {
+        if (!GetBits(pReader, 1, &ulBit)) {
+            return FALSE;
+        }
+        if (ulBit) {
+            break;
+        }
+        ulZeros++;
+        if (ulZeros > (MAXULONG >> ulParameter)) {
+            return FALSE;
+        }
+    }
+
+    if (!GetBits(pReader, ulParameter, &ulLow)) {
+        return FALSE;
+    }
+
+    ULONG ulValue = (ulZeros << ulParameter) | ulLow;
+
+    *plValue = (LONG) ((ulValue >> 1) ^ (0 - (ulValue & 1)));
+
+    return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Decodes one subframe of ulFrames samples of ulBits bits into plSignal.
+//
+static BOOL DecodeSubframe
+(
+    IN OUT PBIT_READER          pReader,
+    IN  ULONG                   ulFrames,
+    IN  ULONG                   ulBits,
+    OUT PLONG                   plSignal,
+    OUT PULONG                  pulType,
+    OUT PULONG                  pulOrder
+)
+{
+    LONG  lCoefs[8];
+    LONG  lMin = -(1 << (ulBits - 1));
+    LONG  lMax = (1 << (ulBits - 1)) - 1;
+    ULONG ulType;
+    ULONG ulOrder = 0;
+    ULONG ulShift = 0;
+    ULONG ulValue;
+    ULONG i;
+    ULONG j;
+
+    if (!GetBits(pReader, 2, &ulType)) {
+        return FALSE;
+    }
+    *pulType  = ulType;
+    *pulOrder = 0;
+
+    switch (ulType) {
+        case AUDIONET_LOSSLESS_SUBFRAME_CONSTANT:
+            if (!GetSigned(pReader, ulBits, &plSignal[0])) {
+                return FALSE;
+            }
+            for (i = 1; i < ulFrames; i++) {
+                plSignal[i] = plSignal[0];
+            }
+            return TRUE;
+
+        case AUDIONET_LOSSLESS_SUBFRAME_VERBATIM:
+            for (i = 0; i < ulFrames; i++) {
+                if (!GetSigned(pReader, ulBits, &plSignal[i])) {
+                    return FALSE;
+                }
+            }
+            return TRUE;
+
+        case AUDIONET_LOSSLESS_SUBFRAME_FIXED:
+            if (!GetBits(pReader, 3, &ulOrder) || (ulOrder > LOSSLESS_MAX_FIXED_ORDER)) {
+                return FALSE;
+            }
+            for (j = 0; j < ulOrder; j++) {
+                lCoefs[j] = FixedCoefs[ulOrder][j];
+            }
+            break;
+
+        default:
+            {
+                ULONG ulPrecision;
+
+                if (!GetBits(pReader, 3, &ulOrder) || !GetBits(pReader, 4, &ulPrecision) || !GetBits(pReader, 4, &ulShift)) {
+                    return FALSE;
+                }
+                ulOrder++;
+                ulPrecision++;
+                for (j = 0; j < ulOrder; j++) {
+                    if (!GetSigned(pReader, ulPrecision, &lCoefs[j])) {
+                        return FALSE;
+                    }
+                }
+            }
+            break;
+    }
+    *pulOrder = ulOrder;
+
+    if (ulOrder > ulFrames) {
+        return FALSE;
+    }
+    for (i = 0; i < ulOrder; i++) {
+        if (!GetSigned(pReader, ulBits, &plSignal[i])) {
+            return FALSE;
+        }
+    }
+
+    ULONG ulPartitionOrder;
+
+    if (!GetBits(pReader, 2, &ulPartitionOrder) || ((ulFrames >> ulPartitionOrder) < ulOrder)) {
+        return FALSE;
+    }
+
+    ULONG ulParts = 1 << ulPartitionOrder;
+    ULONG ulSize  = ulFrames >> ulPartitionOrder;
+
+    i = ulOrder;
+    for (ULONG n = 0; n < ulParts; n++) {
+        ULONG ulEnd = (n == ulParts - 1) ? ulFrames : (n + 1) * ulSize;
+
+        if (!GetBits(pReader, 5, &ulValue)) {
+            return FALSE;
+        }
+
+        for (; i < ulEnd; i++) {
+            ULONG ulSum = 0;
+            LONG  lResidual;
+
+            if (!GetRice(pReader, ulValue, &lResidual)) {
+                return FALSE;
+            }
+            for (j = 0; j < ulOrder; j++) {
+                ulSum += (ULONG) lCoefs[j] * (ULONG) plSignal[i - 1 - j];
+            }
+
+            plSignal[i] = (LONG) ((ULONG) lResidual + (ULONG) ((LONG) ulSum >> ulShift));
+            if ((plSignal[i] < lMin) || (plSignal[i] > lMax)) {
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+#if defined(_M_AMD64)
+//-----------------------------------------------------------------------------
+// Four samples per iteration, two per 64-bit lane, ulBits a multiple of four.
+// Every load reads eight bytes of which only the first ulBits / 4 belong to
+// the lane, so the loop stops eight bytes short of the payload end.
+//
+static ULONG UnpackSse2(IN const BYTE *pIn, IN ULONG ulLength, IN ULONG ulSamples, IN ULONG ulBits, OUT PLONG plOut)
+{
+    const __m128i mask   = _mm_set_epi32(0, (1 << ulBits) - 1, 0, (1 << ulBits) - 1);
+    const __m128i shift  = _mm_cvtsi32_si128(ulBits);
+    const __m128i extend = _mm_cvtsi32_si128(32 - ulBits);
+    const ULONG   ulLane = ulBits / 4;
+    ULONG         ulIn = 0;
+    ULONG         i;
+
+    for (i = 0; (i + 4 <= ulSamples) && (ulIn + ulLane + 8 <= ulLength); i += 4) {
+        __m128i lane = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(pIn + ulIn)), _mm_loadl_epi64((const __m128i *)(pIn + ulIn + ulLane)));
+        __m128i even = _mm_and_si128(lane, mask);
+        __m128i odd  = _mm_and_si128(_mm_srl_epi64(lane, shift), mask);
+        __m128i v    = _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+
+        _mm_storeu_si128((__m128i *)(plOut + i), _mm_sra_epi32(_mm_sll_epi32(v, extend), extend));
+        ulIn += 2 * ulLane;
+    }
+
+    return i;
+}
+#endif
+
+//=============================================================================
+// Functions
+//=============================================================================
+
+//=============================================================================
+BOOL LosslessDecode(
+    IN  const BYTE *            pPayload,
+    IN  ULONG                   ulLength,
+    IN  USHORT                  nChannels,
+    IN  USHORT                  wBitsPerSample,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput,
+    OUT PLOSSLESS_FRAME_INFO    pInfo OPTIONAL
+)
+/*++
+Routine Description:
+  Decodes one lossless payload. The payload must end within the zero
+  padding of its last byte.
+
+Arguments:
+  pPayload - payload of the datagram.
+  ulLength - bytes in the payload.
+  nChannels - channels of the packet header.
+  wBitsPerSample - bits per sample of the packet header, 8 or 16.
+  ulFrames - frames of the packet header.
+  pOutput - receives ulFrames interleaved frames.
+  pInfo - receives the channel assignment and subframe types.
+
+Return Value:
+  FALSE if the payload is malformed.
+--*/
+{
+    LONG                alSignal[AUDIONET_MAX_CHANNELS][DECODER_MAX_FRAMES];
+    BIT_READER          reader = { pPayload, ulLength * 8, 0 };
+    LOSSLESS_FRAME_INFO info;
+    ULONG               ulBits = wBitsPerSample;
+    LONG                lMin = -(1 << (ulBits - 1));
+    LONG                lMax = (1 << (ulBits - 1)) - 1;
+    ULONG               c;
+    ULONG               i;
+
+    if (!nChannels || (nChannels > AUDIONET_MAX_CHANNELS) || ((ulBits != 8) && (ulBits != 16)) ||
+        !ulFrames || (ulFrames > DECODER_MAX_FRAMES) || (ulLength > MAXULONG / 8)) {
+        return FALSE;
+    }
+
+    if (!GetBits(&reader, 4, &info.ChannelAssignment) || (info.ChannelAssignment > AUDIONET_LOSSLESS_CHANNELS_MID_SIDE) ||
+        ((nChannels != 2) && (info.ChannelAssignment != AUDIONET_LOSSLESS_CHANNELS_INDEPENDENT))) {
+        return FALSE;
+    }
+
+    for (c = 0; c < nChannels; c++) {
+        BOOL fSide = ((info.ChannelAssignment == AUDIONET_LOSSLESS_CHANNELS_LEFT_SIDE) && (c == 1)) ||
+                     ((info.ChannelAssignment == AUDIONET_LOSSLESS_CHANNELS_SIDE_RIGHT) && (c == 0)) ||
+                     ((info.ChannelAssignment == AUDIONET_LOSSLESS_CHANNELS_MID_SIDE) && (c == 1));
+
+        if (!DecodeSubframe(&reader, ulFrames, fSide ? ulBits + 1 : ulBits, alSignal[c], &info.Type[c], &info.Order[c])) {
+            return FALSE;
+        }
+    }
+
+    if (reader.ulBits - reader.ulPosition >= 8) {
+        return FALSE;
+    }
+
+    for (i = 0; i < ulFrames; i++) {
+        LONG lLeft  = alSignal[0][i];
+        LONG lRight = (nChannels == 2) ? alSignal[1][i] : 0;
+        LONG lMid;
+
+        switch (info.ChannelAssignment) {
+            case AUDIONET_LOSSLESS_CHANNELS_LEFT_SIDE:
+                lRight = lLeft - lRight;
+                break;
+
+            case AUDIONET_LOSSLESS_CHANNELS_SIDE_RIGHT:
+                lLeft = lLeft + lRight;
+                break;
+
+            case AUDIONET_LOSSLESS_CHANNELS_MID_SIDE:
+                lMid   = (LONG) (((ULONG) lLeft << 1) | (lRight & 1));
+                lLeft  = (lMid + lRight) >> 1;
+                lRight = (lMid - lRight) >> 1;
+                break;
+        }
+
+        if (nChannels == 2) {
+            if ((lLeft < lMin) || (lLeft > lMax) || (lRight < lMin) || (lRight > lMax)) {
+                return FALSE;
+            }
+            alSignal[0][i] = lLeft;
+            alSignal[1][i] = lRight;
+        }
+    }
+
+    for (i = 0; i < ulFrames; i++) {
+        for (c = 0; c < nChannels; c++) {
+            if (ulBits == 8) {
+                pOutput[i * nChannels + c] = (BYTE) (alSignal[c][i] + 0x80);
+            } else {
+                ((SHORT *) pOutput)[i * nChannels + c] = (SHORT) alSignal[c][i];
+            }
+        }
+    }
+
+    if (pInfo) {
+        *pInfo = info;
+    }
+
+    return TRUE;
+} // LosslessDecode
+
+//=============================================================================
+BOOL ImaAdpcmDecode(
+    IN  const BYTE *            pPayload,
+    IN  ULONG                   ulLength,
+    IN  USHORT                  nChannels,
+    IN  ULONG                   ulFrames,
+    OUT SHORT *                 pOutput
+)
+/*++
+Routine Description:
+  Decodes one IMA ADPCM block. The payload must be exactly the block of
+  ulFrames frames, padding included.
+
+Arguments:
+  pPayload - payload of the datagram.
+  ulLength - bytes in the payload.
+  nChannels - channels of the packet header.
+  ulFrames - frames of the packet header.
+  pOutput - receives ulFrames interleaved frames.
+
+Return Value:
+  FALSE if the payload is malformed.
+--*/
+{
+    const AUDIONET_IMA_BLOCK_HEADER *pHeader = (const AUDIONET_IMA_BLOCK_HEADER *) pPayload;
+    const BYTE *                     pWords  = pPayload + sizeof(AUDIONET_IMA_BLOCK_HEADER) * nChannels;
+    ULONG                            ulGroups;
+
+    if (!nChannels || (nChannels > AUDIONET_MAX_CHANNELS) || !ulFrames || (ulFrames > MAXULONG / 2)) {
+        return FALSE;
+    }
+
+    ulGroups = (ulFrames + IMA_SAMPLES_PER_WORD - 2) / IMA_SAMPLES_PER_WORD;
+    if (ulLength != (1 + ulGroups) * sizeof(ULONG) * nChannels) {
+        return FALSE;
+    }
+
+    for (ULONG c = 0; c < nChannels; c++) {
+        LONG lPredictor = pHeader[c].Sample;
+        LONG lStepIndex = pHeader[c].StepIndex;
+
+        if (lStepIndex > IMA_MAX_STEP_INDEX) {
+            return FALSE;
+        }
+
+        pOutput[c] = (SHORT) lPredictor;
+
+        for (ULONG ulFrame = 1; ulFrame < ulFrames; ulFrame++) {
+            ULONG ulGroup = (ulFrame - 1) / IMA_SAMPLES_PER_WORD;
+            ULONG ulShift = 4 * ((ulFrame - 1) % IMA_SAMPLES_PER_WORD);
+            ULONG ulWord;
+            ULONG ulCode;
+            LONG  lStep  = ImaStepTable[lStepIndex];
+            LONG  lDelta = lStep >> 3;
+
+            RtlCopyMemory(&ulWord, pWords + (ulGroup * nChannels + c) * sizeof(ULONG), sizeof(ULONG));
+            ulCode = (ulWord >> ulShift) & 0xF;
+
+            if (ulCode & 4) {
+                lDelta += lStep;
+            }
+            if (ulCode & 2) {
+                lDelta += lStep >> 1;
+            }
+            if (ulCode & 1) {
+                lDelta += lStep >> 2;
+            }
+
+            lPredictor += (ulCode & 8) ? -lDelta : lDelta;
+            lPredictor  = min(max(lPredictor, -32768), 32767);
+
+            lStepIndex += ImaIndexTable[ulCode & 7];
+            lStepIndex  = min(max(lStepIndex, 0), IMA_MAX_STEP_INDEX);
+
+            pOutput[ulFrame * nChannels + c] = (SHORT) lPredictor;
+        }
+    }
+
+    return TRUE;
+} // ImaAdpcmDecode
+
+//=============================================================================
+BOOL PackedPcmUnpack(
+    IN  const BYTE *            pPayload,
+    IN  ULONG                   ulLength,
+    IN  USHORT                  nChannels,
+    IN  USHORT                  wBitsPerSample,
+    IN  ULONG                   ulFrames,
+    OUT PLONG                   plOutput
+)
+/*++
+Routine Description:
+  Unpacks one packed PCM payload. The payload must be exactly the samples
+  of ulFrames frames and the padding of the last byte.
+
+Arguments:
+  pPayload - payload of the datagram.
+  ulLength - bytes in the payload.
+  nChannels - channels of the packet header.
+  wBitsPerSample - bits per sample of the packet header.
+  ulFrames - frames of the packet header.
+  plOutput - receives ulFrames interleaved frames.
+
+Return Value:
+  FALSE if the payload is malformed.
+--*/
+{
+    ULONG     ulBits = wBitsPerSample;
+    ULONG     ulSamples;
+    ULONG     ulMask;
+    ULONG     ulExtend;
+    ULONGLONG ullPending = 0;
+    ULONG     ulPending = 0;
+    ULONG     ulIn;
+    ULONG     i = 0;
+
+    if (!nChannels || (nChannels > AUDIONET_MAX_CHANNELS) || (ulBits < AUDIONET_MIN_BIT_DEPTH) || (ulBits > AUDIONET_MAX_BIT_DEPTH) ||
+        (ulFrames > AUDIONET_MAX_DATAGRAM)) {
+        return FALSE;
+    }
+
+    ulSamples = ulFrames * nChannels;
+    if (ulLength != (ulSamples * ulBits + 7) / 8) {
+        return FALSE;
+    }
+
+    ulMask   = ((ULONG) 1 << ulBits) - 1;
+    ulExtend = 32 - ulBits;
+
+#if defined(_M_AMD64)
+    if (!(ulBits & 3)) {
+        i = UnpackSse2(pPayload, ulLength, ulSamples, ulBits, plOutput);
+    }
+#endif
+
+    // The SSE2 kernel stops on a byte boundary.
+    ulIn = i * ulBits / 8;
+
+    for (; i < ulSamples; i++) {
+        while (ulPending < ulBits) {
+            ullPending |= (ULONGLONG) pPayload[ulIn++] << ulPending;
+            ulPending  += 8;
+        }
+
+        plOutput[i] = (LONG) (((ULONG) ullPending & ulMask) << ulExtend) >> ulExtend;
+        ullPending >>= ulBits;
+        ulPending   -= ulBits;
+    }
+
+    return TRUE;
+} // PackedPcmUnpack
+
+//=============================================================================
+BOOL G711Decode(
+    IN  const BYTE *            pPayload,
+    IN  ULONG                   ulLength,
+    IN  ULONG                   ulCodecId,
+    OUT SHORT *                 pOutput
+)
+/*++
+Routine Description:
+  Expands one G.711 payload, one byte per sample, to 16 bit samples. The
+  value of each code is the middle of the input range the encoder maps to
+  it, so the error of a round trip is at most half a step of its segment
+  away from the clip levels.
+
+Arguments:
+  pPayload - payload of the datagram.
+  ulLength - bytes in the payload.
+  ulCodecId - AUDIONET_CODEC_G711_ULAW or AUDIONET_CODEC_G711_ALAW.
+  pOutput - receives ulLength samples.
+
+Return Value:
+  FALSE if the codec is not G.711.
+--*/
+{
+    if (ulCodecId == AUDIONET_CODEC_G711_ULAW) {
+        for (ULONG i = 0; i < ulLength; i++) {
+            ULONG ulCode = (UCHAR) ~pPayload[i];
+            LONG  lValue = (((ulCode & 0x0F) << 3) + G711_ULAW_BIAS) << ((ulCode >> 4) & 7);
+
+            pOutput[i] = (SHORT) ((ulCode & 0x80) ? G711_ULAW_BIAS - lValue : lValue - G711_ULAW_BIAS);
+        }
+    } else if (ulCodecId == AUDIONET_CODEC_G711_ALAW) {
+        for (ULONG i = 0; i < ulLength; i++) {
+            ULONG ulCode    = pPayload[i] ^ 0x55;
+            ULONG ulSegment = (ulCode >> 4) & 7;
+            LONG  lValue    = ((ulCode & 0x0F) << 4) + 8;
+
+            if (ulSegment) {
+                lValue = (lValue + 0x100) << (ulSegment - 1);
+            }
+
+            pOutput[i] = (SHORT) ((ulCode & 0x80) ? lValue : -lValue);
+        }
+    } else {
+        return FALSE;
+    }
+
+    return TRUE;
+} // G711Decode
+
+//=============================================================================
+BOOL NetworkPcmDecode(
+    IN  const BYTE *            pPayload,
+    IN  ULONG                   ulLength,
+    IN  USHORT                  wBitsPerSample,
+    OUT PBYTE                   pOutput
+)
+/*++
+Routine Description:
+  Converts one network PCM payload back to the stream format: 8 bit
+  samples to unsigned, wider ones to little-endian.
+
+Arguments:
+  pPayload - payload of the datagram.
+  ulLength - bytes in the payload.
+  wBitsPerSample - bits per sample of the stream.
+  pOutput - receives ulLength bytes.
+
+Return Value:
+  FALSE if the payload is not a whole number of samples.
+--*/
+{
+    ULONG ulBytes = wBitsPerSample / 8;
+
+    if ((wBitsPerSample & 7) || !ulBytes || (ulBytes > 4) || (ulLength % ulBytes)) {
+        return FALSE;
+    }
+
+    for (ULONG i = 0; i < ulLength; i += ulBytes) {
+        if (ulBytes == 1) {
+            pOutput[i] = pPayload[i] ^ 0x80;
+        } else {
+            for (ULONG b = 0; b < ulBytes; b++) {
+                pOutput[i + b] = pPayload[i + ulBytes - 1 - b];
+            }
+        }
+    }
+
+    return TRUE;
+} // NetworkPcmDecode
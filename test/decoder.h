@@ -0,0 +1,88 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    decoder.h
+
+Abstract:
+    Receiver side decoders of the payload formats described in audionet.h.
+    They only need audionet.h and integer arithmetic, and check every read
+    against the payload length, so a malformed datagram is rejected rather
+    than decoded past its end.
+--*/
+
+#ifndef _MSVAD_DECODER_H_
+#define _MSVAD_DECODER_H_
+
+#include "audionet.h"
+
+//=============================================================================
+// Structs
+//=============================================================================
+
+// What a lossless payload was coded with, for the round-trip coverage.
+typedef struct _LOSSLESS_FRAME_INFO {
+    ULONG       ChannelAssignment;                  // AUDIONET_LOSSLESS_CHANNELS_xxx
+    ULONG       Type[AUDIONET_MAX_CHANNELS];        // AUDIONET_LOSSLESS_SUBFRAME_xxx
+    ULONG       Order[AUDIONET_MAX_CHANNELS];       // Fixed or LPC order
+} LOSSLESS_FRAME_INFO;
+typedef LOSSLESS_FRAME_INFO *PLOSSLESS_FRAME_INFO;
+
+//=============================================================================
+// Function Prototypes
+//=============================================================================
+
+// Decodes an AUDIONET_CODEC_LOSSLESS payload of ulFrames frames into
+// interleaved 8 bit unsigned or 16 bit signed samples. Returns FALSE if the
+// payload is malformed.
+BOOL LosslessDecode(
+    IN  const BYTE *            pPayload,
+    IN  ULONG                   ulLength,
+    IN  USHORT                  nChannels,
+    IN  USHORT                  wBitsPerSample,
+    IN  ULONG                   ulFrames,
+    OUT PBYTE                   pOutput,
+    OUT PLOSSLESS_FRAME_INFO    pInfo OPTIONAL
+);
+
+// Decodes an AUDIONET_CODEC_IMA_ADPCM payload of ulFrames frames into
+// interleaved 16 bit samples. Returns FALSE if the payload is malformed.
+BOOL ImaAdpcmDecode(
+    IN  const BYTE *            pPayload,
+    IN  ULONG                   ulLength,
+    IN  USHORT                  nChannels,
+    IN  ULONG                   ulFrames,
+    OUT SHORT *                 pOutput
+);
+
+// Unpacks an AUDIONET_CODEC_PACKED_PCM payload of ulFrames frames of
+// wBitsPerSample bits into right aligned 32 bit samples. Returns FALSE if
+// the payload is malformed.
+BOOL PackedPcmUnpack(
+    IN  const BYTE *            pPayload,
+    IN  ULONG                   ulLength,
+    IN  USHORT                  nChannels,
+    IN  USHORT                  wBitsPerSample,
+    IN  ULONG                   ulFrames,
+    OUT PLONG                   plOutput
+);
+
+// Expands an AUDIONET_CODEC_G711_ULAW or AUDIONET_CODEC_G711_ALAW payload
+// into 16 bit samples. Returns FALSE for any other codec.
+BOOL G711Decode(
+    IN  const BYTE *            pPayload,
+    IN  ULONG                   ulLength,
+    IN  ULONG                   ulCodecId,
+    OUT SHORT *                 pOutput
+);
+
+// Converts an AUDIONET_CODEC_PCM_NETWORK payload back to the stream format
+// of wBitsPerSample bits. Returns FALSE if the payload is malformed.
+BOOL NetworkPcmDecode(
+    IN  const BYTE *            pPayload,
+    IN  ULONG                   ulLength,
+    IN  USHORT                  wBitsPerSample,
+    OUT PBYTE                   pOutput
+);
+
+#endif
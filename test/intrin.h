@@ -0,0 +1,25 @@
+/*++
+Module Name:
+    intrin.h
+
+Abstract:
+    User-mode stand-in for the compiler intrinsics header: only the CPUID
+    intrinsics the codecs use, in their MSVC form.
+--*/
+
+#ifndef _MSVAD_TEST_INTRIN_H_
+#define _MSVAD_TEST_INTRIN_H_
+
+static inline void __cpuidex(int info[4], int function, int subfunction)
+{
+    __asm__ __volatile__("cpuid"
+                         : "=a" (info[0]), "=b" (info[1]), "=c" (info[2]), "=d" (info[3])
+                         : "a" (function), "c" (subfunction));
+}
+
+static inline void __cpuid(int info[4], int function)
+{
+    __cpuidex(info, function, 0);
+}
+
+#endif
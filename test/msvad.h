@@ -0,0 +1,217 @@
+/*++
+Copyright (c) 1997-2000  Microsoft Corporation All Rights Reserved
+
+Module Name:
+    msvad.h
+
+Abstract:
+    User-mode stand-in for the driver's msvad.h, so the codec and DSP
+    sources build unchanged into the test harness with g++. Only the kernel
+    types and routines those sources use are declared; pool memory comes
+    from the C runtime and floating point needs no save.
+--*/
+
+#ifndef _MSVAD_H_
+#define _MSVAD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+//=============================================================================
+// Defines
+//=============================================================================
+#define IN
+#define OUT
+#define OPTIONAL
+#define NTAPI
+#define VOID                        void
+
+#define __forceinline               inline __attribute__((always_inline))
+
+#define C_ASSERT(e)                 static_assert(e, #e)
+#define ASSERT(e)                   assert(e)
+#define PAGED_CODE()                ((void) 0)
+#define UNREFERENCED_PARAMETER(p)   ((void) (p))
+#define FIELD_OFFSET(t, f)          ((LONG) offsetof(t, f))
+
+#define D_FUNC                      4
+#define D_BLAB                      3
+#define D_VERBOSE                   2
+#define D_TERSE                     1
+#define D_ERROR                     0
+#define DPF(lvl, args)              ((void) 0)
+
+#define MSVAD_POOLTAG               'DVSM'
+
+#define TRUE                        1
+#define FALSE                       0
+#define MAXLONG                     0x7FFFFFFF
+#define MAXULONG                    0xFFFFFFFF
+
+#define NT_SUCCESS(s)               ((NTSTATUS) (s) >= 0)
+#define STATUS_SUCCESS              ((NTSTATUS) 0x00000000L)
+#define STATUS_UNSUCCESSFUL         ((NTSTATUS) 0xC0000001L)
+#define STATUS_INVALID_PARAMETER    ((NTSTATUS) 0xC000000DL)
+#define STATUS_INSUFFICIENT_RESOURCES ((NTSTATUS) 0xC000009AL)
+#define STATUS_NOT_SUPPORTED        ((NTSTATUS) 0xC00000BBL)
+
+#define WAVE_FORMAT_PCM             0x0001
+#define WAVE_FORMAT_IEEE_FLOAT      0x0003
+#define WAVE_FORMAT_IMA_ADPCM       0x0011
+#define WAVE_FORMAT_EXTENSIBLE      0xFFFE
+
+#define SPEAKER_FRONT_LEFT          0x00000001
+#define SPEAKER_FRONT_RIGHT         0x00000002
+#define SPEAKER_FRONT_CENTER        0x00000004
+#define SPEAKER_LOW_FREQUENCY       0x00000008
+#define SPEAKER_BACK_LEFT           0x00000010
+#define SPEAKER_BACK_RIGHT          0x00000020
+#define SPEAKER_FRONT_LEFT_OF_CENTER 0x00000040
+#define SPEAKER_FRONT_RIGHT_OF_CENTER 0x00000080
+#define SPEAKER_BACK_CENTER         0x00000100
+#define SPEAKER_SIDE_LEFT           0x00000200
+#define SPEAKER_SIDE_RIGHT          0x00000400
+
+#ifndef min
+#define min(a, b)                   (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b)                   (((a) > (b)) ? (a) : (b))
+#endif
+
+//=============================================================================
+// Typedefs
+//=============================================================================
+typedef char                        CHAR;
+typedef unsigned char               UCHAR, BYTE, BOOLEAN;
+typedef int16_t                     SHORT;
+typedef uint16_t                    USHORT, WORD;
+typedef int32_t                     LONG, BOOL, NTSTATUS;
+typedef uint32_t                    ULONG, DWORD;
+typedef int64_t                     LONGLONG;
+typedef uint64_t                    ULONGLONG, ULONG64;
+typedef float                       FLOAT;
+typedef void *                      PVOID;
+
+typedef BYTE *PBYTE;
+typedef SHORT *PSHORT;
+typedef LONG *PLONG;
+typedef ULONG *PULONG;
+
+typedef enum {
+    NonPagedPool = 0,
+    PagedPool
+} POOL_TYPE;
+
+typedef struct _KFLOATING_SAVE {
+    ULONG           Dummy;
+} KFLOATING_SAVE, *PKFLOATING_SAVE;
+
+typedef struct _GUID {
+    ULONG           Data1;
+    USHORT          Data2;
+    USHORT          Data3;
+    UCHAR           Data4[8];
+} GUID;
+
+#define DEFINE_GUIDSTRUCT(g, n)     static const GUID n = { STATIC_##n }
+#define DEFINE_GUIDNAMED(n)         n
+
+#define STATIC_KSDATAFORMAT_SUBTYPE_PCM 0x00000001, 0x0000, 0x0010, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71
+DEFINE_GUIDSTRUCT("00000001-0000-0010-8000-00aa00389b71", KSDATAFORMAT_SUBTYPE_PCM);
+#define KSDATAFORMAT_SUBTYPE_PCM DEFINE_GUIDNAMED(KSDATAFORMAT_SUBTYPE_PCM)
+
+#define STATIC_KSDATAFORMAT_SUBTYPE_IEEE_FLOAT 0x00000003, 0x0000, 0x0010, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71
+DEFINE_GUIDSTRUCT("00000003-0000-0010-8000-00aa00389b71", KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
+#define KSDATAFORMAT_SUBTYPE_IEEE_FLOAT DEFINE_GUIDNAMED(KSDATAFORMAT_SUBTYPE_IEEE_FLOAT)
+
+#define IsEqualGUIDAligned(a, b)    (!memcmp(&(a), &(b), sizeof(GUID)))
+
+#include <pshpack1.h>
+typedef struct tWAVEFORMATEX {
+    WORD            wFormatTag;
+    WORD            nChannels;
+    DWORD           nSamplesPerSec;
+    DWORD           nAvgBytesPerSec;
+    WORD            nBlockAlign;
+    WORD            wBitsPerSample;
+    WORD            cbSize;
+} WAVEFORMATEX, *PWAVEFORMATEX;
+
+typedef struct {
+    WAVEFORMATEX    Format;
+    union {
+        WORD        wValidBitsPerSample;
+        WORD        wSamplesPerBlock;
+        WORD        wReserved;
+    } Samples;
+    DWORD           dwChannelMask;
+    GUID            SubFormat;
+} WAVEFORMATEXTENSIBLE, *PWAVEFORMATEXTENSIBLE;
+#include <poppack.h>
+
+//=============================================================================
+// Inlines
+//=============================================================================
+#define RtlCopyMemory(d, s, n)      memcpy((d), (s), (n))
+#define RtlMoveMemory(d, s, n)      memmove((d), (s), (n))
+#define RtlZeroMemory(d, n)         memset((d), 0, (n))
+#define RtlEqualMemory(a, b, n)     (!memcmp((a), (b), (n)))
+
+static inline PVOID ExAllocatePoolWithTag(IN POOL_TYPE PoolType, IN size_t NumberOfBytes, IN ULONG Tag)
+{
+    UNREFERENCED_PARAMETER(PoolType);
+    UNREFERENCED_PARAMETER(Tag);
+
+    return malloc(NumberOfBytes);
+}
+
+static inline void ExFreePoolWithTag(IN PVOID P, IN ULONG Tag)
+{
+    UNREFERENCED_PARAMETER(Tag);
+
+    free(P);
+}
+
+static inline NTSTATUS KeSaveFloatingPointState(OUT PKFLOATING_SAVE FloatSave)
+{
+    UNREFERENCED_PARAMETER(FloatSave);
+
+    return STATUS_SUCCESS;
+}
+
+static inline NTSTATUS KeRestoreFloatingPointState(IN PKFLOATING_SAVE FloatSave)
+{
+    UNREFERENCED_PARAMETER(FloatSave);
+
+    return STATUS_SUCCESS;
+}
+
+inline void * operator new(size_t iSize, POOL_TYPE poolType, ULONG tag)
+{
+    UNREFERENCED_PARAMETER(poolType);
+    UNREFERENCED_PARAMETER(tag);
+
+    return ::operator new(iSize);
+}
+
+inline void operator delete(void *pVoid, POOL_TYPE poolType, ULONG tag)
+{
+    UNREFERENCED_PARAMETER(poolType);
+    UNREFERENCED_PARAMETER(tag);
+
+    ::operator delete(pVoid);
+}
+
+//-----------------------------------------------------------------------------
+// ullValue * ulNumerator / ullDenominator, rounded down, as in the driver.
+//
+static __forceinline ULONGLONG ScaleRatio(IN ULONGLONG ullValue, IN ULONG ulNumerator, IN ULONGLONG ullDenominator)
+{
+    return (ullValue / ullDenominator) * ulNumerator + (ullValue % ullDenominator) * ulNumerator / ullDenominator;
+}
+
+#endif
@@ -0,0 +1,9 @@
+/*++
+Module Name:
+    poppack.h
+
+Abstract:
+    User-mode stand-in for the SDK header of the same name.
+--*/
+
+#pragma pack(pop)
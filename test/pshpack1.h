@@ -0,0 +1,9 @@
+/*++
+Module Name:
+    pshpack1.h
+
+Abstract:
+    User-mode stand-in for the SDK header of the same name.
+--*/
+
+#pragma pack(push, 1)
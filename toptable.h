@@ -244,6 +244,30 @@ static PCPROPERTY_ITEM PropertiesDevSpecific[] = {
 
 DEFINE_PCAUTOMATION_TABLE_PROP(AutomationDevSpecific, PropertiesDevSpecific);
 
+//=============================================================================
+static PCPROPERTY_ITEM PropertiesPeakMeter[] = {
+  {
+    &KSPROPSETID_Audio,
+    KSPROPERTY_AUDIO_PEAKMETER,
+    KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_BASICSUPPORT,
+    PropertyHandler_Topology
+  },
+  {
+    &KSPROPSETID_AudioNet,
+    KSPROPERTY_AUDIONET_RMS_METER,
+    KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_BASICSUPPORT,
+    PropertyHandler_Topology
+  },
+  {
+    &KSPROPSETID_Audio,
+    KSPROPERTY_AUDIO_CPU_RESOURCES,
+    KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_BASICSUPPORT,
+    PropertyHandler_Topology
+  }
+};
+
+DEFINE_PCAUTOMATION_TABLE_PROP(AutomationPeakMeter, PropertiesPeakMeter);
+
 //=============================================================================
 static PCNODE_DESCRIPTOR TopologyNodes[] = {
   // KSNODE_TOPO_WAVEOUT_VOLUME
@@ -341,6 +365,14 @@ static PCNODE_DESCRIPTOR TopologyNodes[] = {
     &KSNODETYPE_DEV_SPECIFIC,// Type
     NULL                     // Name
   },
+
+  // KSNODE_TOPO_WAVEOUT_PEAKMETER
+  {
+    0,                      // Flags
+    &AutomationPeakMeter,   // AutomationTable
+    &KSNODETYPE_PEAKMETER,  // Type
+    &KSAUDFNAME_PEAKMETER   // Name
+  },
 };
 
 C_ASSERT( KSNODE_TOPO_WAVEOUT_VOLUME  == 0 );
@@ -359,11 +391,13 @@ C_ASSERT( KSNODE_TOPO_DEV_SPECIFIC_BOOL == DEV_SPECIFIC_VT_BOOL );
 C_ASSERT( KSNODE_TOPO_DEV_SPECIFIC_BOOL == DEV_SPECIFIC_VT_BOOL );
 C_ASSERT( KSNODE_TOPO_DEV_SPECIFIC_INT == DEV_SPECIFIC_VT_I4 );
 C_ASSERT( KSNODE_TOPO_DEV_SPECIFIC_UINT == DEV_SPECIFIC_VT_UI4 );
+C_ASSERT( KSNODE_TOPO_WAVEOUT_PEAKMETER == 12 );
 
 //=============================================================================
 static PCCONNECTION_DESCRIPTOR MiniportConnections[] = {
   //  FromNode,                     FromPin,                        ToNode,                      ToPin
-  {   PCFILTER_NODE,                KSPIN_TOPO_WAVEOUT_SOURCE,      KSNODE_TOPO_WAVEOUT_VOLUME,    1 },
+  {   PCFILTER_NODE,                KSPIN_TOPO_WAVEOUT_SOURCE,      KSNODE_TOPO_WAVEOUT_PEAKMETER, 1 },
+  {   KSNODE_TOPO_WAVEOUT_PEAKMETER,0,                              KSNODE_TOPO_WAVEOUT_VOLUME,    1 },
   {   KSNODE_TOPO_WAVEOUT_VOLUME,   0,                              KSNODE_TOPO_WAVEOUT_MUTE,      1 },
   {   KSNODE_TOPO_WAVEOUT_MUTE,     0,                              KSNODE_TOPO_LINEOUT_MIX,       1 },
 
@@ -29,10 +29,27 @@ static KSDATARANGE_AUDIO PinDataRangesStream[] = {
     MIN_SAMPLE_RATE,            
     MAX_SAMPLE_RATE             
   },
+  {
+    {
+      sizeof(KSDATARANGE_AUDIO),
+      0,
+      0,
+      0,
+      STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+      STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEEE_FLOAT),
+      STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+    },
+    MAX_CHANNELS_PCM,           
+    BITS_PER_SAMPLE_FLOAT,    
+    BITS_PER_SAMPLE_FLOAT,    
+    MIN_SAMPLE_RATE,            
+    MAX_SAMPLE_RATE             
+  },
 };
 
 static PKSDATARANGE PinDataRangePointersStream[] = {
-    PKSDATARANGE(&PinDataRangesStream[0])
+    PKSDATARANGE(&PinDataRangesStream[0]),
+    PKSDATARANGE(&PinDataRangesStream[1])
 };
 
 //=============================================================================
@@ -179,6 +196,96 @@ static PCPROPERTY_ITEM PropertiesWaveFilter[] = {
     KSPROPERTY_PIN_PROPOSEDATAFORMAT,
     KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
     PropertyHandler_WaveFilter
+  },
+  {
+    &KSPROPSETID_AudioNet,
+    KSPROPERTY_AUDIONET_CODEC,
+    KSPROPERTY_TYPE_ALL,
+    PropertyHandler_WaveFilter
+  },
+  {
+    &KSPROPSETID_AudioNet,
+    KSPROPERTY_AUDIONET_BITRATE,
+    KSPROPERTY_TYPE_ALL,
+    PropertyHandler_WaveFilter
+  },
+  {
+    &KSPROPSETID_AudioNet,
+    KSPROPERTY_AUDIONET_COMPLEXITY,
+    KSPROPERTY_TYPE_ALL,
+    PropertyHandler_WaveFilter
+  },
+  {
+    &KSPROPSETID_AudioNet,
+    KSPROPERTY_AUDIONET_FRAME_DURATION,
+    KSPROPERTY_TYPE_ALL,
+    PropertyHandler_WaveFilter
+  },
+  {
+    &KSPROPSETID_AudioNet,
+    KSPROPERTY_AUDIONET_BIT_DEPTH,
+    KSPROPERTY_TYPE_ALL,
+    PropertyHandler_WaveFilter
+  },
+  {
+    &KSPROPSETID_AudioNet,
+    KSPROPERTY_AUDIONET_NOISE_SHAPING,
+    KSPROPERTY_TYPE_ALL,
+    PropertyHandler_WaveFilter
+  },
+  {
+    &KSPROPSETID_AudioNet,
+    KSPROPERTY_AUDIONET_SAMPLE_RATE,
+    KSPROPERTY_TYPE_ALL,
+    PropertyHandler_WaveFilter
+  },
+  {
+    &KSPROPSETID_AudioNet,
+    KSPROPERTY_AUDIONET_CHANNEL_MATRIX,
+    KSPROPERTY_TYPE_ALL,
+    PropertyHandler_WaveFilter
+  },
+  {
+    &KSPROPSETID_AudioNet,
+    KSPROPERTY_AUDIONET_DESTINATIONS,
+    KSPROPERTY_TYPE_ALL,
+    PropertyHandler_WaveFilter
+  },
+  {
+    &KSPROPSETID_AudioNet,
+    KSPROPERTY_AUDIONET_EQUALIZER,
+    KSPROPERTY_TYPE_ALL,
+    PropertyHandler_WaveFilter
+  },
+  {
+    &KSPROPSETID_AudioNet,
+    KSPROPERTY_AUDIONET_LIMITER,
+    KSPROPERTY_TYPE_ALL,
+    PropertyHandler_WaveFilter
+  },
+  {
+    &KSPROPSETID_AudioNet,
+    KSPROPERTY_AUDIONET_LIMITER_REDUCTION,
+    KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_BASICSUPPORT,
+    PropertyHandler_WaveFilter
+  },
+  {
+    &KSPROPSETID_AudioNet,
+    KSPROPERTY_AUDIONET_NORMALIZATION,
+    KSPROPERTY_TYPE_ALL,
+    PropertyHandler_WaveFilter
+  },
+  {
+    &KSPROPSETID_AudioNet,
+    KSPROPERTY_AUDIONET_LOUDNESS,
+    KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_BASICSUPPORT,
+    PropertyHandler_WaveFilter
+  },
+  {
+    &KSPROPSETID_AudioNet,
+    KSPROPERTY_AUDIONET_DELAY,
+    KSPROPERTY_TYPE_ALL,
+    PropertyHandler_WaveFilter
   }
 };
 DEFINE_PCAUTOMATION_TABLE_PROP(AutomationWaveFilter, PropertiesWaveFilter);